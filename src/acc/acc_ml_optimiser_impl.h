@@ -234,7 +234,7 @@ void getFourierTransformsAndCtfs(long int part_id,
 				else
 				{
 					CTIC(accMLO->timer,"ParaRead2DImages");
-					img() = baseMLO->exp_imgs[my_metadata_offset];
+					baseMLO->getPooledImage(my_metadata_offset, img());
 					CTOC(accMLO->timer,"ParaRead2DImages");
 				}
 			}
@@ -10,6 +10,7 @@
 #include "src/acc/acc_projector.h"
 #include "src/acc/cpu/cpu_kernels/cpu_utils.h"
 #include "src/acc/cpu/cpu_kernels/helper.h"
+#include "src/acc/cpu/cpu_kernels/diff2_simd.h"
 
 namespace CpuKernels
 {
@@ -381,6 +382,14 @@ inline void diff2_coarse(
 	XFLOAT trans_cos_x[block_sz], trans_sin_x[block_sz];
 	XFLOAT trans_cos_y[block_sz], trans_sin_y[block_sz];
 	XFLOAT trans_cos_z[block_sz], trans_sin_z[block_sz];
+
+	// The shifted image is compared with all orientations of a block by an
+	// explicitly vectorised kernel, chosen once for the instruction set of this CPU
+	const int simd_level = diff2SimdLevel();
+	Diff2CoarsePass pass_data;
+	pass_data.cos_x = trans_cos_x; pass_data.sin_x = trans_sin_x;
+	pass_data.cos_y = trans_cos_y; pass_data.sin_y = trans_sin_y;
+	pass_data.cos_z = trans_cos_z; pass_data.sin_z = trans_sin_z;
 #endif  // not Intel Compiler
 	
 	int x[pass_num][block_sz], y[pass_num][block_sz], z[pass_num][block_sz];
@@ -446,6 +455,10 @@ inline void diff2_coarse(
 		XFLOAT s_ref_imag[eulers_per_block][block_sz];
 
 		memset(&diff2s[0][0], 0, sizeof(XFLOAT) * translation_num * eulers_per_block);
+#ifndef __INTEL_COMPILER
+		pass_data.ref_real = &s_ref_real[0][0];
+		pass_data.ref_imag = &s_ref_imag[0][0];
+#endif
 
 		//Step through data
 		for (unsigned pass = 0; pass < pass_num; pass++) { // finish an entire ref image each block
@@ -536,49 +549,30 @@ inline void diff2_coarse(
 						trans_cos_x[tid] = cos_x[i][xidx];
 						trans_sin_x[tid] = sin_x[i][xidx];
 					}					
-				}  // tid  						
-#endif  // not Intel Compiler
-				
+				}  // tid
+
+				pass_data.elements = elements;
+				pass_data.real = s_real[pass];
+				pass_data.imag = s_imag[pass];
+				pass_data.corr = s_corr[pass];
+				diff2_coarse_translation<DATA3D, eulers_per_block, block_sz>(simd_level, pass_data, diff2s[i]);
+#else  // Intel Compiler - accept the (hopefully vectorized) sincos call every iteration rather than caching
 				#pragma omp simd
 				for (int tid=0; tid<block_sz; tid++) {
 // This will generate masked SVML routines for Intel compiler
 					unsigned long pixel = (unsigned long)start + (unsigned long)tid;
 					if(pixel >= image_size)
-						continue;                
+						continue;
 
 					XFLOAT real, imag;
-#ifndef __INTEL_COMPILER
-					if(DATA3D) {
-//						translatePixel(x[tid], y[tid], z[tid], tx, ty, tz, s_real[tid], s_imag[tid], real, imag);
-						XFLOAT s  = trans_sin_x[tid] * trans_cos_y[tid] + trans_cos_x[tid] * trans_sin_y[tid];
-						XFLOAT c  = trans_cos_x[tid] * trans_cos_y[tid] - trans_sin_x[tid] * trans_sin_y[tid];
-
-						XFLOAT ss = s * trans_cos_z[tid] + c * trans_sin_z[tid];
-						XFLOAT cc = c * trans_cos_z[tid] - s * trans_sin_z[tid];				
-
-						real = cc * s_real[pass][tid] - ss * s_imag[pass][tid];
-						imag = cc * s_imag[pass][tid] + ss * s_real[pass][tid];
-					}
-					else  { // 2D data
-//						translatePixel(x[tid], y[tid],         tx, ty,     s_real[tid], s_imag[tid], real, imag);
-						XFLOAT ss = trans_sin_x[tid] * trans_cos_y[tid] + trans_cos_x[tid] * trans_sin_y[tid];
-						XFLOAT cc = trans_cos_x[tid] * trans_cos_y[tid] - trans_sin_x[tid] * trans_sin_y[tid];
-			
-						real = cc * s_real[pass][tid] - ss * s_imag[pass][tid];
-						imag = cc * s_imag[pass][tid] + ss * s_real[pass][tid];
-					}
-#else  // Intel Compiler - accept the (hopefully vectorized) sincos call every iteration rather than caching
 					if(DATA3D)
 						translatePixel(x[pass][tid], y[pass][tid], z[pass][tid], tx, ty, tz,
 										s_real[pass][tid], s_imag[pass][tid], real, imag);
 					else
 						translatePixel(x[pass][tid], y[pass][tid], tx, ty,
 										s_real[pass][tid], s_imag[pass][tid], real, imag);
-#endif  // not Intel Compiler
 
-#ifdef __INTEL_COMPILER
 					#pragma unroll(eulers_per_block)
-#endif
 					for (int j = 0; j < eulers_per_block; j ++) {
 						XFLOAT diff_real =  s_ref_real[j][tid] - real;
 						XFLOAT diff_imag =  s_ref_imag[j][tid] - imag;
@@ -586,6 +580,7 @@ inline void diff2_coarse(
 						diff2s[i][j] += (diff_real * diff_real + diff_imag * diff_imag) * s_corr[pass][tid];
 					}
 				} // for tid
+#endif  // not Intel Compiler
 			}  // for each translation
 		}  // for each pass
 
@@ -643,6 +638,14 @@ inline void diff2_fine_2D(
 	
 	XFLOAT s[translation_num];   
 	
+	// The loops over the pixels of a row are explicitly vectorised, see diff2_simd.h
+	const int simd_level = diff2SimdLevel();
+	Diff2Row row;
+	row.real = imgs_real; row.imag = imgs_imag;
+	row.ref_real = ref_real; row.ref_imag = ref_imag;
+	row.corr = NULL;
+	row.cos_z = row.sin_z = (XFLOAT)0.;
+
 	// Now do calculations
 	for (unsigned long bid = 0; bid < grid_size; bid++) {
 		unsigned long trans_num        = (unsigned long)d_job_num[bid];     
@@ -715,24 +718,13 @@ inline void diff2_fine_2D(
 					trans_sin_y = sin_y[itrans][y];
 				}
 
-				XFLOAT *trans_cos_x = &cos_x[itrans][0];
-				XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-				XFLOAT sum = (XFLOAT) 0.0;                   
-				#pragma omp simd  reduction(+:sum) 
-				for(int x = xstart; x < xend; x++) {
-					XFLOAT ss = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-					XFLOAT cc = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-					XFLOAT shifted_real = cc * imgs_real[x] - ss * imgs_imag[x];
-					XFLOAT shifted_imag = cc * imgs_imag[x] + ss * imgs_real[x];
-
-					XFLOAT diff_real =  ref_real[x] - shifted_real;
-					XFLOAT diff_imag =  ref_imag[x] - shifted_imag;
-
-					sum += (diff_real * diff_real + diff_imag * diff_imag);
-				}
-				s[itrans] += sum;
+				row.xstart = xstart;
+				row.xend   = xend;
+				row.cos_x = &cos_x[itrans][0];
+				row.sin_x = &sin_x[itrans][0];
+				row.cos_y = trans_cos_y;
+				row.sin_y = trans_sin_y;
+				s[itrans] += diff2_fine_row<false>(simd_level, row);
 			}
 
 			pixel += (unsigned long)xSize;
@@ -795,6 +787,13 @@ inline void diff2_fine_3D(
 	
 	XFLOAT s[translation_num];   
 		
+	// The loops over the pixels of a row are explicitly vectorised, see diff2_simd.h
+	const int simd_level = diff2SimdLevel();
+	Diff2Row row;
+	row.real = imgs_real; row.imag = imgs_imag;
+	row.ref_real = ref_real; row.ref_imag = ref_imag;
+	row.corr = NULL;
+
 	// Now do calculations
 	for (unsigned long bid = 0; bid < grid_size; bid++) {
 		unsigned long trans_num        = (unsigned long)d_job_num[bid];     
@@ -890,27 +889,15 @@ inline void diff2_fine_3D(
 						trans_sin_y = sin_y[itrans][y];
 					}
 
-					XFLOAT *trans_cos_x = &cos_x[itrans][0];
-					XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-					XFLOAT sum = (XFLOAT) 0.0;                   
-					#pragma omp simd  reduction(+:sum) 
-					for(int x = xstart_y; x < xend_y; x++) {
-						XFLOAT s1  = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-						XFLOAT c1  = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-						XFLOAT ss = s1 * trans_cos_z + c1 * trans_sin_z;
-						XFLOAT cc = c1 * trans_cos_z - s1 * trans_sin_z;				
-
-						XFLOAT shifted_real = cc * imgs_real[x] - ss * imgs_imag[x];
-						XFLOAT shifted_imag = cc * imgs_imag[x] + ss * imgs_real[x];
-
-						XFLOAT diff_real =  ref_real[x] - shifted_real;
-						XFLOAT diff_imag =  ref_imag[x] - shifted_imag;
-
-						sum += (diff_real * diff_real + diff_imag * diff_imag);
-					}
-					s[itrans] += sum;
+					row.xstart = xstart_y;
+					row.xend   = xend_y;
+					row.cos_x = &cos_x[itrans][0];
+					row.sin_x = &sin_x[itrans][0];
+					row.cos_y = trans_cos_y;
+					row.sin_y = trans_sin_y;
+					row.cos_z = trans_cos_z;
+					row.sin_z = trans_sin_z;
+					s[itrans] += diff2_fine_row<true>(simd_level, row);
 				}
 
 				pixel += (unsigned long)xSize;
@@ -974,6 +961,14 @@ inline void diff2_CC_coarse_2D(
 	XFLOAT ref_real[xSize], ref_imag[xSize];
 	XFLOAT img_real[xSize], img_imag[xSize], corr_imag[xSize];
 			
+	// The loops over the pixels of a row are explicitly vectorised, see diff2_simd.h
+	const int simd_level = diff2SimdLevel();
+	Diff2Row row;
+	row.real = img_real; row.imag = img_imag;
+	row.ref_real = ref_real; row.ref_imag = ref_imag;
+	row.corr = corr_imag;
+	row.cos_z = row.sin_z = (XFLOAT)0.;
+
 	for (unsigned long iorient = 0; iorient < grid_size; iorient++) {
 	
 		XFLOAT e0,e1,e3,e4,e6,e7;
@@ -1030,20 +1025,13 @@ inline void diff2_CC_coarse_2D(
 					trans_sin_y = sin_y[itrans][y];
 				}
 
-				XFLOAT *trans_cos_x = &cos_x[itrans][0];
-				XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-				for(int x = xstart; x < xend; x++) {
-
-					XFLOAT ss = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-					XFLOAT cc = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-					XFLOAT real = cc * img_real[x] - ss * img_imag[x];
-					XFLOAT imag = cc * img_imag[x] + ss * img_real[x];
-
-					s_weight[itrans][x] += (ref_real[x] * real        + ref_imag[x] * imag       ) * corr_imag[x];
-					s_norm  [itrans][x] += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x]) * corr_imag[x];
-				}
+				row.xstart = xstart;
+				row.xend   = xend;
+				row.cos_x = &cos_x[itrans][0];
+				row.sin_x = &sin_x[itrans][0];
+				row.cos_y = trans_cos_y;
+				row.sin_y = trans_sin_y;
+				diff2_CC_row<false>(simd_level, row, s_weight[itrans], s_norm[itrans]);
 			}
 
 			pixel += (unsigned long)xSize;
@@ -1118,6 +1106,13 @@ inline void diff2_CC_coarse_3D(
 	XFLOAT ref_real[xSize], ref_imag[xSize];
 	XFLOAT img_real[xSize], img_imag[xSize], corr_imag[xSize];
 	
+	// The loops over the pixels of a row are explicitly vectorised, see diff2_simd.h
+	const int simd_level = diff2SimdLevel();
+	Diff2Row row;
+	row.real = img_real; row.imag = img_imag;
+	row.ref_real = ref_real; row.ref_imag = ref_imag;
+	row.corr = corr_imag;
+
 	for (unsigned long iorient = 0; iorient < grid_size; iorient++) {
 		XFLOAT e0, e1, e2, e3, e4, e5, e6, e7, e8;
 		e0 = g_eulers[iorient*9  ];
@@ -1192,23 +1187,15 @@ inline void diff2_CC_coarse_3D(
 						trans_sin_y = sin_y[itrans][y];
 					}
 
-					XFLOAT *trans_cos_x = &cos_x[itrans][0];
-					XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-					for(int x = xstart_y; x < xend_y; x++) {
-
-						XFLOAT s  = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-						XFLOAT c  = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-						XFLOAT ss = s * trans_cos_z + c * trans_sin_z;
-						XFLOAT cc = c * trans_cos_z - s * trans_sin_z;				
-
-						XFLOAT real = cc * img_real[x] - ss * img_imag[x];
-						XFLOAT imag = cc * img_imag[x] + ss * img_real[x];
-
-						s_weight[itrans][x] += (ref_real[x] * real        + ref_imag[x] * imag       ) * corr_imag[x];
-						s_norm  [itrans][x] += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x]) * corr_imag[x];
-					}
+					row.xstart = xstart_y;
+					row.xend   = xend_y;
+					row.cos_x = &cos_x[itrans][0];
+					row.sin_x = &sin_x[itrans][0];
+					row.cos_y = trans_cos_y;
+					row.sin_y = trans_sin_y;
+					row.cos_z = trans_cos_z;
+					row.sin_z = trans_sin_z;
+					diff2_CC_row<true>(simd_level, row, s_weight[itrans], s_norm[itrans]);
 				}
 				
 				pixel += (unsigned long)xSize;
@@ -1284,6 +1271,14 @@ inline void diff2_CC_fine_2D(
 	XFLOAT ref_real[xSize], ref_imag[xSize];
 	XFLOAT img_real[xSize], img_imag[xSize], corr_imag[xSize];
 	
+	// The loops over the pixels of a row are explicitly vectorised, see diff2_simd.h
+	const int simd_level = diff2SimdLevel();
+	Diff2Row row;
+	row.real = img_real; row.imag = img_imag;
+	row.ref_real = ref_real; row.ref_imag = ref_imag;
+	row.corr = corr_imag;
+	row.cos_z = row.sin_z = (XFLOAT)0.;
+
 	// Now do calculations
 	for (unsigned long bid = 0; bid < grid_size; bid++) {
 
@@ -1355,19 +1350,13 @@ inline void diff2_CC_fine_2D(
 					trans_sin_y = sin_y[itrans][y];
 				}
 
-				XFLOAT *trans_cos_x = &cos_x[itrans][0];
-				XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-				for(int x = xstart; x < xend; x++) {			
-					XFLOAT ss = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-					XFLOAT cc = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-					XFLOAT shifted_real = cc * img_real[x] - ss * img_imag[x];
-					XFLOAT shifted_imag = cc * img_imag[x] + ss * img_real[x];					    
-
-					s[itrans][x]    += (ref_real[x] * shifted_real + ref_imag[x] * shifted_imag) * corr_imag[x];
-					s_cc[itrans][x] += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x])   * corr_imag[x];
-				}
+				row.xstart = xstart;
+				row.xend   = xend;
+				row.cos_x = &cos_x[itrans][0];
+				row.sin_x = &sin_x[itrans][0];
+				row.cos_y = trans_cos_y;
+				row.sin_y = trans_sin_y;
+				diff2_CC_row<false>(simd_level, row, s[itrans], s_cc[itrans]);
 			}
 
 			pixel += (unsigned long)xSize;
@@ -1441,6 +1430,13 @@ inline void diff2_CC_fine_3D(
 	XFLOAT ref_real[xSize], ref_imag[xSize];
 	XFLOAT img_real[xSize], img_imag[xSize], corr_imag[xSize];
 	
+	// The loops over the pixels of a row are explicitly vectorised, see diff2_simd.h
+	const int simd_level = diff2SimdLevel();
+	Diff2Row row;
+	row.real = img_real; row.imag = img_imag;
+	row.ref_real = ref_real; row.ref_imag = ref_imag;
+	row.corr = corr_imag;
+
 	// Now do calculations
 	for (unsigned long bid = 0; bid < grid_size; bid++) {
 
@@ -1534,22 +1530,15 @@ inline void diff2_CC_fine_3D(
 						trans_sin_y = sin_y[itrans][y];
 					}
 
-					XFLOAT *trans_cos_x = &cos_x[itrans][0];
-					XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-					for(int x = xstart_y; x < xend_y; x++) {			
-						XFLOAT s1  = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-						XFLOAT c1  = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-						XFLOAT ss = s1 * trans_cos_z + c1 * trans_sin_z;
-						XFLOAT cc = c1 * trans_cos_z - s1 * trans_sin_z;		
-
-						XFLOAT shifted_real = cc * img_real[x] - ss * img_imag[x];
-						XFLOAT shifted_imag = cc * img_imag[x] + ss * img_real[x];			
-
-						s[itrans][x]    += (ref_real[x] * shifted_real + ref_imag[x] * shifted_imag) * corr_imag[x];
-						s_cc[itrans][x] += (ref_real[x]*ref_real[x] + ref_imag[x]*ref_imag[x])       * corr_imag[x];
-					}
+					row.xstart = xstart_y;
+					row.xend   = xend_y;
+					row.cos_x = &cos_x[itrans][0];
+					row.sin_x = &sin_x[itrans][0];
+					row.cos_y = trans_cos_y;
+					row.sin_y = trans_sin_y;
+					row.cos_z = trans_cos_z;
+					row.sin_z = trans_sin_z;
+					diff2_CC_row<true>(simd_level, row, s[itrans], s_cc[itrans]);
 				}
 			}
 
@@ -0,0 +1,471 @@
+#ifndef DIFF2_SIMD_KERNELS_H_
+#define DIFF2_SIMD_KERNELS_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "src/acc/settings.h"
+
+/*
+ *   	EXPLICITLY VECTORISED INNER LOOPS OF THE DIFFERENCE KERNELS
+ */
+
+// For one translation, diff2_coarse compares the shifted pixels of one block of
+// the image with the projections of eulers_per_block orientations. The
+// projections are stored as structure-of-arrays (one row of block_sz pixels per
+// orientation), so that one register holds several pixels of one orientation,
+// and the sums for all orientations of the block are kept in registers at the
+// same time.
+//
+// The fine kernels (diff2_fine_2D/3D) and the cross-correlation kernels
+// (diff2_CC_*) compare one row of pixels of the image, shifted by one
+// translation, with the projection of one orientation. Their inner loops are
+// vectorised along the row.
+//
+// The AVX2 and AVX-512 versions are compiled with function-specific target
+// attributes and are selected at run time, so that the same binary still runs
+// on CPUs without these instruction sets. The scalar version relies on
+// auto-vectorisation, like the rest of the CPU kernels.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(__INTEL_COMPILER)
+#define DIFF2_SIMD_X86
+#endif
+
+namespace CpuKernels
+{
+
+enum Diff2SimdLevel
+{
+	DIFF2_SIMD_SCALAR = 0,
+	DIFF2_SIMD_AVX2 = 1,
+	DIFF2_SIMD_AVX512 = 2
+};
+
+inline const char *diff2SimdLevelName(int level)
+{
+	switch (level)
+	{
+		case DIFF2_SIMD_AVX512: return "avx512";
+		case DIFF2_SIMD_AVX2: return "avx2";
+		default: return "scalar";
+	}
+}
+
+// Highest level supported by this CPU. It can be lowered (e.g. for benchmarking)
+// with the environment variable RELION_CPU_SIMD=scalar, avx2 or avx512.
+inline int detectDiff2SimdLevel()
+{
+	int level = DIFF2_SIMD_SCALAR;
+#ifdef DIFF2_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		level = DIFF2_SIMD_AVX2;
+	if (level == DIFF2_SIMD_AVX2 && __builtin_cpu_supports("avx512f"))
+		level = DIFF2_SIMD_AVX512;
+#endif
+
+	const char *env = getenv("RELION_CPU_SIMD");
+	if (env != NULL)
+	{
+		std::string requested(env);
+		int max_level = level;
+		if (requested == "scalar" || requested == "none")
+			max_level = DIFF2_SIMD_SCALAR;
+		else if (requested == "avx2")
+			max_level = DIFF2_SIMD_AVX2;
+		if (max_level < level)
+			level = max_level;
+	}
+
+	return level;
+}
+
+inline int diff2SimdLevel()
+{
+	static const int level = detectDiff2SimdLevel();
+	return level;
+}
+
+// Pointers to the data of one pass (block of pixels) for one translation
+struct Diff2CoarsePass
+{
+	int elements;                             // number of valid pixels in this block
+	const XFLOAT *cos_x, *sin_x;              // translation phases per pixel, split in x, y (and z)
+	const XFLOAT *cos_y, *sin_y;
+	const XFLOAT *cos_z, *sin_z;
+	const XFLOAT *real, *imag, *corr;         // image and (half) correction per pixel
+	const XFLOAT *ref_real, *ref_imag;        // [eulers_per_block][block_sz] projected references
+};
+
+template<bool DATA3D>
+#ifndef __INTEL_COMPILER
+__attribute__((always_inline))
+#endif
+inline void diff2_shift_pixel(const Diff2CoarsePass &p, int tid, XFLOAT &real, XFLOAT &imag)
+{
+	XFLOAT ss = p.sin_x[tid] * p.cos_y[tid] + p.cos_x[tid] * p.sin_y[tid];
+	XFLOAT cc = p.cos_x[tid] * p.cos_y[tid] - p.sin_x[tid] * p.sin_y[tid];
+	if (DATA3D)
+	{
+		XFLOAT s = ss, c = cc;
+		ss = s * p.cos_z[tid] + c * p.sin_z[tid];
+		cc = c * p.cos_z[tid] - s * p.sin_z[tid];
+	}
+	real = cc * p.real[tid] - ss * p.imag[tid];
+	imag = cc * p.imag[tid] + ss * p.real[tid];
+}
+
+template<bool DATA3D, int eulers_per_block, int block_sz>
+inline void diff2_coarse_translation_scalar(const Diff2CoarsePass &p, XFLOAT *diff2s)
+{
+	XFLOAT real[block_sz], imag[block_sz];
+
+	#pragma omp simd
+	for (int tid = 0; tid < p.elements; tid++)
+		diff2_shift_pixel<DATA3D>(p, tid, real[tid], imag[tid]);
+
+	for (int j = 0; j < eulers_per_block; j++)
+	{
+		const XFLOAT *ref_real = p.ref_real + j * block_sz;
+		const XFLOAT *ref_imag = p.ref_imag + j * block_sz;
+		XFLOAT sum = (XFLOAT)0.0;
+		#pragma omp simd reduction(+:sum)
+		for (int tid = 0; tid < p.elements; tid++)
+		{
+			XFLOAT diff_real = ref_real[tid] - real[tid];
+			XFLOAT diff_imag = ref_imag[tid] - imag[tid];
+			sum += (diff_real * diff_real + diff_imag * diff_imag) * p.corr[tid];
+		}
+		diff2s[j] += sum;
+	}
+}
+
+// Pointers to the data of one row of pixels for one translation, in the fine and CC kernels
+struct Diff2Row
+{
+	int xstart, xend;                         // range of valid pixels in this row
+	const XFLOAT *cos_x, *sin_x;              // translation phases per pixel in x
+	XFLOAT cos_y, sin_y, cos_z, sin_z;        // translation phases of this row in y (and z)
+	const XFLOAT *real, *imag;                // image
+	const XFLOAT *ref_real, *ref_imag;        // projected reference
+	const XFLOAT *corr;                       // correction per pixel (CC kernels only)
+};
+
+template<bool DATA3D>
+#ifndef __INTEL_COMPILER
+__attribute__((always_inline))
+#endif
+inline void diff2_row_shift_pixel(const Diff2Row &r, int x, XFLOAT &real, XFLOAT &imag)
+{
+	XFLOAT ss = r.sin_x[x] * r.cos_y + r.cos_x[x] * r.sin_y;
+	XFLOAT cc = r.cos_x[x] * r.cos_y - r.sin_x[x] * r.sin_y;
+	if (DATA3D)
+	{
+		XFLOAT s = ss, c = cc;
+		ss = s * r.cos_z + c * r.sin_z;
+		cc = c * r.cos_z - s * r.sin_z;
+	}
+	real = cc * r.real[x] - ss * r.imag[x];
+	imag = cc * r.imag[x] + ss * r.real[x];
+}
+
+template<bool DATA3D>
+inline XFLOAT diff2_fine_row_scalar(const Diff2Row &r)
+{
+	XFLOAT sum = (XFLOAT)0.0;
+	#pragma omp simd reduction(+:sum)
+	for (int x = r.xstart; x < r.xend; x++)
+	{
+		XFLOAT real, imag;
+		diff2_row_shift_pixel<DATA3D>(r, x, real, imag);
+		XFLOAT diff_real = r.ref_real[x] - real;
+		XFLOAT diff_imag = r.ref_imag[x] - imag;
+		sum += (diff_real * diff_real + diff_imag * diff_imag);
+	}
+	return sum;
+}
+
+template<bool DATA3D>
+inline void diff2_CC_row_scalar(const Diff2Row &r, XFLOAT *s_weight, XFLOAT *s_norm)
+{
+	#pragma omp simd
+	for (int x = r.xstart; x < r.xend; x++)
+	{
+		XFLOAT real, imag;
+		diff2_row_shift_pixel<DATA3D>(r, x, real, imag);
+		s_weight[x] += (r.ref_real[x] * real        + r.ref_imag[x] * imag       ) * r.corr[x];
+		s_norm  [x] += (r.ref_real[x] * r.ref_real[x] + r.ref_imag[x] * r.ref_imag[x]) * r.corr[x];
+	}
+}
+
+#ifdef DIFF2_SIMD_X86
+
+typedef XFLOAT Diff2Vec256 __attribute__((vector_size(32)));
+typedef XFLOAT Diff2Vec512 __attribute__((vector_size(64)));
+
+template<typename V>
+__attribute__((always_inline))
+inline void diff2_simd_load(V &v, const XFLOAT *ptr)
+{
+	__builtin_memcpy(&v, ptr, sizeof(V));
+}
+
+// Generic body, which is only ever inlined into the target-specific functions below
+template<typename V, bool DATA3D, int eulers_per_block, int block_sz>
+__attribute__((always_inline))
+inline void diff2_coarse_translation_vec(const Diff2CoarsePass &p, XFLOAT *diff2s)
+{
+	const int W = sizeof(V) / sizeof(XFLOAT);
+
+	V acc[eulers_per_block];
+	for (int j = 0; j < eulers_per_block; j++)
+		acc[j] = V{};
+
+	int tid = 0;
+	for (; tid + W <= p.elements; tid += W)
+	{
+		V cx, sx, cy, sy, re, im, corr;
+		diff2_simd_load(cx, p.cos_x + tid);
+		diff2_simd_load(sx, p.sin_x + tid);
+		diff2_simd_load(cy, p.cos_y + tid);
+		diff2_simd_load(sy, p.sin_y + tid);
+		diff2_simd_load(re, p.real + tid);
+		diff2_simd_load(im, p.imag + tid);
+		diff2_simd_load(corr, p.corr + tid);
+
+		V ss = sx * cy + cx * sy;
+		V cc = cx * cy - sx * sy;
+		if (DATA3D)
+		{
+			V cz, sz;
+			diff2_simd_load(cz, p.cos_z + tid);
+			diff2_simd_load(sz, p.sin_z + tid);
+			V s = ss, c = cc;
+			ss = s * cz + c * sz;
+			cc = c * cz - s * sz;
+		}
+		V real = cc * re - ss * im;
+		V imag = cc * im + ss * re;
+
+		for (int j = 0; j < eulers_per_block; j++)
+		{
+			V ref_real, ref_imag;
+			diff2_simd_load(ref_real, p.ref_real + j * block_sz + tid);
+			diff2_simd_load(ref_imag, p.ref_imag + j * block_sz + tid);
+			V diff_real = ref_real - real;
+			V diff_imag = ref_imag - imag;
+			acc[j] += (diff_real * diff_real + diff_imag * diff_imag) * corr;
+		}
+	}
+
+	for (int j = 0; j < eulers_per_block; j++)
+	{
+		XFLOAT sum = (XFLOAT)0.0;
+		for (int k = 0; k < W; k++)
+			sum += acc[j][k];
+		diff2s[j] += sum;
+	}
+
+	// Remaining pixels of the last block
+	for (; tid < p.elements; tid++)
+	{
+		XFLOAT real, imag;
+		diff2_shift_pixel<DATA3D>(p, tid, real, imag);
+		for (int j = 0; j < eulers_per_block; j++)
+		{
+			XFLOAT diff_real = p.ref_real[j * block_sz + tid] - real;
+			XFLOAT diff_imag = p.ref_imag[j * block_sz + tid] - imag;
+			diff2s[j] += (diff_real * diff_real + diff_imag * diff_imag) * p.corr[tid];
+		}
+	}
+}
+
+template<bool DATA3D, int eulers_per_block, int block_sz>
+__attribute__((target("avx2,fma")))
+void diff2_coarse_translation_avx2(const Diff2CoarsePass &p, XFLOAT *diff2s)
+{
+	diff2_coarse_translation_vec<Diff2Vec256, DATA3D, eulers_per_block, block_sz>(p, diff2s);
+}
+
+template<bool DATA3D, int eulers_per_block, int block_sz>
+__attribute__((target("avx512f")))
+void diff2_coarse_translation_avx512(const Diff2CoarsePass &p, XFLOAT *diff2s)
+{
+	diff2_coarse_translation_vec<Diff2Vec512, DATA3D, eulers_per_block, block_sz>(p, diff2s);
+}
+
+// Shifts W pixels of a row, starting at x
+template<typename V, bool DATA3D>
+__attribute__((always_inline))
+inline void diff2_row_shift_vec(const Diff2Row &r, int x, V &real, V &imag)
+{
+	V cx, sx, re, im;
+	diff2_simd_load(cx, r.cos_x + x);
+	diff2_simd_load(sx, r.sin_x + x);
+	diff2_simd_load(re, r.real + x);
+	diff2_simd_load(im, r.imag + x);
+
+	V ss = sx * r.cos_y + cx * r.sin_y;
+	V cc = cx * r.cos_y - sx * r.sin_y;
+	if (DATA3D)
+	{
+		V s = ss, c = cc;
+		ss = s * r.cos_z + c * r.sin_z;
+		cc = c * r.cos_z - s * r.sin_z;
+	}
+	real = cc * re - ss * im;
+	imag = cc * im + ss * re;
+}
+
+template<typename V, bool DATA3D>
+__attribute__((always_inline))
+inline XFLOAT diff2_fine_row_vec(const Diff2Row &r)
+{
+	const int W = sizeof(V) / sizeof(XFLOAT);
+
+	V acc = V{};
+	int x = r.xstart;
+	for (; x + W <= r.xend; x += W)
+	{
+		V real, imag, ref_real, ref_imag;
+		diff2_row_shift_vec<V, DATA3D>(r, x, real, imag);
+		diff2_simd_load(ref_real, r.ref_real + x);
+		diff2_simd_load(ref_imag, r.ref_imag + x);
+		V diff_real = ref_real - real;
+		V diff_imag = ref_imag - imag;
+		acc += diff_real * diff_real + diff_imag * diff_imag;
+	}
+
+	XFLOAT sum = (XFLOAT)0.0;
+	for (int k = 0; k < W; k++)
+		sum += acc[k];
+
+	for (; x < r.xend; x++)
+	{
+		XFLOAT real, imag;
+		diff2_row_shift_pixel<DATA3D>(r, x, real, imag);
+		XFLOAT diff_real = r.ref_real[x] - real;
+		XFLOAT diff_imag = r.ref_imag[x] - imag;
+		sum += (diff_real * diff_real + diff_imag * diff_imag);
+	}
+
+	return sum;
+}
+
+// The sums are kept per pixel, as in the scalar loop, so the order in which they are added does not change
+template<typename V, bool DATA3D>
+__attribute__((always_inline))
+inline void diff2_CC_row_vec(const Diff2Row &r, XFLOAT *s_weight, XFLOAT *s_norm)
+{
+	const int W = sizeof(V) / sizeof(XFLOAT);
+
+	int x = r.xstart;
+	for (; x + W <= r.xend; x += W)
+	{
+		V real, imag, ref_real, ref_imag, corr, weight, norm;
+		diff2_row_shift_vec<V, DATA3D>(r, x, real, imag);
+		diff2_simd_load(ref_real, r.ref_real + x);
+		diff2_simd_load(ref_imag, r.ref_imag + x);
+		diff2_simd_load(corr, r.corr + x);
+		diff2_simd_load(weight, s_weight + x);
+		diff2_simd_load(norm, s_norm + x);
+		weight += (ref_real * real     + ref_imag * imag    ) * corr;
+		norm   += (ref_real * ref_real + ref_imag * ref_imag) * corr;
+		__builtin_memcpy(s_weight + x, &weight, sizeof(V));
+		__builtin_memcpy(s_norm + x, &norm, sizeof(V));
+	}
+
+	for (; x < r.xend; x++)
+	{
+		XFLOAT real, imag;
+		diff2_row_shift_pixel<DATA3D>(r, x, real, imag);
+		s_weight[x] += (r.ref_real[x] * real        + r.ref_imag[x] * imag       ) * r.corr[x];
+		s_norm  [x] += (r.ref_real[x] * r.ref_real[x] + r.ref_imag[x] * r.ref_imag[x]) * r.corr[x];
+	}
+}
+
+template<bool DATA3D>
+__attribute__((target("avx2,fma")))
+XFLOAT diff2_fine_row_avx2(const Diff2Row &r)
+{
+	return diff2_fine_row_vec<Diff2Vec256, DATA3D>(r);
+}
+
+template<bool DATA3D>
+__attribute__((target("avx512f")))
+XFLOAT diff2_fine_row_avx512(const Diff2Row &r)
+{
+	return diff2_fine_row_vec<Diff2Vec512, DATA3D>(r);
+}
+
+template<bool DATA3D>
+__attribute__((target("avx2,fma")))
+void diff2_CC_row_avx2(const Diff2Row &r, XFLOAT *s_weight, XFLOAT *s_norm)
+{
+	diff2_CC_row_vec<Diff2Vec256, DATA3D>(r, s_weight, s_norm);
+}
+
+template<bool DATA3D>
+__attribute__((target("avx512f")))
+void diff2_CC_row_avx512(const Diff2Row &r, XFLOAT *s_weight, XFLOAT *s_norm)
+{
+	diff2_CC_row_vec<Diff2Vec512, DATA3D>(r, s_weight, s_norm);
+}
+
+#endif // DIFF2_SIMD_X86
+
+// Adds the squared differences of one pass for one translation to diff2s[0..eulers_per_block-1]
+template<bool DATA3D, int eulers_per_block, int block_sz>
+inline void diff2_coarse_translation(int simd_level, const Diff2CoarsePass &p, XFLOAT *diff2s)
+{
+#ifdef DIFF2_SIMD_X86
+	if (simd_level == DIFF2_SIMD_AVX512)
+	{
+		diff2_coarse_translation_avx512<DATA3D, eulers_per_block, block_sz>(p, diff2s);
+		return;
+	}
+	if (simd_level == DIFF2_SIMD_AVX2)
+	{
+		diff2_coarse_translation_avx2<DATA3D, eulers_per_block, block_sz>(p, diff2s);
+		return;
+	}
+#endif
+	diff2_coarse_translation_scalar<DATA3D, eulers_per_block, block_sz>(p, diff2s);
+}
+
+// Returns the squared differences of one row for one translation (fine kernels)
+template<bool DATA3D>
+inline XFLOAT diff2_fine_row(int simd_level, const Diff2Row &r)
+{
+#ifdef DIFF2_SIMD_X86
+	if (simd_level == DIFF2_SIMD_AVX512)
+		return diff2_fine_row_avx512<DATA3D>(r);
+	if (simd_level == DIFF2_SIMD_AVX2)
+		return diff2_fine_row_avx2<DATA3D>(r);
+#endif
+	return diff2_fine_row_scalar<DATA3D>(r);
+}
+
+// Adds the cross-correlation terms of one row for one translation to s_weight[x] and s_norm[x] (CC kernels)
+template<bool DATA3D>
+inline void diff2_CC_row(int simd_level, const Diff2Row &r, XFLOAT *s_weight, XFLOAT *s_norm)
+{
+#ifdef DIFF2_SIMD_X86
+	if (simd_level == DIFF2_SIMD_AVX512)
+	{
+		diff2_CC_row_avx512<DATA3D>(r, s_weight, s_norm);
+		return;
+	}
+	if (simd_level == DIFF2_SIMD_AVX2)
+	{
+		diff2_CC_row_avx2<DATA3D>(r, s_weight, s_norm);
+		return;
+	}
+#endif
+	diff2_CC_row_scalar<DATA3D>(r, s_weight, s_norm);
+}
+
+} // end of namespace CpuKernels
+
+#endif /* DIFF2_SIMD_KERNELS_H_ */
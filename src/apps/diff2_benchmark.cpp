@@ -0,0 +1,360 @@
+#include <src/args.h>
+#include <src/time.h>
+#include <src/acc/cpu/cpu_kernels/diff2_simd.h>
+
+// Times the inner loops of the CPU difference kernels for every instruction set
+// supported by this CPU, on random data, and checks the results against the
+// original per-pixel loops, evaluated in double precision:
+//  - coarse: diff2_coarse, one block of pixels against a block of orientations
+//  - fine:   diff2_fine_2D/3D, one row of pixels against one orientation
+//  - CC:     diff2_CC_*, the cross-correlation terms of one row of pixels
+
+using namespace CpuKernels;
+
+#define BENCH_BLOCK_SZ 256
+#define BENCH_EULERS_PER_BLOCK 16
+
+// The loop as it was written in diff2_coarse before it was vectorised explicitly.
+// With T = double, it gives the reference to which all kernels are compared.
+template <typename T>
+void originalTranslation(const Diff2CoarsePass &p, T *diff2s)
+{
+	for (int tid = 0; tid < p.elements; tid++)
+	{
+		T ss = (T)p.sin_x[tid] * p.cos_y[tid] + (T)p.cos_x[tid] * p.sin_y[tid];
+		T cc = (T)p.cos_x[tid] * p.cos_y[tid] - (T)p.sin_x[tid] * p.sin_y[tid];
+		T real = cc * p.real[tid] - ss * p.imag[tid];
+		T imag = cc * p.imag[tid] + ss * p.real[tid];
+
+		for (int j = 0; j < BENCH_EULERS_PER_BLOCK; j++)
+		{
+			T diff_real = p.ref_real[j * BENCH_BLOCK_SZ + tid] - real;
+			T diff_imag = p.ref_imag[j * BENCH_BLOCK_SZ + tid] - imag;
+			diff2s[j] += (diff_real * diff_real + diff_imag * diff_imag) * p.corr[tid];
+		}
+	}
+}
+
+// The per-pixel loops of diff2_fine_2D and diff2_CC_fine_2D, before they were vectorised explicitly
+template <typename T>
+T originalFineRow(const Diff2Row &r)
+{
+	T sum = (T)0.;
+	for (int x = r.xstart; x < r.xend; x++)
+	{
+		T ss = (T)r.sin_x[x] * r.cos_y + (T)r.cos_x[x] * r.sin_y;
+		T cc = (T)r.cos_x[x] * r.cos_y - (T)r.sin_x[x] * r.sin_y;
+		T diff_real = r.ref_real[x] - (cc * r.real[x] - ss * r.imag[x]);
+		T diff_imag = r.ref_imag[x] - (cc * r.imag[x] + ss * r.real[x]);
+		sum += (diff_real * diff_real + diff_imag * diff_imag);
+	}
+	return sum;
+}
+
+template <typename T>
+void originalCCRow(const Diff2Row &r, T *s_weight, T *s_norm)
+{
+	for (int x = r.xstart; x < r.xend; x++)
+	{
+		T ss = (T)r.sin_x[x] * r.cos_y + (T)r.cos_x[x] * r.sin_y;
+		T cc = (T)r.cos_x[x] * r.cos_y - (T)r.sin_x[x] * r.sin_y;
+		T real = cc * r.real[x] - ss * r.imag[x];
+		T imag = cc * r.imag[x] + ss * r.real[x];
+		s_weight[x] += ((T)r.ref_real[x] * real + (T)r.ref_imag[x] * imag) * r.corr[x];
+		s_norm[x] += ((T)r.ref_real[x] * r.ref_real[x] + (T)r.ref_imag[x] * r.ref_imag[x]) * r.corr[x];
+	}
+}
+
+// Prints one line per kernel, and returns false if any of them differs from the reference.
+// The differences are relative to scale, or to the reference itself if no scale is given.
+bool printResults(const std::string &kernel, Timer &timer, const std::vector<int> &timers, double flops,
+                  const std::vector<double> &reference, const std::vector<std::vector<XFLOAT> > &results,
+                  const std::vector<double> *scale = NULL)
+{
+	bool all_ok = true;
+	for (int t = 0; t < timers.size(); t++)
+	{
+		double max_rel_diff = 0.;
+		for (size_t n = 0; n < results[t].size(); n++)
+		{
+			double rel_diff = fabs(results[t][n] - reference[n]) / fabs(scale ? (*scale)[n] : reference[n]);
+			max_rel_diff = XMIPP_MAX(max_rel_diff, rel_diff);
+		}
+		const bool ok = max_rel_diff < 1e-4;
+		all_ok = all_ok && ok;
+
+		const double seconds = timer.times[timers[t]] * 1e-6;
+		std::cout << "  " << std::setw(7) << std::left << kernel
+		          << std::setw(14) << timer.tags[timers[t]] << std::right
+		          << std::setw(10) << std::fixed << std::setprecision(3) << seconds << " sec "
+		          << std::setw(8) << std::setprecision(2) << flops / seconds * 1e-9 << " GFLOP/s "
+		          << " max. relative difference: " << std::scientific << std::setprecision(2) << max_rel_diff
+		          << (ok ? "" : " WRONG") << std::endl;
+	}
+	return all_ok;
+}
+
+int main(int argc, char *argv[])
+{
+	IOParser parser;
+
+	parser.setCommandLine(argc, argv);
+	parser.addSection("General options");
+	int image_size = textToInteger(parser.getOption("--pixels", "Number of Fourier pixels per image", "4000"));
+	int nr_trans = textToInteger(parser.getOption("--trans", "Number of translations", "50"));
+	int nr_blocks = textToInteger(parser.getOption("--blocks", "Number of blocks of orientations (coarse kernel)", "200"));
+	int nr_orients = textToInteger(parser.getOption("--orients", "Number of orientations (fine and CC kernels)", "500"));
+	int row_size = textToInteger(parser.getOption("--row", "Number of pixels per row (fine and CC kernels)", "65"));
+
+	if (parser.checkForErrors()) return RELION_EXIT_FAILURE;
+
+	const int pass_num = (image_size + BENCH_BLOCK_SZ - 1) / BENCH_BLOCK_SZ;
+	const size_t pass_size = (size_t)pass_num * BENCH_BLOCK_SZ;
+
+	// All data is stored as structure-of-arrays, padded to whole blocks, as in diff2_coarse
+	std::vector<XFLOAT> cos_x(nr_trans * pass_size), sin_x(nr_trans * pass_size);
+	std::vector<XFLOAT> cos_y(nr_trans * pass_size), sin_y(nr_trans * pass_size);
+	std::vector<XFLOAT> real(pass_size), imag(pass_size), corr(pass_size);
+	std::vector<XFLOAT> ref_real(pass_size * BENCH_EULERS_PER_BLOCK), ref_imag(pass_size * BENCH_EULERS_PER_BLOCK);
+
+	srand(1993);
+	for (size_t n = 0; n < cos_x.size(); n++)
+	{
+		XFLOAT a = 2. * PI * rand() / RAND_MAX, b = 2. * PI * rand() / RAND_MAX;
+		cos_x[n] = cos(a); sin_x[n] = sin(a);
+		cos_y[n] = cos(b); sin_y[n] = sin(b);
+	}
+	for (size_t n = 0; n < pass_size; n++)
+	{
+		real[n] = (XFLOAT)rand() / RAND_MAX - 0.5;
+		imag[n] = (XFLOAT)rand() / RAND_MAX - 0.5;
+		corr[n] = (XFLOAT)rand() / RAND_MAX;
+	}
+	for (size_t n = 0; n < ref_real.size(); n++)
+	{
+		ref_real[n] = (XFLOAT)rand() / RAND_MAX - 0.5;
+		ref_imag[n] = (XFLOAT)rand() / RAND_MAX - 0.5;
+	}
+
+	const int max_level = diff2SimdLevel();
+	Timer timer;
+	std::vector<int> timers;
+	timers.push_back(timer.setNew("original loop"));
+	for (int level = DIFF2_SIMD_SCALAR; level <= max_level; level++)
+		timers.push_back(timer.setNew(diff2SimdLevelName(level)));
+
+	// As in diff2_coarse, the differences are summed per block of orientations;
+	// those of the last block are kept to check the results
+	std::vector<double> reference(nr_trans * BENCH_EULERS_PER_BLOCK);
+	std::vector<std::vector<XFLOAT> > results(timers.size());
+
+	for (int t = -1; t < (int)timers.size(); t++)
+	{
+		const int level = t - 1;
+		std::vector<XFLOAT> diff2s(nr_trans * BENCH_EULERS_PER_BLOCK);
+
+		if (t >= 0) timer.tic(timers[t]);
+		for (int block = 0; block < (t < 0 ? 1 : nr_blocks); block++)
+		{
+			std::fill(diff2s.begin(), diff2s.end(), (XFLOAT)0.);
+			for (int pass = 0; pass < pass_num; pass++)
+			{
+				const size_t start = (size_t)pass * BENCH_BLOCK_SZ;
+				Diff2CoarsePass p;
+				p.elements = std::min(BENCH_BLOCK_SZ, image_size - pass * BENCH_BLOCK_SZ);
+				p.real = &real[start];
+				p.imag = &imag[start];
+				p.corr = &corr[start];
+				p.ref_real = &ref_real[start * BENCH_EULERS_PER_BLOCK];
+				p.ref_imag = &ref_imag[start * BENCH_EULERS_PER_BLOCK];
+				p.cos_z = p.sin_z = NULL;
+
+				for (int i = 0; i < nr_trans; i++)
+				{
+					const size_t offset = i * pass_size + start;
+					p.cos_x = &cos_x[offset]; p.sin_x = &sin_x[offset];
+					p.cos_y = &cos_y[offset]; p.sin_y = &sin_y[offset];
+
+					XFLOAT *out = &diff2s[i * BENCH_EULERS_PER_BLOCK];
+					if (t < 0)
+						originalTranslation(p, &reference[i * BENCH_EULERS_PER_BLOCK]);
+					else if (level < 0)
+						originalTranslation(p, out);
+					else
+						diff2_coarse_translation<false, BENCH_EULERS_PER_BLOCK, BENCH_BLOCK_SZ>(level, p, out);
+				}
+			}
+		}
+		if (t < 0) continue;
+		timer.toc(timers[t]);
+
+		results[t] = diff2s;
+	}
+
+	// Shifting a pixel costs 12 flops, comparing it with one orientation 7
+	const double flops = (double)nr_blocks * nr_trans * image_size * (12. + 7. * BENCH_EULERS_PER_BLOCK);
+
+	std::cout << " Compared " << nr_blocks * BENCH_EULERS_PER_BLOCK << " orientations x " << nr_trans
+	          << " translations x " << image_size << " pixels (" << sizeof(XFLOAT) * 8 << "-bit floats)" << std::endl;
+
+	bool all_ok = printResults("coarse", timer, timers, flops, reference, results);
+
+	// The fine and CC kernels work on rows of row_size pixels, with one phase per pixel
+	// in x, and one phase per row in y, for every translation
+	const int nr_rows = (image_size + row_size - 1) / row_size;
+	const size_t row_pixels = (size_t)nr_rows * row_size;
+
+	std::vector<XFLOAT> row_cos_x(nr_trans * row_size), row_sin_x(nr_trans * row_size);
+	std::vector<XFLOAT> row_cos_y(nr_trans * nr_rows), row_sin_y(nr_trans * nr_rows);
+	std::vector<XFLOAT> row_real(row_pixels), row_imag(row_pixels), row_corr(row_pixels);
+	std::vector<XFLOAT> row_ref_real(row_pixels), row_ref_imag(row_pixels);
+
+	for (size_t n = 0; n < row_cos_x.size(); n++)
+	{
+		XFLOAT a = 2. * PI * rand() / RAND_MAX;
+		row_cos_x[n] = cos(a); row_sin_x[n] = sin(a);
+	}
+	for (size_t n = 0; n < row_cos_y.size(); n++)
+	{
+		XFLOAT b = 2. * PI * rand() / RAND_MAX;
+		row_cos_y[n] = cos(b); row_sin_y[n] = sin(b);
+	}
+	for (size_t n = 0; n < row_pixels; n++)
+	{
+		row_real[n] = (XFLOAT)rand() / RAND_MAX - 0.5;
+		row_imag[n] = (XFLOAT)rand() / RAND_MAX - 0.5;
+		row_corr[n] = (XFLOAT)rand() / RAND_MAX;
+		row_ref_real[n] = (XFLOAT)rand() / RAND_MAX - 0.5;
+		row_ref_imag[n] = (XFLOAT)rand() / RAND_MAX - 0.5;
+	}
+
+	Diff2Row r;
+	r.cos_z = r.sin_z = (XFLOAT)0.;
+
+	// Sets up row iy for translation i
+	#define BENCH_SET_ROW(i, iy) \
+		r.xstart = 0; \
+		r.xend = std::min(row_size, image_size - (iy) * row_size); \
+		r.cos_x = &row_cos_x[(i) * row_size]; r.sin_x = &row_sin_x[(i) * row_size]; \
+		r.cos_y = row_cos_y[(i) * nr_rows + (iy)]; r.sin_y = row_sin_y[(i) * nr_rows + (iy)]; \
+		r.real = &row_real[(iy) * row_size]; r.imag = &row_imag[(iy) * row_size]; \
+		r.corr = &row_corr[(iy) * row_size]; \
+		r.ref_real = &row_ref_real[(iy) * row_size]; r.ref_imag = &row_ref_imag[(iy) * row_size];
+
+	// Fine kernels: one sum of squared differences per orientation and translation
+	std::vector<int> fine_timers, cc_timers;
+	fine_timers.push_back(timer.setNew("original loop"));
+	cc_timers.push_back(timer.setNew("original loop"));
+	for (int level = DIFF2_SIMD_SCALAR; level <= max_level; level++)
+	{
+		fine_timers.push_back(timer.setNew(diff2SimdLevelName(level)));
+		cc_timers.push_back(timer.setNew(diff2SimdLevelName(level)));
+	}
+
+	std::vector<double> fine_reference(nr_trans, 0.);
+	std::vector<std::vector<XFLOAT> > fine_results(fine_timers.size());
+	for (int i = 0; i < nr_trans; i++)
+		for (int iy = 0; iy < nr_rows; iy++)
+		{
+			BENCH_SET_ROW(i, iy);
+			fine_reference[i] += originalFineRow<double>(r);
+		}
+
+	for (int t = 0; t < fine_timers.size(); t++)
+	{
+		const int level = t - 1;
+		std::vector<XFLOAT> s(nr_trans);
+
+		timer.tic(fine_timers[t]);
+		for (int iorient = 0; iorient < nr_orients; iorient++)
+		{
+			std::fill(s.begin(), s.end(), (XFLOAT)0.);
+			for (int iy = 0; iy < nr_rows; iy++)
+				for (int i = 0; i < nr_trans; i++)
+				{
+					BENCH_SET_ROW(i, iy);
+					s[i] += (level < 0) ? originalFineRow<XFLOAT>(r) : diff2_fine_row<false>(level, r);
+				}
+		}
+		timer.toc(fine_timers[t]);
+
+		fine_results[t] = s;
+	}
+
+	// Shifting a pixel costs 12 flops, comparing it with the orientation 6
+	const double fine_flops = (double)nr_orients * nr_trans * image_size * (12. + 6.);
+
+	std::cout << " Compared " << nr_orients << " orientations x " << nr_trans << " translations x "
+	          << image_size << " pixels in rows of " << row_size << std::endl;
+
+	all_ok = printResults("fine", timer, fine_timers, fine_flops, fine_reference, fine_results) && all_ok;
+
+	// CC kernels: the cross-correlation terms are summed per pixel, and then over the image
+	std::vector<double> cc_reference(2 * nr_trans, 0.);
+	std::vector<std::vector<XFLOAT> > cc_results(cc_timers.size());
+	for (int i = 0; i < nr_trans; i++)
+	{
+		std::vector<double> s_weight(row_size, 0.), s_norm(row_size, 0.);
+		for (int iy = 0; iy < nr_rows; iy++)
+		{
+			BENCH_SET_ROW(i, iy);
+			originalCCRow<double>(r, &s_weight[0], &s_norm[0]);
+		}
+		for (int x = 0; x < row_size; x++)
+		{
+			cc_reference[2 * i] += s_weight[x];
+			cc_reference[2 * i + 1] += s_norm[x];
+		}
+	}
+
+	for (int t = 0; t < cc_timers.size(); t++)
+	{
+		const int level = t - 1;
+		std::vector<XFLOAT> s_weight(nr_trans * row_size), s_norm(nr_trans * row_size);
+
+		timer.tic(cc_timers[t]);
+		for (int iorient = 0; iorient < nr_orients; iorient++)
+		{
+			std::fill(s_weight.begin(), s_weight.end(), (XFLOAT)0.);
+			std::fill(s_norm.begin(), s_norm.end(), (XFLOAT)0.);
+			for (int iy = 0; iy < nr_rows; iy++)
+				for (int i = 0; i < nr_trans; i++)
+				{
+					BENCH_SET_ROW(i, iy);
+					if (level < 0)
+						originalCCRow<XFLOAT>(r, &s_weight[i * row_size], &s_norm[i * row_size]);
+					else
+						diff2_CC_row<false>(level, r, &s_weight[i * row_size], &s_norm[i * row_size]);
+				}
+		}
+		timer.toc(cc_timers[t]);
+
+		cc_results[t].resize(2 * nr_trans, (XFLOAT)0.);
+		for (int i = 0; i < nr_trans; i++)
+			for (int x = 0; x < row_size; x++)
+			{
+				cc_results[t][2 * i] += s_weight[i * row_size + x];
+				cc_results[t][2 * i + 1] += s_norm[i * row_size + x];
+			}
+	}
+
+	#undef BENCH_SET_ROW
+
+	// The weighted sums of products can be close to zero, so they are compared relative to the norms
+	std::vector<double> cc_scale(2 * nr_trans);
+	for (int i = 0; i < nr_trans; i++)
+		cc_scale[2 * i] = cc_scale[2 * i + 1] = cc_reference[2 * i + 1];
+
+	// Shifting a pixel costs 12 flops, the two cross-correlation terms 10
+	const double cc_flops = (double)nr_orients * nr_trans * image_size * (12. + 10.);
+
+	all_ok = printResults("CC", timer, cc_timers, cc_flops, cc_reference, cc_results, &cc_scale) && all_ok;
+
+	if (!all_ok)
+	{
+		std::cerr << " ERROR: not all kernels gave the same results!" << std::endl;
+		return RELION_EXIT_FAILURE;
+	}
+
+	return RELION_EXIT_SUCCESS;
+}
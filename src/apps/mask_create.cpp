@@ -34,7 +34,7 @@ class mask_create_parameters
 	FileName fn_apply_in, fn_mask, fn_apply_out, fn_thr, fn_omask, fn_and, fn_or, fn_andnot, fn_ornot;
 	RFLOAT ini_threshold, extend_ini_mask, width_soft_edge, lowpass, angpix, helical_z_percentage;
 	RFLOAT inner_radius, outer_radius, center_x, center_y, center_z;
-	bool do_invert, do_helix, do_denovo;
+	bool do_invert, do_helix, do_denovo, do_distance_transform;
 	int n_threads, box_size;
 	IOParser parser;
 
@@ -65,6 +65,7 @@ class mask_create_parameters
 		angpix = textToFloat(parser.getOption("--angpix", "Pixel size (in Angstroms) for the lowpass filter", "-1"));
 		helical_z_percentage = textToFloat(parser.getOption("--z_percentage", "This box length along the center of Z axis contains good information of the helix", "0.3"));
 		n_threads = textToInteger(parser.getOption("--j", "Number of threads", "1"));
+		do_distance_transform = parser.checkOption("--distance_transform", "Extend the mask and add the soft edge using an exact Euclidean distance transform (much faster for large extensions)");
 
 		int denovo_section = parser.addSection("De novo mask creation");
 		do_denovo = parser.checkOption("--denovo", "Create a mask de novo");
@@ -204,7 +205,7 @@ class mask_create_parameters
 			}
 		}
 
-		autoMask(Iin(), Iout(), ini_threshold, extend_ini_mask, width_soft_edge, true, n_threads); // true sets verbosity
+		autoMask(Iin(), Iout(), ini_threshold, extend_ini_mask, width_soft_edge, true, n_threads, do_distance_transform); // true sets verbosity
 
 		if (do_helix)
 		{
@@ -0,0 +1,143 @@
+#include <src/args.h>
+#include <src/time.h>
+#include <src/multidim_array.h>
+#include <src/multidim_array_pool.h>
+
+// Times a few element-wise expressions on 3D volumes, as they are evaluated by the
+// MultidimArray operators (in one loop, without temporary arrays), and as they were
+// evaluated before (one temporary array per operator, followed by a copy into the
+// result), and compares the results. The allocations are counted through the
+// statistics of the array pool.
+
+int main(int argc, char *argv[])
+{
+	IOParser parser;
+
+	parser.setCommandLine(argc, argv);
+	parser.addSection("General options");
+	int box = textToInteger(parser.getOption("--box", "Edge length of the volumes", "256"));
+	int nr_repeats = textToInteger(parser.getOption("--repeats", "Number of times each expression is evaluated", "10"));
+	int nr_threads = textToInteger(parser.getOption("--j", "Number of threads used to evaluate the expressions", "1"));
+
+	if (parser.checkForErrors()) return RELION_EXIT_FAILURE;
+
+	setMultidimExprThreads(nr_threads);
+
+	MultidimArray<RFLOAT> A(box, box, box), B(box, box, box), C(box, box, box), D(box, box, box);
+	MultidimArray<RFLOAT> R_old(box, box, box), R_new(box, box, box);
+
+	srand(1993);
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(A)
+	{
+		DIRECT_MULTIDIM_ELEM(A, n) = (RFLOAT)rand() / RAND_MAX - 0.5;
+		DIRECT_MULTIDIM_ELEM(B, n) = (RFLOAT)rand() / RAND_MAX;
+		DIRECT_MULTIDIM_ELEM(C, n) = (RFLOAT)rand() / RAND_MAX - 0.5;
+		DIRECT_MULTIDIM_ELEM(D, n) = (RFLOAT)rand() / RAND_MAX + 0.5;
+	}
+
+	const RFLOAT k = 0.7;
+
+	std::vector<std::string> cases;
+	cases.push_back("A * B");
+	cases.push_back("A * B + C * D");
+	cases.push_back("(A - B) * k + C / D");
+
+	Timer timer;
+	std::vector<int> timers_old, timers_new;
+	for (int c = 0; c < cases.size(); c++)
+	{
+		timers_old.push_back(timer.setNew(cases[c] + " (old)"));
+		timers_new.push_back(timer.setNew(cases[c]));
+	}
+
+	std::cout << " Evaluating expressions of " << box << "^3 volumes (" << sizeof(RFLOAT) * 8
+	          << "-bit floats) " << nr_repeats << " times on " << nr_threads << " thread(s)" << std::endl;
+
+	bool all_ok = true;
+
+	// A guard that keeps no memory: every allocation is counted, but still goes to the system
+	MultidimArrayPoolGuard counter(true, 0);
+
+	for (int c = 0; c < cases.size(); c++)
+	{
+		MultidimArrayPoolStatistics before = getMultidimArrayPoolStatistics();
+
+		timer.tic(timers_old[c]);
+		for (int r = 0; r < nr_repeats; r++)
+		{
+			if (c == 0)
+			{
+				MultidimArray<RFLOAT> t1;
+				arrayByArray(A, B, t1, '*');
+				R_old = t1;
+			}
+			else if (c == 1)
+			{
+				MultidimArray<RFLOAT> t1, t2, t3;
+				arrayByArray(A, B, t1, '*');
+				arrayByArray(C, D, t2, '*');
+				arrayByArray(t1, t2, t3, '+');
+				R_old = t3;
+			}
+			else
+			{
+				MultidimArray<RFLOAT> t1, t2, t3, t4;
+				arrayByArray(A, B, t1, '-');
+				arrayByScalar(t1, k, t2, '*');
+				arrayByArray(C, D, t3, '/');
+				arrayByArray(t2, t3, t4, '+');
+				R_old = t4;
+			}
+		}
+		timer.toc(timers_old[c]);
+
+		MultidimArrayPoolStatistics between = getMultidimArrayPoolStatistics();
+
+		timer.tic(timers_new[c]);
+		for (int r = 0; r < nr_repeats; r++)
+		{
+			if (c == 0)
+				R_new = A * B;
+			else if (c == 1)
+				R_new = A * B + C * D;
+			else
+				R_new = (A - B) * k + C / D;
+		}
+		timer.toc(timers_new[c]);
+
+		MultidimArrayPoolStatistics after = getMultidimArrayPoolStatistics();
+
+		const double allocations_old = (double)(between.requests - before.requests) / nr_repeats;
+		const double allocations_new = (double)(after.requests - between.requests) / nr_repeats;
+		const double gb_old = (between.requested_bytes - before.requested_bytes) / 1e9 / nr_repeats;
+		const double gb_new = (after.requested_bytes - between.requested_bytes) / 1e9 / nr_repeats;
+
+		double max_diff = 0.;
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(R_old)
+		{
+			max_diff = XMIPP_MAX(max_diff, fabs(DIRECT_MULTIDIM_ELEM(R_old, n) - DIRECT_MULTIDIM_ELEM(R_new, n)));
+		}
+		const bool ok = max_diff < 1e-12;
+		all_ok = all_ok && ok;
+
+		const double seconds_old = timer.times[timers_old[c]] * 1e-6 / nr_repeats;
+		const double seconds_new = timer.times[timers_new[c]] * 1e-6 / nr_repeats;
+
+		std::cout << "  " << std::setw(22) << std::left << cases[c] << std::right << std::fixed
+		          << " old: " << std::setprecision(4) << seconds_old << " sec, " << std::setprecision(1) << allocations_old
+		          << " allocations (" << std::setprecision(2) << gb_old << " GB);"
+		          << " new: " << std::setprecision(4) << seconds_new << " sec, " << std::setprecision(1) << allocations_new
+		          << " allocations (" << std::setprecision(2) << gb_new << " GB);"
+		          << " speed-up: " << seconds_old / seconds_new
+		          << " max. difference: " << std::scientific << std::setprecision(2) << max_diff
+		          << (ok ? "" : " WRONG") << std::endl;
+	}
+
+	if (!all_ok)
+	{
+		std::cerr << " ERROR: the expressions did not give the same results!" << std::endl;
+		return RELION_EXIT_FAILURE;
+	}
+
+	return RELION_EXIT_SUCCESS;
+}
@@ -611,27 +611,17 @@ class star_handler_parameters
 			if (!MDout.containsLabel(label))
 				REPORT_ERROR("ERROR: the output file does not contain the label to check for duplicates. Is it present in all input files?");
 
-			/// Don't want to mess up original order, so make a MDsort with only that label...
-			FileName fn_this, fn_prev = "";
-			MetaDataTable MDsort;
-			FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDout)
-			{
-				MDout.getValue(label, fn_this);
-				MDsort.addObject();
-				MDsort.setValue(label, fn_this);
-			}
-			// sort on the label
-			MDsort.newSort(label);
+			/// Don't want to mess up original order, so sort a copy of only that column...
+			std::vector<std::string> values = MDout.getColumn<std::string>(label);
+			std::sort(values.begin(), values.end());
 			long int nr_duplicates = 0;
-			FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDsort)
+			for (long int i = 1; i < values.size(); i++)
 			{
-				MDsort.getValue(label, fn_this);
-				if (fn_this == fn_prev)
+				if (values[i] == values[i - 1])
 				{
 					nr_duplicates++;
-					std::cerr << " WARNING: duplicate entry: " << fn_this << std::endl;
+					std::cerr << " WARNING: duplicate entry: " << values[i] << std::endl;
 				}
-				fn_prev = fn_this;
 			}
 
 			if (nr_duplicates > 0)
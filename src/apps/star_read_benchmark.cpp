@@ -0,0 +1,91 @@
+#include <src/args.h>
+#include <src/metadata_table.h>
+#include <src/time.h>
+#include <unistd.h>
+
+// Compares reading a STAR file line by line on one thread, as it was read
+// before the rows of a loop were parsed from a memory-mapped file, with
+// reading it through MetaDataTable::read() on several threads, and optionally
+// with reading it from its binary cache.
+// All reads are done on a temporary copy of the file, so that an existing
+// binary cache of the file is neither used nor overwritten.
+
+int main(int argc, char *argv[])
+{
+	IOParser parser;
+
+	parser.setCommandLine(argc, argv);
+	parser.addSection("General options");
+	std::string fn_in = parser.getOption("--i", "Input STAR file");
+	std::string block = parser.getOption("--block", "Name of the data block to read (default: first one)", "");
+	int nr_threads = textToInteger(parser.getOption("--j", "Number of threads for MetaDataTable::read()", "1"));
+	int nr_repeats = textToInteger(parser.getOption("--repeat", "Number of times to read the file", "3"));
+	bool do_rbin = parser.checkOption("--rbin", "Also write a binary cache of the temporary copy and time reading from it");
+
+	if (parser.checkForErrors()) return RELION_EXIT_FAILURE;
+
+	const FileName fn_tmp = fn_in + ".benchmark" + integerToString(getpid()) + ".star";
+	{
+		std::ifstream src(fn_in.c_str(), std::ios::binary);
+		if (!src)
+			REPORT_ERROR("Cannot read " + fn_in);
+
+		std::ofstream dest(fn_tmp.c_str(), std::ios::binary);
+		if (!(dest << src.rdbuf()))
+			REPORT_ERROR("Cannot write the temporary copy " + fn_tmp);
+	}
+
+	Timer timer;
+	int TIMING_LINES = timer.setNew("line by line, 1 thread");
+	int TIMING_READ = timer.setNew("read(), " + integerToString(nr_threads) + " threads");
+	int TIMING_RBIN = timer.setNew("read() from binary cache");
+
+	MetaDataTable MDlines, MDread, MDrbin;
+
+	for (int i = 0; i < nr_repeats; i++)
+	{
+		MetaDataTable::setLineByLineStarReading(true);
+		timer.tic(TIMING_LINES);
+		MDlines.read(fn_tmp, block);
+		timer.toc(TIMING_LINES);
+
+		MetaDataTable::setLineByLineStarReading(false);
+		timer.tic(TIMING_READ);
+		MDread.read(fn_tmp, block, false, nr_threads);
+		timer.toc(TIMING_READ);
+	}
+
+	if (do_rbin)
+	{
+		MetaDataTable::writeBinaryCache(fn_tmp);
+
+		for (int i = 0; i < nr_repeats; i++)
+		{
+			timer.tic(TIMING_RBIN);
+			MDrbin.read(fn_tmp, block);
+			timer.toc(TIMING_RBIN);
+		}
+
+		std::remove((fn_tmp + ".rbin").c_str());
+	}
+
+	std::remove(fn_tmp.c_str());
+
+	std::cout << " Read " << MDread.numberOfObjects() << " objects " << nr_repeats << " times" << std::endl;
+	timer.printTimes(false);
+
+	std::ostringstream out_lines, out_read, out_rbin;
+	MDlines.write(out_lines);
+	MDread.write(out_read);
+	if (do_rbin) MDrbin.write(out_rbin);
+
+	if (out_lines.str() != out_read.str() || (do_rbin && out_lines.str() != out_rbin.str()))
+	{
+		std::cerr << " ERROR: the tables are not identical!" << std::endl;
+		return RELION_EXIT_FAILURE;
+	}
+
+	std::cout << " The tables are identical." << std::endl;
+
+	return RELION_EXIT_SUCCESS;
+}
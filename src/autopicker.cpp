@@ -107,6 +107,7 @@ void AutoPicker::read(int argc, char **argv)
 	do_only_unfinished = parser.checkOption("--only_do_unfinished", "Only autopick those micrographs for which the coordinate file does not yet exist");
 	do_gpu = parser.checkOption("--gpu", "Use GPU acceleration when availiable");
 	gpu_ids = parser.getOption("--gpu", "Device ids for each MPI-thread","default");
+	nr_threads = textToInteger(parser.getOption("--j", "Number of threads to calculate the FOM maps of all in-plane rotations (or all LoG diameters) in parallel (CPU only)", "1"));
 #ifndef CUDA
 	if(do_gpu)
 	{
@@ -138,6 +139,7 @@ void AutoPicker::read(int argc, char **argv)
 	LoG_adjust_threshold = textToFloat(parser.getOption("--LoG_adjust_threshold", "Use this option to adjust the picking threshold: positive for less particles, negative for more", "0."));
 	LoG_upper_limit = textToFloat(parser.getOption("--LoG_upper_threshold", "Use this option to set the upper limit of the picking threshold", "99999"));
 	LoG_use_ctf = parser.checkOption("--LoG_use_ctf", "Use CTF until the first peak in Laplacian-of-Gaussian picker");
+	LoG_prefetch_mics = textToInteger(parser.getOption("--LoG_prefetch_mics", "Read this many micrographs ahead on a separate I/O thread, while the current one is being picked", "0"));
 
 	if (do_gpu && do_LoG)
 	{
@@ -902,6 +904,9 @@ void AutoPicker::run()
 	}
 
 
+	if (do_LoG && !do_read_fom_maps && LoG_prefetch_mics > 0)
+		mic_prefetcher = new ImagePrefetcher(1, LoG_prefetch_mics);
+
 	FileName fn_olddir="";
 	for (long int imic = 0; imic < fn_micrographs.size(); imic++)
 	{
@@ -926,7 +931,10 @@ void AutoPicker::run()
 		timer.tic(TIMING_A5);
 #endif
 		if (do_LoG)
+		{
+			prefetchLoGMicrographs(imic, fn_micrographs.size() - 1);
 			autoPickLoGOneMicrograph(fn_micrographs[imic], imic);
+		}
 		else
 			autoPickOneMicrograph(fn_micrographs[imic], imic);
 #ifdef TIMING
@@ -934,6 +942,12 @@ void AutoPicker::run()
 #endif
 	}
 
+	if (mic_prefetcher != NULL)
+	{
+		delete mic_prefetcher;
+		mic_prefetcher = NULL;
+	}
+
 	if (verb > 0)
 		progress_bar(fn_micrographs.size());
 }
@@ -2521,6 +2535,19 @@ void AutoPicker::exportHelicalTubes(
 	return;
 }
 
+void AutoPicker::prefetchLoGMicrographs(long int imic, long int last_mic)
+{
+	if (mic_prefetcher == NULL)
+		return;
+
+	// The prefetcher itself limits how many of the requested micrographs are read ahead
+	for (long int inext = XMIPP_MAX(imic, last_prefetched_mic + 1); inext <= XMIPP_MIN(imic + LoG_prefetch_mics, last_mic); inext++)
+	{
+		mic_prefetcher->request(inext, std::vector<FileName>(1, fn_micrographs[inext]));
+		last_prefetched_mic = inext;
+	}
+}
+
 void AutoPicker::autoPickLoGOneMicrograph(FileName &fn_mic, long int imic)
 {
 	Image<RFLOAT> Imic;
@@ -2542,7 +2569,14 @@ void AutoPicker::autoPickLoGOneMicrograph(FileName &fn_mic, long int imic)
 		init_random_generator(random_seed + imic);
 
 		// Read in the micrograph
-		Imic.read(fn_mic);
+		if (mic_prefetcher != NULL)
+		{
+			mic_prefetcher->setCurrent(imic);
+			mic_prefetcher->getImage(0, Imic());
+			mic_prefetcher->releaseCurrent();
+		}
+		else
+			Imic.read(fn_mic);
 		Imic().setXmippOrigin();
 
 		// Let's just check the square size again....
@@ -2624,37 +2658,48 @@ void AutoPicker::autoPickLoGOneMicrograph(FileName &fn_mic, long int imic)
 			}
 		}
 
-		Image<RFLOAT> Maux(workSize, workSize);
-
-//		transformer.inverseFourierTransform(Fmic, Maux());
-//		Maux.write("LoG-ctf-filtered.mrc");
-//		REPORT_ERROR("stop");
-
 		// Make the diameter of the LoG filter larger in steps of LoG_incr_search (=1.5)
 		// Search sizes from LoG_min_diameter to LoG_max_search (=5) * LoG_max_diameter
-		for (int i = 0; i < diams_LoG.size(); i++)
+		// The filtered maps are calculated from the same Fmic for nr_threads diameters at a time,
+		// and are then compared in the order of the diameters, so that at most nr_threads maps are kept in memory
+		const int nr_diams_at_once = XMIPP_MAX(1, XMIPP_MIN(nr_threads, (int)diams_LoG.size()));
+		std::vector<Image<RFLOAT> > Mlogs(nr_diams_at_once);
+		for (int first_diam = 0; first_diam < diams_LoG.size(); first_diam += nr_diams_at_once)
 		{
-			RFLOAT myd = diams_LoG[i];
+			const int last_diam = XMIPP_MIN(first_diam + nr_diams_at_once, (int)diams_LoG.size()) - 1;
 
-			Faux = Fmic;
-			LoGFilterMap(Faux, micrograph_size, myd, angpix);
-			transformer.inverseFourierTransform(Faux, Maux());
+			#pragma omp parallel for num_threads(nr_diams_at_once)
+			for (int i = first_diam; i <= last_diam; i++)
+			{
+				// All transformers of the same size share their FFTW plans
+				FourierTransformer my_transformer;
+				MultidimArray<Complex > Fmy = Fmic;
+				LoGFilterMap(Fmy, micrograph_size, diams_LoG[i], angpix);
+				Mlogs[i - first_diam]().resize(workSize, workSize);
+				my_transformer.inverseFourierTransform(Fmy, Mlogs[i - first_diam]());
+			}
 
 			if (do_write_fom_maps)
 			{
-				FileName fn_tmp=getOutputRootName(fn_mic)+"_"+fn_out+"_LoG"+integerToString(ROUND(myd))+".spi";
-				Maux.write(fn_tmp);
+				for (int i = first_diam; i <= last_diam; i++)
+				{
+					FileName fn_tmp=getOutputRootName(fn_mic)+"_"+fn_out+"_LoG"+integerToString(ROUND(diams_LoG[i]))+".spi";
+					Mlogs[i - first_diam].write(fn_tmp);
+				}
 			}
 
-			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Maux())
+			#pragma omp parallel for num_threads(nr_diams_at_once)
+			for (long int n = 0; n < NZYXSIZE(Mbest_fom); n++)
 			{
-				if (DIRECT_MULTIDIM_ELEM(Maux(), n) > DIRECT_MULTIDIM_ELEM(Mbest_fom, n))
+				for (int i = first_diam; i <= last_diam; i++)
 				{
-					DIRECT_MULTIDIM_ELEM(Mbest_fom, n) = DIRECT_MULTIDIM_ELEM(Maux(), n);
-					DIRECT_MULTIDIM_ELEM(Mbest_size, n) = myd;
+					if (DIRECT_MULTIDIM_ELEM(Mlogs[i - first_diam](), n) > DIRECT_MULTIDIM_ELEM(Mbest_fom, n))
+					{
+						DIRECT_MULTIDIM_ELEM(Mbest_fom, n) = DIRECT_MULTIDIM_ELEM(Mlogs[i - first_diam](), n);
+						DIRECT_MULTIDIM_ELEM(Mbest_size, n) = diams_LoG[i];
+					}
 				}
 			}
-
 		}
 
 	} // end if !do_read_fom_maps
@@ -3126,32 +3171,13 @@ void AutoPicker::autoPickOneMicrograph(FileName &fn_mic, long int imic)
 #ifdef TIMING
 			timer.tic(TIMING_B3);
 #endif
-			Mccf_best.initConstant(-LARGE_NUMBER);
-			bool is_first_psi = true;
-			for (RFLOAT psi = 0. ; psi < 360.; psi+=psi_sampling)
+			// Get the FT of the non-rotated template, to calculate the statistics of this reference
 			{
-				// Get the Euler matrix
 				Matrix2D<RFLOAT> A(3,3);
-				Euler_angles2matrix(0., 0., psi, A);
-
-				// Now get the FT of the rotated (non-ctf-corrected) template
+				Euler_angles2matrix(0., 0., 0., A);
 				Faux.initZeros(downsize_mic, downsize_mic/2 + 1);
 				PPref[iref].get2DFourierTransform(Faux, A);
 
-#ifdef DEBUG
-				std::cerr << " psi= " << psi << std::endl;
-				windowFourierTransform(Faux, Faux2, micrograph_size);
-				CenterFFTbySign(Faux2);
-				tt().resize(micrograph_size, micrograph_size);
-				transformer.inverseFourierTransform(Faux2, tt());
-				tt.write("Mref_rot.spi");
-
-				windowFourierTransform(Fmic, Faux2, micrograph_size);
-				CenterFFTbySign(Faux2);
-				transformer.inverseFourierTransform(Faux2, tt());
-				tt.write("Mmic.spi");
-
-#endif
 #ifdef TIMING
 	timer.tic(TIMING_B4);
 #endif
@@ -3162,141 +3188,77 @@ void AutoPicker::autoPickOneMicrograph(FileName &fn_mic, long int imic)
 					{
 						DIRECT_MULTIDIM_ELEM(Faux, n) *= DIRECT_MULTIDIM_ELEM(Fctf, n);
 					}
+				}
 #ifdef TIMING
 	timer.toc(TIMING_B4);
 #endif
-#ifdef DEBUG
-				MultidimArray<RFLOAT> ttt(micrograph_size, micrograph_size);
-				windowFourierTransform(Faux, Faux2, micrograph_size);
-				CenterFFTbySign(Faux2);
-				transformer.inverseFourierTransform(Faux2, ttt);
-				ttt.setXmippOrigin();
-				tt().resize(particle_size, particle_size);
-				tt().setXmippOrigin();
-				FOR_ALL_ELEMENTS_IN_ARRAY2D(tt())
-				{
-					A2D_ELEM(tt(), i, j) = A2D_ELEM(ttt, i, j);
-				}
-				tt.write("Mref_rot_ctf.spi");
-#endif
-				}
 
-				if (is_first_psi)
-				{
 #ifdef TIMING
 	timer.tic(TIMING_B5);
 #endif
-					// Calculate the expected ratio of probabilities for this CTF-corrected reference
-					// and the sum_ref_under_circ_mask and sum_ref_under_circ_mask2
-					// Do this also if we're not recalculating the fom maps...
-					// This calculation needs to be done on an "non-shrinked" micrograph, in order to get the correct I^2 statistics
-					windowFourierTransform(Faux, Faux2, micrograph_size);
-					CenterFFTbySign(Faux2);
-					Maux.resize(micrograph_size, micrograph_size);
-					transformer.inverseFourierTransform(Faux2, Maux);
-					Maux.setXmippOrigin();
+				// Calculate the expected ratio of probabilities for this CTF-corrected reference
+				// and the sum_ref_under_circ_mask and sum_ref_under_circ_mask2
+				// Do this also if we're not recalculating the fom maps...
+				// This calculation needs to be done on an "non-shrinked" micrograph, in order to get the correct I^2 statistics
+				windowFourierTransform(Faux, Faux2, micrograph_size);
+				CenterFFTbySign(Faux2);
+				Maux.resize(micrograph_size, micrograph_size);
+				transformer.inverseFourierTransform(Faux2, Maux);
+				Maux.setXmippOrigin();
 #ifdef DEBUG
-					Image<RFLOAT> ttt;
-					ttt()=Maux;
-					ttt.write("Maux.spi");
+				Image<RFLOAT> ttt;
+				ttt()=Maux;
+				ttt.write("Maux.spi");
 #endif
-					sum_ref_under_circ_mask = 0.;
-					sum_ref2_under_circ_mask = 0.;
-					RFLOAT suma2 = 0.;
-					RFLOAT sumn = 1.;
-					MultidimArray<RFLOAT> Mctfref(particle_size, particle_size);
-					Mctfref.setXmippOrigin();
-					FOR_ALL_ELEMENTS_IN_ARRAY2D(Mctfref) // only loop over smaller Mctfref, but take values from large Maux!
+				sum_ref_under_circ_mask = 0.;
+				sum_ref2_under_circ_mask = 0.;
+				RFLOAT suma2 = 0.;
+				RFLOAT sumn = 1.;
+				MultidimArray<RFLOAT> Mctfref(particle_size, particle_size);
+				Mctfref.setXmippOrigin();
+				FOR_ALL_ELEMENTS_IN_ARRAY2D(Mctfref) // only loop over smaller Mctfref, but take values from large Maux!
+				{
+					if (i*i + j*j < particle_radius2)
 					{
-						if (i*i + j*j < particle_radius2)
-						{
-							suma2 += A2D_ELEM(Maux, i, j) * A2D_ELEM(Maux, i, j);
-							suma2 += 2. * A2D_ELEM(Maux, i, j) * rnd_gaus(0., 1.);
-							sum_ref_under_circ_mask += A2D_ELEM(Maux, i, j);
-							sum_ref2_under_circ_mask += A2D_ELEM(Maux, i, j) * A2D_ELEM(Maux, i, j);
-							sumn += 1.;
-						}
+						suma2 += A2D_ELEM(Maux, i, j) * A2D_ELEM(Maux, i, j);
+						suma2 += 2. * A2D_ELEM(Maux, i, j) * rnd_gaus(0., 1.);
+						sum_ref_under_circ_mask += A2D_ELEM(Maux, i, j);
+						sum_ref2_under_circ_mask += A2D_ELEM(Maux, i, j) * A2D_ELEM(Maux, i, j);
+						sumn += 1.;
+					}
 #ifdef DEBUG
-						A2D_ELEM(Mctfref, i, j) = A2D_ELEM(Maux, i, j);
+					A2D_ELEM(Mctfref, i, j) = A2D_ELEM(Maux, i, j);
 #endif
-					}
-					sum_ref_under_circ_mask /= sumn;
-					sum_ref2_under_circ_mask /= sumn;
-					expected_Pratio = exp(suma2 / (2. * sumn));
+				}
+				sum_ref_under_circ_mask /= sumn;
+				sum_ref2_under_circ_mask /= sumn;
+				expected_Pratio = exp(suma2 / (2. * sumn));
 #ifdef DEBUG
-					std::cerr << " expected_Pratio["<<iref<<"]= " << expected_Pratio << std::endl;
-					tt()=Mctfref;
-					tt.write("Mctfref.spi");
-					std::cerr << "suma2 " << suma2<< " sumn " << sumn << " suma2/2sumn="<< suma2 / (2. * sumn) << std::endl;
-					std::cerr << " nr_pixels_under_mask= " << nr_pixels_circular_mask << " nr_pixels_under_invmask= " << nr_pixels_circular_invmask << std::endl;
-					std::cerr << "sum_ref_under_circ_mask " << sum_ref_under_circ_mask << std::endl;
-					std::cerr << "sum_ref2_under_circ_mask " << sum_ref2_under_circ_mask << std::endl;
-					std::cerr << "expected_Pratio " << expected_Pratio << std::endl;
+				std::cerr << " expected_Pratio["<<iref<<"]= " << expected_Pratio << std::endl;
+				tt()=Mctfref;
+				tt.write("Mctfref.spi");
+				std::cerr << "suma2 " << suma2<< " sumn " << sumn << " suma2/2sumn="<< suma2 / (2. * sumn) << std::endl;
+				std::cerr << " nr_pixels_under_mask= " << nr_pixels_circular_mask << " nr_pixels_under_invmask= " << nr_pixels_circular_invmask << std::endl;
+				std::cerr << "sum_ref_under_circ_mask " << sum_ref_under_circ_mask << std::endl;
+				std::cerr << "sum_ref2_under_circ_mask " << sum_ref2_under_circ_mask << std::endl;
+				std::cerr << "expected_Pratio " << expected_Pratio << std::endl;
 #endif
 
-					// Maux goes back to the workSize
-					Maux.resize(workSize, workSize);
+				// Maux goes back to the workSize
+				Maux.resize(workSize, workSize);
 #ifdef TIMING
-					timer.toc(TIMING_B5);
+				timer.toc(TIMING_B5);
 #endif
-				}
+			}
 
 #ifdef TIMING
-				timer.tic(TIMING_B6);
-#endif
-				// Now multiply template and micrograph to calculate the cross-correlation
-				FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Faux)
-				{
-					DIRECT_MULTIDIM_ELEM(Faux, n) = conj(DIRECT_MULTIDIM_ELEM(Faux, n)) * DIRECT_MULTIDIM_ELEM(Fmic, n);
-				}
-
-				// If we're not doing shrink, then Faux is bigger than Faux2!
-				windowFourierTransform(Faux, Faux2, workSize);
-				CenterFFTbySign(Faux2);
-				transformer.inverseFourierTransform(Faux2, Maux);
-#ifdef DEBUG
-				tt()=Maux*normfft;
-				tt.write("Mcc.spi");
+			timer.tic(TIMING_B6);
 #endif
-
-				// Calculate ratio of prabilities P(ref)/P(zero)
-				// Keep track of the best values and their corresponding iref and psi
-
-				// So now we already had precalculated: Mdiff2 = 1/sig*Sum(X^2) - 2/sig*Sum(X) + mu^2/sig*Sum(1)
-				// Still to do (per reference): - 2/sig*Sum(AX) + 2*mu/sig*Sum(A) + Sum(A^2)
-				FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Maux)
-				{
-					RFLOAT diff2 = - 2. * normfft * DIRECT_MULTIDIM_ELEM(Maux, n);
-					diff2 += 2. * DIRECT_MULTIDIM_ELEM(Mmean, n) * sum_ref_under_circ_mask;
-					if (DIRECT_MULTIDIM_ELEM(Mstddev, n) > 1E-10)
-						diff2 /= DIRECT_MULTIDIM_ELEM(Mstddev, n);
-					diff2 += sum_ref2_under_circ_mask;
-					diff2 = exp(- diff2 / 2.); // exponentiate to reflect the Gaussian error model. sigma=1 after normalization, 0.4=1/sqrt(2pi)
-
-					// Store fraction of (1 - probability-ratio) wrt  (1 - expected Pratio)
-					diff2 = (diff2 - 1.) / (expected_Pratio - 1.);
-#ifdef DEBUG
-					DIRECT_MULTIDIM_ELEM(Maux, n) = diff2;
-#endif
-					if (diff2 > DIRECT_MULTIDIM_ELEM(Mccf_best, n))
-					{
-						DIRECT_MULTIDIM_ELEM(Mccf_best, n) = diff2;
-						DIRECT_MULTIDIM_ELEM(Mpsi_best, n) = psi;
-					}
-				}
-#ifdef DEBUG
-				std::cerr << " Maux.computeMax()= " << Maux.computeMax() << std::endl;
-				tt()=Maux;
-				tt.write("Mccf.spi");
-			    std::cerr << " Press any key to continue... "  << std::endl;
-			    char c;
-			    std::cin >> c;
-#endif
-			    is_first_psi = false;
+			calculateBestFomOverPsi(iref, Fmic, Fctf, Mmean, Mstddev, sum_ref_under_circ_mask, sum_ref2_under_circ_mask,
+					expected_Pratio, normfft, Mccf_best, Mpsi_best);
 #ifdef TIMING
-	timer.toc(TIMING_B6);
+			timer.toc(TIMING_B6);
 #endif
-			} // end for psi
 #ifdef TIMING
 	timer.toc(TIMING_B3);
 #endif
@@ -3468,6 +3430,113 @@ void AutoPicker::autoPickOneMicrograph(FileName &fn_mic, long int imic)
 	}
 }
 
+void AutoPicker::calculateBestFomOverPsi(int iref,
+		const MultidimArray<Complex > &Fmic,
+		const MultidimArray<RFLOAT> &Fctf,
+		const MultidimArray<RFLOAT> &Mmean,
+		const MultidimArray<RFLOAT> &Mstddev,
+		RFLOAT sum_ref_under_circ_mask,
+		RFLOAT sum_ref2_under_circ_mask,
+		RFLOAT expected_Pratio,
+		RFLOAT normfft,
+		MultidimArray<RFLOAT> &Mccf_best,
+		MultidimArray<RFLOAT> &Mpsi_best)
+{
+	std::vector<RFLOAT> psis;
+	for (RFLOAT psi = 0. ; psi < 360.; psi+=psi_sampling)
+		psis.push_back(psi);
+
+	// Each thread takes a contiguous range of psi-angles and keeps its own best values.
+	// These are combined in the order of the threads, so that ties are resolved towards the
+	// first psi-angle, as in a single loop over all psi-angles.
+	const int my_nr_threads = XMIPP_MAX(1, XMIPP_MIN(nr_threads, (int)psis.size()));
+	std::vector<MultidimArray<RFLOAT> > Mccf_best_thread(my_nr_threads), Mpsi_best_thread(my_nr_threads);
+
+	#pragma omp parallel for num_threads(my_nr_threads) schedule(static, 1)
+	for (int ithread = 0; ithread < my_nr_threads; ithread++)
+	{
+		// The first thread writes directly into the output arrays
+		MultidimArray<RFLOAT> &my_ccf_best = (ithread == 0) ? Mccf_best : Mccf_best_thread[ithread];
+		MultidimArray<RFLOAT> &my_psi_best = (ithread == 0) ? Mpsi_best : Mpsi_best_thread[ithread];
+		my_ccf_best.resize(workSize, workSize);
+		my_ccf_best.initConstant(-LARGE_NUMBER);
+		my_psi_best.resize(workSize, workSize);
+
+		// All transformers of the same size share their FFTW plans
+		FourierTransformer transformer;
+		MultidimArray<Complex > Faux, Faux2;
+		MultidimArray<RFLOAT> Maux(workSize, workSize);
+
+		const int ipsi_start = (ithread * psis.size()) / my_nr_threads;
+		const int ipsi_end = ((ithread + 1) * psis.size()) / my_nr_threads;
+		for (int ipsi = ipsi_start; ipsi < ipsi_end; ipsi++)
+		{
+			// Get the Euler matrix
+			Matrix2D<RFLOAT> A(3,3);
+			Euler_angles2matrix(0., 0., psis[ipsi], A);
+
+			// Now get the FT of the rotated (non-ctf-corrected) template
+			Faux.initZeros(downsize_mic, downsize_mic/2 + 1);
+			PPref[iref].get2DFourierTransform(Faux, A);
+
+			// Apply the CTF on-the-fly (so same PPref can be used for many different micrographs)
+			if (do_ctf)
+			{
+				FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Faux)
+				{
+					DIRECT_MULTIDIM_ELEM(Faux, n) *= DIRECT_MULTIDIM_ELEM(Fctf, n);
+				}
+			}
+
+			// Now multiply template and micrograph to calculate the cross-correlation
+			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Faux)
+			{
+				DIRECT_MULTIDIM_ELEM(Faux, n) = conj(DIRECT_MULTIDIM_ELEM(Faux, n)) * DIRECT_MULTIDIM_ELEM(Fmic, n);
+			}
+
+			// If we're not doing shrink, then Faux is bigger than Faux2!
+			windowFourierTransform(Faux, Faux2, workSize);
+			CenterFFTbySign(Faux2);
+			transformer.inverseFourierTransform(Faux2, Maux);
+
+			// Calculate ratio of prabilities P(ref)/P(zero)
+			// Keep track of the best values and their corresponding psi
+
+			// So now we already had precalculated: Mdiff2 = 1/sig*Sum(X^2) - 2/sig*Sum(X) + mu^2/sig*Sum(1)
+			// Still to do (per reference): - 2/sig*Sum(AX) + 2*mu/sig*Sum(A) + Sum(A^2)
+			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Maux)
+			{
+				RFLOAT diff2 = - 2. * normfft * DIRECT_MULTIDIM_ELEM(Maux, n);
+				diff2 += 2. * DIRECT_MULTIDIM_ELEM(Mmean, n) * sum_ref_under_circ_mask;
+				if (DIRECT_MULTIDIM_ELEM(Mstddev, n) > 1E-10)
+					diff2 /= DIRECT_MULTIDIM_ELEM(Mstddev, n);
+				diff2 += sum_ref2_under_circ_mask;
+				diff2 = exp(- diff2 / 2.); // exponentiate to reflect the Gaussian error model. sigma=1 after normalization, 0.4=1/sqrt(2pi)
+
+				// Store fraction of (1 - probability-ratio) wrt  (1 - expected Pratio)
+				diff2 = (diff2 - 1.) / (expected_Pratio - 1.);
+				if (diff2 > DIRECT_MULTIDIM_ELEM(my_ccf_best, n))
+				{
+					DIRECT_MULTIDIM_ELEM(my_ccf_best, n) = diff2;
+					DIRECT_MULTIDIM_ELEM(my_psi_best, n) = psis[ipsi];
+				}
+			}
+		} // end for psi
+	} // end for ithread
+
+	for (int ithread = 1; ithread < my_nr_threads; ithread++)
+	{
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Mccf_best)
+		{
+			if (DIRECT_MULTIDIM_ELEM(Mccf_best_thread[ithread], n) > DIRECT_MULTIDIM_ELEM(Mccf_best, n))
+			{
+				DIRECT_MULTIDIM_ELEM(Mccf_best, n) = DIRECT_MULTIDIM_ELEM(Mccf_best_thread[ithread], n);
+				DIRECT_MULTIDIM_ELEM(Mpsi_best, n) = DIRECT_MULTIDIM_ELEM(Mpsi_best_thread[ithread], n);
+			}
+		}
+	}
+}
+
 FileName AutoPicker::getOutputRootName(FileName fn_mic)
 {
 	FileName fn_pre, fn_jobnr, fn_post;
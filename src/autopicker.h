@@ -20,6 +20,7 @@
 #include "src/mask.h"
 #include "src/macros.h"
 #include "src/helix.h"
+#include "src/image_prefetcher.h"
 #ifdef CUDA
 #include "src/acc/cuda/cuda_mem_utils.h"
 #include "src/acc/acc_projector.h"
@@ -171,6 +172,15 @@ public:
 	// Vector with all diameters to be sampled
 	std::vector<RFLOAT> diams_LoG;
 
+	// Number of micrographs to read ahead from disc while LoG-picking the current one
+	int LoG_prefetch_mics;
+
+	// Reads the next micrographs for the LoG picker (NULL if they are read when needed)
+	ImagePrefetcher *mic_prefetcher;
+
+	// Last micrograph that was requested from mic_prefetcher
+	long int last_prefetched_mic;
+
 	//// Specific amyloid picker
 	bool do_amyloid;
 
@@ -215,6 +225,9 @@ public:
 	// Which GPU devices to use?
 	std::string gpu_ids;
 
+	// Number of threads to calculate the FOM maps for all in-plane rotations of a reference on the CPU
+	int nr_threads;
+
 	// Keep the CTFs unchanged until the first peak?
 	bool intact_ctf_first_peak;
 
@@ -277,7 +290,9 @@ public:
 	AutoPicker():
 		available_memory(0),
 		available_gpu_memory(0),
-		requested_gpu_memory(0)
+		requested_gpu_memory(0),
+		mic_prefetcher(NULL),
+		last_prefetched_mic(-1)
 	{}
 
 	// Read command line arguments
@@ -353,9 +368,27 @@ public:
 			RFLOAT tube_length_min_pix,
 			int skip_side, float scale);
 
+	// Start reading micrographs imic+1 to imic+LoG_prefetch_mics (but not beyond last_mic) on the I/O thread
+	void prefetchLoGMicrographs(long int imic, long int last_mic);
+
 	void autoPickLoGOneMicrograph(FileName &fn_mic, long int imic);
 	void autoPickOneMicrograph(FileName &fn_mic, long int imic);
 
+	// Calculate the probability-ratio maps of one (CTF-affected) reference for all in-plane rotations, and keep
+	// the best value and its psi-angle for every pixel in Mccf_best and Mpsi_best.
+	// The rotations are divided over nr_threads threads, which all share the FT of the micrograph (Fmic)
+	void calculateBestFomOverPsi(int iref,
+			const MultidimArray<Complex > &Fmic,
+			const MultidimArray<RFLOAT> &Fctf,
+			const MultidimArray<RFLOAT> &Mmean,
+			const MultidimArray<RFLOAT> &Mstddev,
+			RFLOAT sum_ref_under_circ_mask,
+			RFLOAT sum_ref2_under_circ_mask,
+			RFLOAT expected_Pratio,
+			RFLOAT normfft,
+			MultidimArray<RFLOAT> &Mccf_best,
+			MultidimArray<RFLOAT> &Mpsi_best);
+
 	// Get the output coordinate filename given the micrograph filename
 	FileName getOutputRootName(FileName fn_mic);
 	// Uses Roseman2003 formulae to calculate stddev under the mask through FFTs
@@ -89,6 +89,9 @@ void AutoPickerMpi::run()
 		barstep = XMIPP_MAX(1, my_nr_micrographs / 60);
 	}
 
+	if (do_LoG && !do_read_fom_maps && LoG_prefetch_mics > 0)
+		mic_prefetcher = new ImagePrefetcher(1, LoG_prefetch_mics);
+
 	FileName fn_olddir="";
 	for (long int imic = my_first_micrograph; imic <= my_last_micrograph; imic++)
 	{
@@ -110,11 +113,20 @@ void AutoPickerMpi::run()
 		}
 
 		if (do_LoG)
+		{
+			prefetchLoGMicrographs(imic, my_last_micrograph);
 			autoPickLoGOneMicrograph(fn_micrographs[imic], imic);
+		}
 		else
 			autoPickOneMicrograph(fn_micrographs[imic], imic);
 	}
 
+	if (mic_prefetcher != NULL)
+	{
+		delete mic_prefetcher;
+		mic_prefetcher = NULL;
+	}
+
 	if (verb > 0)
 		progress_bar(my_nr_micrographs);
 }
@@ -2023,134 +2023,185 @@ void BackProjector::applyPointGroupSymmetry(int threads)
 		Matrix2D<RFLOAT> L(4, 4), R(4, 4); // A matrix from the list
 		MultidimArray<RFLOAT> sum_weight;
 		MultidimArray<Complex > sum_data;
-
-		// First symmetry operator (not stored in SL) is the identity matrix
-		sum_weight = weight;
-		sum_data = data;
-		// Loop over all other symmetry operators
-		for (int isym = 0; isym < SL.SymsNo(); isym++)
+		sum_weight.resize(weight);
+		sum_data.resize(data);
+
+		// The rotated coordinates xp = x * R(0, 0) + y * R(0, 1) + z * R(0, 2) etc. are sums of products
+		// of one voxel index and one matrix element: tabulate these products for all operators
+		// rotx[isym][3*j + c] = j * R(c, 0), roty[isym][3*(i - STARTINGY) + c] = i * R(c, 1), etc.
+		const int nr_sym = SL.SymsNo();
+		std::vector<std::vector<RFLOAT> > rotx(nr_sym), roty(nr_sym), rotz(nr_sym);
+		for (int isym = 0; isym < nr_sym; isym++)
 		{
 			SL.get_matrices(isym, L, R);
 #ifdef DEBUG_SYMM
 			std::cerr << " isym= " << isym << " R= " << R << std::endl;
 #endif
-			// Loop over all points in the output (i.e. rotated, or summed) array
+			rotx[isym].resize(3 * XSIZE(sum_weight));
+			roty[isym].resize(3 * YSIZE(sum_weight));
+			rotz[isym].resize(3 * ZSIZE(sum_weight));
+			for (int c = 0; c < 3; c++)
+			{
+				for (long int j = STARTINGX(sum_weight); j <= FINISHINGX(sum_weight); j++)
+					rotx[isym][3 * (j - STARTINGX(sum_weight)) + c] = (RFLOAT)j * R(c, 0);
+				for (long int i = STARTINGY(sum_weight); i <= FINISHINGY(sum_weight); i++)
+					roty[isym][3 * (i - STARTINGY(sum_weight)) + c] = (RFLOAT)i * R(c, 1);
+				for (long int k = STARTINGZ(sum_weight); k <= FINISHINGZ(sum_weight); k++)
+					rotz[isym][3 * (k - STARTINGZ(sum_weight)) + c] = (RFLOAT)k * R(c, 2);
+			}
+		}
 
-			#pragma omp parallel for num_threads(threads)
+		// Loop over all rows of the output (i.e. rotated, or summed) array, and sum the interpolated
+		// values of all symmetry operators for one row at a time. Per output point, the sum is taken in
+		// the same order as one operator at a time, while applying one operator to a whole row keeps
+		// the interpolated points close together in memory.
+		// Slabs near the edges have few points inside r_max, so distribute them dynamically.
+		#pragma omp parallel num_threads(threads)
+		{
+			std::vector<Complex > row_data(XSIZE(sum_data));
+			std::vector<RFLOAT> row_weight(XSIZE(sum_weight));
+
+			#pragma omp for schedule(dynamic)
 			for (long int k=STARTINGZ(sum_weight); k<=FINISHINGZ(sum_weight); k++)
 			for (long int i=STARTINGY(sum_weight); i<=FINISHINGY(sum_weight); i++)
-			for (long int j=STARTINGX(sum_weight); j<=FINISHINGX(sum_weight); j++)
 			{
-	        	RFLOAT x = (RFLOAT)j; // STARTINGX(sum_weight) is zero!
-	        	RFLOAT y = (RFLOAT)i;
-	        	RFLOAT z = (RFLOAT)k;
-	        	RFLOAT r2 = x*x + y*y + z*z;
-
-	        	if (r2 <= rmax2)
-	        	{
-	        		// coords_output(x,y) = A * coords_input (xp,yp)
-					RFLOAT xp = x * R(0, 0) + y * R(0, 1) + z * R(0, 2);
-					RFLOAT yp = x * R(1, 0) + y * R(1, 1) + z * R(1, 2);
-					RFLOAT zp = x * R(2, 0) + y * R(2, 1) + z * R(2, 2);
-
-					bool is_neg_x;
+				// First symmetry operator (not stored in SL) is the identity matrix
+				for (long int j=STARTINGX(sum_weight); j<=FINISHINGX(sum_weight); j++)
+				{
+					row_data[j] = A3D_ELEM(data, k, i, j); // STARTINGX(sum_weight) is zero!
+					row_weight[j] = A3D_ELEM(weight, k, i, j);
+				}
 
-					// Only asymmetric half is stored
-					if (xp < 0)
-					{
-						// Get complex conjugated hermitian symmetry pair
-						xp = -xp;
-						yp = -yp;
-						zp = -zp;
-						is_neg_x = true;
-					}
-					else
-					{
-						is_neg_x = false;
-					}
+				// As x >= 0, the points with r2 <= rmax2 are the first ones of the row
+				RFLOAT y = (RFLOAT)i;
+				RFLOAT z = (RFLOAT)k;
+				long int nr_inside = 0;
+				for (long int j=STARTINGX(sum_weight); j<=FINISHINGX(sum_weight); j++, nr_inside++)
+				{
+					RFLOAT x = (RFLOAT)j;
+					if (x*x + y*y + z*z > rmax2)
+						break;
+				}
 
-					// Trilinear interpolation (with physical coords)
-					// Subtract STARTINGY and STARTINGZ to accelerate access to data (STARTINGX=0)
-					// In that way use DIRECT_A3D_ELEM, rather than A3D_ELEM
-					int x0 = FLOOR(xp);
-					RFLOAT fx = xp - x0;
-					int x1 = x0 + 1;
+				const long int ii = 3 * (i - STARTINGY(sum_weight));
+				const long int kk = 3 * (k - STARTINGZ(sum_weight));
 
-					int y0 = FLOOR(yp);
-					RFLOAT fy = yp - y0;
-					y0 -=  STARTINGY(data);
-					int y1 = y0 + 1;
+				for (int isym = 0; isym < nr_sym; isym++)
+				{
+					const RFLOAT *rx = &rotx[isym][0];
+					const RFLOAT yzp0 = roty[isym][ii    ], zp0 = rotz[isym][kk    ];
+					const RFLOAT yzp1 = roty[isym][ii + 1], zp1 = rotz[isym][kk + 1];
+					const RFLOAT yzp2 = roty[isym][ii + 2], zp2 = rotz[isym][kk + 2];
 
-					int z0 = FLOOR(zp);
-					RFLOAT fz = zp - z0;
-					z0 -= STARTINGZ(data);
-					int z1 = z0 + 1;
+					for (long int j = 0; j < nr_inside; j++)
+					{
+						// coords_output(x,y) = A * coords_input (xp,yp)
+						RFLOAT xp = (rx[3 * j    ] + yzp0) + zp0;
+						RFLOAT yp = (rx[3 * j + 1] + yzp1) + zp1;
+						RFLOAT zp = (rx[3 * j + 2] + yzp2) + zp2;
+
+						bool is_neg_x;
+
+						// Only asymmetric half is stored
+						if (xp < 0)
+						{
+							// Get complex conjugated hermitian symmetry pair
+							xp = -xp;
+							yp = -yp;
+							zp = -zp;
+							is_neg_x = true;
+						}
+						else
+						{
+							is_neg_x = false;
+						}
+
+						// Trilinear interpolation (with physical coords)
+						// Subtract STARTINGY and STARTINGZ to accelerate access to data (STARTINGX=0)
+						// In that way use DIRECT_A3D_ELEM, rather than A3D_ELEM
+						int x0 = FLOOR(xp);
+						RFLOAT fx = xp - x0;
+						int x1 = x0 + 1;
+
+						int y0 = FLOOR(yp);
+						RFLOAT fy = yp - y0;
+						y0 -=  STARTINGY(data);
+						int y1 = y0 + 1;
+
+						int z0 = FLOOR(zp);
+						RFLOAT fz = zp - z0;
+						z0 -= STARTINGZ(data);
+						int z1 = z0 + 1;
 
 #ifdef CHECK_SIZE
-					if (x0 < 0 || y0 < 0 || z0 < 0 ||
-						x1 < 0 || y1 < 0 || z1 < 0 ||
-						x0 >= XSIZE(data) || y0  >= YSIZE(data) || z0 >= ZSIZE(data) ||
-						x1 >= XSIZE(data) || y1  >= YSIZE(data)  || z1 >= ZSIZE(data) 	)
-					{
-						std::cerr << " x0= " << x0 << " y0= " << y0 << " z0= " << z0 << std::endl;
-						std::cerr << " x1= " << x1 << " y1= " << y1 << " z1= " << z1 << std::endl;
-						data.printShape();
-						REPORT_ERROR("BackProjector::applyPointGroupSymmetry: checksize!!!");
-					}
+						if (x0 < 0 || y0 < 0 || z0 < 0 ||
+							x1 < 0 || y1 < 0 || z1 < 0 ||
+							x0 >= XSIZE(data) || y0  >= YSIZE(data) || z0 >= ZSIZE(data) ||
+							x1 >= XSIZE(data) || y1  >= YSIZE(data)  || z1 >= ZSIZE(data) 	)
+						{
+							std::cerr << " x0= " << x0 << " y0= " << y0 << " z0= " << z0 << std::endl;
+							std::cerr << " x1= " << x1 << " y1= " << y1 << " z1= " << z1 << std::endl;
+							data.printShape();
+							REPORT_ERROR("BackProjector::applyPointGroupSymmetry: checksize!!!");
+						}
 #endif
-					// First interpolate (complex) data
-					Complex d000 = DIRECT_A3D_ELEM(data, z0, y0, x0);
-					Complex d001 = DIRECT_A3D_ELEM(data, z0, y0, x1);
-					Complex d010 = DIRECT_A3D_ELEM(data, z0, y1, x0);
-					Complex d011 = DIRECT_A3D_ELEM(data, z0, y1, x1);
-					Complex d100 = DIRECT_A3D_ELEM(data, z1, y0, x0);
-					Complex d101 = DIRECT_A3D_ELEM(data, z1, y0, x1);
-					Complex d110 = DIRECT_A3D_ELEM(data, z1, y1, x0);
-					Complex d111 = DIRECT_A3D_ELEM(data, z1, y1, x1);
-
-					Complex dx00 = LIN_INTERP(fx, d000, d001);
-					Complex dx01 = LIN_INTERP(fx, d100, d101);
-					Complex dx10 = LIN_INTERP(fx, d010, d011);
-					Complex dx11 = LIN_INTERP(fx, d110, d111);
-
-					Complex dxy0 = LIN_INTERP(fy, dx00, dx10);
-					Complex dxy1 = LIN_INTERP(fy, dx01, dx11);
-
-					// Take complex conjugated for half with negative x
-					if (is_neg_x)
-					{
-						A3D_ELEM(sum_data, k, i, j) += conj(LIN_INTERP(fz, dxy0, dxy1));
-					}
-					else
-					{
-						A3D_ELEM(sum_data, k, i, j) += LIN_INTERP(fz, dxy0, dxy1);
-					}
-
-					// Then interpolate (real) weight
-					RFLOAT dd000 = DIRECT_A3D_ELEM(weight, z0, y0, x0);
-					RFLOAT dd001 = DIRECT_A3D_ELEM(weight, z0, y0, x1);
-					RFLOAT dd010 = DIRECT_A3D_ELEM(weight, z0, y1, x0);
-					RFLOAT dd011 = DIRECT_A3D_ELEM(weight, z0, y1, x1);
-					RFLOAT dd100 = DIRECT_A3D_ELEM(weight, z1, y0, x0);
-					RFLOAT dd101 = DIRECT_A3D_ELEM(weight, z1, y0, x1);
-					RFLOAT dd110 = DIRECT_A3D_ELEM(weight, z1, y1, x0);
-					RFLOAT dd111 = DIRECT_A3D_ELEM(weight, z1, y1, x1);
-
-					RFLOAT ddx00 = LIN_INTERP(fx, dd000, dd001);
-					RFLOAT ddx01 = LIN_INTERP(fx, dd100, dd101);
-					RFLOAT ddx10 = LIN_INTERP(fx, dd010, dd011);
-					RFLOAT ddx11 = LIN_INTERP(fx, dd110, dd111);
-
-					RFLOAT ddxy0 = LIN_INTERP(fy, ddx00, ddx10);
-					RFLOAT ddxy1 = LIN_INTERP(fy, ddx01, ddx11);
-
-					A3D_ELEM(sum_weight, k, i, j) += LIN_INTERP(fz, ddxy0, ddxy1);
-
-	        	} // end if r2 <= rmax2
-
-	        } // end loop over all elements of sum_weight
-
-	    } // end loop over symmetry operators
+						// First interpolate (complex) data
+						Complex d000 = DIRECT_A3D_ELEM(data, z0, y0, x0);
+						Complex d001 = DIRECT_A3D_ELEM(data, z0, y0, x1);
+						Complex d010 = DIRECT_A3D_ELEM(data, z0, y1, x0);
+						Complex d011 = DIRECT_A3D_ELEM(data, z0, y1, x1);
+						Complex d100 = DIRECT_A3D_ELEM(data, z1, y0, x0);
+						Complex d101 = DIRECT_A3D_ELEM(data, z1, y0, x1);
+						Complex d110 = DIRECT_A3D_ELEM(data, z1, y1, x0);
+						Complex d111 = DIRECT_A3D_ELEM(data, z1, y1, x1);
+
+						Complex dx00 = LIN_INTERP(fx, d000, d001);
+						Complex dx01 = LIN_INTERP(fx, d100, d101);
+						Complex dx10 = LIN_INTERP(fx, d010, d011);
+						Complex dx11 = LIN_INTERP(fx, d110, d111);
+
+						Complex dxy0 = LIN_INTERP(fy, dx00, dx10);
+						Complex dxy1 = LIN_INTERP(fy, dx01, dx11);
+
+						// Take complex conjugated for half with negative x
+						if (is_neg_x)
+						{
+							row_data[j] += conj(LIN_INTERP(fz, dxy0, dxy1));
+						}
+						else
+						{
+							row_data[j] += LIN_INTERP(fz, dxy0, dxy1);
+						}
+
+						// Then interpolate (real) weight
+						RFLOAT dd000 = DIRECT_A3D_ELEM(weight, z0, y0, x0);
+						RFLOAT dd001 = DIRECT_A3D_ELEM(weight, z0, y0, x1);
+						RFLOAT dd010 = DIRECT_A3D_ELEM(weight, z0, y1, x0);
+						RFLOAT dd011 = DIRECT_A3D_ELEM(weight, z0, y1, x1);
+						RFLOAT dd100 = DIRECT_A3D_ELEM(weight, z1, y0, x0);
+						RFLOAT dd101 = DIRECT_A3D_ELEM(weight, z1, y0, x1);
+						RFLOAT dd110 = DIRECT_A3D_ELEM(weight, z1, y1, x0);
+						RFLOAT dd111 = DIRECT_A3D_ELEM(weight, z1, y1, x1);
+
+						RFLOAT ddx00 = LIN_INTERP(fx, dd000, dd001);
+						RFLOAT ddx01 = LIN_INTERP(fx, dd100, dd101);
+						RFLOAT ddx10 = LIN_INTERP(fx, dd010, dd011);
+						RFLOAT ddx11 = LIN_INTERP(fx, dd110, dd111);
+
+						RFLOAT ddxy0 = LIN_INTERP(fy, ddx00, ddx10);
+						RFLOAT ddxy1 = LIN_INTERP(fy, ddx01, ddx11);
+
+						row_weight[j] += LIN_INTERP(fz, ddxy0, ddxy1);
+					} // end loop over points of this row inside r_max
+				} // end loop over symmetry operators
+
+				for (long int j=STARTINGX(sum_weight); j<=FINISHINGX(sum_weight); j++)
+				{
+					A3D_ELEM(sum_data, k, i, j) = row_data[j];
+					A3D_ELEM(sum_weight, k, i, j) = row_weight[j];
+				}
+			} // end loop over all rows of sum_weight
+		}
 
 	    data = sum_data;
 	    weight = sum_weight;
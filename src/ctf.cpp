@@ -395,6 +395,8 @@ void CTF::getFftwImage(MultidimArray<RFLOAT> &result, int orixdim, int oriydim,
 		RFLOAT xs = (RFLOAT)orixdim * angpix;
 		RFLOAT ys = (RFLOAT)oriydim * angpix;
 
+		const Image<RFLOAT>* gammaOffset = 0;
+
 		if (obsModel != 0 && obsModel->hasEvenZernike)
 		{
 			if (orixdim != oriydim)
@@ -417,31 +419,128 @@ void CTF::getFftwImage(MultidimArray<RFLOAT> &result, int orixdim, int oriydim,
 				                 << obsModel->getPixelSize(opticsGroup) << "\n");
 			}
 
-			const Image<RFLOAT>& gammaOffset = obsModel->getGammaOffset(opticsGroup, oriydim);
+			gammaOffset = &obsModel->getGammaOffset(opticsGroup, oriydim);
+		}
 
-			for (int y1 = 0; y1 < result.ydim; y1++)
-			for (int x1 = 0; x1 < result.xdim; x1++)
-			{
-				RFLOAT x = x1 / xs;
-				RFLOAT y = y1 <= result.ydim/2? y1 / ys : (y1 - result.ydim) / ys;
+		// The frequencies of all columns and rows
+		std::vector<RFLOAT> xfreq(XSIZE(result)), yfreq(YSIZE(result));
+		for (int j = 0; j < XSIZE(result); j++)
+			xfreq[j] = (RFLOAT)j / xs;
+		for (int i = 0; i < YSIZE(result); i++)
+		{
+			if (gammaOffset != 0)
+				yfreq[i] = i <= YSIZE(result)/2? i / ys : (i - YSIZE(result)) / ys;
+			else
+				yfreq[i] = (RFLOAT)((i < XSIZE(result)) ? i : i - YSIZE(result)) / ys;
+		}
 
-				const int x0 = x1;
-				const int y0 = y1 <= result.ydim/2? y1 : gammaOffset.data.ydim + y1 - result.ydim;
+		Matrix2D<RFLOAT> M;
+		const bool has_mag = (obsModel != 0 && obsModel->hasMagMatrices);
+		if (has_mag)
+			M = obsModel->getMagMatrix(opticsGroup);
+
+		if (has_mag && gammaOffset != 0)
+			getFftwImageFromFrequencies<true, true>(result, xfreq, yfreq, M, gammaOffset, do_abs, do_only_flip_phases,
+			                                        do_intact_until_first_peak, do_damping, do_intact_after_first_peak);
+		else if (has_mag)
+			getFftwImageFromFrequencies<true, false>(result, xfreq, yfreq, M, gammaOffset, do_abs, do_only_flip_phases,
+			                                         do_intact_until_first_peak, do_damping, do_intact_after_first_peak);
+		else if (gammaOffset != 0)
+			getFftwImageFromFrequencies<false, true>(result, xfreq, yfreq, M, gammaOffset, do_abs, do_only_flip_phases,
+			                                         do_intact_until_first_peak, do_damping, do_intact_after_first_peak);
+		else
+			getFftwImageFromFrequencies<false, false>(result, xfreq, yfreq, M, gammaOffset, do_abs, do_only_flip_phases,
+			                                          do_intact_until_first_peak, do_damping, do_intact_after_first_peak);
+	}
+}
 
-				DIRECT_A2D_ELEM(result, y1, x1) = getCTF(x, y, do_abs, do_only_flip_phases,
-				                                         do_intact_until_first_peak, do_damping, gammaOffset(y0,x0), do_intact_after_first_peak);
-			}
+template <bool HAS_MAG, bool HAS_GAMMA_OFFSET>
+void CTF::getFftwImageFromFrequencies(MultidimArray<RFLOAT> &result,
+                                      const std::vector<RFLOAT> &xfreq, const std::vector<RFLOAT> &yfreq,
+                                      const Matrix2D<RFLOAT> &M, const Image<RFLOAT> *gammaOffset,
+                                      bool do_abs, bool do_only_flip_phases, bool do_intact_until_first_peak,
+                                      bool do_damping, bool do_intact_after_first_peak) const
+{
+	// This follows getCTF() exactly, so that the results are identical
+	RFLOAT M00 = 0., M01 = 0., M10 = 0., M11 = 0.;
+	if (HAS_MAG)
+	{
+		M00 = M(0,0);
+		M01 = M(0,1);
+		M10 = M(1,0);
+		M11 = M(1,1);
+	}
+
+	// exp(0) = 1: no need to evaluate the damping without a B-factor
+	const bool do_decay = do_damping && K4 != 0.;
+	const bool do_intact = do_intact_until_first_peak || do_intact_after_first_peak;
+
+	for (int i = 0; i < YSIZE(result); i++)
+	{
+		const RFLOAT *gamma_offset_row = 0;
+		if (HAS_GAMMA_OFFSET)
+		{
+			const int i0 = i <= YSIZE(result)/2? i : YSIZE(gammaOffset->data) + i - YSIZE(result);
+			gamma_offset_row = &DIRECT_A2D_ELEM(gammaOffset->data, i0, 0);
 		}
-		else
+
+		RFLOAT *result_row = &DIRECT_A2D_ELEM(result, i, 0);
+
+		for (int j = 0; j < XSIZE(result); j++)
 		{
-			FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM2D(result)
+			RFLOAT X = xfreq[j];
+			RFLOAT Y = yfreq[i];
+
+			if (HAS_MAG)
 			{
-				RFLOAT x = (RFLOAT)jp / xs;
-				RFLOAT y = (RFLOAT)ip / ys;
+				RFLOAT Xd = M00 * X + M01 * Y;
+				RFLOAT Yd = M10 * X + M11 * Y;
 
-				DIRECT_A2D_ELEM(result, i, j) = getCTF(x, y, do_abs, do_only_flip_phases,
-				                                       do_intact_until_first_peak, do_damping, 0.0, do_intact_after_first_peak);
+				X = Xd;
+				Y = Yd;
 			}
+
+			RFLOAT u2 = X * X + Y * Y;
+			RFLOAT u4 = u2 * u2;
+
+			double gamma_offset = (HAS_GAMMA_OFFSET) ? gamma_offset_row[j] : 0.0;
+			RFLOAT gamma = K1 * (Axx*X*X + 2.0*Axy*X*Y + Ayy*Y*Y) + K2 * u4 - K5 - K3 + gamma_offset;
+
+			RFLOAT retval;
+
+			if (do_intact &&
+			    ((do_intact_until_first_peak && ABS(gamma) < PI/2.) ||
+			     (do_intact_after_first_peak && ABS(gamma) > PI/2.)))
+			{
+				retval = 1.;
+			}
+			else
+			{
+				retval = -sin(gamma);
+			}
+
+			if (do_decay)
+			{
+				retval *= exp(K4 * u2);
+			}
+
+			if (do_abs)
+			{
+				retval = ABS(retval);
+			}
+			else if (do_only_flip_phases)
+			{
+				retval = (retval < 0.) ? -1. : 1.;
+			}
+
+			retval *= scale;
+
+			if (fabs(retval) < 1e-8)
+			{
+				retval = SGN(retval) * 1e-8;
+			}
+
+			result_row[j] = retval;
 		}
 	}
 }
@@ -334,5 +334,17 @@ public:
 	double getAxx();
 	double getAxy();
 	double getAyy();
+
+protected:
+
+	/// Evaluate getCTF() at all pixels of an FFTW-format image, given the frequencies of its columns and rows.
+	/// Everything that is the same for all particles of an optics group (frequencies, magnification matrix
+	/// and gamma offsets from symmetric aberrations) is passed in, and the flags are fixed for the whole image.
+	template <bool HAS_MAG, bool HAS_GAMMA_OFFSET>
+	void getFftwImageFromFrequencies(MultidimArray<RFLOAT> &result,
+	                                 const std::vector<RFLOAT> &xfreq, const std::vector<RFLOAT> &yfreq,
+	                                 const Matrix2D<RFLOAT> &M, const Image<RFLOAT> *gammaOffset,
+	                                 bool do_abs, bool do_only_flip_phases, bool do_intact_until_first_peak,
+	                                 bool do_damping, bool do_intact_after_first_peak) const;
 };
 #endif
@@ -141,7 +141,7 @@ unsigned char rgbToGrey(const unsigned char red, const unsigned char green, cons
 	return 0;
 }
 
-void DisplayBox::setData(MultidimArray<RFLOAT> &img, MetaDataContainer *MDCin, int _ipos,
+void DisplayBox::setData(MultidimArray<RFLOAT> &img, const MetaDataContainer &MDCin, int _ipos,
                          RFLOAT _minval, RFLOAT _maxval, RFLOAT _scale, bool do_relion_scale)
 {
 	scale = _scale;
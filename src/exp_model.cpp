@@ -747,7 +747,7 @@ void Experiment::copyParticlesToScratch(int verb, bool do_copy, bool also_do_ctf
 
 // Read from file
 void Experiment::read(FileName fn_exp, bool do_ignore_particle_name, bool do_ignore_group_name, bool do_preread_images,
-                      bool need_tiltpsipriors_for_helical_refine, int verb)
+                      bool need_tiltpsipriors_for_helical_refine, int verb, int nr_threads)
 {
 
 //#define DEBUG_READ
@@ -829,7 +829,7 @@ void Experiment::read(FileName fn_exp, bool do_ignore_particle_name, bool do_ign
 	{
 		// MDimg and MDopt have to be read at the same time, so that the optics groups can be
 		// renamed in case they are non-contiguous or not sorted
-		ObservationModel::loadSafely(fn_exp, obsModel, MDimg, "particles", verb);
+		ObservationModel::loadSafely(fn_exp, obsModel, MDimg, "particles", verb, true, nr_threads);
 		nr_images_per_optics_group.resize(obsModel.numberOfOpticsGroups(), 0);
 
 #ifdef DEBUG_READ
@@ -393,7 +393,7 @@ public:
 		FileName fn_in,
 		bool do_ignore_particle_name = false,
 		bool do_ignore_group_name = false, bool do_preread_images = false,
-		bool need_tiltpsipriors_for_helical_refine = false, int verb = 0);
+		bool need_tiltpsipriors_for_helical_refine = false, int verb = 0, int nr_threads = 1);
 
 	// Write
 	void write(FileName fn_root);
@@ -48,9 +48,17 @@
 #include "src/args.h"
 #include <string.h>
 #include <math.h>
+#include <map>
+#include <unistd.h>
 
 static pthread_mutex_t fftw_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+#ifdef RELION_SINGLE_PRECISION
+	#define RFFTW(name) fftwf_ ## name
+#else
+	#define RFFTW(name) fftw_ ## name
+#endif
+
 //#define TIMING_FFTW
 #ifdef TIMING_FFTW
 	#define RCTIC(label) (timer_fftw.tic(label))
@@ -68,6 +76,228 @@ static pthread_mutex_t fftw_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 //#define DEBUG_PLANS
 
+// Plan cache --------------------------------------------------------------
+// All FourierTransformers share one set of plans. A plan is made once for each
+// combination of transform type, size and alignment of the arrays, and it is
+// executed on the arrays of each transformer through the new-array execute functions.
+// Cached plans are only destroyed when the program exits, as other transformers may still use them.
+
+enum FftwPlanKind
+{
+	PLAN_R2C,
+	PLAN_C2R,
+	PLAN_C2C_FORWARD,
+	PLAN_C2C_BACKWARD
+};
+
+struct FftwPlanKey
+{
+	// kind, rank, 3 dimensions, alignment of input and output, in-place, precision, planner flags and planner threads
+	int values[11];
+
+	bool operator<(const FftwPlanKey &other) const
+	{
+		return std::lexicographical_compare(values, values + 11, other.values, other.values + 11);
+	}
+};
+
+static std::map<FftwPlanKey, RFFTW(plan)> fftw_plan_cache;
+static pthread_rwlock_t fftw_plan_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned int fftw_planner_flags = FFTW_ESTIMATE;
+static int fftw_planner_threads = 1;
+static bool fftw_plan_cache_cleared_at_exit = false;
+static FileName fftw_wisdom_file = "";
+static bool fftw_wisdom_env_checked = false;
+
+// Only called with fftw_plan_cache_lock locked for writing
+static void setWisdomFile(const FileName &fn_wisdom)
+{
+	pthread_mutex_lock(&fftw_plan_mutex);
+
+	fftw_wisdom_file = fn_wisdom;
+	fftw_planner_flags = FFTW_MEASURE;
+	if (exists(fn_wisdom) && !RFFTW(import_wisdom_from_filename)(fn_wisdom.c_str()))
+		std::cerr << " + WARNING: could not read FFTW wisdom from " << fn_wisdom << std::endl;
+
+	pthread_mutex_unlock(&fftw_plan_mutex);
+}
+
+static void exportWisdomAtExit()
+{
+	FourierTransformer::exportWisdom();
+}
+
+// Only called with fftw_plan_cache_lock locked for writing
+static void checkWisdomEnvironment()
+{
+	if (fftw_wisdom_env_checked)
+		return;
+
+	fftw_wisdom_env_checked = true;
+
+	const char *fn_wisdom = getenv("RELION_FFTW_WISDOM");
+	if (fn_wisdom != NULL && std::string(fn_wisdom) != "")
+	{
+		setWisdomFile(fn_wisdom);
+		atexit(exportWisdomAtExit);
+	}
+}
+
+// Registered with atexit when the first plan is cached.
+// fftw_cleanup is not called, as it would forget the wisdom before it is exported.
+static void clearPlanCache()
+{
+	pthread_rwlock_wrlock(&fftw_plan_cache_lock);
+	pthread_mutex_lock(&fftw_plan_mutex);
+
+	for (std::map<FftwPlanKey, RFFTW(plan)>::iterator it = fftw_plan_cache.begin(); it != fftw_plan_cache.end(); it++)
+		RFFTW(destroy_plan)(it->second);
+	fftw_plan_cache.clear();
+
+	pthread_mutex_unlock(&fftw_plan_mutex);
+	pthread_rwlock_unlock(&fftw_plan_cache_lock);
+}
+
+static RFFTW(plan) getCachedPlan(FftwPlanKind kind, int ndim, const int *N, void *in, void *out)
+{
+	FftwPlanKey key;
+	key.values[0] = kind;
+	key.values[1] = ndim;
+	for (int i = 0; i < 3; i++)
+		key.values[2 + i] = (i < ndim) ? N[i] : 1;
+	key.values[5] = RFFTW(alignment_of)((RFLOAT*)in);
+	key.values[6] = RFFTW(alignment_of)((RFLOAT*)out);
+	key.values[7] = (in == out);
+	key.values[8] = sizeof(RFLOAT);
+
+	pthread_rwlock_rdlock(&fftw_plan_cache_lock);
+	key.values[9] = fftw_planner_flags;
+	key.values[10] = fftw_planner_threads;
+	std::map<FftwPlanKey, RFFTW(plan)>::iterator it = fftw_plan_cache.find(key);
+	RFFTW(plan) plan = (it == fftw_plan_cache.end()) ? NULL : it->second;
+	pthread_rwlock_unlock(&fftw_plan_cache_lock);
+
+	if (plan != NULL)
+		return plan;
+
+	pthread_rwlock_wrlock(&fftw_plan_cache_lock);
+
+	checkWisdomEnvironment();
+	key.values[9] = fftw_planner_flags;
+	key.values[10] = fftw_planner_threads;
+	it = fftw_plan_cache.find(key);
+
+	if (it != fftw_plan_cache.end())
+	{
+		plan = it->second;
+	}
+	else
+	{
+		// FFTW_ESTIMATE leaves the arrays alone, but measuring overwrites them,
+		// so in that case the plan is made on scratch arrays with the same alignment
+		RFFTW(complex) *scratch_in = NULL, *scratch_out = NULL;
+
+		if (!(fftw_planner_flags & FFTW_ESTIMATE))
+		{
+			size_t nr_elems = 1;
+			for (int i = 0; i < ndim - 1; i++)
+				nr_elems *= N[i];
+			// Enough for the complex half of a real transform, or for a complex transform
+			nr_elems *= (kind == PLAN_R2C || kind == PLAN_C2R) ? N[ndim - 1] / 2 + 1 : N[ndim - 1];
+
+			const size_t nr_bytes = nr_elems * sizeof(RFFTW(complex)) + 64;
+			scratch_in = (RFFTW(complex)*) RFFTW(malloc)(nr_bytes);
+			in = (char*)scratch_in + key.values[5];
+
+			if (key.values[7])
+			{
+				out = in;
+			}
+			else
+			{
+				scratch_out = (RFFTW(complex)*) RFFTW(malloc)(nr_bytes);
+				out = (char*)scratch_out + key.values[6];
+			}
+		}
+
+		pthread_mutex_lock(&fftw_plan_mutex);
+		switch (kind)
+		{
+		case PLAN_R2C:
+			plan = RFFTW(plan_dft_r2c)(ndim, N, (RFLOAT*)in, (RFFTW(complex)*)out, fftw_planner_flags);
+			break;
+		case PLAN_C2R:
+			plan = RFFTW(plan_dft_c2r)(ndim, N, (RFFTW(complex)*)in, (RFLOAT*)out, fftw_planner_flags);
+			break;
+		case PLAN_C2C_FORWARD:
+			plan = RFFTW(plan_dft)(ndim, N, (RFFTW(complex)*)in, (RFFTW(complex)*)out, FFTW_FORWARD, fftw_planner_flags);
+			break;
+		case PLAN_C2C_BACKWARD:
+			plan = RFFTW(plan_dft)(ndim, N, (RFFTW(complex)*)in, (RFFTW(complex)*)out, FFTW_BACKWARD, fftw_planner_flags);
+			break;
+		}
+		pthread_mutex_unlock(&fftw_plan_mutex);
+
+		if (scratch_in != NULL) RFFTW(free)(scratch_in);
+		if (scratch_out != NULL) RFFTW(free)(scratch_out);
+
+		if (plan != NULL)
+			fftw_plan_cache[key] = plan;
+
+		if (!fftw_plan_cache_cleared_at_exit)
+		{
+			fftw_plan_cache_cleared_at_exit = true;
+			atexit(clearPlanCache);
+		}
+	}
+
+	pthread_rwlock_unlock(&fftw_plan_cache_lock);
+
+	if (plan == NULL)
+		REPORT_ERROR("FFTW plans cannot be created");
+
+	return plan;
+}
+
+void FourierTransformer::useWisdom(const FileName &fn_wisdom)
+{
+	pthread_rwlock_wrlock(&fftw_plan_cache_lock);
+	fftw_wisdom_env_checked = true;
+	setWisdomFile(fn_wisdom);
+	pthread_rwlock_unlock(&fftw_plan_cache_lock);
+}
+
+void FourierTransformer::setPlannerThreads(int nr_threads)
+{
+	pthread_rwlock_wrlock(&fftw_plan_cache_lock);
+	pthread_mutex_lock(&fftw_plan_mutex);
+
+#ifdef MKLFFT
+	fftw_plan_with_nthreads(nr_threads);
+#endif
+	fftw_planner_threads = nr_threads;
+
+	pthread_mutex_unlock(&fftw_plan_mutex);
+	pthread_rwlock_unlock(&fftw_plan_cache_lock);
+}
+
+void FourierTransformer::exportWisdom()
+{
+	pthread_mutex_lock(&fftw_plan_mutex);
+
+	if (fftw_wisdom_file != "")
+	{
+		// Write to a temporary file first, as other processes may be reading or writing the same wisdom
+		const FileName fn_tmp = fftw_wisdom_file + ".tmp" + integerToString(getpid());
+		if (RFFTW(export_wisdom_to_filename)(fn_tmp.c_str()))
+			std::rename(fn_tmp.c_str(), fftw_wisdom_file.c_str());
+		else
+			std::cerr << " + WARNING: could not write FFTW wisdom to " << fftw_wisdom_file << std::endl;
+	}
+
+	pthread_mutex_unlock(&fftw_plan_mutex);
+}
+
 // Constructors and destructors --------------------------------------------
 FourierTransformer::FourierTransformer():
 		plans_are_set(false)
@@ -118,15 +348,10 @@ void FourierTransformer::clear()
 
 void FourierTransformer::cleanup()
 {
-	// First clear object and destroy plans
+	// Clear object and forget its plans.
+	// The cached plans are shared with other transformers that may still be alive,
+	// so they are only destroyed at exit.
 	clear();
-	// Then clean up all the junk fftw keeps lying around
-	// SOMEHOW THE FOLLOWING IS NOT ALLOWED WHEN USING MULTPLE TRANSFORMER OBJECTS....
-#ifdef RELION_SINGLE_PRECISION
-	fftwf_cleanup();
-#else
-	fftw_cleanup();
-#endif
 
 #ifdef DEBUG_PLANS
 	std::cerr << "CLEANED-UP this= "<<this<< std::endl;
@@ -136,23 +361,10 @@ void FourierTransformer::cleanup()
 
 void FourierTransformer::destroyPlans()
 {
-	// Anything to do with plans has to be protected for threads!
-	pthread_mutex_lock(&fftw_plan_mutex);
-
-	if (plans_are_set)
-	{
-#ifdef RELION_SINGLE_PRECISION
-		fftwf_destroy_plan(fPlanForward);
-		fftwf_destroy_plan(fPlanBackward);
-#else
-		fftw_destroy_plan(fPlanForward);
-		fftw_destroy_plan(fPlanBackward);
-#endif
-		plans_are_set = false;
-	}
-
-	pthread_mutex_unlock(&fftw_plan_mutex);
-
+	// The plans themselves belong to the plan cache and are shared with other transformers
+	fPlanForward = NULL;
+	fPlanBackward = NULL;
+	plans_are_set = false;
 }
 
 // Initialization ----------------------------------------------------------
@@ -209,32 +421,16 @@ void FourierTransformer::setReal(MultidimArray<RFLOAT> &input, bool force_new_pl
 			break;
 		}
 
-		// Destroy both forward and backward plans if they already exist
+		// Forget the old plans if they already exist
 		destroyPlans();
 
-		// Make new plans
-		plans_are_set = true;
-
+		// Get plans for these sizes from the cache
 		RCTIC(TIMING_FFTW_PLAN);
-		pthread_mutex_lock(&fftw_plan_mutex);
-#ifdef RELION_SINGLE_PRECISION
-		fPlanForward = fftwf_plan_dft_r2c(ndim, N, MULTIDIM_ARRAY(*fReal),
-		                                  (fftwf_complex*) MULTIDIM_ARRAY(fFourier), FFTW_ESTIMATE);
-		fPlanBackward = fftwf_plan_dft_c2r(ndim, N,
-		                                   (fftwf_complex*) MULTIDIM_ARRAY(fFourier), MULTIDIM_ARRAY(*fReal),
-		                                   FFTW_ESTIMATE);
-#else
-		fPlanForward = fftw_plan_dft_r2c(ndim, N, MULTIDIM_ARRAY(*fReal),
-		                                 (fftw_complex*) MULTIDIM_ARRAY(fFourier), FFTW_ESTIMATE);
-		fPlanBackward = fftw_plan_dft_c2r(ndim, N,
-		                                  (fftw_complex*) MULTIDIM_ARRAY(fFourier), MULTIDIM_ARRAY(*fReal),
-		                                  FFTW_ESTIMATE);
-#endif
-		pthread_mutex_unlock(&fftw_plan_mutex);
+		fPlanForward = getCachedPlan(PLAN_R2C, ndim, N, MULTIDIM_ARRAY(*fReal), MULTIDIM_ARRAY(fFourier));
+		fPlanBackward = getCachedPlan(PLAN_C2R, ndim, N, MULTIDIM_ARRAY(fFourier), MULTIDIM_ARRAY(*fReal));
 		RCTOC(TIMING_FFTW_PLAN);
 
-		if (fPlanForward == NULL || fPlanBackward == NULL)
-			REPORT_ERROR("FFTW plans cannot be created");
+		plans_are_set = true;
 
 #ifdef DEBUG_PLANS
 		std::cerr << " SETREAL fPlanForward= " << fPlanForward << " fPlanBackward= " << fPlanBackward  <<" this= "<<this<< std::endl;
@@ -286,29 +482,16 @@ void FourierTransformer::setReal(MultidimArray<Complex > &input, bool force_new_
 			break;
 		}
 
-		// Destroy both forward and backward plans if they already exist
+		// Forget the old plans if they already exist
 		destroyPlans();
 
-		plans_are_set = true;
-
+		// Get plans for these sizes from the cache
 		RCTIC(TIMING_FFTW_PLAN);
-		pthread_mutex_lock(&fftw_plan_mutex);
-#ifdef RELION_SINGLE_PRECISION
-		fPlanForward = fftwf_plan_dft(ndim, N, (fftwf_complex*) MULTIDIM_ARRAY(*fComplex),
-		                              (fftwf_complex*) MULTIDIM_ARRAY(fFourier), FFTW_FORWARD, FFTW_ESTIMATE);
-		fPlanBackward = fftwf_plan_dft(ndim, N, (fftwf_complex*) MULTIDIM_ARRAY(fFourier),
-		                               (fftwf_complex*) MULTIDIM_ARRAY(*fComplex), FFTW_BACKWARD, FFTW_ESTIMATE);
-#else
-		fPlanForward = fftw_plan_dft(ndim, N, (fftw_complex*) MULTIDIM_ARRAY(*fComplex),
-		                             (fftw_complex*) MULTIDIM_ARRAY(fFourier), FFTW_FORWARD, FFTW_ESTIMATE);
-		fPlanBackward = fftw_plan_dft(ndim, N, (fftw_complex*) MULTIDIM_ARRAY(fFourier),
-		                              (fftw_complex*) MULTIDIM_ARRAY(*fComplex), FFTW_BACKWARD, FFTW_ESTIMATE);
-#endif
-		pthread_mutex_unlock(&fftw_plan_mutex);
+		fPlanForward = getCachedPlan(PLAN_C2C_FORWARD, ndim, N, MULTIDIM_ARRAY(*fComplex), MULTIDIM_ARRAY(fFourier));
+		fPlanBackward = getCachedPlan(PLAN_C2C_BACKWARD, ndim, N, MULTIDIM_ARRAY(fFourier), MULTIDIM_ARRAY(*fComplex));
 		RCTOC(TIMING_FFTW_PLAN);
 
-		if (fPlanForward == NULL || fPlanBackward == NULL)
-			REPORT_ERROR("FFTW plans cannot be created");
+		plans_are_set = true;
 
 		delete [] N;
 		complexDataPtr=MULTIDIM_ARRAY(*fComplex);
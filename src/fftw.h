@@ -186,6 +186,19 @@ public:
 	 */
 	FourierTransformer(const FourierTransformer& op);
 
+	/** All transformers share their FFTW plans through a process-wide cache.
+	    By default, plans are made with FFTW_ESTIMATE. After calling useWisdom,
+	    new plans are made with FFTW_MEASURE, starting from the wisdom stored in fn_wisdom
+	    (if that file exists). exportWisdom writes the wisdom gathered so far back to that file.
+	    Setting the environment variable RELION_FFTW_WISDOM to a filename does both automatically:
+	    the wisdom is read before the first plan is made and written when the program exits. */
+	static void useWisdom(const FileName &fn_wisdom);
+	static void exportWisdom();
+
+	/** Number of threads of the plans that are made from now on (only used with MKLFFT).
+	    Plans for different numbers of threads are cached separately. */
+	static void setPlannerThreads(int nr_threads);
+
 	/** Compute the Fourier transform of a MultidimArray, 2D and 3D.
 	    If getCopy is false, an alias to the transformed data is returned.
 	    This is a faster option since a copy of all the data is avoided,
@@ -333,11 +346,12 @@ public:
 	/** Clear object */
 	void clear();
 
-	/** This calls fftw_cleanup.
+	/** Clear object. The cached plans, which other transformers may share,
+	    are only destroyed when the program exits.
 	*/
 	void cleanup();
 
-	/** Destroy both forward and backward fftw planes (mutex locked */
+	/** Forget both forward and backward fftw plans (they stay in the plan cache) */
 	void destroyPlans();
 
 	/** Computes the transform, specified in Init() function
@@ -22,6 +22,87 @@
 //#define DEBUG_CHECKSIZES
 //#define DEBUG_HELICAL_ORIENTATIONAL_SEARCH
 
+void HealpixDirectionIndex::clear()
+{
+	max_bin_radius = 0.;
+	bin_start.clear();
+	dirs.clear();
+	dir_x.clear();
+	dir_y.clear();
+	dir_z.clear();
+}
+
+void HealpixDirectionIndex::build(const std::vector<RFLOAT> &rot_angles, const std::vector<RFLOAT> &tilt_angles, int bin_order)
+{
+	clear();
+
+	// Discs are queried most efficiently in the RING scheme
+	base.Set(XMIPP_MAX(bin_order, 0), RING);
+	max_bin_radius = base.max_pixrad();
+
+	long int nr_dirs = rot_angles.size();
+	dir_x.resize(nr_dirs);
+	dir_y.resize(nr_dirs);
+	dir_z.resize(nr_dirs);
+	std::vector<int> dir_bin(nr_dirs);
+	bin_start.resize(base.Npix() + 1, 0);
+	for (long int idir = 0; idir < nr_dirs; idir++)
+	{
+		Matrix1D<RFLOAT> my_direction;
+		Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
+		dir_x[idir] = XX(my_direction);
+		dir_y[idir] = YY(my_direction);
+		dir_z[idir] = ZZ(my_direction);
+		dir_bin[idir] = base.vec2pix(vec3(dir_x[idir], dir_y[idir], dir_z[idir]));
+		bin_start[dir_bin[idir] + 1]++;
+	}
+
+	for (int ibin = 0; ibin < base.Npix(); ibin++)
+		bin_start[ibin + 1] += bin_start[ibin];
+
+	// Within each bin, the directions remain in increasing order
+	std::vector<long int> bin_fill(bin_start.begin(), bin_start.end() - 1);
+	dirs.resize(nr_dirs);
+	for (long int idir = 0; idir < nr_dirs; idir++)
+		dirs[bin_fill[dir_bin[idir]]++] = idir;
+}
+
+void HealpixDirectionIndex::findDirectionsWithinAngle(const Matrix1D<RFLOAT> &direction, RFLOAT max_ang, std::vector<long int> &idirs) const
+{
+	if (dir_x.size() == 0)
+		return;
+
+	// Leave some margin for rounding errors, so that no direction within max_ang is missed
+	const double eps = 1e-6;
+	double radius = DEG2RAD(max_ang) + eps;
+	double min_dot = (radius < PI) ? cos(radius) : -2.;
+
+	// Any bin with a direction inside the disc has its centre within max_bin_radius of the disc
+	std::vector<int> bins;
+	if (radius + max_bin_radius < PI)
+	{
+		pointing centre(vec3(XX(direction), YY(direction), ZZ(direction)));
+		base.query_disc(centre, radius + max_bin_radius, bins);
+	}
+	else
+	{
+		bins.resize(base.Npix());
+		for (int ibin = 0; ibin < bins.size(); ibin++)
+			bins[ibin] = ibin;
+	}
+
+	for (int i = 0; i < bins.size(); i++)
+	{
+		for (long int n = bin_start[bins[i]]; n < bin_start[bins[i] + 1]; n++)
+		{
+			long int idir = dirs[n];
+			double my_dot = dir_x[idir] * XX(direction) + dir_y[idir] * YY(direction) + dir_z[idir] * ZZ(direction);
+			if (my_dot >= min_dot)
+				idirs.push_back(idir);
+		}
+	}
+}
+
 void HealpixSampling::clear()
 {
 	is_3D = false;
@@ -43,6 +124,7 @@ void HealpixSampling::clear()
 	R_repository.clear();
 	L_repository_relax.clear();
 	R_repository_relax.clear();
+	direction_index.clear();
 	pgGroup = pgOrder = 0;
 	pgGroupRelaxSym = pgOrderRelaxSym = 0;
 
@@ -535,6 +617,8 @@ void HealpixSampling::setOrientations(int _order, RFLOAT _psi_step)
 		directions_ipix.push_back(-1);
 	}
 
+	buildDirectionIndex();
+
 	// 2D in-plane angles
 	// By default in 3D case: use more-or-less same psi-sampling as the 3D healpix object
 	// By default in 2D case: use 5 degree
@@ -585,7 +669,18 @@ void HealpixSampling::addOneOrientation(RFLOAT rot, RFLOAT tilt, RFLOAT psi, boo
 	// in-plane rotation
 	psi_angles.push_back(psi);
 
+	// Not worth indexing
+	direction_index.clear();
+
+}
 
+void HealpixSampling::buildDirectionIndex()
+{
+	// Use bins of about eight times the angular sampling, so that a typical local search covers only a few of them
+	if (is_3D)
+		direction_index.build(rot_angles, tilt_angles, healpix_order - 3);
+	else
+		direction_index.clear();
 }
 
 
@@ -686,6 +781,18 @@ void HealpixSampling::selectOrientationsWithNonZeroPriorProbability(
 			Euler_angles2direction(0., 90., prior90_direction);
 		}
 
+		// Get the direction of the prior
+		Matrix1D<RFLOAT> prior_direction;
+		Euler_angles2direction(prior_rot, prior_tilt, prior_direction);
+
+		// With a prior on both rot and tilt, only directions within the cut-off of the prior direction
+		// (or of its symmetry mates) can have a non-zero prior: get those from the spatial index
+		std::vector<long int> near_dirs;
+		bool use_index = (sigma_rot > 0. && sigma_tilt > 0. && !isRelax && direction_index.size() == rot_angles.size());
+		if (use_index)
+			findDirectionsNearPriorDirection(prior_direction, sigma_cutoff * XMIPP_MAX(sigma_rot, sigma_tilt),
+					do_bimodal_search_psi, near_dirs);
+
 		// Loop over all directions
 		RFLOAT sumprior = 0.;
 		RFLOAT sumprior_withsigmafromzero = 0.;
@@ -693,8 +800,11 @@ void HealpixSampling::selectOrientationsWithNonZeroPriorProbability(
 		RFLOAT best_ang = 9999.;
 		long int best_idir = -999;
 
-		for (long int idir = 0; idir < rot_angles.size(); idir++)
+		long int nr_loop = (use_index) ? near_dirs.size() : rot_angles.size();
+		for (long int iloop = 0; iloop < nr_loop; iloop++)
 		{
+			long int idir = (use_index) ? near_dirs[iloop] : iloop;
+
 			// Check if this direction was met before as symmetry mate
 			if (idir_flag[idir] == true)
 					continue;
@@ -704,36 +814,7 @@ void HealpixSampling::selectOrientationsWithNonZeroPriorProbability(
 			// Any prior involving BOTH rot and tilt.
 			if ( (sigma_rot > 0.) && (sigma_tilt > 0.) )
 			{
-				// Get the direction of the prior
-				Matrix1D<RFLOAT> prior_direction, my_direction, sym_direction, best_direction;
-				Euler_angles2direction(prior_rot, prior_tilt, prior_direction);
-
-				// Get the current direction in the loop
-				Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
-				best_direction = my_direction;
-
-				// Loop over all symmetry operators to find the operator that brings this direction nearest to the prior if no symmetry relaxation
-				if (!isRelax)
-				{
-					RFLOAT best_dotProduct = dotProduct(prior_direction, my_direction);
-					for (int j = 0; j < R_repository.size(); j++)
-					{
-						sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
-						RFLOAT my_dotProduct = dotProduct(prior_direction, sym_direction);
-						if (my_dotProduct > best_dotProduct)
-						{
-							best_direction = sym_direction;
-							best_dotProduct = my_dotProduct;
-						}
-					}
-				}
-
-				// Now that we have the best direction, find the corresponding prior probability
-				RFLOAT diffang = ACOSD( dotProduct(best_direction, prior_direction) );
-				if (diffang > 180.)
-					diffang = ABS(diffang - 360.);
-				if (do_bimodal_search_psi && (diffang > 90.))  // KThurber
-					diffang = ABS(diffang - 180.);	// KThurber
+				RFLOAT diffang = calculateAngleToPriorDirection(idir, prior_direction, do_bimodal_search_psi);
 
 				// Only consider differences within sigma_cutoff * sigma_rot
 				// TODO: If sigma_rot and sigma_tilt are not the same (NOT for helices)?
@@ -906,6 +987,28 @@ void HealpixSampling::selectOrientationsWithNonZeroPriorProbability(
 				directions_prior[idir] /= sumprior;
 		}
 
+		// The nearest direction may lie outside the neighbourhood that was taken from the index:
+		// search larger neighbourhoods until the nearest direction in it is closer than its radius
+		if (use_index && directions_prior.size() == 0)
+		{
+			RFLOAT radius = sigma_cutoff * XMIPP_MAX(sigma_rot, sigma_tilt);
+			do
+			{
+				radius = XMIPP_MIN(2. * radius, 180.);
+				findDirectionsNearPriorDirection(prior_direction, radius, do_bimodal_search_psi, near_dirs);
+				best_ang = 9999.;
+				for (long int iloop = 0; iloop < near_dirs.size(); iloop++)
+				{
+					RFLOAT diffang = calculateAngleToPriorDirection(near_dirs[iloop], prior_direction, do_bimodal_search_psi);
+					if (diffang < best_ang)
+					{
+						best_idir = near_dirs[iloop];
+						best_ang = diffang;
+					}
+				}
+			} while (best_ang > radius && radius < 180.);
+		}
+
 		// If there were no directions at all, just select the single nearest one:
 		if (directions_prior.size() == 0)
 		{
@@ -1046,6 +1149,58 @@ void HealpixSampling::selectOrientationsWithNonZeroPriorProbability(
 	return;
 }
 
+void HealpixSampling::findDirectionsNearPriorDirection(const Matrix1D<RFLOAT> &prior_direction, RFLOAT max_ang,
+		bool do_bimodal_search_psi, std::vector<long int> &near_dirs)
+{
+	near_dirs.clear();
+	for (int j = 0; j < R_repository.size(); j++)
+	{
+		// The symmetry operators map a direction d onto L*R^T*d, so its angle to the prior is that between d and R*L^T*prior
+		Matrix1D<RFLOAT> sym_prior_direction = R_repository[j] * (L_repository[j].transpose() * prior_direction);
+		direction_index.findDirectionsWithinAngle(sym_prior_direction, max_ang, near_dirs);
+	}
+	// For bimodal searches, directions opposite to the prior are also accepted
+	if (do_bimodal_search_psi)
+		direction_index.findDirectionsWithinAngle(-prior_direction, max_ang, near_dirs);
+
+	std::sort(near_dirs.begin(), near_dirs.end());
+	near_dirs.erase(std::unique(near_dirs.begin(), near_dirs.end()), near_dirs.end());
+}
+
+RFLOAT HealpixSampling::calculateAngleToPriorDirection(long int idir, const Matrix1D<RFLOAT> &prior_direction, bool do_bimodal_search_psi)
+{
+	Matrix1D<RFLOAT> my_direction, sym_direction, best_direction;
+
+	// Get the current direction in the loop
+	Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
+	best_direction = my_direction;
+
+	// Loop over all symmetry operators to find the operator that brings this direction nearest to the prior if no symmetry relaxation
+	if (!isRelax)
+	{
+		RFLOAT best_dotProduct = dotProduct(prior_direction, my_direction);
+		for (int j = 0; j < R_repository.size(); j++)
+		{
+			sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
+			RFLOAT my_dotProduct = dotProduct(prior_direction, sym_direction);
+			if (my_dotProduct > best_dotProduct)
+			{
+				best_direction = sym_direction;
+				best_dotProduct = my_dotProduct;
+			}
+		}
+	}
+
+	// Now that we have the best direction, find the corresponding prior probability
+	RFLOAT diffang = ACOSD( dotProduct(best_direction, prior_direction) );
+	if (diffang > 180.)
+		diffang = ABS(diffang - 360.);
+	if (do_bimodal_search_psi && (diffang > 90.))  // KThurber
+		diffang = ABS(diffang - 180.);	// KThurber
+
+	return diffang;
+}
+
 void HealpixSampling::findSymmetryMate(long int idir_, RFLOAT prior_,
     		std::vector<int> &pointer_dir_nonzeroprior,
 			std::vector<RFLOAT> &directions_prior, std::vector<bool> &idir_flag)
@@ -34,6 +34,49 @@
 #define NOPRIOR 0
 #define PRIOR_ROTTILT_PSI 1
 
+/** Spatial index of the sampled directions
+ *
+ * The directions are binned in the pixels of a coarser HEALPix grid, so that all
+ * directions within a given angle of any point on the sphere can be found without
+ * looping over all of them. The index is built once when the sampling changes and is
+ * only read afterwards, so it can be shared by all threads.
+ */
+class HealpixDirectionIndex
+{
+	// HEALPix grid with the bins
+	Healpix_Base base;
+
+	// Maximum angle (in radians) between the centre of a bin and any point inside it
+	double max_bin_radius;
+
+	// Directions in bin ibin are dirs[bin_start[ibin]] ... dirs[bin_start[ibin+1]-1]
+	std::vector<long int> bin_start, dirs;
+
+	// Unit vectors of all directions
+	std::vector<double> dir_x, dir_y, dir_z;
+
+public:
+
+	HealpixDirectionIndex(): max_bin_radius(0.)
+	{}
+
+	void clear();
+
+	/* Build the index for the given directions (in degrees), with bins of HEALPix order bin_order */
+	void build(const std::vector<RFLOAT> &rot_angles, const std::vector<RFLOAT> &tilt_angles, int bin_order);
+
+	/* Number of directions in the index (zero if it has not been built) */
+	long int size() const
+	{
+		return dir_x.size();
+	}
+
+	/* Append the indices of all directions within max_ang degrees of the unit vector direction to idirs.
+	 * The indices are not sorted, and directions close to the boundary may be included as well.
+	 */
+	void findDirectionsWithinAngle(const Matrix1D<RFLOAT> &direction, RFLOAT max_ang, std::vector<long int> &idirs) const;
+};
+
 class HealpixSampling
 {
 
@@ -91,6 +134,9 @@ public:
     /** vector with sampling points described by angles */
     std::vector<RFLOAT > rot_angles, tilt_angles;
 
+    /** Spatial index of rot_angles and tilt_angles for local searches */
+    HealpixDirectionIndex direction_index;
+
     /** vector with the psi-samples */
     std::vector<RFLOAT> psi_angles;
 
@@ -218,6 +264,11 @@ public:
     /* Add a single orientation */
     void addOneOrientation(RFLOAT rot, RFLOAT tilt, RFLOAT psi, bool do_clear = false);
 
+    /* (Re-)build the spatial index of the directions
+     * This is done by setOrientations, but should be called again if rot_angles and tilt_angles are changed otherwise
+     */
+    void buildDirectionIndex();
+
     /* Write all orientations as a sphere in a bild file
      * Mainly useful for debugging */
     void writeAllOrientationsToBild(FileName fn_bild, std::string rgb = "1 0 0", RFLOAT size = 0.025);
@@ -251,6 +302,18 @@ public:
 			RFLOAT prior_rot_flip_ratio = 0.5,  // KThurber
     		RFLOAT sigma_cutoff = 3.);
 
+    /* Get the sorted indices of all directions within max_ang degrees of the prior direction or of one of its
+     * symmetry mates (or of the opposite direction for bimodal searches) from the spatial index.
+     * A few directions just outside max_ang may be included as well.
+     */
+    void findDirectionsNearPriorDirection(const Matrix1D<RFLOAT> &prior_direction, RFLOAT max_ang,
+    		bool do_bimodal_search_psi, std::vector<long int> &near_dirs);
+
+    /* Angle (in degrees) between direction idir and the prior direction, after applying the symmetry
+     * operator that brings them closest together (unless relaxing symmetry)
+     */
+    RFLOAT calculateAngleToPriorDirection(long int idir, const Matrix1D<RFLOAT> &prior_direction, bool do_bimodal_search_psi);
+
     // Find the symmetry mate by searching the Healpix library
     void findSymmetryMate(long int idir_, RFLOAT prior_,
     		std::vector<int> &pointer_dir_nonzeroprior,
@@ -17,11 +17,91 @@
  * source code. Additional authorship citations may be added, but existing
  * author citations must be preserved.
  ***************************************************************************/
+#include <sys/stat.h>
 #include "src/image.h"
 
 //#define DEBUG_REGULARISE_HELICAL_SEGMENTS
 
 // Get size of datatype
+static bool checkMmapEnvironment()
+{
+	char *env = getenv("RELION_MMAP_IMAGES");
+	return (env == NULL || std::string(env) != "0");
+}
+
+bool fImageHandler::use_mmap = checkMmapEnvironment();
+
+ImageFileMapping::ImageFileMapping(int fd)
+{
+	data = map_start = NULL;
+	size = map_size = file_end = next_offset = advised_end = 0;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+		return;
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	data = map_start = (char*)map;
+	size = map_size = file_end = st.st_size;
+}
+
+ImageFileMapping::ImageFileMapping(int fd, size_t offset, size_t length)
+{
+	data = map_start = NULL;
+	size = map_size = file_end = next_offset = advised_end = 0;
+
+	struct stat st;
+	if (length == 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (off_t)(offset + length) > st.st_size)
+		return;
+
+	// Mappings have to start at a page boundary
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = (offset / page) * page;
+
+	// Private and writable: writes to the data of an Image end up in copies of the pages
+	void *map = mmap(NULL, offset + length - start, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, start);
+	if (map == MAP_FAILED)
+		return;
+
+	map_start = (char*)map;
+	map_size = offset + length - start;
+	data = map_start + (offset - start);
+	size = length;
+	file_end = offset + length;
+}
+
+ImageFileMapping::~ImageFileMapping()
+{
+	if (map_start != NULL)
+		munmap(map_start, map_size);
+}
+
+bool ImageFileMapping::fileCovers(int fd) const
+{
+	struct stat st;
+	return (fstat(fd, &st) == 0 && st.st_size >= (off_t)file_end);
+}
+
+void ImageFileMapping::willNeed(size_t offset, size_t length)
+{
+	const size_t readahead = 8 * 1024 * 1024;
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	// Sequential access through a stack: keep the next few Mb coming in
+	if (offset == next_offset && offset + length > advised_end)
+	{
+		char *first = data + offset;
+		char *start = map_start + ((first - map_start) / page) * page;
+		char *end = data + XMIPP_MIN(size, offset + length + readahead);
+		madvise(start, end - start, MADV_WILLNEED);
+		advised_end = end - data;
+	}
+	next_offset = offset + length;
+}
+
 unsigned long  gettypesize(DataType type)
 {
 	unsigned long	size;
@@ -33,6 +113,7 @@ unsigned long  gettypesize(DataType type)
 		case Float:              size = sizeof(float); break;
 		case Double:             size = sizeof(RFLOAT); break;
 		case Boolean:            size = sizeof(bool); break;
+		case Float16:            size = 2; break;
 		case UHalf: REPORT_ERROR("Logic error: UHalf (4-bit) needs special consideration. Don't use this function."); break;
 		default: size = 0;
 	}
@@ -54,6 +54,7 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <memory>
 #include <tiffio.h>
 #include "src/funcs.h"
 #include "src/memory.h"
@@ -83,6 +84,7 @@ typedef enum
 	Double = 9,       // Double precision floating point (8-byte)
 	Boolean = 10,     // Boolean (1-byte?)
 	UHalf = 11,       // Signed 4-bit integer (SerialEM extension)
+	Float16 = 12,     // Half-precision floating point (2-byte, MRC mode 12)
 	LastEntry = 15    // This must be the last entry
 } DataType;
 
@@ -193,6 +195,81 @@ extern "C" {
 	}
 }
 
+/** Convert an IEEE 754 half-precision number to single precision
+ */
+inline float half2float(unsigned short h)
+{
+	unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+	unsigned int exponent = (h >> 10) & 0x1f;
+	unsigned int mantissa = h & 0x3ff;
+	unsigned int bits;
+
+	if (exponent == 0)
+	{
+		if (mantissa == 0)
+			bits = sign;
+		else
+		{
+			// Subnormal half: normalise it
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400))
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+		}
+	}
+	else if (exponent == 31) // Inf or NaN
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+
+	float f;
+	memcpy(&f, &bits, sizeof(float));
+	return f;
+}
+
+/** Memory mapping of (part of) an image file
+ * Mappings of whole files are read-only, so they take no memory of their own. For Images
+ * whose data point into a file (mmapOn), only their data are mapped, and written pages
+ * become private copies, so that the data can be modified without changing the file.
+ * A mapping is shared between the fImageHandler that opened the file and the Images whose
+ * data point into it.
+ */
+class ImageFileMapping
+{
+public:
+	char *data; // NULL if the file could not be mapped
+	size_t size;
+
+	/** Map the whole file, read-only */
+	ImageFileMapping(int fd);
+
+	/** Map length bytes from offset, writable and copy-on-write */
+	ImageFileMapping(int fd, size_t offset, size_t length);
+
+	/** Unmap the file */
+	~ImageFileMapping();
+
+	/** Whether the file (still) has all the mapped bytes.
+	 * Reading mapped pages beyond the end of a file that was truncated raises SIGBUS.
+	 */
+	bool fileCovers(int fd) const;
+
+	/** Tell the kernel that length bytes from offset are needed soon.
+	 * When the accesses go through the file sequentially, also read ahead.
+	 */
+	void willNeed(size_t offset, size_t length);
+
+private:
+	char *map_start; // start of the mapped pages, at or before data
+	size_t map_size, file_end, next_offset, advised_end;
+
+	ImageFileMapping(const ImageFileMapping&);
+	ImageFileMapping& operator=(const ImageFileMapping&);
+};
+
 /** File handler class
  * This struct is used to share the File handlers with Image Collection class
  */
@@ -205,6 +282,12 @@ public:
 	FileName  ext_name; // Filename extension
 	bool	  exist;    // Shows if the file exists
 	bool	  isTiff;   // Shows if this is a TIFF file
+	std::shared_ptr<ImageFileMapping> mapping; // MRC files opened for reading are memory-mapped
+
+	/** Read MRC files through a memory mapping instead of fread (default: true,
+	 * unless the environment variable RELION_MMAP_IMAGES is set to 0)
+	 */
+	static bool use_mmap;
 
 	/** Empty constructor
 	 */
@@ -308,12 +391,20 @@ public:
 		else
 			fhed = NULL;
 
+		// Map MRC files that are read, so that many slices can be read without further I/O calls
+		if (use_mmap && mode == WRITE_READONLY && !isTiff && ext_name.contains("mrc"))
+		{
+			mapping.reset(new ImageFileMapping(fileno(fimg)));
+			if (mapping->data == NULL)
+				mapping.reset();
+		}
 	}
 
 	void closeFile()
 	{
 		ext_name="";
 		exist=false;
+		mapping.reset();
 
 		// Check whether the file was closed already
 		if (fimg == NULL && fhed == NULL && ftiff == NULL)
@@ -372,8 +463,8 @@ private:
 	bool _exists;  // does target file exists?
 	// equal 0 is not exists or not a stack
 	bool mmapOn; // Mapping when loading from file
-	int mFd; // Handle the file in reading method and mmap
-	size_t mappedSize; // Size of the mapped file
+	std::shared_ptr<ImageFileMapping> readMapping; // Mapping of the file that is being read
+	std::shared_ptr<ImageFileMapping> dataMapping; // Mapping that the data point into
 
 public:
 	/** Empty constructor
@@ -414,11 +505,7 @@ public:
 	void clear()
 	{
 		if (mmapOn)
-		{
-			munmap(data.data-offset,mappedSize);
-			close(mFd);
-			data.data = NULL;
-		}
+			releaseMapping();
 		else
 			data.clear();
 
@@ -439,6 +526,18 @@ public:
 		MDMainHeader.clear();
 	}
 
+	/** Stop pointing into a mapped file (the data are cleared)
+	 */
+	void releaseMapping()
+	{
+		if (dataMapping)
+		{
+			data.data = NULL;
+			data.clear();
+			dataMapping.reset();
+		}
+	}
+
 	/** Destructor.
 	 */
 	~Image()
@@ -478,6 +577,8 @@ public:
 	 * file name takes precedence over select_img
 	 * If -1 is given the whole object is read
 	 * The number before @ in the filename is 1-indexed, while select_img is 0-indexed.
+	 * With mapData, the data of MRC files in the native byte order and type T are not
+	 * copied, but point into a (copy-on-write) mapping of the file: don't resize them.
 	 */
 	int read(const FileName &name, bool readdata=true, long int select_img=-1, bool mapData = false, bool is_2D = false)
 	{
@@ -662,6 +763,13 @@ public:
 				}
 				break;
 			}
+		case Float16:
+			{
+				unsigned short *ptr = (unsigned short *)page;
+				for (size_t i = 0; i < pageSize; i++)
+					ptrDest[i] = (T)half2float(ptr[i]);
+				break;
+			}
 		case UHalf:
 			{
 				if (pageSize % 2 != 0) REPORT_ERROR("Logic error in castPage2T; for UHalf, pageSize must be even.");
@@ -844,6 +952,8 @@ public:
 				else
 					return 0;
 			}
+		case Float16:
+			return 0;
 		default:
 			{
 				std::cerr << "Datatype= " << datatype << std::endl;
@@ -936,42 +1046,68 @@ public:
 		{
 			std::cout << "WARNING: Image Class. File datatype and image declaration not compatible with mmap. Loading into memory." <<std::endl;
 			mmapOn = false;
-			mFd = -1;
 		}
 
-		if (mmapOn)
+		// Reset select to get the correct offset
+		if ( select_img < 0 )
+			select_img = 0;
+		myoffset = offset + select_img*(pagesize + pad);
+
+		// Only read through the mapping if the data are within the file and aligned
+		char *mapped = NULL;
+		if (readMapping && datatype != UHalf && myoffset % datatypesize == 0 &&
+		    myoffset + NSIZE(data) * (pagesize + pad) - pad <= readMapping->size)
 		{
-			if ( NSIZE(data) > 1 )
-			{
-				REPORT_ERROR("Image Class::ReadData: mmap with multiple \
-							 images file not compatible. Try selecting a unique image.");
-			}
+			// Don't touch pages that are beyond the end of a file that was truncated since
+			if (!readMapping->fileCovers(fileno(fimg)))
+				REPORT_ERROR("Image::readData: " + filename + " was truncated while it was being read");
 
-			fclose(fimg);
+			mapped = readMapping->data + myoffset;
+		}
 
-			//if ( ( mFd = open(filename.c_str(), O_RDWR, S_IREAD | S_IWRITE) ) == -1 )
-			if ( ( mFd = open(filename.c_str(), O_RDWR, S_IRUSR | S_IWUSR) ) == -1 )
-				REPORT_ERROR("Image Class::ReadData: Error opening the image file.");
+		if (mmapOn && (mapped == NULL || swap || (pad > 0 && NSIZE(data) > 1) || myoffset % sizeof(T) != 0))
+		{
+			std::cout << "WARNING: Image Class. File data cannot be mapped. Loading into memory." <<std::endl;
+			mmapOn = false;
+		}
 
-			char * map;
-			mappedSize = pagesize+offset;
+		std::shared_ptr<ImageFileMapping> writableMapping;
+		if (mmapOn)
+		{
+			// The data may be modified, so they need a writable (copy-on-write) mapping of their own
+			writableMapping.reset(new ImageFileMapping(fileno(fimg), myoffset, NSIZE(data) * pagesize));
+			if (writableMapping->data == NULL)
+			{
+				std::cout << "WARNING: Image Class. File data cannot be mapped. Loading into memory." <<std::endl;
+				mmapOn = false;
+			}
+		}
 
-			if ( (map = (char*) mmap(0,mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0)) == (void*) -1 )
-				REPORT_ERROR("Image Class::ReadData: mmap of image file failed.");
-			data.data = reinterpret_cast<T*> (map+offset);
+		if (mmapOn)
+		{
+			// Point into the mapping, which is kept alive with the data
+			data.coreDeallocate();
+			data.data = reinterpret_cast<T*> (writableMapping->data);
+			data.destroyData = false;
+			dataMapping = writableMapping;
+			dataMapping->willNeed(0, NSIZE(data) * pagesize);
+		}
+		else if (mapped != NULL && !swap)
+		{
+			// Cast straight from the mapping, without reading pages into a buffer first
+			data.coreAllocateReuse();
+			readMapping->willNeed(myoffset, NSIZE(data) * (pagesize + pad));
+			for (size_t myn = 0; myn < NSIZE(data); myn++)
+				castPage2T(mapped + myn * (pagesize + pad), MULTIDIM_ARRAY(data) + myn * ZYXSIZE(data), datatype, ZYXSIZE(data));
 		}
 		else
 		{
-			// Reset select to get the correct offset
-			if ( select_img < 0 )
-				select_img = 0;
 
 			char* page = NULL;
 
 			// Allocate memory for image data (Assume xdim, ydim, zdim and ndim are already set
 			// if memory already allocated use it (no resize allowed)
 			data.coreAllocateReuse();
-			myoffset = offset + select_img*(pagesize + pad);
 			//#define DEBUG
 
 #ifdef DEBUG
@@ -1273,6 +1409,9 @@ public:
 		case UHalf:
 			o << "4-bit integer";
 			break;
+		case Float16:
+			o << "Half-precision floating point (2-byte)";
+			break;
 		}
 		o << std::endl;
 
@@ -1302,6 +1441,9 @@ public:
 		// Check whether to read the data or only the header
 		dataflag = ( readdata ) ? 1 : -1;
 
+		// Don't point into the mapping of a previously read file anymore
+		releaseMapping();
+
 		// Check whether to map the data or not
 		mmapOn = mapData;
 
@@ -1328,12 +1470,16 @@ private:
 		// Check whether to read the data or only the header
 		dataflag = ( readdata ) ? 1 : -1;
 
+		// Don't point into the mapping of a previously read file anymore
+		releaseMapping();
+
 		// Check whether to map the data or not
 		mmapOn = mapData;
 
 		FileName ext_name = hFile.ext_name;
 		fimg = hFile.fimg;
 		fhed = hFile.fhed;
+		readMapping = hFile.mapping;
 
 		long int dump;
 		name.decompose(dump, filename);
@@ -1380,6 +1526,8 @@ private:
 		else
 			err = readSPIDER(select_img);
 
+		readMapping.reset();
+
 		// Negative errors are bad.
 		return err;
 	}
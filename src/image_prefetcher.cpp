@@ -0,0 +1,260 @@
+/***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "src/image_prefetcher.h"
+#include "src/image.h"
+
+void * _imagePrefetcherMain(void * data)
+{
+	ImagePrefetcher *prefetcher = (ImagePrefetcher*) data;
+
+	// Only open/close stacks once
+	fImageHandler hFile;
+	long int dump;
+	FileName fn_stack, fn_open_stack = "";
+
+	ImagePrefetcher::Batch *batch;
+	long int i;
+	while (prefetcher->getWork(batch, i))
+	{
+		Image<RFLOAT> img;
+		std::string error = "";
+		try
+		{
+			const FileName &fn_img = batch->fn_imgs[i];
+			fn_img.decompose(dump, fn_stack);
+			if (fn_stack != fn_open_stack)
+			{
+				hFile.openFile(fn_stack, WRITE_READONLY);
+				fn_open_stack = fn_stack;
+			}
+			img.readFromOpenFile(fn_img, hFile, -1, false);
+			img().setXmippOrigin();
+		}
+		// Nothing may escape this thread, so any error is passed on to getImage
+		catch (RelionError XE)
+		{
+			error = XE.msg;
+			fn_open_stack = "";
+		}
+		catch (std::exception &e)
+		{
+			error = "ImagePrefetcher: error while reading " + batch->fn_imgs[i] + ": " + e.what();
+			fn_open_stack = "";
+		}
+		catch (...)
+		{
+			error = "ImagePrefetcher: unknown error while reading " + batch->fn_imgs[i];
+			fn_open_stack = "";
+		}
+
+		pthread_mutex_lock(&prefetcher->mutex);
+		batch->imgs[i] = img();
+		batch->errors[i] = error;
+		batch->is_read[i] = true;
+		batch->nr_reading--;
+		pthread_cond_broadcast(&prefetcher->read_cond);
+		pthread_mutex_unlock(&prefetcher->mutex);
+	}
+
+	return NULL;
+}
+
+ImagePrefetcher::ImagePrefetcher(int nr_threads, long int max_images)
+{
+	has_current = stopping = false;
+	this->max_images = max_images;
+	nr_images_ahead = 0;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&work_cond, NULL);
+	pthread_cond_init(&read_cond, NULL);
+
+	threads.resize(XMIPP_MAX(1, nr_threads));
+	for (int i = 0; i < threads.size(); i++)
+	{
+		if (pthread_create(&threads[i], NULL, _imagePrefetcherMain, (void*) this) != 0)
+			REPORT_ERROR("ImagePrefetcher: cannot create I/O threads.");
+	}
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+	pthread_mutex_lock(&mutex);
+	stopping = true;
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&mutex);
+
+	for (int i = 0; i < threads.size(); i++)
+		pthread_join(threads[i], NULL);
+
+	for (int i = 0; i < batches.size(); i++)
+		delete batches[i];
+
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&work_cond);
+	pthread_cond_destroy(&read_cond);
+}
+
+void ImagePrefetcher::request(long int key, const std::vector<FileName> &fn_imgs)
+{
+	Batch *batch = new Batch();
+	batch->key = key;
+	batch->fn_imgs = fn_imgs;
+	batch->imgs.resize(fn_imgs.size());
+	batch->errors.resize(fn_imgs.size());
+	batch->is_read.resize(fn_imgs.size(), false);
+	batch->nr_started = batch->nr_reading = 0;
+
+	pthread_mutex_lock(&mutex);
+	batches.push_back(batch);
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+bool ImagePrefetcher::isRequested(long int key)
+{
+	pthread_mutex_lock(&mutex);
+	bool result = false;
+	for (int i = 0; i < batches.size(); i++)
+	{
+		if (batches[i]->key == key)
+		{
+			result = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	return result;
+}
+
+void ImagePrefetcher::setCurrent(long int key)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (has_current)
+	{
+		dropFirst();
+		has_current = false;
+	}
+
+	while (!batches.empty() && batches.front()->key != key)
+		dropFirst();
+
+	if (batches.empty())
+	{
+		pthread_mutex_unlock(&mutex);
+		REPORT_ERROR("ImagePrefetcher::setCurrent BUG: this batch was never requested");
+	}
+
+	// Images of the current batch no longer count as read ahead
+	has_current = true;
+	nr_images_ahead -= batches.front()->nr_started;
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void ImagePrefetcher::getImage(long int i, MultidimArray<RFLOAT> &img)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (!has_current || i < 0 || i >= batches.front()->fn_imgs.size())
+	{
+		pthread_mutex_unlock(&mutex);
+		REPORT_ERROR("ImagePrefetcher::getImage BUG: image is not in the current batch");
+	}
+
+	Batch *batch = batches.front();
+	while (!batch->is_read[i])
+		pthread_cond_wait(&read_cond, &mutex);
+	std::string error = batch->errors[i];
+
+	pthread_mutex_unlock(&mutex);
+
+	if (error != "")
+		REPORT_ERROR(error);
+
+	// The batch stays until the next call to setCurrent
+	img = batch->imgs[i];
+}
+
+void ImagePrefetcher::releaseCurrent()
+{
+	pthread_mutex_lock(&mutex);
+	if (has_current)
+	{
+		dropFirst();
+		has_current = false;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+long int ImagePrefetcher::getNrImagesAhead()
+{
+	pthread_mutex_lock(&mutex);
+	long int result = nr_images_ahead;
+	pthread_mutex_unlock(&mutex);
+	return result;
+}
+
+bool ImagePrefetcher::getWork(Batch* &batch, long int &i)
+{
+	pthread_mutex_lock(&mutex);
+	while (!stopping)
+	{
+		for (int ibatch = 0; ibatch < batches.size(); ibatch++)
+		{
+			Batch *b = batches[ibatch];
+			if (b->nr_started >= b->fn_imgs.size())
+				continue;
+
+			bool is_current = (ibatch == 0 && has_current);
+			if (!is_current)
+			{
+				// All later batches are ahead as well
+				if (nr_images_ahead >= max_images)
+					break;
+				nr_images_ahead++;
+			}
+
+			batch = b;
+			i = b->nr_started++;
+			b->nr_reading++;
+			pthread_mutex_unlock(&mutex);
+			return true;
+		}
+
+		pthread_cond_wait(&work_cond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+	return false;
+}
+
+void ImagePrefetcher::dropFirst()
+{
+	Batch *batch = batches.front();
+
+	// Don't start on any further images, and wait for those that are being read
+	if (!has_current)
+		nr_images_ahead -= batch->nr_started;
+	batch->nr_started = batch->fn_imgs.size();
+	while (batch->nr_reading > 0)
+		pthread_cond_wait(&read_cond, &mutex);
+
+	batches.pop_front();
+	delete batch;
+	pthread_cond_broadcast(&work_cond);
+}
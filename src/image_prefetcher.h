@@ -0,0 +1,95 @@
+/***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef IMAGE_PREFETCHER_H_
+#define IMAGE_PREFETCHER_H_
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include "src/multidim_array.h"
+#include "src/funcs.h"
+
+/** Reads batches of (particle) images on dedicated I/O threads.
+ *
+ * Batches are requested with a list of image names and are read in the order
+ * in which they were requested, so that the images of the next batches can be
+ * read from disc while the current one is being processed. The images of the
+ * current batch can be taken as soon as they have been read, so processing can
+ * already start before the whole batch is in memory.
+ *
+ * At most max_images images of the batches after the current one are kept in
+ * memory, to limit the RAM that is spent on reading ahead.
+ */
+class ImagePrefetcher
+{
+public:
+
+	ImagePrefetcher(int nr_threads = 1, long int max_images = 1000);
+
+	// Waits for the I/O threads to finish
+	~ImagePrefetcher();
+
+	// Queue a batch of images to be read. The key identifies the batch (e.g. its first particle).
+	void request(long int key, const std::vector<FileName> &fn_imgs);
+
+	// Has the batch with this key been requested (and not been dropped yet)?
+	bool isRequested(long int key);
+
+	// Make the batch with this key the current one, drop all batches requested before it
+	void setCurrent(long int key);
+
+	// Get image i of the current batch, waiting until it has been read if needed
+	void getImage(long int i, MultidimArray<RFLOAT> &img);
+
+	// Drop the current batch when it is no longer needed
+	void releaseCurrent();
+
+	// Number of images of the batches after the current one that are being read or have been read
+	long int getNrImagesAhead();
+
+private:
+
+	struct Batch
+	{
+		long int key;
+		std::vector<FileName> fn_imgs;
+		std::vector<MultidimArray<RFLOAT> > imgs;
+		std::vector<std::string> errors;
+		std::vector<bool> is_read;
+		long int nr_started, nr_reading;
+	};
+
+	std::vector<pthread_t> threads;
+	std::deque<Batch*> batches; // the current batch (if any) is the first one
+	bool has_current, stopping;
+	long int max_images, nr_images_ahead;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond, read_cond;
+
+	// Find the next image to read, returns false when stopping
+	bool getWork(Batch* &batch, long int &i);
+
+	// Drop the first batch, mutex should be locked
+	void dropFirst();
+
+	friend void * _imagePrefetcherMain(void * data);
+};
+
+void * _imagePrefetcherMain(void * data);
+
+#endif /* IMAGE_PREFETCHER_H_ */
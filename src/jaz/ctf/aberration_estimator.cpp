@@ -24,7 +24,7 @@ using namespace gravis;
 
 
 AberrationEstimator::AberrationEstimator()
-	:	ready(false)
+	:	ready(false), inMemory(false)
 {}
 
 void AberrationEstimator::read(IOParser &parser, int argc, char *argv[])
@@ -44,7 +44,8 @@ void AberrationEstimator::read(IOParser &parser, int argc, char *argv[])
 void AberrationEstimator::init(
 		int verb, int nr_omp_threads,
 		bool debug, bool diag, std::string outPath,
-		ReferenceMap* reference, ObservationModel* obsModel)
+		ReferenceMap* reference, ObservationModel* obsModel,
+		bool inMemory)
 {
 	this->verb = verb;
 	this->nr_omp_threads = nr_omp_threads;
@@ -52,6 +53,7 @@ void AberrationEstimator::init(
 	this->debug = debug;
 	this->diag = diag;
 	this->outPath = outPath;
+	this->inMemory = inMemory;
 
 	this->reference = reference;
 	this->obsModel = obsModel;
@@ -59,6 +61,16 @@ void AberrationEstimator::init(
 	angpix = obsModel->getPixelSizes();
 	obsModel->getBoxSizes(s, sh);
 
+	const int ogc = obsModel->numberOfOpticsGroups();
+
+	AxxAcc = std::vector<Image<double>>(ogc);
+	AxyAcc = std::vector<Image<double>>(ogc);
+	AyyAcc = std::vector<Image<double>>(ogc);
+	bxAcc = std::vector<Image<double>>(ogc);
+	byAcc = std::vector<Image<double>>(ogc);
+
+	accUsed = std::vector<bool>(ogc, false);
+
 	ready = true;
 }
 
@@ -146,6 +158,33 @@ void AberrationEstimator::processMicrograph(
 			ImageOp::linearCombination(bySum, by[threadnum], 1.0, 1.0, bySum);
 		}
 
+		// In memory, the sums of all micrographs are kept in double precision
+
+		if (inMemory)
+		{
+			if (!accUsed[og])
+			{
+				Image<double>* acc[5] = {&AxxAcc[og], &AxyAcc[og], &AyyAcc[og], &bxAcc[og], &byAcc[og]};
+
+				for (int i = 0; i < 5; i++)
+				{
+					*acc[i] = Image<double>(sh[og],s[og]);
+					acc[i]->data.initZeros();
+				}
+
+				accUsed[og] = true;
+			}
+
+			addToAccumulator(AxxAcc[og], AxxSum);
+			addToAccumulator(AxyAcc[og], AxySum);
+			addToAccumulator(AyyAcc[og], AyySum);
+
+			addToAccumulator(bxAcc[og], bxSum);
+			addToAccumulator(byAcc[og], bySum);
+
+			continue;
+		}
+
 		// Write out the intermediate results per-micrograph:
 
 		std::string outRoot = CtfRefiner::getOutputFilenameRoot(mdt, outPath);
@@ -192,7 +231,19 @@ void AberrationEstimator::parametricFit(
 			AxxSum(sh[og],s[og]), AxySum(sh[og],s[og]), AyySum(sh[og],s[og]),
 			bxSum(sh[og],s[og]), bySum(sh[og],s[og]);
 
-		for (long g = 0; g < gc; g++)
+		if (inMemory && accUsed[og])
+		{
+			typeCast(AxxAcc[og](), AxxSum());
+			typeCast(AxyAcc[og](), AxySum());
+			typeCast(AyyAcc[og](), AyySum());
+
+			typeCast(bxAcc[og](), bxSum());
+			typeCast(byAcc[og](), bySum());
+
+			groupUsed[og] = true;
+		}
+
+		for (long g = 0; g < gc && !inMemory; g++)
 		{
 			std::string outRoot = CtfRefiner::getOutputFilenameRoot(mdts[g], outPath);
 
@@ -367,6 +418,12 @@ bool AberrationEstimator::isFinished(const MetaDataTable &mdt)
 		REPORT_ERROR("ERROR: AberrationEstimator::isFinished: AberrationEstimator not initialized.");
 	}
 
+	// the in-memory sums are lost when the program ends
+	if (inMemory)
+	{
+		return false;
+	}
+
 	std::string outRoot = CtfRefiner::getOutputFilenameRoot(mdt, outPath);
 
 	bool allDone = true;
@@ -393,3 +450,61 @@ bool AberrationEstimator::isFinished(const MetaDataTable &mdt)
 
 	return allDone;
 }
+
+void AberrationEstimator::packAccumulators(std::vector<double>& data)
+{
+	std::vector<Image<double>>* acc[5] = {&AxxAcc, &AxyAcc, &AyyAcc, &bxAcc, &byAcc};
+
+	for (int og = 0; og < AxxAcc.size(); og++)
+	{
+		const long n = sh[og] * s[og];
+
+		data.push_back(accUsed[og]? 1.0 : 0.0);
+
+		for (int i = 0; i < 5; i++)
+		{
+			if (accUsed[og])
+			{
+				const double* src = (*acc[i])[og].data.data;
+				data.insert(data.end(), src, src + n);
+			}
+			else
+			{
+				data.resize(data.size() + n, 0.0);
+			}
+		}
+	}
+}
+
+void AberrationEstimator::unpackAccumulators(const std::vector<double>& data, long& offset)
+{
+	std::vector<Image<double>>* acc[5] = {&AxxAcc, &AxyAcc, &AyyAcc, &bxAcc, &byAcc};
+
+	for (int og = 0; og < AxxAcc.size(); og++)
+	{
+		const long n = sh[og] * s[og];
+
+		accUsed[og] = data[offset] > 0.0;
+
+		offset++;
+
+		for (int i = 0; i < 5; i++)
+		{
+			if (accUsed[og])
+			{
+				(*acc[i])[og] = Image<double>(sh[og],s[og]);
+				std::copy(&data[offset], &data[offset] + n, (*acc[i])[og].data.data);
+			}
+
+			offset += n;
+		}
+	}
+}
+
+void AberrationEstimator::addToAccumulator(Image<double>& acc, const Image<RFLOAT>& img)
+{
+	for (long i = 0; i < img.data.nzyxdim; i++)
+	{
+		acc.data.data[i] += img.data.data[i];
+	}
+}
@@ -19,7 +19,8 @@ class AberrationEstimator
 		void init(
 				int verb, int nr_omp_threads,
 				bool debug, bool diag, std::string outPath,
-				ReferenceMap* reference, ObservationModel* obsModel);
+				ReferenceMap* reference, ObservationModel* obsModel,
+				bool inMemory = false);
 
 		// Compute per-pixel information for one micrograph
 		void processMicrograph(
@@ -36,6 +37,11 @@ class AberrationEstimator
 		// Has this mdt been processed already?
 		bool isFinished(const MetaDataTable& mdt);
 
+		// Append the in-memory sums of all optics groups to data (e.g. to reduce them over MPI),
+		// or replace them by the sums found in data, starting at offset
+		void packAccumulators(std::vector<double>& data);
+		void unpackAccumulators(const std::vector<double>& data, long& offset);
+
 
 	private:
 
@@ -46,15 +52,21 @@ class AberrationEstimator
 
 		// parameters obtained through init()
 		int verb, nr_omp_threads;
-		bool debug, diag, ready;
+		bool debug, diag, ready, inMemory;
 		std::string outPath;
 
+		// if inMemory: per-pixel sums over all micrographs, per optics group, in double precision
+		std::vector<Image<double>> AxxAcc, AxyAcc, AyyAcc, bxAcc, byAcc;
+		std::vector<bool> accUsed;
+
 		std::vector<int> s, sh;
 		std::vector<double> angpix;
 
 		ReferenceMap* reference;
 		ObservationModel* obsModel;
 
+		// add the sums of one micrograph to an in-memory sum
+		static void addToAccumulator(Image<double>& acc, const Image<RFLOAT>& img);
 };
 
 #endif
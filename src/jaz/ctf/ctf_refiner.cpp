@@ -96,6 +96,8 @@ void CtfRefiner::read(int argc, char **argv)
 	nr_omp_threads = textToInteger(parser.getOption("--j", "Number of (OMP) threads", "1"));
 	minMG = textToInteger(parser.getOption("--min_MG", "First micrograph index", "0"));
 	maxMG = textToInteger(parser.getOption("--max_MG", "Last micrograph index (default is to process all)", "-1"));
+	do_in_memory = parser.checkOption("--in_memory",
+		"Sum up the per-pixel data of the beamtilt, aberration and magnification fits in memory, instead of writing them out for each micrograph");
 
 	debug = parser.checkOption("--debug", "Write debugging data");
 	verb = textToInteger(parser.getOption("--verb", "Verbosity", "1"));
@@ -194,11 +196,11 @@ void CtfRefiner::init()
 	// Get dimensions
 	int s = reference.s;
 
-	tiltEstimator.init(verb, nr_omp_threads, debug, diag, outPath, &reference, &obsModel);
-	aberrationEstimator.init(verb, nr_omp_threads, debug, diag, outPath, &reference, &obsModel);
+	tiltEstimator.init(verb, nr_omp_threads, debug, diag, outPath, &reference, &obsModel, do_in_memory);
+	aberrationEstimator.init(verb, nr_omp_threads, debug, diag, outPath, &reference, &obsModel, do_in_memory);
 	defocusEstimator.init(verb && do_defocus_fit, nr_omp_threads, debug, diag, outPath, &reference, &obsModel);
 	bfactorEstimator.init(verb, nr_omp_threads, debug, diag, outPath, &reference, &obsModel);
-	magnificationEstimator.init(verb, nr_omp_threads, debug, diag, outPath, &reference, &obsModel);
+	magnificationEstimator.init(verb, nr_omp_threads, debug, diag, outPath, &reference, &obsModel, do_in_memory);
 
 	// check whether output files exist and skip the micrographs for which they do
 	if (only_do_unfinished)
@@ -75,6 +75,10 @@ class CtfRefiner
 		bool debug,     // write out debugging info
 		     diag;      // write out diagnostic info
 
+		// Keep the per-pixel sums of the tilt, aberration and magnification fits in memory
+		// (per thread, and per MPI process), instead of writing them out for every micrograph
+		bool do_in_memory;
+
 		long maxMG, minMG;
 
 		int nr_omp_threads;
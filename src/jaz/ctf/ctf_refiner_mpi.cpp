@@ -57,6 +57,24 @@ void CtfRefinerMpi::run()
     	processSubsetMicrographs(my_first_micrograph, my_last_micrograph);
     }
 
+	// Sum up the in-memory data of all processes
+	if (do_in_memory && (do_tilt_fit || do_aberr_fit || do_mag_fit))
+	{
+		std::vector<double> data;
+
+		if (do_tilt_fit) tiltEstimator.packAccumulators(data);
+		if (do_aberr_fit) aberrationEstimator.packAccumulators(data);
+		if (do_mag_fit) magnificationEstimator.packAccumulators(data);
+
+		node->relion_MPI_Allreduce_sum(&data[0], data.size(), MPI_COMM_WORLD);
+
+		long offset = 0;
+
+		if (do_tilt_fit) tiltEstimator.unpackAccumulators(data, offset);
+		if (do_aberr_fit) aberrationEstimator.unpackAccumulators(data, offset);
+		if (do_mag_fit) magnificationEstimator.unpackAccumulators(data, offset);
+	}
+
     MPI_Barrier(MPI_COMM_WORLD);
 
     if (node->isLeader())
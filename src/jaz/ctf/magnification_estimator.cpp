@@ -35,6 +35,7 @@
 using namespace gravis;
 
 MagnificationEstimator::MagnificationEstimator()
+	:	ready(false), inMemory(false)
 {
 
 }
@@ -54,7 +55,8 @@ void MagnificationEstimator::init(
 		bool debug, bool diag,
 		std::string outPath,
 		ReferenceMap* reference,
-		ObservationModel* obsModel)
+		ObservationModel* obsModel,
+		bool inMemory)
 {
 	this->verb = verb;
 	this->nr_omp_threads = nr_omp_threads;
@@ -62,6 +64,7 @@ void MagnificationEstimator::init(
 	this->debug = debug;
 	this->diag = diag;
 	this->outPath = outPath;
+	this->inMemory = inMemory;
 
 	this->reference = reference;
 	this->obsModel = obsModel;
@@ -69,6 +72,8 @@ void MagnificationEstimator::init(
 	angpix = obsModel->getPixelSizes();
 	obsModel->getBoxSizes(s, sh);
 
+	magEqAccs = std::vector<std::vector<Volume<Equation2x2>>>(obsModel->numberOfOpticsGroups());
+
 	ready = true;
 }
 
@@ -99,11 +104,13 @@ void MagnificationEstimator::processMicrograph(
 
 		const int pc = partIndices.size();
 
-		std::vector<Volume<Equation2x2>> magEqs(nr_omp_threads);
+		// In memory, the equations of each thread are kept over all micrographs
+		std::vector<Volume<Equation2x2>> magEqsMg;
+		std::vector<Volume<Equation2x2>>& magEqs = inMemory? magEqAccs[og] : magEqsMg;
 
-		for (int i = 0; i < nr_omp_threads; i++)
+		for (int i = magEqs.size(); i < nr_omp_threads; i++)
 		{
-			magEqs[i] = Volume<Equation2x2>(sh[og],s[og],1);
+			magEqs.push_back(Volume<Equation2x2>(sh[og],s[og],1));
 		}
 
 		#pragma omp parallel for num_threads(nr_omp_threads)
@@ -120,6 +127,11 @@ void MagnificationEstimator::processMicrograph(
 				pred[p], predGradient[p], obs[p], ctf, angpix[og], magEqs[threadnum], do_ctf_padding);
 		}
 
+		if (inMemory)
+		{
+			continue;
+		}
+
 		Volume<Equation2x2> magEq(sh[og], s[og],1);
 
 		for (int threadnum = 0; threadnum < nr_omp_threads; threadnum++)
@@ -161,6 +173,11 @@ void MagnificationEstimator::parametricFit(
 
 	std::vector<Matrix2D<RFLOAT>> mat_by_optGroup(ogc);
 
+	if (inMemory)
+	{
+		reduceThreads();
+	}
+
 	#pragma omp parallel for num_threads(nr_omp_threads)
 	for (int og = 0; og < ogc; og++)
 	{
@@ -171,7 +188,13 @@ void MagnificationEstimator::parametricFit(
 
 		bool groupPresent = false;
 
-		for (long g = 0; g < gc; g++)
+		if (inMemory && magEqAccs[og].size() > 0)
+		{
+			magEqs = magEqAccs[og][0];
+			groupPresent = true;
+		}
+
+		for (long g = 0; g < gc && !inMemory; g++)
 		{
 			std::string outRoot = CtfRefiner::getOutputFilenameRoot(mdts[g], outPath);
 
@@ -298,6 +321,12 @@ bool MagnificationEstimator::isFinished(
 		REPORT_ERROR("ERROR: TiltEstimator::isFinished: DefocusEstimator not initialized.");
 	}
 
+	// the in-memory sums are lost when the program ends
+	if (inMemory)
+	{
+		return false;
+	}
+
 	std::string outRoot = CtfRefiner::getOutputFilenameRoot(mdt, outPath);
 
 	bool allThere = true;
@@ -325,3 +354,82 @@ bool MagnificationEstimator::isFinished(
 
 	return allThere;
 }
+
+void MagnificationEstimator::packAccumulators(std::vector<double>& data)
+{
+	reduceThreads();
+
+	for (int og = 0; og < magEqAccs.size(); og++)
+	{
+		const long n = sh[og] * s[og];
+		const bool present = magEqAccs[og].size() > 0;
+
+		data.push_back(present? 1.0 : 0.0);
+
+		if (present)
+		{
+			const Equation2x2* eqs = magEqAccs[og][0].data();
+
+			for (long i = 0; i < n; i++)
+			{
+				data.push_back(eqs[i].Axx);
+				data.push_back(eqs[i].Axy);
+				data.push_back(eqs[i].Ayy);
+				data.push_back(eqs[i].bx);
+				data.push_back(eqs[i].by);
+			}
+		}
+		else
+		{
+			data.resize(data.size() + 5 * n, 0.0);
+		}
+	}
+}
+
+void MagnificationEstimator::unpackAccumulators(const std::vector<double>& data, long& offset)
+{
+	for (int og = 0; og < magEqAccs.size(); og++)
+	{
+		const long n = sh[og] * s[og];
+		const bool present = data[offset] > 0.0;
+
+		offset++;
+
+		magEqAccs[og].clear();
+
+		if (present)
+		{
+			magEqAccs[og].push_back(Volume<Equation2x2>(sh[og],s[og],1));
+
+			Equation2x2* eqs = magEqAccs[og][0].data();
+			const double* src = &data[offset];
+
+			for (long i = 0; i < n; i++)
+			{
+				eqs[i].Axx = src[5*i];
+				eqs[i].Axy = src[5*i + 1];
+				eqs[i].Ayy = src[5*i + 2];
+				eqs[i].bx = src[5*i + 3];
+				eqs[i].by = src[5*i + 4];
+			}
+		}
+
+		offset += 5 * n;
+	}
+}
+
+void MagnificationEstimator::reduceThreads()
+{
+	for (int og = 0; og < magEqAccs.size(); og++)
+	{
+		for (int t = 1; t < magEqAccs[og].size(); t++)
+		{
+			magEqAccs[og][0] += magEqAccs[og][t];
+		}
+
+		if (magEqAccs[og].size() > 1)
+		{
+			magEqAccs[og].resize(1);
+		}
+	}
+}
@@ -28,6 +28,7 @@
 #include <src/image.h>
 #include <src/jaz/volume.h>
 #include <src/jaz/gravis/t2Vector.h>
+#include "equation2x2.h"
 
 class IOParser;
 class ReferenceMap;
@@ -45,7 +46,8 @@ class MagnificationEstimator
 		void init(
 				int verb, int nr_omp_threads,
 				bool debug, bool diag, std::string outPath,
-				ReferenceMap* reference, ObservationModel* obsModel);
+				ReferenceMap* reference, ObservationModel* obsModel,
+				bool inMemory = false);
 
 		// Compute per-pixel information for one micrograph
 		void processMicrograph(
@@ -64,6 +66,11 @@ class MagnificationEstimator
 		// Has this mdt been processed already?
 		bool isFinished(const MetaDataTable& mdt);
 
+		// Append the in-memory sums of all optics groups to data (e.g. to reduce them over MPI),
+		// or replace them by the sums found in data, starting at offset
+		void packAccumulators(std::vector<double>& data);
+		void unpackAccumulators(const std::vector<double>& data, long& offset);
+
 
 	private:
 
@@ -73,14 +80,20 @@ class MagnificationEstimator
 
 		// parameters obtained through init()
 		int verb, nr_omp_threads;
-		bool debug, diag, ready;
+		bool debug, diag, ready, inMemory;
 		std::string outPath;
 
+		// if inMemory: per-pixel equations summed over all micrographs, per optics group and thread
+		std::vector<std::vector<Volume<Equation2x2>>> magEqAccs;
+
 		std::vector<int> s, sh;
 		std::vector<double> angpix;
 
 		ReferenceMap* reference;
 		ObservationModel* obsModel;
+
+		// add up the in-memory sums of all threads
+		void reduceThreads();
 };
 
 #endif
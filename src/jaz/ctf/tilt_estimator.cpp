@@ -44,7 +44,7 @@ using namespace gravis;
 
 
 TiltEstimator::TiltEstimator()
-	:	ready(false)
+	:	ready(false), inMemory(false)
 {}
 
 void TiltEstimator::read(IOParser &parser, int argc, char *argv[])
@@ -68,7 +68,8 @@ void TiltEstimator::read(IOParser &parser, int argc, char *argv[])
 void TiltEstimator::init(
 		int verb, int nr_omp_threads,
 		bool debug, bool diag, std::string outPath,
-		ReferenceMap* reference, ObservationModel* obsModel)
+		ReferenceMap* reference, ObservationModel* obsModel,
+		bool inMemory)
 {
 	this->verb = verb;
 	this->nr_omp_threads = nr_omp_threads;
@@ -76,6 +77,7 @@ void TiltEstimator::init(
 	this->debug = debug;
 	this->diag = diag;
 	this->outPath = outPath;
+	this->inMemory = inMemory;
 
 	this->reference = reference;
 	this->obsModel = obsModel;
@@ -83,6 +85,10 @@ void TiltEstimator::init(
 	angpix = obsModel->getPixelSizes();
 	obsModel->getBoxSizes(s, sh);
 
+	xyAccs = std::vector<Image<dComplex>>(obsModel->numberOfOpticsGroups());
+	wAccs = std::vector<Image<double>>(obsModel->numberOfOpticsGroups());
+	accUsed = std::vector<bool>(obsModel->numberOfOpticsGroups(), false);
+
 	ready = true;
 }
 
@@ -150,6 +156,31 @@ void TiltEstimator::processMicrograph(
 			ImageOp::linearCombination(wAccSum, wAcc[threadnum], 1.0, 1.0, wAccSum);
 		}
 
+		// In memory, the sums of all micrographs are kept in double precision
+
+		if (inMemory)
+		{
+			if (!accUsed[og])
+			{
+				xyAccs[og] = Image<dComplex>(sh[og],s[og]);
+				xyAccs[og].data.initZeros();
+
+				wAccs[og] = Image<double>(sh[og],s[og]);
+				wAccs[og].data.initZeros();
+
+				accUsed[og] = true;
+			}
+
+			for (long i = 0; i < xyAccSum.data.nzyxdim; i++)
+			{
+				xyAccs[og].data.data[i].real += xyAccSum.data.data[i].real;
+				xyAccs[og].data.data[i].imag += xyAccSum.data.data[i].imag;
+				wAccs[og].data.data[i] += wAccSum.data.data[i];
+			}
+
+			continue;
+		}
+
 		// Write out the intermediate results for this micrograph:
 
 		std::string outRoot = CtfRefiner::getOutputFilenameRoot(mdt, outPath);
@@ -197,7 +228,18 @@ void TiltEstimator::parametricFit(
 		xyAccSum.data.initZeros();
 		wAccSum.data.initZeros();
 
-		for (long g = 0; g < gc; g++)
+		if (inMemory && accUsed[og])
+		{
+			for (long i = 0; i < xyAccSum.data.nzyxdim; i++)
+			{
+				xyAccSum.data.data[i] = Complex(xyAccs[og].data.data[i].real, xyAccs[og].data.data[i].imag);
+				wAccSum.data.data[i] = wAccs[og].data.data[i];
+			}
+
+			groupUsed[og] = true;
+		}
+
+		for (long g = 0; g < gc && !inMemory; g++)
 		{
 			std::string outRoot = CtfRefiner::getOutputFilenameRoot(mdts[g], outPath);
 
@@ -384,6 +426,12 @@ bool TiltEstimator::isFinished(const MetaDataTable &mdt)
 		REPORT_ERROR("ERROR: TiltEstimator::isFinished: TiltEstimator not initialized.");
 	}
 
+	// the in-memory sums are lost when the program ends
+	if (inMemory)
+	{
+		return false;
+	}
+
 	std::string outRoot = CtfRefiner::getOutputFilenameRoot(mdt, outPath);
 
 	bool allDone = true;
@@ -407,3 +455,60 @@ bool TiltEstimator::isFinished(const MetaDataTable &mdt)
 
 	return allDone;
 }
+
+void TiltEstimator::packAccumulators(std::vector<double>& data)
+{
+	for (int og = 0; og < xyAccs.size(); og++)
+	{
+		const long n = sh[og] * s[og];
+
+		data.push_back(accUsed[og]? 1.0 : 0.0);
+
+		if (accUsed[og])
+		{
+			const dComplex* xy = xyAccs[og].data.data;
+			const double* w = wAccs[og].data.data;
+
+			for (long i = 0; i < n; i++)
+			{
+				data.push_back(xy[i].real);
+				data.push_back(xy[i].imag);
+			}
+
+			data.insert(data.end(), w, w + n);
+		}
+		else
+		{
+			data.resize(data.size() + 3 * n, 0.0);
+		}
+	}
+}
+
+void TiltEstimator::unpackAccumulators(const std::vector<double>& data, long& offset)
+{
+	for (int og = 0; og < xyAccs.size(); og++)
+	{
+		const long n = sh[og] * s[og];
+
+		accUsed[og] = data[offset] > 0.0;
+
+		offset++;
+
+		if (accUsed[og])
+		{
+			xyAccs[og] = Image<dComplex>(sh[og],s[og]);
+			wAccs[og] = Image<double>(sh[og],s[og]);
+
+			dComplex* xy = xyAccs[og].data.data;
+
+			for (long i = 0; i < n; i++)
+			{
+				xy[i] = dComplex(data[offset + 2*i], data[offset + 2*i + 1]);
+			}
+
+			std::copy(&data[offset + 2*n], &data[offset + 2*n] + n, wAccs[og].data.data);
+		}
+
+		offset += 3 * n;
+	}
+}
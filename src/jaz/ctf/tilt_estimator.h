@@ -39,7 +39,8 @@ class TiltEstimator
 		void init(
 				int verb, int nr_omp_threads,
 				bool debug, bool diag, std::string outPath,
-				ReferenceMap* reference, ObservationModel* obsModel);
+				ReferenceMap* reference, ObservationModel* obsModel,
+				bool inMemory = false);
 
 		// Compute per-pixel information for one micrograph
 		void processMicrograph(
@@ -57,6 +58,11 @@ class TiltEstimator
 		// Has this mdt been processed already?
 		bool isFinished(const MetaDataTable& mdt);
 
+		// Append the in-memory sums of all optics groups to data (e.g. to reduce them over MPI),
+		// or replace them by the sums found in data, starting at offset
+		void packAccumulators(std::vector<double>& data);
+		void unpackAccumulators(const std::vector<double>& data, long& offset);
+
 
 	private:
 
@@ -67,15 +73,19 @@ class TiltEstimator
 
 		// parameters obtained through init()
 		int verb, nr_omp_threads;
-		bool debug, diag, ready;
+		bool debug, diag, ready, inMemory;
 		std::string outPath;
 
+		// if inMemory: per-pixel sums over all micrographs, per optics group, in double precision
+		std::vector<Image<dComplex>> xyAccs;
+		std::vector<Image<double>> wAccs;
+		std::vector<bool> accUsed;
+
 		std::vector<int> s, sh;
 		std::vector<double> angpix;
 
 		ReferenceMap* reference;
 		ObservationModel* obsModel;
-
 };
 
 #endif
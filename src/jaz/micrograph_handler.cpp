@@ -412,7 +412,26 @@ std::vector<std::vector<Image<Complex>>> MicrographHandler::loadMovie(
 	FileName fn_pre, fn_jobnr, fn_post;
 	decomposePipelineFileName(mgFn0, fn_pre, fn_jobnr, fn_post);
 
-	if (hasCorrMic)
+	// The tiles are large enough to extract squares that are shifted by up to tileCache.margin
+	const int tileSize = 2*(int)(0.5 * s * angpix / movie_angpix + 0.5) + 2 * tileCache.margin;
+
+	MovieTiles tiles;
+
+	const bool fromCache = hasCorrMic
+		&& tileCache.load(fn_post, tiles)
+		&& StackHelper::extractMovieStackFS(&mdt, tiles, angpix, coords_angpix, movie_angpix, data_angpix,
+		                                    s, nr_omp_threads, movie, offsets_in, offsets_out);
+
+	if (fromCache)
+	{
+		micrograph = Micrograph(getMetaName(fn_post));
+
+		if (debug)
+		{
+			std::cout << "loading: " << fn_post << " from the movie cache\n";
+		}
+	}
+	else if (hasCorrMic)
 	{
 		std::string metaFn = getMetaName(fn_post);
 		micrograph = Micrograph(metaFn);
@@ -464,10 +483,25 @@ std::vector<std::vector<Image<Complex>>> MicrographHandler::loadMovie(
 		{
 #define OLD_CODE
 #ifdef OLD_CODE
-			movie = StackHelper::extractMovieStackFS(&mdt, mgHasGain? &lastGainRef : 0, hasDefect ? &defectMask : 0,
-			                                         mgFn, angpix, coords_angpix, movie_angpix, data_angpix, s,
-			                                         nr_omp_threads, true, firstFrame, lastFrame,
-			                                         hotCutoff, debug, saveMem, offsets_in, offsets_out);
+			if (tileCache.isEnabled())
+			{
+				tiles = StackHelper::extractMovieTiles(&mdt, mgHasGain? &lastGainRef : 0, hasDefect ? &defectMask : 0,
+				                                       mgFn, coords_angpix, movie_angpix, tileSize,
+				                                       nr_omp_threads, firstFrame, lastFrame,
+				                                       hotCutoff, saveMem);
+				tileCache.store(fn_post, tiles);
+			}
+
+			// Squares shifted further than the margin still have to be cut out of the movie itself
+			if (!tileCache.isEnabled()
+			    || !StackHelper::extractMovieStackFS(&mdt, tiles, angpix, coords_angpix, movie_angpix, data_angpix,
+			                                         s, nr_omp_threads, movie, offsets_in, offsets_out))
+			{
+				movie = StackHelper::extractMovieStackFS(&mdt, mgHasGain? &lastGainRef : 0, hasDefect ? &defectMask : 0,
+				                                         mgFn, angpix, coords_angpix, movie_angpix, data_angpix, s,
+				                                         nr_omp_threads, true, firstFrame, lastFrame,
+				                                         hotCutoff, debug, saveMem, offsets_in, offsets_out);
+			}
 #else
 			// TODO: Implement gain and defect correction, and remove the old code path
 			std::cout << "New code path" << std::endl;
@@ -625,9 +659,21 @@ std::vector<std::vector<Image<Complex>>> MicrographHandler::loadMovie(
 #endif
 			}
 
-			movie = StackHelper::extractMovieStackFS(&mdt, Iframes, angpix, coords_angpix, movie_angpix, data_angpix, s,
-			                                         nr_omp_threads, true,
-			                                         debug, offsets_in, offsets_out);
+			if (tileCache.isEnabled())
+			{
+				tiles = StackHelper::extractMovieTiles(&mdt, Iframes, coords_angpix, movie_angpix,
+				                                       tileSize, nr_omp_threads);
+				tileCache.store(fn_post, tiles);
+			}
+
+			if (!tileCache.isEnabled()
+			    || !StackHelper::extractMovieStackFS(&mdt, tiles, angpix, coords_angpix, movie_angpix, data_angpix,
+			                                         s, nr_omp_threads, movie, offsets_in, offsets_out))
+			{
+				movie = StackHelper::extractMovieStackFS(&mdt, Iframes, angpix, coords_angpix, movie_angpix, data_angpix, s,
+				                                         nr_omp_threads, true,
+				                                         debug, offsets_in, offsets_out);
+			}
 		}
 	}
 	else
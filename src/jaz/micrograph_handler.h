@@ -26,6 +26,7 @@
 
 #include <src/jaz/gravis/t2Vector.h>
 #include <src/jaz/parallel_ft.h>
+#include <src/jaz/movie_tile_cache.h>
 
 #include <src/micrograph_model.h>
 #include <src/image.h>
@@ -47,6 +48,9 @@ class MicrographHandler
 
 	gravis::t2Vector<int> micrograph_size;
 
+	// squares around the particles of the movies loaded so far, if enabled
+	MovieTileCache tileCache;
+
 
 	// initialise corrected/uncorrected micrograph dictionary, then
 	// load first movie (or read corrected_micrographs.star) to obtain:
@@ -34,7 +34,8 @@ GpMotionFit::GpMotionFit(
     int maxDims,
     const std::vector<d2Vector>& positions,
     const std::vector<d2Vector>& perFrameOffsets,
-    int threads, bool expKer)
+    int threads, bool expKer,
+    double edAccuracy)
 :
     expKer(expKer),
     pc(correlation.size()),
@@ -63,10 +64,11 @@ GpMotionFit::GpMotionFit(
         A(j,i) = k;
     }
 
-    Matrix2D<RFLOAT> U, Vt;
+    Matrix2D<RFLOAT> V;
     Matrix1D<RFLOAT> S;
 
-    SvdHelper::decompose(A, U, S, Vt);
+    // A is symmetric and positive semi-definite, so its SVD is its eigendecomposition
+    SvdHelper::decomposeSymmetric(A, S, V);
 
 	dc = (maxDims < 0 || maxDims > pc)? pc : maxDims;
 	
@@ -81,6 +83,31 @@ GpMotionFit::GpMotionFit(
 			break;
 		}
 	}
+	
+	// keep only as many eigendeformations as are needed to
+	// represent the given fraction of the total variance
+	if (edAccuracy > 0.0 && edAccuracy < 1.0)
+	{
+		double totalVar = 0.0;
+		
+		for (int d = 0; d < pc; d++)
+		{
+			totalVar += S(d);
+		}
+		
+		double var = 0.0;
+		
+		for (int d = 0; d < dc; d++)
+		{
+			var += S(d);
+			
+			if (var >= edAccuracy * totalVar)
+			{
+				dc = d + 1;
+				break;
+			}
+		}
+	}
 
     basis = Matrix2D<RFLOAT>(pc,dc);
 
@@ -90,7 +117,7 @@ GpMotionFit::GpMotionFit(
 
         for (int p = 0; p < pc; p++)
         {
-            basis(p,d) = l * Vt(p,d);
+            basis(p,d) = l * V(p,d);
         }
     }
 
@@ -100,6 +127,14 @@ GpMotionFit::GpMotionFit(
     {
         eigenVals[d] = S(d);
     }
+
+    basisT = std::vector<double>(dc*pc);
+
+    for (int d = 0; d < dc; d++)
+    for (int p = 0; p < pc; p++)
+    {
+        basisT[d*pc + p] = basis(p,d);
+    }
 }
 
 
@@ -179,7 +214,7 @@ double GpMotionFit::f(const std::vector<double> &x, void* tempStorage) const
 
     TempStorage* ts = (TempStorage*) tempStorage;
 
-    paramsToPos(x, ts->pos);
+    paramsToPos(x, ts);
 
     for (int t = 0; t < threads; t++)
     {
@@ -194,8 +229,8 @@ double GpMotionFit::f(const std::vector<double> &x, void* tempStorage) const
         for (int f = 0; f < fc; f++)
         {
 			const double epf = Interpolation::cubicXY(correlation[p][f],
-                    cc_pad * (ts->pos[p][f].x + perFrameOffsets[f].x),
-                    cc_pad * (ts->pos[p][f].y + perFrameOffsets[f].y), 
+                    cc_pad * (ts->posX[f*pc + p] + perFrameOffsets[f].x),
+                    cc_pad * (ts->posY[f*pc + p] + perFrameOffsets[f].y),
 					0, 0, true);
 			
 			ts->e_t[ts->pad*t] -= epf;
@@ -361,7 +396,11 @@ void GpMotionFit::grad(const std::vector<double> &x,
 
     TempStorage* ts = (TempStorage*) tempStorage;
 
-    paramsToPos(x, ts->pos);
+    // LBFGS evaluates f right before grad at the same point
+    if (ts->lastX != x)
+    {
+        paramsToPos(x, ts);
+    }
 
     #pragma omp parallel for num_threads(threads)
     for (int p = 0; p < pc; p++)
@@ -370,11 +409,12 @@ void GpMotionFit::grad(const std::vector<double> &x,
         {
             d2Vector vr = Interpolation::cubicXYgrad(
                 correlation[p][f],
-                cc_pad * (ts->pos[p][f].x + perFrameOffsets[f].x),
-                cc_pad * (ts->pos[p][f].y + perFrameOffsets[f].y),
+                cc_pad * (ts->posX[f*pc + p] + perFrameOffsets[f].x),
+                cc_pad * (ts->posY[f*pc + p] + perFrameOffsets[f].y),
                 0, 0, true);
 
-            ts->ccg_pf[p][f] = d2Vector(vr.x, vr.y);
+            ts->ccgX[f*pc + p] = vr.x;
+            ts->ccgY[f*pc + p] = vr.y;
         }
     }
 
@@ -391,27 +431,64 @@ void GpMotionFit::grad(const std::vector<double> &x,
     {
         int t = omp_get_thread_num();
 
-        ts->gradDestT[t][2*p  ] -= ts->ccg_pf[p][f].x;
-        ts->gradDestT[t][2*p+1] -= ts->ccg_pf[p][f].y;
+        ts->gradDestT[t][2*p  ] -= ts->ccgX[f*pc + p];
+        ts->gradDestT[t][2*p+1] -= ts->ccgY[f*pc + p];
     }
 
+    // The velocity in frame f moves the particle in all later frames, so the
+    // coefficients of frame f see the sum of the gradients of all later frames.
+    // These sums replace the gradients of the frames in ccgX/Y.
     #pragma omp parallel for num_threads(threads)
-    for (int d = 0; d < dc; d++)
     for (int p = 0; p < pc; p++)
     {
-        int t = omp_get_thread_num();
-
         d2Vector g(0.0, 0.0);
 
-        const double bpd = basis(p,d);
+        for (int f = fc-1; f >= 0; f--)
+        {
+            const d2Vector gf(ts->ccgX[f*pc + p], ts->ccgY[f*pc + p]);
 
-        for (int f = fc-2; f >= 0; f--)
+            ts->ccgX[f*pc + p] = g.x;
+            ts->ccgY[f*pc + p] = g.y;
+
+            g += gf;
+        }
+    }
+
+    #pragma omp parallel for num_threads(threads)
+    for (int d = 0; d < dc; d++)
+    {
+        int t = omp_get_thread_num();
+
+        const double* bd = &basisT[d*pc];
+
+        for (int f = 0; f < fc-1; f++)
         {
-            g.x += bpd * ts->ccg_pf[p][f+1].x;
-            g.y += bpd * ts->ccg_pf[p][f+1].y;
+            const double* gx = &ts->ccgX[f*pc];
+            const double* gy = &ts->ccgY[f*pc];
+
+            // four partial sums, so that the loop can be vectorised
+            double sx[4] = {0.0, 0.0, 0.0, 0.0};
+            double sy[4] = {0.0, 0.0, 0.0, 0.0};
+
+            int p = 0;
+
+            for (; p + 4 <= pc; p += 4)
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    sx[i] += bd[p+i] * gx[p+i];
+                    sy[i] += bd[p+i] * gy[p+i];
+                }
+            }
 
-            ts->gradDestT[t][2*(pc + dc*f + d)  ] -= g.x;
-            ts->gradDestT[t][2*(pc + dc*f + d)+1] -= g.y;
+            for (; p < pc; p++)
+            {
+                sx[0] += bd[p] * gx[p];
+                sy[0] += bd[p] * gy[p];
+            }
+
+            ts->gradDestT[t][2*(pc + dc*f + d)  ] -= (sx[0] + sx[1]) + (sx[2] + sx[3]);
+            ts->gradDestT[t][2*(pc + dc*f + d)+1] -= (sy[0] + sy[1]) + (sy[2] + sy[3]);
         }
     }
 
@@ -443,8 +520,6 @@ void GpMotionFit::grad(const std::vector<double> &x,
             const double dcx = cx1 - cx0;
             const double dcy = cy1 - cy0;
 
-            //e_tot += eigenVals[d]*(dcx*dcx + dcy*dcy) / (sig_acc_px*sig_acc_px);
-
             ts->gradDestT[t][2*(pc + dc*f + d)  ] -= 2.0 * eigenVals[d] * dcx / sa2;
             ts->gradDestT[t][2*(pc + dc*f + d)+1] -= 2.0 * eigenVals[d] * dcy / sa2;
             ts->gradDestT[t][2*(pc + dc*(f+1) + d)  ] += 2.0 * eigenVals[d] * dcx / sa2;
@@ -472,8 +547,10 @@ void *GpMotionFit::allocateTempStorage() const
     const int parCt = 2*(pc + dc*(fc-1));
 
     ts->pad = pad;
-    ts->pos = std::vector<std::vector<d2Vector>>(pc, std::vector<d2Vector>(fc + pad));
-    ts->ccg_pf = std::vector<std::vector<d2Vector>>(pc, std::vector<d2Vector>(fc + pad));
+    ts->posX = std::vector<double>(fc*pc);
+    ts->posY = std::vector<double>(fc*pc);
+    ts->ccgX = std::vector<double>(fc*pc);
+    ts->ccgY = std::vector<double>(fc*pc);
     ts->gradDestT = std::vector<std::vector<double>>(threads, std::vector<double>(parCt + pad, 0.0));
     ts->e_t = std::vector<double>(pad*threads, 0.0);
 
@@ -517,6 +594,139 @@ void GpMotionFit::paramsToPos(
     }
 }
 
+void GpMotionFit::paramsToPos(
+    const std::vector<double>& x,
+    TempStorage* ts) const
+{
+    // blocks of particles, so that the rows of the basis stay in the cache
+    const int block = 128;
+    const int bc = (pc + block - 1) / block;
+
+    #pragma omp parallel for num_threads(threads)
+    for (int b = 0; b < bc; b++)
+    {
+        const int p0 = b * block;
+        const int p1 = p0 + block < pc? p0 + block : pc;
+
+        for (int p = p0; p < p1; p++)
+        {
+            ts->posX[p] = x[2*p];
+            ts->posY[p] = x[2*p+1];
+        }
+
+        for (int f = 0; f < fc-1; f++)
+        {
+            // the velocities are summed up in the positions of the next frame
+            double* vx = &ts->posX[(f+1)*pc];
+            double* vy = &ts->posY[(f+1)*pc];
+
+            for (int p = p0; p < p1; p++)
+            {
+                vx[p] = 0.0;
+                vy[p] = 0.0;
+            }
+
+            for (int d = 0; d < dc; d++)
+            {
+                const double cx = x[2*(pc + dc*f + d)    ];
+                const double cy = x[2*(pc + dc*f + d) + 1];
+                const double* bd = &basisT[d*pc];
+
+                for (int p = p0; p < p1; p++)
+                {
+                    vx[p] += cx * bd[p];
+                    vy[p] += cy * bd[p];
+                }
+            }
+
+            const double* px = &ts->posX[f*pc];
+            const double* py = &ts->posY[f*pc];
+
+            for (int p = p0; p < p1; p++)
+            {
+                vx[p] += px[p];
+                vy[p] += py[p];
+            }
+        }
+    }
+
+    ts->lastX = x;
+}
+
+int GpMotionFit::getDimensionCount() const
+{
+    return dc;
+}
+
+std::vector<double> GpMotionFit::getParamScales(const std::vector<double>& x) const
+{
+    std::vector<std::vector<d2Vector>> pos(pc, std::vector<d2Vector>(fc));
+    paramsToPos(x, pos);
+
+    // mean curvature of the negative cross-correlation, from finite differences of its gradient
+    const double h = 0.5;
+    const int pad = 512;
+    std::vector<double> k_t(pad*threads, 0.0);
+
+    #pragma omp parallel for num_threads(threads)
+    for (int p = 0; p < pc; p++)
+    {
+        int t = omp_get_thread_num();
+
+        for (int f = 0; f < fc; f++)
+        {
+            const double x0 = cc_pad * (pos[p][f].x + perFrameOffsets[f].x);
+            const double y0 = cc_pad * (pos[p][f].y + perFrameOffsets[f].y);
+
+            const d2Vector gx0 = Interpolation::cubicXYgrad(correlation[p][f], x0 - cc_pad * h, y0, 0, 0, true);
+            const d2Vector gx1 = Interpolation::cubicXYgrad(correlation[p][f], x0 + cc_pad * h, y0, 0, 0, true);
+            const d2Vector gy0 = Interpolation::cubicXYgrad(correlation[p][f], x0, y0 - cc_pad * h, 0, 0, true);
+            const d2Vector gy1 = Interpolation::cubicXYgrad(correlation[p][f], x0, y0 + cc_pad * h, 0, 0, true);
+
+            k_t[pad*t] -= (gx1.x - gx0.x + gy1.y - gy0.y) / (2.0 * h);
+        }
+    }
+
+    double kappa = 0.0;
+
+    for (int t = 0; t < threads; t++)
+    {
+        kappa += k_t[pad*t];
+    }
+
+    kappa /= 2.0 * pc * fc;
+
+    std::vector<double> scales(2*(pc + dc*(fc-1)), 1.0);
+
+    // no usable curvature: leave the problem unscaled
+    if (!(kappa > 0.0)) return scales;
+
+    for (int p = 0; p < pc; p++)
+    {
+        scales[2*p  ] = 1.0 / sqrt(kappa * fc);
+        scales[2*p+1] = 1.0 / sqrt(kappa * fc);
+    }
+
+    const double sa2 = sig_acc_px * sig_acc_px;
+
+    for (int f = 0; f < fc-1; f++)
+    for (int d = 0; d < dc; d++)
+    {
+        // the velocity in frame f moves the particles in all fc-1-f later frames
+        double hess = 2.0 + kappa * eigenVals[d] * (fc - 1 - f);
+
+        if (sig_acc_px > 0.0)
+        {
+            hess += 4.0 * eigenVals[d] / sa2;
+        }
+
+        scales[2*(pc + dc*f + d)  ] = 1.0 / sqrt(hess);
+        scales[2*(pc + dc*f + d)+1] = 1.0 / sqrt(hess);
+    }
+
+    return scales;
+}
+
 void GpMotionFit::posToParams(
     const std::vector<std::vector<d2Vector>>& pos,
     std::vector<double>& x) const
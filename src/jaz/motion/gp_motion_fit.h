@@ -37,7 +37,8 @@ class GpMotionFit : public DifferentiableOptimization
                 int maxDims,
                 const std::vector<gravis::d2Vector>& positions,
                 const std::vector<gravis::d2Vector>& perFrameOffsets,
-                int threads, bool expKer);
+                int threads, bool expKer,
+                double edAccuracy = -1.0);
 
         double f(const std::vector<double>& x) const;
         double f(const std::vector<double>& x, void* tempStorage) const;
@@ -54,13 +55,27 @@ class GpMotionFit : public DifferentiableOptimization
         void posToParams(const std::vector<std::vector<gravis::d2Vector>>& pos,
                          std::vector<double>& x) const;
 
+        // number of eigendeformations kept
+        int getDimensionCount() const;
+
+        /* Approximate inverse square roots of the diagonal of the Hessian at x, for
+           use as a diagonal preconditioner (see ScaledOptimization). The curvature of
+           the cost grows with the eigenvalue of an eigendeformation and with the number
+           of frames it moves, so it varies by orders of magnitude between the parameters.*/
+        std::vector<double> getParamScales(const std::vector<double>& x) const;
+
+        /* The versions of f and grad that take temp storage (i.e. those called by LBFGS)
+           keep the positions and the gradients of the correlation in structure-of-arrays
+           form, indexed [f*pc + p], so that the sums over the eigendeformations run over
+           contiguous memory. The positions computed by f are reused by grad.*/
         class TempStorage
         {
             public:
 
                 int pad;
 
-                std::vector<std::vector<gravis::d2Vector>> pos, ccg_pf;
+                std::vector<double> posX, posY, ccgX, ccgY;
+                std::vector<double> lastX;
                 std::vector<std::vector<double>> gradDestT;
                 std::vector<double> e_t;
         };
@@ -74,6 +89,11 @@ class GpMotionFit : public DifferentiableOptimization
         Matrix2D<RFLOAT> basis;
         std::vector<double> eigenVals;
 
+        // the basis transposed, indexed [d*pc + p]
+        std::vector<double> basisT;
+
+        void paramsToPos(const std::vector<double>& x, TempStorage* ts) const;
+
         const std::vector<std::vector<Image<double>>>& correlation;
         const std::vector<gravis::d2Vector>& positions;
         const std::vector<gravis::d2Vector>& perFrameOffsets;
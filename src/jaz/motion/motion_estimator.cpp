@@ -78,6 +78,8 @@ void MotionEstimator::read(IOParser& parser, int argc, char *argv[])
 	global_init = parser.checkOption("--gi", "Initialize with global trajectories instead of loading them from metadata file");
 	expKer = !parser.checkOption("--sq_exp_ker", "Use a square-exponential kernel instead of an exponential one");
 	maxEDs = textToInteger(parser.getOption("--max_ed", "Maximum number of eigendeformations", "-1"));
+	edAccuracy = textToDouble(parser.getOption("--ed_accuracy", "Only keep the eigendeformations that make up this fraction of the variance of the motion model (e.g. 0.99; negative means all)", "-1"));
+	fastFit = parser.checkOption("--fast_fit", "Precondition the optimization of the motion model (converges in far fewer iterations)");
 
 	cutoffOut = parser.checkOption("--out_cut", "Do not consider frequencies beyond the 0.143-FSC threshold for alignment");
 
@@ -196,7 +198,7 @@ void MotionEstimator::process(const std::vector<MetaDataTable>& mdts, long g_sta
 	if (verb > 0)
 	{
 		std::cout << " + Performing loop over micrographs ... " << std::endl;
-		if (!debug) init_progress_bar(my_nr_micrographs);
+		if (!debug && verb == 1) init_progress_bar(my_nr_micrographs);
 	}
 
 	std::vector<ParFourierTransformer> fts(nr_omp_threads);
@@ -312,20 +314,30 @@ void MotionEstimator::process(const std::vector<MetaDataTable>& mdts, long g_sta
 
 		std::vector<std::vector<gravis::d2Vector>> tracks;
 
+		std::string fn_root = MotionRefiner::getOutputFileNameRoot(outPath, mdts[g]);
+
 		if (pc > 1)
 		{
+			int iterations;
+			const double t0 = omp_get_wtime();
+
 			tracks = optimize(
 				movieCC, initialTracks,
 				sig_vel_px, sig_acc_px, sig_div_px,
-				positions, globComp);
+				positions, globComp, &iterations);
+
+			if (verb > 1)
+			{
+				std::cout << "    " << fn_root << ": " << pc << " particles, "
+				          << iterations << " iterations, "
+				          << (omp_get_wtime() - t0) << " sec" << std::endl;
+			}
 		}
 		else
 		{
 			tracks = initialTracks;
 		}
 
-		std::string fn_root = MotionRefiner::getOutputFileNameRoot(outPath, mdts[g]);
-
 		bool hasNaNs = false;
 
 		// find NaNs:
@@ -359,13 +371,13 @@ void MotionEstimator::process(const std::vector<MetaDataTable>& mdts, long g_sta
 
 		nr_done++;
 
-		if (!debug && verb > 0 && nr_done % barstep == 0)
+		if (!debug && verb == 1 && nr_done % barstep == 0)
 		{
 			progress_bar(nr_done);
 		}
 	}
 
-	if (!debug && verb > 0)
+	if (!debug && verb == 1)
 	{
 		progress_bar(my_nr_micrographs);
 	}
@@ -497,8 +509,11 @@ std::vector<std::vector<d2Vector>> MotionEstimator::optimize(
 		const std::vector<std::vector<gravis::d2Vector>>& inTracks,
 		double sig_vel_px, double sig_acc_px, double sig_div_px,
 		const std::vector<gravis::d2Vector>& positions,
-		const std::vector<gravis::d2Vector>& globComp) const
+		const std::vector<gravis::d2Vector>& globComp,
+		int* iterations) const
 {
+	if (iterations != 0) *iterations = 0;
+
 	if (maxIters == 0) return inTracks;
 
 	const double eps = 1e-20;
@@ -520,14 +535,26 @@ std::vector<std::vector<d2Vector>> MotionEstimator::optimize(
 	const int fc = inTracks[0].size();
 
 	GpMotionFit gpmf(movieCC, cc_pad, sig_vel_px, sig_div_px, sig_acc_px,
-					 maxEDs, positions, globComp, nr_omp_threads, expKer);
+					 maxEDs, positions, globComp, nr_omp_threads, expKer, edAccuracy);
 
 	std::vector<double> initialCoeffs;
 
 	gpmf.posToParams(inTracks, initialCoeffs);
 
-	std::vector<double> optCoeffs = LBFGS::optimize(
-				initialCoeffs, gpmf, debugOpt, maxIters, optEps);
+	std::vector<double> optCoeffs;
+
+	if (fastFit)
+	{
+		ScaledOptimization scaledGpmf(gpmf, gpmf.getParamScales(initialCoeffs));
+
+		optCoeffs = scaledGpmf.fromScaled(LBFGS::optimize(
+				scaledGpmf.toScaled(initialCoeffs), scaledGpmf, debugOpt, maxIters, optEps, iterations));
+	}
+	else
+	{
+		optCoeffs = LBFGS::optimize(
+				initialCoeffs, gpmf, debugOpt, maxIters, optEps, iterations);
+	}
 
 	std::vector<std::vector<d2Vector>> out(pc, std::vector<d2Vector>(fc));
 	gpmf.paramsToPos(optCoeffs, out);
@@ -546,7 +573,8 @@ std::vector<std::vector<d2Vector>> MotionEstimator::optimize(
 		const std::vector<std::vector<gravis::d2Vector>>& inTracks,
 		double sig_vel_px, double sig_acc_px, double sig_div_px,
 		const std::vector<gravis::d2Vector>& positions,
-		const std::vector<gravis::d2Vector>& globComp) const
+		const std::vector<gravis::d2Vector>& globComp,
+		int* iterations) const
 {
 	const int pc = movieCC.size();
 	const int fc = movieCC[0].size();
@@ -572,7 +600,7 @@ std::vector<std::vector<d2Vector>> MotionEstimator::optimize(
 		}
 	}
 
-	return optimize(CCd, inTracks, sig_vel_px, sig_acc_px, sig_div_px, positions, globComp);
+	return optimize(CCd, inTracks, sig_vel_px, sig_acc_px, sig_div_px, positions, globComp, iterations);
 }
 
 std::vector<Image<RFLOAT>> MotionEstimator::computeDamageWeights(int opticsGroup)
@@ -70,7 +70,8 @@ class MotionEstimator
             const std::vector<std::vector<gravis::d2Vector>>& inTracks,
             double sig_vel_px, double sig_acc_px, double sig_div_px,
             const std::vector<gravis::d2Vector>& positions,
-            const std::vector<gravis::d2Vector>& globComp) const;
+            const std::vector<gravis::d2Vector>& globComp,
+            int* iterations = 0) const;
 
         // syntactic sugar for float-valued CCs
         std::vector<std::vector<gravis::d2Vector>> optimize(
@@ -78,7 +79,8 @@ class MotionEstimator
             const std::vector<std::vector<gravis::d2Vector>>& inTracks,
             double sig_vel_px, double sig_acc_px, double sig_div_px,
             const std::vector<gravis::d2Vector>& positions,
-            const std::vector<gravis::d2Vector>& globComp) const;
+            const std::vector<gravis::d2Vector>& globComp,
+            int* iterations = 0) const;
 
 	std::vector<Image<RFLOAT>> computeDamageWeights(int opticsGroup);
 		
@@ -108,11 +110,11 @@ class MotionEstimator
 
             bool unregGlob, globOff, cutoffOut,
                 diag, expKer, global_init, debugOpt,
-				params_scaled_by_dose;
+				params_scaled_by_dose, fastFit;
 
             double dmga, dmgb, dmgc, dosePerFrame,
                 sig_vel, sig_div, sig_acc, optEps,
-				cc_pad;
+				cc_pad, edAccuracy;
 			
 			std::string paramsFn;
 
@@ -76,6 +76,11 @@ void MotionRefiner::read(int argc, char **argv)
 	maxMG = textToInteger(parser.getOption("--max_MG", "Last micrograph index (default is to process all)", "-1"));
 	
 	micrographHandler.saveMem = parser.checkOption("--sbs", "Load movies slice-by-slice to save memory (slower)");
+	cacheMovies = parser.checkOption("--cache_movies", "Read each movie only once: keep squares around the particles for frame recombination");
+	cacheDir = parser.getOption("--cache_dir", "Write these squares into this (local scratch) directory instead of keeping them in memory", "");
+	cacheMemory = textToDouble(parser.getOption("--cache_mem", "Without --cache_dir, keep at most this many GB of squares in memory per process; further movies are read again. The squares of one movie take 4 bytes (2 with --cache_float16) x frames x (box + 2 x margin)^2 per particle, in movie pixels", "4"));
+	cacheHalfPrecision = parser.checkOption("--cache_float16", "Store these squares as 16-bit floats (half the space, but not bit-identical results)");
+	cacheMargin = textToInteger(parser.getOption("--cache_margin", "Extra movie pixels around these squares, to allow for particle motion", "32"));
 	
 	parser.addSection("Expert options");
 	
@@ -313,6 +318,17 @@ void MotionRefiner::init()
 
 	micrographHandler.validatePixelSize(reference.angpix);
 	
+	// The squares are only worth keeping if they are needed a second time
+	if (cacheMovies && estimateMotion && recombineFrames)
+	{
+		if (cacheDir != "" && !exists(cacheDir))
+		{
+			REPORT_ERROR("The cache directory " + cacheDir + " does not exist.");
+		}
+		
+		micrographHandler.tileCache.init(cacheDir, cacheHalfPrecision, cacheMargin, (size_t)(cacheMemory * 1024. * 1024. * 1024.));
+	}
+	
 	if (estimateMotion || estimateParams)
 	{
 		if (verb > 0) std::cout << " + Initializing motion estimator ..." << std::endl;
@@ -354,8 +370,8 @@ void MotionRefiner::run()
 	}
 	
 	// TODO: TAKANORI: then process all movies, simultaneously estimating tracks and recombining.
-	//                 micrograph handler can cache movie frames to avoid reading movies twice.
-	//                 (if --sbs, don't cache to save memory)
+	//                 (with --cache_movies, the micrograph handler keeps the squares around the
+	//                 particles, so that the movies are not read twice)
 	if (recombineFrames)
 	{
 		double k_out_A = reference.pixToAng(reference.k_out);
@@ -368,6 +384,8 @@ void MotionRefiner::run()
 		frameRecombiner.process(recombMdts, 0, recombMdts.size()-1);
 	}
 	
+	micrographHandler.tileCache.clear();
+	
 	if (generateStar)
 	{
 		combineEPSAndSTARfiles();
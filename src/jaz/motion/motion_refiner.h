@@ -80,6 +80,12 @@ class MotionRefiner
 		
 		bool debug, findShortestMovie;
 		
+		// keep squares around the particles between motion estimation and frame recombination
+		bool cacheMovies, cacheHalfPrecision;
+		std::string cacheDir;
+		double cacheMemory;
+		int cacheMargin;
+		
 		int nr_omp_threads;
 		std::string outPath;
 		
@@ -92,6 +92,8 @@ void MotionRefinerMpi::run()
         frameRecombiner.process(recombMdts, my_first_micrograph, my_last_micrograph);
 	}
 
+	micrographHandler.tileCache.clear();
+
 	MPI_Barrier(MPI_COMM_WORLD);
 
     if (generateStar && node->isLeader())
@@ -0,0 +1,389 @@
+/***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "movie_tile_cache.h"
+#include <src/error.h>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <stdio.h>
+
+using namespace gravis;
+
+MovieTiles::MovieTiles()
+:	size(0)
+{
+}
+
+int MovieTiles::getParticleCount() const
+{
+	return tiles.size();
+}
+
+int MovieTiles::getFrameCount() const
+{
+	return tiles.size() > 0? tiles[0].size() : 0;
+}
+
+bool MovieTiles::contains(int p, int x0, int y0, int sq) const
+{
+	return x0 >= origins[p].x && x0 + sq <= origins[p].x + size
+		&& y0 >= origins[p].y && y0 + sq <= origins[p].y + size;
+}
+
+MovieTileCache::MovieTileCache()
+:	margin(0),
+	enabled(false),
+	halfPrecision(false),
+	directory(""),
+	maxMemory(0),
+	usedMemory(0)
+{
+}
+
+void MovieTileCache::init(std::string directory, bool halfPrecision, int margin, size_t maxMemory)
+{
+	clear();
+
+	enabled = true;
+	this->directory = directory;
+	this->halfPrecision = halfPrecision;
+	this->margin = margin;
+	this->maxMemory = maxMemory;
+
+	if (directory != "" && directory[directory.length()-1] != '/')
+	{
+		this->directory += "/";
+	}
+}
+
+bool MovieTileCache::isEnabled() const
+{
+	return enabled;
+}
+
+bool MovieTileCache::load(std::string movieName, MovieTiles& tiles) const
+{
+	if (!enabled) return false;
+
+	if (directory == "")
+	{
+		std::map<std::string, std::vector<char>>::const_iterator it = inMemory.find(movieName);
+
+		if (it == inMemory.end()) return false;
+
+		return decode(it->second, tiles);
+	}
+	else
+	{
+		std::ifstream ifs(getFilename(movieName).c_str(), std::ios::binary | std::ios::ate);
+
+		if (!ifs) return false;
+
+		std::vector<char> data(ifs.tellg());
+		ifs.seekg(0);
+
+		if (data.size() == 0 || !ifs.read(&data[0], data.size())) return false;
+
+		return decode(data, tiles);
+	}
+}
+
+void MovieTileCache::store(std::string movieName, const MovieTiles& tiles)
+{
+	if (!enabled) return;
+
+	if (directory == "")
+	{
+		std::map<std::string, std::vector<char>>::iterator it = inMemory.find(movieName);
+
+		if (it != inMemory.end())
+		{
+			usedMemory -= it->second.size();
+			inMemory.erase(it);
+		}
+
+		const size_t bytes = getEncodedSize(tiles);
+
+		// the movie will have to be read again
+		if (usedMemory + bytes > maxMemory) return;
+
+		encode(tiles, inMemory[movieName]);
+		usedMemory += bytes;
+	}
+	else
+	{
+		std::vector<char> data;
+		encode(tiles, data);
+
+		const std::string fn = getFilename(movieName);
+		std::ofstream ofs(fn.c_str(), std::ios::binary);
+
+		if (!ofs || !ofs.write(&data[0], data.size()))
+		{
+			REPORT_ERROR("MovieTileCache::store: unable to write " + fn);
+		}
+
+		filesWritten.push_back(fn);
+	}
+}
+
+void MovieTileCache::clear()
+{
+	inMemory.clear();
+	usedMemory = 0;
+
+	for (int i = 0; i < filesWritten.size(); i++)
+	{
+		remove(filesWritten[i].c_str());
+	}
+
+	filesWritten.clear();
+}
+
+std::string MovieTileCache::getFilename(std::string movieName) const
+{
+	for (int i = 0; i < movieName.length(); i++)
+	{
+		if (movieName[i] == '/') movieName[i] = '_';
+	}
+
+	return directory + movieName + ".tiles";
+}
+
+// The data of one movie consists of:
+//   int: particle count, frame count, tile size, bytes per pixel
+//   per particle: int: x and y of the origin, length of the name; the characters of the name
+//   per particle and frame: size x size pixels
+size_t MovieTileCache::getEncodedSize(const MovieTiles& tiles) const
+{
+	const int pc = tiles.getParticleCount();
+	const int fc = tiles.getFrameCount();
+	const int s = tiles.size;
+	const int bpp = halfPrecision? 2 : 4;
+
+	size_t bytes = 4 * sizeof(int);
+
+	for (int p = 0; p < pc; p++)
+	{
+		bytes += 3 * sizeof(int) + tiles.names[p].length();
+	}
+
+	return bytes + (size_t)pc * fc * s * s * bpp;
+}
+
+void MovieTileCache::encode(const MovieTiles& tiles, std::vector<char>& data) const
+{
+	const int pc = tiles.getParticleCount();
+	const int fc = tiles.getFrameCount();
+	const int s = tiles.size;
+	const int bpp = halfPrecision? 2 : 4;
+
+	const size_t bytes = getEncodedSize(tiles);
+	const size_t pixelOffset = bytes - (size_t)pc * fc * s * s * bpp;
+
+	data.resize(bytes);
+
+	char* ptr = &data[0];
+
+	int header[4] = {pc, fc, s, bpp};
+	memcpy(ptr, header, sizeof(header));
+	ptr += sizeof(header);
+
+	for (int p = 0; p < pc; p++)
+	{
+		int particle[3] = {tiles.origins[p].x, tiles.origins[p].y, (int)tiles.names[p].length()};
+		memcpy(ptr, particle, sizeof(particle));
+		ptr += sizeof(particle);
+
+		memcpy(ptr, tiles.names[p].c_str(), tiles.names[p].length());
+		ptr += tiles.names[p].length();
+	}
+
+	for (int p = 0; p < pc; p++)
+	{
+		for (int f = 0; f < fc; f++)
+		{
+			const MultidimArray<float>& tile = tiles.tiles[p][f];
+			char* dest = &data[pixelOffset + ((size_t)p * fc + f) * s * s * bpp];
+
+			if (halfPrecision)
+			{
+				unsigned short* dest16 = (unsigned short*) dest;
+
+				for (long n = 0; n < s * s; n++)
+				{
+					dest16[n] = floatToHalf(tile.data[n]);
+				}
+			}
+			else
+			{
+				memcpy(dest, tile.data, s * s * sizeof(float));
+			}
+		}
+	}
+}
+
+bool MovieTileCache::decode(const std::vector<char>& data, MovieTiles& tiles) const
+{
+	if (data.size() < 4 * sizeof(int)) return false;
+
+	const char* ptr = &data[0];
+	const char* end = ptr + data.size();
+
+	int header[4];
+	memcpy(header, ptr, sizeof(header));
+	ptr += sizeof(header);
+
+	const int pc = header[0];
+	const int fc = header[1];
+	const int s = header[2];
+	const int bpp = header[3];
+
+	tiles.size = s;
+	tiles.names.resize(pc);
+	tiles.origins.resize(pc);
+	tiles.tiles.resize(pc);
+
+	for (int p = 0; p < pc; p++)
+	{
+		int particle[3];
+
+		if (ptr + sizeof(particle) > end) return false;
+
+		memcpy(particle, ptr, sizeof(particle));
+		ptr += sizeof(particle);
+
+		if (ptr + particle[2] > end) return false;
+
+		tiles.origins[p] = t2Vector<int>(particle[0], particle[1]);
+		tiles.names[p] = std::string(ptr, particle[2]);
+		ptr += particle[2];
+	}
+
+	if (ptr + (size_t)pc * fc * s * s * bpp != end) return false;
+
+	const size_t pixelOffset = ptr - &data[0];
+
+	for (int p = 0; p < pc; p++)
+	{
+		tiles.tiles[p].resize(fc);
+
+		for (int f = 0; f < fc; f++)
+		{
+			MultidimArray<float>& tile = tiles.tiles[p][f];
+			tile.resize(s, s);
+
+			const char* src = &data[pixelOffset + ((size_t)p * fc + f) * s * s * bpp];
+
+			if (bpp == 2)
+			{
+				const unsigned short* src16 = (const unsigned short*) src;
+
+				for (long n = 0; n < s * s; n++)
+				{
+					tile.data[n] = halfToFloat(src16[n]);
+				}
+			}
+			else
+			{
+				memcpy(tile.data, src, s * s * sizeof(float));
+			}
+		}
+	}
+
+	return true;
+}
+
+// IEEE 754 half precision, rounding to the nearest even value
+unsigned short MovieTileCache::floatToHalf(float f)
+{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(float));
+
+	const unsigned int sign = (x >> 16) & 0x8000;
+	const int exp8 = (x >> 23) & 0xff;
+	unsigned int mant = x & 0x7fffff;
+
+	// infinity and NaN
+	if (exp8 == 0xff)
+	{
+		return sign | 0x7c00 | (mant != 0? 0x200 : 0);
+	}
+
+	const int exp = exp8 - 127 + 15;
+
+	// too large: infinity
+	if (exp >= 31)
+	{
+		return sign | 0x7c00;
+	}
+
+	// too small for a normal half: subnormal or zero
+	if (exp <= 0)
+	{
+		if (exp < -10) return sign;
+
+		mant |= 0x800000;
+
+		const int shift = 14 - exp;
+		unsigned int h = mant >> shift;
+		const unsigned int rest = mant & ((1u << shift) - 1);
+		const unsigned int halfway = 1u << (shift - 1);
+
+		if (rest > halfway || (rest == halfway && (h & 1))) h++;
+
+		return sign | h;
+	}
+
+	unsigned int h = (exp << 10) | (mant >> 13);
+	const unsigned int rest = mant & 0x1fff;
+
+	// a carry into the exponent is correct, also towards infinity
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+
+	return sign | h;
+}
+
+float MovieTileCache::halfToFloat(unsigned short h)
+{
+	const unsigned int sign = (h & 0x8000) << 16;
+	const int exp = (h >> 10) & 0x1f;
+	const unsigned int mant = h & 0x3ff;
+
+	if (exp == 0)
+	{
+		const float val = ldexpf((float)mant, -24);
+		return sign? -val : val;
+	}
+
+	unsigned int x;
+
+	if (exp == 31)
+	{
+		x = sign | 0x7f800000 | (mant << 13);
+	}
+	else
+	{
+		x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+	}
+
+	float f;
+	memcpy(&f, &x, sizeof(float));
+
+	return f;
+}
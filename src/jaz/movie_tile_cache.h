@@ -0,0 +1,98 @@
+/***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef MOVIE_TILE_CACHE_H
+#define MOVIE_TILE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <src/multidim_array.h>
+#include <src/jaz/gravis/t2Vector.h>
+
+/* Real-space squares around all particles of one movie, cut out of the gain-corrected
+   (and negated) frames. Pixels outside the movie hold the value of the nearest
+   pixel inside it, as when the squares are cut out of the frames directly. */
+class MovieTiles
+{
+	public:
+
+		MovieTiles();
+
+		// edge length of the tiles in movie pixels
+		int size;
+
+		// per particle: name of the image, and position of the first pixel of its tiles in the movie
+		std::vector<std::string> names;
+		std::vector<gravis::t2Vector<int>> origins;
+
+		// per particle, per frame
+		std::vector<std::vector<MultidimArray<float>>> tiles;
+
+		int getParticleCount() const;
+		int getFrameCount() const;
+
+		// does the square of edge length sq starting at (x0,y0) lie inside the tiles of particle p?
+		bool contains(int p, int x0, int y0, int sq) const;
+};
+
+/* Keeps the tiles of all movies that have been loaded once, so that they do not have to
+   be read and gain-corrected again by a later step (e.g. frame recombination after
+   motion estimation). The tiles are kept in RAM, or written to a (local scratch)
+   directory. They can be stored as 16-bit floats to halve the space they take.
+   In RAM, at most maxMemory bytes are kept: the tiles of further movies are not
+   stored, so those movies are read again when they are needed. */
+class MovieTileCache
+{
+	public:
+
+		MovieTileCache();
+
+		// number of extra movie pixels around the squares that are extracted first
+		int margin;
+
+		void init(std::string directory, bool halfPrecision, int margin, size_t maxMemory);
+
+		bool isEnabled() const;
+
+		// tiles can only be used if they belong to the same particles, in the same order
+		bool load(std::string movieName, MovieTiles& tiles) const;
+		void store(std::string movieName, const MovieTiles& tiles);
+
+		// forget all tiles and delete all files that have been written
+		void clear();
+
+		static unsigned short floatToHalf(float f);
+		static float halfToFloat(unsigned short h);
+
+	protected:
+
+		bool enabled, halfPrecision;
+		std::string directory;
+		size_t maxMemory, usedMemory;
+		std::map<std::string, std::vector<char>> inMemory;
+		std::vector<std::string> filesWritten;
+
+		std::string getFilename(std::string movieName) const;
+
+		size_t getEncodedSize(const MovieTiles& tiles) const;
+		void encode(const MovieTiles& tiles, std::vector<char>& data) const;
+		bool decode(const std::vector<char>& data, MovieTiles& tiles) const;
+};
+
+#endif
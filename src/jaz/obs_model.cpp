@@ -36,7 +36,7 @@ using namespace gravis;
 
 void ObservationModel::loadSafely(std::string filename, ObservationModel& obsModel,
                                   MetaDataTable& particlesMdt, std::string tablename,
-                                  int verb, bool do_die_upon_error)
+                                  int verb, bool do_die_upon_error, int nr_threads)
 {
 	MetaDataTable opticsMdt;
 
@@ -44,22 +44,22 @@ void ObservationModel::loadSafely(std::string filename, ObservationModel& obsMod
 
 	if (tablename == "discover")
 	{
-		if (particlesMdt.read(filename, "particles"))
+		if (particlesMdt.read(filename, "particles", false, nr_threads))
 		{
 			mytablename = "particles";
 		}
-		else if (particlesMdt.read(filename, "micrographs"))
+		else if (particlesMdt.read(filename, "micrographs", false, nr_threads))
 		{
 			mytablename = "micrographs";
 		}
-		else if (particlesMdt.read(filename, "movies"))
+		else if (particlesMdt.read(filename, "movies", false, nr_threads))
 		{
 			mytablename = "movies";
 		}
 	}
 	else
 	{
-		particlesMdt.read(filename, tablename);
+		particlesMdt.read(filename, tablename, false, nr_threads);
 		mytablename = tablename;
 	}
 	opticsMdt.read(filename, "optics");
@@ -73,7 +73,7 @@ void ObservationModel::loadSafely(std::string filename, ObservationModel& obsMod
 		}
 
 		MetaDataTable oldMdt;
-		oldMdt.read(filename);
+		oldMdt.read(filename, "", false, nr_threads);
 
 		StarConverter::convert_3p0_particlesTo_3p1(oldMdt, particlesMdt, opticsMdt, mytablename, do_die_upon_error);
 		if (!do_die_upon_error && opticsMdt.numberOfObjects() == 0) return; // return an empty optics table if error was raised
@@ -157,8 +157,10 @@ void ObservationModel::saveNew(
 
 	particlesMdt.setName(tablename);
 	particlesMdt.write(of);
+	of.close();
 
 	std::rename(tmpfilename.c_str(), filename.c_str());
+	MetaDataTable::updateBinaryCache(filename);
 }
 
 void ObservationModel::save(MetaDataTable &particlesMdt, std::string filename, std::string tablename)
@@ -171,8 +173,10 @@ void ObservationModel::save(MetaDataTable &particlesMdt, std::string filename, s
 
 	particlesMdt.setName(tablename);
 	particlesMdt.write(of);
+	of.close();
 
 	std::rename(tmpfilename.c_str(), filename.c_str());
+	MetaDataTable::updateBinaryCache(filename);
 }
 
 ObservationModel::ObservationModel()
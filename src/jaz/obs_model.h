@@ -35,8 +35,10 @@ class ObservationModel
     public:
 		// tablename can be "particles", "micrographs" or "movies".
 		// If tablename is "discover", the function will try to read the data table with all three names (in that order).
+		// The rows of the data table are parsed on nr_threads threads.
 		static void loadSafely(std::string filename, ObservationModel& obsModel,
-		                       MetaDataTable& particlesMdt, std::string tablename = "particles", int verb = 0, bool do_die_upon_error = true);
+		                       MetaDataTable& particlesMdt, std::string tablename = "particles", int verb = 0, bool do_die_upon_error = true,
+		                       int nr_threads = 1);
 
 		static void saveNew(MetaDataTable& particlesMdt, MetaDataTable& opticsMdt,
 		                    std::string filename, std::string _tablename = "particles");
@@ -26,7 +26,7 @@ static pthread_mutex_t lib_lbfgs_mutex = PTHREAD_MUTEX_INITIALIZER;
 std::vector<double> LBFGS::optimize(
     const std::vector<double> &initial,
     const DifferentiableOptimization &opt,
-    bool verbose, int max_iters, double epsilon)
+    bool verbose, int max_iters, double epsilon, int* iterations)
 {
     const int N = initial.size();
 
@@ -78,6 +78,11 @@ std::vector<double> LBFGS::optimize(
 
     lbfgs_free(m_x);
 
+    if (iterations != 0)
+    {
+        *iterations = adapter.iterations;
+    }
+
     opt.deallocateTempStorage(tempStorage);
 
     return out;
@@ -164,7 +169,8 @@ LBFGS::LibLbfgsAdapter::LibLbfgsAdapter(
     verbose(verbose),
     x_vec(n),
     grad_vec(n),
-    tempStorage(tempStorage)
+    tempStorage(tempStorage),
+    iterations(0)
 {    
 }
 
@@ -195,6 +201,8 @@ int LBFGS::LibLbfgsAdapter::progress(
     const lbfgsfloatval_t gnorm, const lbfgsfloatval_t step,
     int n, int k, int ls)
 {
+    iterations = k;
+
     if (verbose)
     {
         std::cout << k << ": " << fx << "\n";
@@ -35,7 +35,8 @@ class LBFGS
             const DifferentiableOptimization& opt,
             bool verbose = false,
             int max_iters = 0,
-            double epsilon = 1e-5);
+            double epsilon = 1e-5,
+            int* iterations = 0); // if given, receives the number of iterations performed
 
         static void test();
 
@@ -75,6 +76,7 @@ class LBFGS
                 bool verbose;
                 std::vector<double> x_vec, grad_vec;
                 void* tempStorage;
+                int iterations;
 
 
                 lbfgsfloatval_t evaluate(
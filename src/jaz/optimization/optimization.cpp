@@ -44,6 +44,86 @@ void RosenbrockBanana::grad(
     gradDest[1] = 2.0 * b * (yy - xx * xx);
 }
 
+ScaledOptimization::ScaledOptimization(
+    const DifferentiableOptimization& opt, const std::vector<double>& scale)
+:   opt(opt),
+    scale(scale)
+{
+}
+
+double ScaledOptimization::f(const std::vector<double> &y, void *tempStorage) const
+{
+    TempStorage* ts = (TempStorage*) tempStorage;
+
+    for (int i = 0; i < y.size(); i++)
+    {
+        ts->x[i] = scale[i] * y[i];
+    }
+
+    return opt.f(ts->x, ts->optStorage);
+}
+
+void ScaledOptimization::grad(
+    const std::vector<double> &y, std::vector<double> &gradDest, void *tempStorage) const
+{
+    TempStorage* ts = (TempStorage*) tempStorage;
+
+    for (int i = 0; i < y.size(); i++)
+    {
+        ts->x[i] = scale[i] * y[i];
+    }
+
+    opt.grad(ts->x, gradDest, ts->optStorage);
+
+    for (int i = 0; i < y.size(); i++)
+    {
+        gradDest[i] *= scale[i];
+    }
+}
+
+void* ScaledOptimization::allocateTempStorage() const
+{
+    TempStorage* ts = new TempStorage;
+
+    ts->optStorage = opt.allocateTempStorage();
+    ts->x = std::vector<double>(scale.size());
+
+    return ts;
+}
+
+void ScaledOptimization::deallocateTempStorage(void *ts) const
+{
+    if (ts == 0) return;
+
+    opt.deallocateTempStorage(((TempStorage*) ts)->optStorage);
+
+    delete (TempStorage*) ts;
+}
+
+std::vector<double> ScaledOptimization::toScaled(const std::vector<double> &x) const
+{
+    std::vector<double> y(x.size());
+
+    for (int i = 0; i < x.size(); i++)
+    {
+        y[i] = x[i] / scale[i];
+    }
+
+    return y;
+}
+
+std::vector<double> ScaledOptimization::fromScaled(const std::vector<double> &y) const
+{
+    std::vector<double> x(y.size());
+
+    for (int i = 0; i < y.size(); i++)
+    {
+        x[i] = scale[i] * y[i];
+    }
+
+    return x;
+}
+
 void DifferentiableOptimization::testGradient(const std::vector<double> &x, double eps)
 {
 	const int n = x.size();	
@@ -44,6 +44,36 @@ class DifferentiableOptimization : public Optimization
 	void testGradient(const std::vector<double>& x, double eps = 1e-9);
 };
 
+/* Optimizes opt over rescaled parameters y = x / scale. With suitable scales (i.e. an
+   approximation of the inverse square root of the diagonal of the Hessian), this acts as
+   a diagonal preconditioner and can greatly reduce the number of iterations needed.*/
+class ScaledOptimization : public DifferentiableOptimization
+{
+    public:
+
+    ScaledOptimization(const DifferentiableOptimization& opt, const std::vector<double>& scale);
+
+    double f(const std::vector<double>& y, void* tempStorage) const;
+    void grad(const std::vector<double>& y, std::vector<double>& gradDest, void* tempStorage) const;
+
+    void* allocateTempStorage() const;
+    void deallocateTempStorage(void* ts) const;
+
+    std::vector<double> toScaled(const std::vector<double>& x) const;
+    std::vector<double> fromScaled(const std::vector<double>& y) const;
+
+    protected:
+
+    const DifferentiableOptimization& opt;
+    std::vector<double> scale;
+
+    struct TempStorage
+    {
+        void* optStorage;
+        std::vector<double> x;
+    };
+};
+
 class RosenbrockBanana : public DifferentiableOptimization
 {
     public:
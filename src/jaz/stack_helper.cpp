@@ -286,6 +286,87 @@ std::vector<std::vector<Image<RFLOAT> > > StackHelper::loadMovieStack(const Meta
 	return out;
 }
 
+// Whether the pixels in the defect mask are replaced in frames read from a movie file
+static bool fixesMovieDefects(MultidimArray<bool>* defectMask)
+{
+	return false; // TAKANORI DEBUG: defectMask != 0;
+}
+
+// Gain-correct a frame read from a movie file, clip hot pixels and replace the pixels in defectMask
+// (if not 0) by neighbouring ones. The sign is inverted, as expected by the particle extraction.
+static void correctMovieFrame(
+		MultidimArray<float>& frame, Image<RFLOAT>* gainRef, MultidimArray<bool>* defectMask,
+		RFLOAT hot, int threads)
+{
+	const int w0 = frame.xdim;
+	const int h0 = frame.ydim;
+	const bool useGain = gainRef != 0;
+
+	#pragma omp parallel for num_threads(threads)
+	for (long int y = 0; y < h0; y++)
+	for (long int x = 0; x < w0; x++)
+	{
+		RFLOAT val = DIRECT_NZYX_ELEM(frame, 0, 0, y, x);
+		RFLOAT gain = 1.0;
+
+		if (useGain) gain = DIRECT_NZYX_ELEM(gainRef->data, 0, 0, y, x);
+		if (hot > 0.0 && val > hot) val = hot;
+
+		DIRECT_NZYX_ELEM(frame, 0, 0, y, x) = -gain * val;
+	}
+
+	if (defectMask != 0)
+	{
+		RFLOAT frame_mean = 0, frame_std = 0;
+		long long n_valid = 0;
+
+		#pragma omp parallel for reduction(+:frame_mean, n_valid) num_threads(threads)
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(frame) {
+			if (!DIRECT_MULTIDIM_ELEM(*defectMask, n)) continue;
+			frame_mean += DIRECT_MULTIDIM_ELEM(frame, n);
+			n_valid ++;
+		}
+		frame_mean /=  n_valid;
+
+		#pragma omp parallel for reduction(+:frame_std) num_threads(threads)
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(frame) {
+			if (!DIRECT_MULTIDIM_ELEM(*defectMask, n)) continue;
+			RFLOAT d = (DIRECT_MULTIDIM_ELEM(frame, n) - frame_mean);
+			frame_std += d * d;
+		}
+		frame_std = std::sqrt(frame_std / n_valid);
+
+		// 25 neighbours; should be enough even for super-resolution images.
+		const int NUM_MIN_OK = 6;
+		const int D_MAX = 2; // EER code path does not use this function
+		const int PBUF_SIZE = 100;	
+		#pragma omp parallel for num_threads(threads)
+		FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(frame)
+		{
+			if (!DIRECT_A2D_ELEM(*defectMask, i, j)) continue;
+
+			int n_ok = 0;
+			RFLOAT pbuf[PBUF_SIZE];
+			for (int dy= -D_MAX; dy <= D_MAX; dy++)
+			{
+				int y = i + dy;
+				if (y < 0 || y >= h0) continue;
+				for (int dx = -D_MAX; dx <= D_MAX; dx++)
+				{
+					int x = j + dx;
+					if (x < 0 || x >= w0) continue;
+					if (DIRECT_A2D_ELEM(*defectMask, y, x)) continue;
+
+					pbuf[n_ok] = DIRECT_A2D_ELEM(frame, y, x);
+					n_ok++;
+				}
+			}
+			if (n_ok > NUM_MIN_OK) DIRECT_A2D_ELEM(frame, i, j) = pbuf[rand() % n_ok];
+			else DIRECT_A2D_ELEM(frame, i, j) = rnd_gaus(frame_mean, frame_std);
+		}
+	}
+}
+
 std::vector<std::vector<Image<Complex>>> StackHelper::extractMovieStackFS(
 		const MetaDataTable* mdt,
 		Image<RFLOAT>* gainRef, MultidimArray<bool>* defectMask, std::string movieFn,
@@ -332,7 +413,7 @@ std::vector<std::vector<Image<Complex>>> StackHelper::extractMovieStackFS(
 		REPORT_ERROR("StackHelper::extractMovieStackFS: incompatible gain reference - size is different from "+movieFn);
 	}
 
-	const bool fixDefect = false; // TAKANORI DEBUG: defectMask != 0;
+	const bool fixDefect = fixesMovieDefects(defectMask);
 	if (fixDefect && (w0 != defectMask->xdim || h0 != defectMask->ydim))
 	{
 		REPORT_ERROR("StackHelper::extractMovieStackFS: incompatible defect mask - size is different from "+movieFn);
@@ -393,69 +474,7 @@ std::vector<std::vector<Image<Complex>>> StackHelper::extractMovieStackFS(
 
 		if (verbose) std::cout << (f+1) << "/" << fc << "\n";
 
-		#pragma omp parallel for num_threads(threads_p)
-		for (long int y = 0; y < h0; y++)
-		for (long int x = 0; x < w0; x++)
-		{
-			RFLOAT val = DIRECT_NZYX_ELEM(muGraph.data, 0, 0, y, x);
-			RFLOAT gain = 1.0;
-
-			if (useGain) gain = DIRECT_NZYX_ELEM(gainRef->data, 0, 0, y, x);
-			if (hot > 0.0 && val > hot) val = hot;
-
-			 DIRECT_NZYX_ELEM(muGraph.data, 0, 0, y, x) = -gain * val;
-		}
-
-		if (fixDefect)
-		{
-			RFLOAT frame_mean = 0, frame_std = 0;
-			long long n_valid = 0;
-
-			#pragma omp parallel for reduction(+:frame_mean, n_valid) num_threads(threads_p)
-			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(muGraph.data) {
-				if (!DIRECT_MULTIDIM_ELEM(*defectMask, n)) continue;
-				frame_mean += DIRECT_MULTIDIM_ELEM(muGraph.data, n);
-				n_valid ++;
-			}
-			frame_mean /=  n_valid;
-
-			#pragma omp parallel for reduction(+:frame_std) num_threads(threads_p)
-			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(muGraph.data) {
-				if (!DIRECT_MULTIDIM_ELEM(*defectMask, n)) continue;
-				RFLOAT d = (DIRECT_MULTIDIM_ELEM(muGraph.data, n) - frame_mean);
-				frame_std += d * d;
-			}
-			frame_std = std::sqrt(frame_std / n_valid);
-
-			// 25 neighbours; should be enough even for super-resolution images.
-			const int NUM_MIN_OK = 6;
-			const int D_MAX = 2; // EER code path does not use this function
-			const int PBUF_SIZE = 100;	
-			#pragma omp parallel for num_threads(threads_p)
-			FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(muGraph.data)
-			{
-				if (!DIRECT_A2D_ELEM(*defectMask, i, j)) continue;
-
-				int n_ok = 0;
-				RFLOAT pbuf[PBUF_SIZE];
-				for (int dy= -D_MAX; dy <= D_MAX; dy++)
-				{
-					int y = i + dy;
-					if (y < 0 || y >= h0) continue;
-					for (int dx = -D_MAX; dx <= D_MAX; dx++)
-					{
-						int x = j + dx;
-						if (x < 0 || x >= w0) continue;
-						if (DIRECT_A2D_ELEM(*defectMask, y, x)) continue;
-
-						pbuf[n_ok] = DIRECT_A2D_ELEM(muGraph.data, y, x);
-						n_ok++;
-					}
-				}
-				if (n_ok > NUM_MIN_OK) DIRECT_A2D_ELEM(muGraph.data, i, j) = pbuf[rand() % n_ok];
-				else DIRECT_A2D_ELEM(muGraph.data, i, j) = rnd_gaus(frame_mean, frame_std);
-			}
-		}
+		correctMovieFrame(muGraph.data, gainRef, fixDefect? defectMask : 0, hot, threads_p);
 
 		// TODO: TAKANORI: Cache muGraph HERE
 
@@ -657,6 +676,294 @@ std::vector<std::vector<Image<Complex>>> StackHelper::extractMovieStackFS(
 
 	return out;
 }
+
+// Tiles are centred on the particle coordinates in the movie
+static MovieTiles initMovieTiles(const MetaDataTable* mdt, double coordsPs, double moviePs, int tileSize, int fc)
+{
+	const long pc = mdt->numberOfObjects();
+
+	MovieTiles tiles;
+	tiles.size = tileSize;
+	tiles.names.resize(pc);
+	tiles.origins.resize(pc);
+	tiles.tiles.resize(pc);
+
+	for (long p = 0; p < pc; p++)
+	{
+		double xpC, ypC;
+
+		mdt->getValue(EMDL_IMAGE_COORD_X, xpC, p);
+		mdt->getValue(EMDL_IMAGE_COORD_Y, ypC, p);
+
+		if (!mdt->getValue(EMDL_IMAGE_NAME, tiles.names[p], p))
+		{
+			tiles.names[p] = "";
+		}
+
+		tiles.origins[p].x = (int)round(coordsPs * xpC / moviePs) - tileSize / 2;
+		tiles.origins[p].y = (int)round(coordsPs * ypC / moviePs) - tileSize / 2;
+
+		tiles.tiles[p].resize(fc);
+
+		for (int f = 0; f < fc; f++)
+		{
+			tiles.tiles[p][f].resize(tileSize, tileSize);
+		}
+	}
+
+	return tiles;
+}
+
+MovieTiles StackHelper::extractMovieTiles(
+		const MetaDataTable* mdt,
+		Image<RFLOAT>* gainRef, MultidimArray<bool>* defectMask, std::string movieFn,
+		double coordsPs, double moviePs,
+		int tileSize, int threads,
+		int firstFrame, int lastFrame,
+		RFLOAT hot, bool saveMemory)
+{
+	Image<float> mgStack;
+	mgStack.read(movieFn, false);
+
+	const bool dataInZ = mgStack.data.zdim > 1;
+
+	const int w0 = mgStack.data.xdim;
+	const int h0 = mgStack.data.ydim;
+	const int fcM = dataInZ? mgStack.data.zdim : mgStack.data.ndim;
+	const int fc = lastFrame > 0? lastFrame - firstFrame + 1 : fcM - firstFrame;
+
+	if (fcM <= lastFrame)
+	{
+		REPORT_ERROR("StackHelper::extractMovieTiles: insufficient number of frames in "+movieFn);
+	}
+
+	const bool useGain = gainRef != 0;
+	if (useGain && (w0 != gainRef->data.xdim || h0 != gainRef->data.ydim))
+	{
+		REPORT_ERROR("StackHelper::extractMovieTiles: incompatible gain reference - size is different from "+movieFn);
+	}
+
+	const bool fixDefect = fixesMovieDefects(defectMask);
+	if (fixDefect && (w0 != defectMask->xdim || h0 != defectMask->ydim))
+	{
+		REPORT_ERROR("StackHelper::extractMovieTiles: incompatible defect mask - size is different from "+movieFn);
+	}
+
+	MovieTiles tiles = initMovieTiles(mdt, coordsPs, moviePs, tileSize, fc);
+	const long pc = tiles.getParticleCount();
+
+	int threads_f = saveMemory? 1 : threads;
+	int threads_p = saveMemory? threads : 1;
+
+	#pragma omp parallel for num_threads(threads_f)
+	for (long f = 0; f < fc; f++)
+	{
+		Image<float> muGraph;
+		muGraph.read(movieFn, true, f+firstFrame, false, true);
+
+		correctMovieFrame(muGraph.data, gainRef, fixDefect? defectMask : 0, hot, threads_p);
+
+		#pragma omp parallel for num_threads(threads_p)
+		for (long p = 0; p < pc; p++)
+		{
+			const int x0 = tiles.origins[p].x;
+			const int y0 = tiles.origins[p].y;
+
+			for (long int y = 0; y < tileSize; y++)
+			for (long int x = 0; x < tileSize; x++)
+			{
+				int xx = x0 + x;
+				int yy = y0 + y;
+
+				if (xx < 0) xx = 0;
+				else if (xx >= w0) xx = w0 - 1;
+
+				if (yy < 0) yy = 0;
+				else if (yy >= h0) yy = h0 - 1;
+
+				DIRECT_A2D_ELEM(tiles.tiles[p][f], y, x) = DIRECT_NZYX_ELEM(muGraph.data, 0, 0, yy, xx);
+			}
+		}
+	}
+
+	return tiles;
+}
+
+MovieTiles StackHelper::extractMovieTiles(
+		const MetaDataTable* mdt, std::vector<MultidimArray<float> > &Iframes,
+		double coordsPs, double moviePs,
+		int tileSize, int threads)
+{
+	const int fc = Iframes.size();
+	if (fc == 0)
+		REPORT_ERROR("Empty Iframes passed to StackHelper::extractMovieTiles");
+	const int w0 = Iframes[0].xdim;
+	const int h0 = Iframes[0].ydim;
+
+	MovieTiles tiles = initMovieTiles(mdt, coordsPs, moviePs, tileSize, fc);
+	const long pc = tiles.getParticleCount();
+
+	#pragma omp parallel for num_threads(threads)
+	for (long f = 0; f < fc; f++)
+	{
+		for (long p = 0; p < pc; p++)
+		{
+			const int x0 = tiles.origins[p].x;
+			const int y0 = tiles.origins[p].y;
+
+			for (long int y = 0; y < tileSize; y++)
+			for (long int x = 0; x < tileSize; x++)
+			{
+				int xx = x0 + x;
+				int yy = y0 + y;
+
+				if (xx < 0) xx = 0;
+				else if (xx >= w0) xx = w0 - 1;
+
+				if (yy < 0) yy = 0;
+				else if (yy >= h0) yy = h0 - 1;
+
+				// Note the MINUS here, as in extractMovieStackFS
+				DIRECT_A2D_ELEM(tiles.tiles[p][f], y, x) = -DIRECT_A2D_ELEM(Iframes[f], yy, xx);
+			}
+		}
+	}
+
+	return tiles;
+}
+
+bool StackHelper::extractMovieStackFS(
+		const MetaDataTable* mdt, const MovieTiles& tiles,
+		double outPs, double coordsPs, double moviePs, double dataPs,
+		int squareSize, int threads,
+		std::vector<std::vector<Image<Complex>>>& out,
+		const std::vector<std::vector<gravis::d2Vector>>* offsets_in,
+		std::vector<std::vector<gravis::d2Vector>>* offsets_out)
+{
+	const long pc = mdt->numberOfObjects();
+	const int fc = tiles.getFrameCount();
+
+	if (tiles.getParticleCount() != pc) return false;
+
+	for (long p = 0; p < pc; p++)
+	{
+		std::string name;
+
+		if (!mdt->getValue(EMDL_IMAGE_NAME, name, p))
+		{
+			name = "";
+		}
+
+		if (name != tiles.names[p]) return false;
+	}
+
+	if (dataPs < 0) dataPs = outPs;
+
+	const int sqMg = 2*(int)(0.5 * squareSize * outPs / moviePs + 0.5);
+
+	// Origins of all squares, as in extractMovieStackFS
+	std::vector<std::vector<gravis::t2Vector<int>>> origins(pc, std::vector<gravis::t2Vector<int>>(fc));
+	std::vector<std::vector<gravis::d2Vector>> remainders(pc, std::vector<gravis::d2Vector>(fc));
+
+	for (long p = 0; p < pc; p++)
+	{
+		double xpC, ypC;
+
+		mdt->getValue(EMDL_IMAGE_COORD_X, xpC, p);
+		mdt->getValue(EMDL_IMAGE_COORD_Y, ypC, p);
+
+		const double xpO = (int)(coordsPs * xpC / dataPs);
+		const double ypO = (int)(coordsPs * ypC / dataPs);
+
+		for (int f = 0; f < fc; f++)
+		{
+			int x0 = (int)round(xpO * dataPs / moviePs) - sqMg / 2;
+			int y0 = (int)round(ypO * dataPs / moviePs) - sqMg / 2;
+
+			if (offsets_in != 0 && offsets_out != 0)
+			{
+				double dxM = (*offsets_in)[p][f].x * outPs / moviePs;
+				double dyM = (*offsets_in)[p][f].y * outPs / moviePs;
+
+				int dxI = (int)round(dxM);
+				int dyI = (int)round(dyM);
+
+				x0 += dxI;
+				y0 += dyI;
+
+				double dxR = (dxM - dxI) * moviePs / outPs;
+				double dyR = (dyM - dyI) * moviePs / outPs;
+
+				remainders[p][f] = d2Vector(dxR, dyR);
+			}
+
+			if (!tiles.contains(p, x0, y0, sqMg)) return false;
+
+			origins[p][f] = gravis::t2Vector<int>(x0, y0);
+		}
+	}
+
+	if (offsets_in != 0 && offsets_out != 0)
+	{
+		for (long p = 0; p < pc; p++)
+		for (int f = 0; f < fc; f++)
+		{
+			(*offsets_out)[p][f] = remainders[p][f];
+		}
+	}
+
+	out = std::vector<std::vector<Image<Complex>>>(pc, std::vector<Image<Complex>>(fc));
+
+	std::vector<ParFourierTransformer> fts(threads);
+
+	std::vector<Image<RFLOAT>> aux0(threads);
+	std::vector<Image<Complex>> aux1(threads);
+
+	for (int t = 0; t < threads; t++)
+	{
+		aux0[t] = Image<RFLOAT>(sqMg, sqMg);
+
+		if (outPs != moviePs)
+		{
+			aux1[t] = Image<Complex>(sqMg/2+1,sqMg);
+		}
+	}
+
+	#pragma omp parallel for num_threads(threads)
+	for (long f = 0; f < fc; f++)
+	{
+		int t = omp_get_thread_num();
+
+		for (long p = 0; p < pc; p++)
+		{
+			out[p][f] = Image<Complex>(sqMg,sqMg);
+
+			const int x0 = origins[p][f].x - tiles.origins[p].x;
+			const int y0 = origins[p][f].y - tiles.origins[p].y;
+
+			for (long int y = 0; y < sqMg; y++)
+			for (long int x = 0; x < sqMg; x++)
+			{
+				DIRECT_NZYX_ELEM(aux0[t].data, 0, 0, y, x) = DIRECT_A2D_ELEM(tiles.tiles[p][f], y0 + y, x0 + x);
+			}
+
+			if (outPs == moviePs)
+			{
+				fts[t].FourierTransform(aux0[t](), out[p][f]());
+			}
+			else
+			{
+				fts[t].FourierTransform(aux0[t](), aux1[t]());
+				out[p][f] = FilterHelper::cropCorner2D(aux1[t], squareSize/2+1, squareSize);
+			}
+
+			out[p][f](0,0) = Complex(0.0,0.0);
+		}
+	}
+
+	return true;
+}
+
 std::vector<Image<Complex> > StackHelper::FourierTransform(std::vector<Image<RFLOAT> >& stack)
 {
 	std::vector<Image<Complex> > out(stack.size());
@@ -28,6 +28,7 @@
 #include <src/jaz/volume.h>
 #include <src/jaz/gravis/t2Matrix.h>
 #include <src/jaz/parallel_ft.h>
+#include <src/jaz/movie_tile_cache.h>
 #include <vector>
 
 class Projector;
@@ -79,6 +80,32 @@ class StackHelper
 				const std::vector<std::vector<gravis::d2Vector>>* offsets_in = 0,
 				std::vector<std::vector<gravis::d2Vector>>* offsets_out = 0);
 
+		// Cut squares of tileSize movie pixels around all particles out of all frames of a movie
+		// in a file, after gain and defect correction, as extractMovieStackFS does
+		static MovieTiles extractMovieTiles(
+				const MetaDataTable* mdt,
+				Image<RFLOAT>* gainRef, MultidimArray<bool>* defectMask, std::string movieFn,
+				double coordsPs, double moviePs,
+				int tileSize, int threads,
+				int firstFrame = 0, int lastFrame = -1,
+				RFLOAT hot = -1.0, bool saveMemory = false);
+
+		// The same for movies in memory
+		static MovieTiles extractMovieTiles(
+				const MetaDataTable* mdt, std::vector<MultidimArray<float> > &mgStack,
+				double coordsPs, double moviePs,
+				int tileSize, int threads);
+
+		// Extract the same particle stacks as extractMovieStackFS, but from tiles cut out before.
+		// Returns false if the tiles belong to other particles, or if a square does not lie inside its tile.
+		static bool extractMovieStackFS(
+				const MetaDataTable* mdt, const MovieTiles& tiles,
+				double outPs, double coordsPs, double moviePs, double dataPs,
+				int squareSize, int threads,
+				std::vector<std::vector<Image<Complex>>>& out,
+				const std::vector<std::vector<gravis::d2Vector>>* offsets_in = 0,
+				std::vector<std::vector<gravis::d2Vector>>* offsets_out = 0);
+
 		static std::vector<Image<Complex>> FourierTransform(std::vector<Image<RFLOAT> >& stack);
 		
 		static std::vector<Image<RFLOAT>> inverseFourierTransform(std::vector<Image<Complex> >& stack);
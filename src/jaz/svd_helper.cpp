@@ -20,6 +20,8 @@
 
 #include <src/jaz/svd_helper.h>
 #include <src/jaz/index_sort.h>
+#include <src/error.h>
+#include <limits>
 
 void SvdHelper::decompose(
         const Matrix2D<RFLOAT>& A,
@@ -65,3 +67,247 @@ void SvdHelper::decompose(
         }
     }
 }
+
+void SvdHelper::decomposeSymmetric(
+        const Matrix2D<RFLOAT>& A,
+        Matrix1D<RFLOAT>& S,
+        Matrix2D<RFLOAT>& V)
+{
+    const int n = A.mdimx;
+
+    if (A.mdimy != n)
+    {
+        REPORT_ERROR("SvdHelper::decomposeSymmetric: matrix is not square");
+    }
+
+    // a is overwritten by the orthogonal transformation, row i of z will hold eigenvector i
+    std::vector<double> a(n*n), d(n), e(n);
+
+    for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+    {
+        a[i*n + j] = A(i,j);
+    }
+
+    // Householder reduction to a tridiagonal matrix (diagonal d, off-diagonal e)
+    for (int i = n-1; i > 0; i--)
+    {
+        const int l = i-1;
+        double h = 0.0;
+
+        if (l > 0)
+        {
+            double scale = 0.0;
+
+            for (int k = 0; k < i; k++)
+            {
+                scale += std::abs(a[i*n + k]);
+            }
+
+            if (scale == 0.0)
+            {
+                e[i] = a[i*n + l];
+            }
+            else
+            {
+                for (int k = 0; k < i; k++)
+                {
+                    a[i*n + k] /= scale;
+                    h += a[i*n + k] * a[i*n + k];
+                }
+
+                double f = a[i*n + l];
+                double g = f >= 0.0? -sqrt(h) : sqrt(h);
+
+                e[i] = scale * g;
+                h -= f * g;
+                a[i*n + l] = f - g;
+                f = 0.0;
+
+                for (int j = 0; j < i; j++)
+                {
+                    a[j*n + i] = a[i*n + j] / h;
+                    g = 0.0;
+
+                    for (int k = 0; k <= j; k++)
+                    {
+                        g += a[j*n + k] * a[i*n + k];
+                    }
+
+                    for (int k = j+1; k < i; k++)
+                    {
+                        g += a[k*n + j] * a[i*n + k];
+                    }
+
+                    e[j] = g / h;
+                    f += e[j] * a[i*n + j];
+                }
+
+                const double hh = f / (h + h);
+
+                for (int j = 0; j < i; j++)
+                {
+                    f = a[i*n + j];
+                    e[j] = g = e[j] - hh * f;
+
+                    for (int k = 0; k <= j; k++)
+                    {
+                        a[j*n + k] -= f * e[k] + g * a[i*n + k];
+                    }
+                }
+            }
+        }
+        else
+        {
+            e[i] = a[i*n + l];
+        }
+
+        d[i] = h;
+    }
+
+    d[0] = 0.0;
+    e[0] = 0.0;
+
+    // accumulate the transformations, transposed
+    std::vector<double> z(n*n);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (d[i] != 0.0)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                double g = 0.0;
+
+                for (int k = 0; k < i; k++)
+                {
+                    g += a[i*n + k] * a[k*n + j];
+                }
+
+                for (int k = 0; k < i; k++)
+                {
+                    a[k*n + j] -= g * a[k*n + i];
+                }
+            }
+        }
+
+        d[i] = a[i*n + i];
+        a[i*n + i] = 1.0;
+
+        for (int j = 0; j < i; j++)
+        {
+            a[j*n + i] = a[i*n + j] = 0.0;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    for (int k = 0; k < n; k++)
+    {
+        z[i*n + k] = a[k*n + i];
+    }
+
+    // implicit QL iterations on the tridiagonal matrix
+    for (int i = 1; i < n; i++)
+    {
+        e[i-1] = e[i];
+    }
+
+    e[n-1] = 0.0;
+
+    const double eps = std::numeric_limits<double>::epsilon();
+
+    for (int l = 0; l < n; l++)
+    {
+        int iter = 0;
+        int m;
+
+        do
+        {
+            for (m = l; m < n-1; m++)
+            {
+                const double dd = std::abs(d[m]) + std::abs(d[m+1]);
+
+                if (std::abs(e[m]) <= eps * dd) break;
+            }
+
+            if (m != l)
+            {
+                if (iter++ == 60)
+                {
+                    REPORT_ERROR("SvdHelper::decomposeSymmetric: too many iterations");
+                }
+
+                double g = (d[l+1] - d[l]) / (2.0 * e[l]);
+                double r = hypot(g, 1.0);
+
+                g = d[m] - d[l] + e[l] / (g + (g >= 0.0? std::abs(r) : -std::abs(r)));
+
+                double s = 1.0, c = 1.0, p = 0.0;
+                int i;
+
+                for (i = m-1; i >= l; i--)
+                {
+                    double f = s * e[i];
+                    const double b = c * e[i];
+
+                    e[i+1] = (r = hypot(f, g));
+
+                    if (r == 0.0)
+                    {
+                        d[i+1] -= p;
+                        e[m] = 0.0;
+                        break;
+                    }
+
+                    s = f / r;
+                    c = g / r;
+                    g = d[i+1] - p;
+                    r = (d[i] - g) * s + 2.0 * c * b;
+                    d[i+1] = g + (p = s * r);
+                    g = c * r - b;
+
+                    double* z0 = &z[i*n];
+                    double* z1 = &z[(i+1)*n];
+
+                    for (int k = 0; k < n; k++)
+                    {
+                        f = z1[k];
+                        z1[k] = s * z0[k] + c * f;
+                        z0[k] = c * z0[k] - s * f;
+                    }
+                }
+
+                if (r == 0.0 && i >= l) continue;
+
+                d[l] -= p;
+                e[l] = g;
+                e[m] = 0.0;
+            }
+        }
+        while (m != l);
+    }
+
+    std::vector<RFLOAT> Svec(n);
+
+    for (int i = 0; i < n; i++)
+    {
+        Svec[i] = d[i];
+    }
+
+    std::vector<int> order = IndexSort<RFLOAT>::sortIndices(Svec);
+
+    S = Matrix1D<RFLOAT>(n);
+    V = Matrix2D<RFLOAT>(n,n);
+
+    for (int i = 0; i < n; i++)
+    {
+        const int j = order[n - i - 1];
+
+        S(i) = d[j];
+
+        for (int c = 0; c < n; c++)
+        {
+            V(c,i) = z[j*n + c];
+        }
+    }
+}
@@ -32,6 +32,15 @@ class SvdHelper
             Matrix2D<RFLOAT>& U,
             Matrix1D<RFLOAT>& S,
             Matrix2D<RFLOAT>& Vt);
+
+        /* For symmetric matrices: A = V * diag(S) * V^T, with the eigenvalues in S
+           in descending order and the eigenvectors in the columns of V, as in decompose.
+           Uses Householder tridiagonalisation and the implicit QL algorithm, which is
+           considerably faster than a general SVD for large matrices.*/
+        static void decomposeSymmetric(
+            const Matrix2D<RFLOAT>& A,
+            Matrix1D<RFLOAT>& S,
+            Matrix2D<RFLOAT>& V);
 };
 
 #endif
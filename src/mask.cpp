@@ -18,6 +18,8 @@
  * author citations must be preserved.
  ***************************************************************************/
 #include <omp.h>
+#include <limits>
+#include <vector>
 #include "src/mask.h"
 
 // https://stackoverflow.com/questions/48273190/undefined-symbol-error-for-stdstringempty-c-standard-method-linking-error/48273604#48273604
@@ -295,8 +297,144 @@ void softMaskOutsideMap(MultidimArray<RFLOAT> &vol, MultidimArray<RFLOAT> &msk,
 
 }
 
+// Lower envelope of the parabolas (q - p)^2 + f[p] along one line of n elements, spaced stride apart.
+// Negative values of f mark elements without a feature; they never contribute to the envelope.
+static void squaredDistanceTransform1D(double *f, long int n, long int stride,
+		std::vector<double> &fl, std::vector<long int> &v, std::vector<double> &z)
+{
+	long int k = -1;
+	for (long int q = 0; q < n; q++)
+	{
+		fl[q] = f[q * stride];
+		if (fl[q] < 0.)
+			continue;
+		if (k < 0)
+		{
+			k = 0;
+			v[0] = q;
+			z[0] = -std::numeric_limits<double>::infinity();
+			continue;
+		}
+		double s;
+		while (true)
+		{
+			long int p = v[k];
+			s = ((fl[q] + (double)(q * q)) - (fl[p] + (double)(p * p))) / (double)(2 * (q - p));
+			if (s > z[k])
+				break;
+			k--;
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+	}
+
+	// No feature on this line: leave everything unset
+	if (k < 0)
+		return;
+
+	z[k + 1] = std::numeric_limits<double>::infinity();
+	long int j = 0;
+	for (long int q = 0; q < n; q++)
+	{
+		while (z[j + 1] < (double)q)
+			j++;
+		long int d = q - v[j];
+		f[q * stride] = (double)(d * d) + fl[v[j]];
+	}
+}
+
+void squaredDistanceTransform(const MultidimArray<RFLOAT> &msk, MultidimArray<double> &dist2, bool to_ones, int n_threads)
+{
+	dist2.clear();
+	dist2.resize(msk);
+
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(msk)
+	{
+		bool is_feature = (to_ones) ? DIRECT_MULTIDIM_ELEM(msk, n) > 0.999 : DIRECT_MULTIDIM_ELEM(msk, n) < 0.001;
+		DIRECT_MULTIDIM_ELEM(dist2, n) = (is_feature) ? 0. : -1.;
+	}
+
+	const long int xdim = XSIZE(dist2), ydim = YSIZE(dist2), zdim = ZSIZE(dist2);
+	const long int maxdim = XMIPP_MAX(xdim, XMIPP_MAX(ydim, zdim));
+	double *data = MULTIDIM_ARRAY(dist2);
+
+	// Three separable passes: along X, then Y, then Z. The lines within each pass are independent.
+	#pragma omp parallel num_threads(n_threads)
+	{
+		std::vector<double> fl(maxdim), z(maxdim + 1);
+		std::vector<long int> v(maxdim);
+
+		#pragma omp for
+		for (long int line = 0; line < zdim * ydim; line++)
+			squaredDistanceTransform1D(data + line * xdim, xdim, 1, fl, v, z);
+
+		#pragma omp for
+		for (long int line = 0; line < zdim * xdim; line++)
+		{
+			long int k = line / xdim, j = line % xdim;
+			squaredDistanceTransform1D(data + k * ydim * xdim + j, ydim, xdim, fl, v, z);
+		}
+
+		#pragma omp for
+		for (long int line = 0; line < ydim * xdim; line++)
+			squaredDistanceTransform1D(data + line, zdim, ydim * xdim, fl, v, z);
+	}
+}
+
+// Steps B and C of autoMask using the squared distance transform of the binary mask
+static void extendAndSoftenMaskByDistance(MultidimArray<RFLOAT> &msk_out,
+		RFLOAT extend_ini_mask, RFLOAT width_soft_mask_edge, bool verb, int n_threads)
+{
+	MultidimArray<double> dist2;
+
+	if (extend_ini_mask > 0. || extend_ini_mask < 0.)
+	{
+		bool do_extend = (extend_ini_mask > 0.);
+		if (verb)
+		{
+			if (do_extend)
+				std::cout << "== Extending initial binary mask (distance transform) ..." << std::endl;
+			else
+				std::cout << "== Shrinking initial binary mask (distance transform) ..." << std::endl;
+		}
+
+		// Extending sets zeros within extend_ini_mask of a one to one; shrinking does the opposite
+		RFLOAT extend_ini_mask2 = extend_ini_mask * extend_ini_mask;
+		squaredDistanceTransform(msk_out, dist2, do_extend, n_threads);
+		RFLOAT new_value = (do_extend) ? 1. : 0.;
+		#pragma omp parallel for num_threads(n_threads)
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(msk_out)
+		{
+			double d2 = DIRECT_MULTIDIM_ELEM(dist2, n);
+			if (d2 > 0. && (RFLOAT)d2 < extend_ini_mask2)
+				DIRECT_MULTIDIM_ELEM(msk_out, n) = new_value;
+		}
+	}
+
+	if (width_soft_mask_edge > 0.)
+	{
+		if (verb)
+			std::cout << "== Making a soft edge on the extended mask (distance transform) ..." << std::endl;
+
+		RFLOAT width_soft_mask_edge2 = width_soft_mask_edge * width_soft_mask_edge;
+		squaredDistanceTransform(msk_out, dist2, true, n_threads);
+		#pragma omp parallel for num_threads(n_threads)
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(msk_out)
+		{
+			double d2 = DIRECT_MULTIDIM_ELEM(dist2, n);
+			if (d2 > 0. && (RFLOAT)d2 < width_soft_mask_edge2)
+			{
+				RFLOAT min_r2 = d2;
+				DIRECT_MULTIDIM_ELEM(msk_out, n) = 0.5 + 0.5 * cos( PI * sqrt(min_r2) / width_soft_mask_edge);
+			}
+		}
+	}
+}
+
 void autoMask(MultidimArray<RFLOAT> &img_in, MultidimArray<RFLOAT> &msk_out,
-		RFLOAT ini_mask_density_threshold, RFLOAT extend_ini_mask, RFLOAT width_soft_mask_edge, bool verb, int n_threads)
+		RFLOAT ini_mask_density_threshold, RFLOAT extend_ini_mask, RFLOAT width_soft_mask_edge, bool verb, int n_threads,
+		bool do_distance_transform)
 
 {
 	MultidimArray<RFLOAT> msk_cp;
@@ -316,6 +454,12 @@ void autoMask(MultidimArray<RFLOAT> &img_in, MultidimArray<RFLOAT> &msk_out,
 			DIRECT_MULTIDIM_ELEM(msk_out, n) = 0.;
 	}
 
+	if (do_distance_transform)
+	{
+		extendAndSoftenMaskByDistance(msk_out, extend_ini_mask, width_soft_mask_edge, verb, n_threads);
+		return;
+	}
+
 	// B. extend/shrink initial binary mask. To save memory store a temporary copy of Im in I1
 	if (extend_ini_mask > 0. || extend_ini_mask < 0.)
 	{
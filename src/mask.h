@@ -53,8 +53,16 @@ void softMaskOutsideMap(MultidimArray<RFLOAT> &vol, MultidimArray<RFLOAT> &msk,
 // 2. Growing extend_ini_mask in all directions
 // 3. Putting a raised-cosine edge on the mask with width width_soft_mask_edge
 // If verb, then output description of steps and progress bars
+// If do_distance_transform, steps 2 and 3 use an exact Euclidean distance transform instead of
+// scanning a cube of neighbours around every voxel (same result, linear in the number of voxels)
 void autoMask(MultidimArray<RFLOAT> &img_in, MultidimArray<RFLOAT> &msk_out,
-		RFLOAT  ini_mask_density_threshold, RFLOAT extend_ini_mask, RFLOAT width_soft_mask_edge, bool verb = false, int n_threads = 1);
+		RFLOAT  ini_mask_density_threshold, RFLOAT extend_ini_mask, RFLOAT width_soft_mask_edge, bool verb = false, int n_threads = 1,
+		bool do_distance_transform = false);
+
+// Squared Euclidean distance (in pixels) from every voxel in a binary mask to the nearest voxel that is one
+// (or zero if to_ones is false). Voxels without any such voxel in the box get a value of -1.
+// Separable algorithm of Felzenszwalb & Huttenlocher (2012), exact for integer distances.
+void squaredDistanceTransform(const MultidimArray<RFLOAT> &msk, MultidimArray<double> &dist2, bool to_ones = true, int n_threads = 1);
 
 // Fills mask with a soft-edge circular mask (soft-edge in between radius and radius_p), centred at (x, y, z)
 void raisedCosineMask(MultidimArray<RFLOAT> &mask, RFLOAT radius, RFLOAT radius_p, int x, int y, int z = 0);
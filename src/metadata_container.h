@@ -31,41 +31,25 @@
 
 class MetaDataTable;
 
+/*	class MetaDataContainer:
+ *
+ *	A lightweight reference to one row (object) of a MetaDataTable.
+ *	The values themselves live in the column arrays of the table,
+ *	so a MetaDataContainer is only valid for as long as its table
+ *	is alive and the row has not been removed or moved (e.g. by sorting).
+ *
+ *	It is returned by MetaDataTable::getObject() and consumed by
+ *	addObject(), setObject() etc. to copy rows between tables.
+ */
 class MetaDataContainer
 {
     public:
 
-        MetaDataTable* table;
-
-        std::vector<double> doubles;
-        std::vector<long> ints;
-        std::vector<bool> bools;
-	std::vector<std::string> strings;
-	std::vector<std::vector<double> > doubleVectors;
-	std::vector<std::string> unknowns;
+        const MetaDataTable* table;
+        long objectID;
 
         MetaDataContainer();
-        MetaDataContainer(MetaDataTable* table, long doubleCount, long intCount,
-                          long boolCount, long stringCount, long doubleVectorCount, long unknownCount);
-        MetaDataContainer(MetaDataTable* table, MetaDataContainer* mdc);
-
-        void getValue(long offset, double& dest) const;
-        void getValue(long offset, float& dest) const;
-        void getValue(long offset, int& dest) const;
-        void getValue(long offset, long& dest) const;
-        void getValue(long offset, bool& dest) const;
-	void getValue(long offset, std::string& dest) const;
-	void getValue(long offset, std::vector<double>& dest) const;
-	void getValue(long offset, std::vector<float>& dest) const;
-
-        void setValue(long offset, const double& src);
-        void setValue(long offset, const float& src);
-        void setValue(long offset, const int& src);
-        void setValue(long offset, const long& src);
-        void setValue(long offset, const bool& src);
-	void setValue(long offset, const std::string& src);
-	void setValue(long offset, const std::vector<double>& src);
-	void setValue(long offset, const std::vector<float>& src);
+        MetaDataContainer(const MetaDataTable* table, long objectID);
 };
 
 #endif
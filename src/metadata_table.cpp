@@ -42,19 +42,25 @@
  *	e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cfloat>
+#include <cstring>
+#include <set>
+#include <stdint.h>
 #include "src/metadata_table.h"
 #include "src/metadata_label.h"
 
+bool MetaDataTable::line_by_line_star_reading = false;
+
 MetaDataTable::MetaDataTable()
-:	objects(0),
+:	nr_objects(0),
 	label2offset(EMDL_LAST_LABEL, -1),
 	current_objectID(0),
-	doubleLabels(0),
-	intLabels(0),
-	boolLabels(0),
-	stringLabels(0),
-	doubleVectorLabels(0),
-	unknownLabels(0),
+	reserved_objects(0),
 	isList(false),
 	name(""),
 	comment(""),
@@ -64,28 +70,24 @@ MetaDataTable::MetaDataTable()
 }
 
 MetaDataTable::MetaDataTable(const MetaDataTable &MD)
-:	objects(MD.objects.size()),
+:	nr_objects(MD.nr_objects),
+	doubleColumns(MD.doubleColumns),
+	intColumns(MD.intColumns),
+	boolColumns(MD.boolColumns),
+	stringColumns(MD.stringColumns),
+	doubleVectorColumns(MD.doubleVectorColumns),
+	unknownColumns(MD.unknownColumns),
 	label2offset(MD.label2offset),
 	unknownLabelPosition2Offset(MD.unknownLabelPosition2Offset),
 	unknownLabelNames(MD.unknownLabelNames),
 	current_objectID(0),
-	doubleLabels(MD.doubleLabels),
-	intLabels(MD.intLabels),
-	boolLabels(MD.boolLabels),
-	stringLabels(MD.stringLabels),
-	doubleVectorLabels(MD.doubleVectorLabels),
-	unknownLabels(MD.unknownLabels),
+	reserved_objects(0),
 	isList(MD.isList),
 	name(MD.name),
 	comment(MD.comment),
 	version(MD.version),
 	activeLabels(MD.activeLabels)
 {
-	for (size_t idx = 0; idx < MD.objects.size(); idx++)
-	{
-		objects[idx] = new MetaDataContainer(*(MD.objects[idx]));
-		objects[idx]->table = this;
-	}
 }
 
 MetaDataTable& MetaDataTable::operator = (const MetaDataTable &MD)
@@ -94,17 +96,18 @@ MetaDataTable& MetaDataTable::operator = (const MetaDataTable &MD)
 	{
 		clear();
 
-		objects.resize(MD.objects.size());
+		nr_objects = MD.nr_objects;
+		doubleColumns = MD.doubleColumns;
+		intColumns = MD.intColumns;
+		boolColumns = MD.boolColumns;
+		stringColumns = MD.stringColumns;
+		doubleVectorColumns = MD.doubleVectorColumns;
+		unknownColumns = MD.unknownColumns;
+
 		label2offset = MD.label2offset;
 		unknownLabelPosition2Offset = MD.unknownLabelPosition2Offset;
 		unknownLabelNames = MD.unknownLabelNames;
 		current_objectID = 0;
-		doubleLabels = MD.doubleLabels;
-		intLabels = MD.intLabels;
-		boolLabels = MD.boolLabels;
-		stringLabels = MD.stringLabels;
-		doubleVectorLabels = MD.doubleVectorLabels;
-		unknownLabels = MD.unknownLabels;
 
 		isList = MD.isList;
 		name = MD.name;
@@ -112,12 +115,6 @@ MetaDataTable& MetaDataTable::operator = (const MetaDataTable &MD)
 		version = MD.version;
 
 		activeLabels = MD.activeLabels;
-
-		for (long int idx = 0; idx < MD.objects.size(); idx++)
-		{
-			objects[idx] = new MetaDataContainer(this, MD.objects[idx]);
-			objects[idx]->table = this;
-		}
 	}
 
 	return *this;
@@ -130,41 +127,34 @@ void MetaDataTable::setIsList(bool is_list)
 
 MetaDataTable::~MetaDataTable()
 {
-	for (long i = 0; i < objects.size(); i++)
-	{
-		delete objects[i];
-	}
 }
 
 bool MetaDataTable::isEmpty() const
 {
-	return (objects.size()==0);
+	return (nr_objects == 0);
 }
 
 size_t MetaDataTable::numberOfObjects() const
 {
-	return objects.size();
+	return nr_objects;
 }
 
 void MetaDataTable::clear()
 {
-	for (long i = 0; i < objects.size(); i++)
-	{
-		delete objects[i];
-	}
-	objects.clear();
+	nr_objects = 0;
+	doubleColumns.clear();
+	intColumns.clear();
+	boolColumns.clear();
+	stringColumns.clear();
+	doubleVectorColumns.clear();
+	unknownColumns.clear();
 
 	label2offset = std::vector<long>(EMDL_LAST_LABEL, -1);
 	current_objectID = 0;
+	reserved_objects = 0;
 	unknownLabelPosition2Offset.clear();
 	unknownLabelNames.clear();
 
-	doubleLabels = 0;
-	intLabels = 0;
-	boolLabels = 0;
-	stringLabels = 0;
-	unknownLabels = 0;
-
 	isList = false;
 	name = "";
 	comment = "";
@@ -327,7 +317,7 @@ bool MetaDataTable::setUnknownValue(int labelPosition, const std::string &value)
 
 	if (offset > -1)
 	{
-		objects[current_objectID]->unknowns[offset] = value;
+		unknownColumns[offset][current_objectID] = value;
 		return true;
 	}
 	else
@@ -336,6 +326,30 @@ bool MetaDataTable::setUnknownValue(int labelPosition, const std::string &value)
 	}
 }
 
+// parse a vector of doubles written as "[1,2,3]"
+static void parseDoubleVector(const std::string &value, std::vector<double> &v)
+{
+	v.clear();
+	v.reserve(32);
+
+	char* temp = new char[value.size()+1];
+	strcpy(temp, value.c_str());
+
+	char* token;
+	char* rest = temp;
+
+	while ((token = strtok_r(rest, "[,]", &rest)) != 0)
+	{
+		double d;
+		std::stringstream sts(token);
+		sts >> d;
+
+		v.push_back(d);
+	}
+
+	delete[] temp;
+}
+
 bool MetaDataTable::setValueFromString(
 		EMDLabel label, const std::string &value, long int objectID)
 {
@@ -368,24 +382,7 @@ bool MetaDataTable::setValueFromString(
 		else if (EMDL::isDoubleVector(label))
 		{
 			std::vector<double> v;
-			v.reserve(32);
-
-			char* temp = new char[value.size()+1];
-			strcpy(temp, value.c_str());
-
-			char* token;
-			char* rest = temp;
-
-			while ((token = strtok_r(rest, "[,]", &rest)) != 0)
-			{
-				double d;
-				std::stringstream sts(token);
-				sts >> d;
-
-				v.push_back(d);
-			}
-
-			delete[] temp;
+			parseDoubleVector(value, v);
 
 			return setValue(label, v, objectID);
 		}
@@ -395,81 +392,19 @@ bool MetaDataTable::setValueFromString(
 	return false;
 }
 
-// comparators used for sorting
-
-struct MdDoubleComparator
-{
-	MdDoubleComparator(long index) : index(index) {}
-
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
-	{
-		return lh->doubles[index] < rh->doubles[index];
-	}
-
-	long index;
-};
-
-struct MdIntComparator
-{
-	MdIntComparator(long index) : index(index) {}
-
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
-	{
-		return lh->ints[index] < rh->ints[index];
-	}
-
-	long index;
-};
-
-struct MdStringComparator
-{
-	MdStringComparator(long index) : index(index) {}
-
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
-	{
-		return lh->strings[index] < rh->strings[index];
-	}
-
-	long index;
-};
-
-struct MdStringAfterAtComparator
-{
-	MdStringAfterAtComparator(long index) : index(index) {}
-
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
-	{
-		std::string slh = lh->strings[index];
-		std::string srh = rh->strings[index];
-		slh = slh.substr(slh.find("@")+1);
-		srh = srh.substr(srh.find("@")+1);
-		return slh < srh;
-	}
-
-	long index;
-};
+// comparator used for sorting: compares two row indices by their values in one column
 
-struct MdStringBeforeAtComparator
+template<class T>
+struct MdColumnComparator
 {
-	MdStringBeforeAtComparator(long index) : index(index) {}
+	MdColumnComparator(const std::vector<T> &column) : column(column) {}
 
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
+	bool operator()(long lh, long rh) const
 	{
-		std::string slh = lh->strings[index];
-		std::string srh = rh->strings[index];
-		slh = slh.substr(0, slh.find("@"));
-		srh = srh.substr(0, srh.find("@"));
-		std::stringstream stslh, stsrh;
-		stslh << slh;
-		stsrh << srh;
-		long ilh, irh;
-		stslh >> ilh;
-		stsrh >> irh;
-
-		return ilh < irh;
+		return column[lh] < column[rh];
 	}
 
-	long index;
+	const std::vector<T> &column;
 };
 
 void MetaDataTable::sort(EMDLabel name, bool do_reverse, bool only_set_index, bool do_random)
@@ -484,29 +419,24 @@ void MetaDataTable::sort(EMDLabel name, bool do_reverse, bool only_set_index, bo
 	}
 
 	std::vector<std::pair<double,long int> > vp;
-	vp.reserve(objects.size());
-	long int i = 0;
+	vp.reserve(nr_objects);
 
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(*this)
+	if (do_random)
 	{
-		double dval;
-		if (do_random)
-		{
-			dval = (double)rand();
-		}
-		else if (EMDL::isInt(name))
-		{
-			long val;
-			getValue(name, val);
-			dval = (double) val;
-		}
-		else // EMDL::isDouble(name)
-		{
-			getValue(name, dval);
-		}
-
-		vp.push_back(std::make_pair(dval, i));
-		i++;
+		for (long i = 0; i < nr_objects; i++)
+			vp.push_back(std::make_pair((double)rand(), i));
+	}
+	else if (EMDL::isInt(name))
+	{
+		const std::vector<long> values = getColumn<long>(name);
+		for (long i = 0; i < nr_objects; i++)
+			vp.push_back(std::make_pair((double)values[i], i));
+	}
+	else // EMDL::isDouble(name)
+	{
+		const std::vector<double> values = getColumn<double>(name);
+		for (long i = 0; i < nr_objects; i++)
+			vp.push_back(std::make_pair(values[i], i));
 	}
 
 	std::sort(vp.begin(), vp.end());
@@ -524,14 +454,14 @@ void MetaDataTable::sort(EMDLabel name, bool do_reverse, bool only_set_index, bo
 	else
 	{
 		// Change the actual order in the MetaDataTable
-		std::vector<MetaDataContainer*> objs(objects.size());
+		std::vector<long> order(vp.size());
 
 		for (long j = 0; j < vp.size(); j++)
 		{
-			objs[j] = objects[vp[j].second];
+			order[j] = vp[j].second;
 		}
 
-		objects = objs;
+		permuteObjects(order);
 	}
 	// reset pointer to the beginning of the table
 	firstObject();
@@ -539,30 +469,52 @@ void MetaDataTable::sort(EMDLabel name, bool do_reverse, bool only_set_index, bo
 
 void MetaDataTable::newSort(const EMDLabel label, bool do_reverse, bool do_sort_after_at, bool do_sort_before_at)
 {
+	std::vector<long> order(nr_objects);
+	for (long i = 0; i < nr_objects; i++)
+		order[i] = i;
+
+	const long off = label2offset[label];
+	if (off < 0)
+		REPORT_ERROR("Cannot sort on a label that is not present: " + EMDL::label2Str(label));
+
 	if (EMDL::isString(label))
 	{
+		const std::vector<std::string> &column = stringColumns[off];
+
 		if (do_sort_after_at)
 		{
-			std::stable_sort(objects.begin(), objects.end(),
-							 MdStringAfterAtComparator(label2offset[label]));
+			std::vector<std::string> keys(nr_objects);
+			for (long i = 0; i < nr_objects; i++)
+				keys[i] = column[i].substr(column[i].find("@")+1);
+
+			std::stable_sort(order.begin(), order.end(), MdColumnComparator<std::string>(keys));
 		}
 		else if (do_sort_before_at)
 		{
-			std::stable_sort(objects.begin(), objects.end(),
-							 MdStringBeforeAtComparator(label2offset[label]));
+			std::vector<long> keys(nr_objects);
+			for (long i = 0; i < nr_objects; i++)
+			{
+				std::stringstream sts;
+				sts << column[i].substr(0, column[i].find("@"));
+				long key = 0;
+				sts >> key;
+				keys[i] = key;
+			}
+
+			std::stable_sort(order.begin(), order.end(), MdColumnComparator<long>(keys));
 		}
 		else
 		{
-			std::stable_sort(objects.begin(), objects.end(), MdStringComparator(label2offset[label]));
+			std::stable_sort(order.begin(), order.end(), MdColumnComparator<std::string>(column));
 		}
 	}
 	else if (EMDL::isDouble(label))
 	{
-		std::stable_sort(objects.begin(), objects.end(), MdDoubleComparator(label2offset[label]));
+		std::stable_sort(order.begin(), order.end(), MdColumnComparator<double>(doubleColumns[off]));
 	}
 	else if (EMDL::isInt(label))
 	{
-		std::stable_sort(objects.begin(), objects.end(), MdIntComparator(label2offset[label]));
+		std::stable_sort(order.begin(), order.end(), MdColumnComparator<long>(intColumns[off]));
 	}
 	else
 	{
@@ -571,8 +523,56 @@ void MetaDataTable::newSort(const EMDLabel label, bool do_reverse, bool do_sort_
 
 	if (do_reverse)
 	{
-		std::reverse(objects.begin(), objects.end());
+		std::reverse(order.begin(), order.end());
+	}
+
+	permuteObjects(order);
+}
+
+template<class T>
+static void permuteColumn(std::vector<T> &column, const std::vector<long> &order)
+{
+	std::vector<T> permuted(order.size());
+
+	for (long i = 0; i < order.size(); i++)
+	{
+		permuted[i] = column[order[i]];
 	}
+
+	column.swap(permuted);
+}
+
+template<class T>
+static void permuteColumnBySwap(std::vector<T> &column, const std::vector<long> &order)
+{
+	// For columns of heap-allocated values (strings, vectors), avoid deep copies
+	std::vector<T> permuted(order.size());
+
+	for (long i = 0; i < order.size(); i++)
+	{
+		permuted[i].swap(column[order[i]]);
+	}
+
+	column.swap(permuted);
+}
+
+void MetaDataTable::permuteObjects(const std::vector<long> &order)
+{
+	if (order.size() != nr_objects)
+		REPORT_ERROR("MetaDataTable::permuteObjects BUG: the new order does not contain all objects.");
+
+	for (long c = 0; c < doubleColumns.size(); c++)
+		permuteColumn(doubleColumns[c], order);
+	for (long c = 0; c < intColumns.size(); c++)
+		permuteColumn(intColumns[c], order);
+	for (long c = 0; c < boolColumns.size(); c++)
+		permuteColumn(boolColumns[c], order);
+	for (long c = 0; c < stringColumns.size(); c++)
+		permuteColumnBySwap(stringColumns[c], order);
+	for (long c = 0; c < doubleVectorColumns.size(); c++)
+		permuteColumnBySwap(doubleVectorColumns[c], order);
+	for (long c = 0; c < unknownColumns.size(); c++)
+		permuteColumnBySwap(unknownColumns[c], order);
 }
 
 // Will be removed in 3.2
@@ -627,70 +627,41 @@ void MetaDataTable::addLabel(EMDLabel label, std::string unknownLabel)
 
 		if (EMDL::isDouble(label))
 		{
-			id = doubleLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->doubles.push_back(0);
-			}
-
-			doubleLabels++;
+			id = doubleColumns.size();
+			doubleColumns.push_back(std::vector<double>(nr_objects, 0));
+			doubleColumns.back().reserve(reserved_objects);
 		}
 		else if (EMDL::isInt(label))
 		{
-			id = intLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->ints.push_back(0);
-			}
-
-			intLabels++;
+			id = intColumns.size();
+			intColumns.push_back(std::vector<long>(nr_objects, 0));
+			intColumns.back().reserve(reserved_objects);
 		}
 		else if (EMDL::isBool(label))
 		{
-			id = boolLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->bools.push_back(false);
-			}
-
-			boolLabels++;
+			id = boolColumns.size();
+			boolColumns.push_back(std::vector<bool>(nr_objects, false));
+			boolColumns.back().reserve(reserved_objects);
 		}
 		else if (EMDL::isString(label))
 		{
-			id = stringLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->strings.push_back("empty");
-			}
-
-			stringLabels++;
+			id = stringColumns.size();
+			stringColumns.push_back(std::vector<std::string>(nr_objects, "empty"));
+			stringColumns.back().reserve(reserved_objects);
 		}
 		else if (EMDL::isDoubleVector(label))
 		{
-			id = doubleVectorLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->doubleVectors.push_back(std::vector<double>());
-			}
-
-			doubleVectorLabels++;
+			id = doubleVectorColumns.size();
+			doubleVectorColumns.push_back(std::vector<std::vector<double> >(nr_objects));
+			doubleVectorColumns.back().reserve(reserved_objects);
 		}
 		else if (EMDL::isUnknown(label))
 		{
-			id = unknownLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->unknowns.push_back("empty");
-			}
+			id = unknownColumns.size();
+			unknownColumns.push_back(std::vector<std::string>(nr_objects, "empty"));
+			unknownColumns.back().reserve(reserved_objects);
 
 			unknownLabelNames.push_back(unknownLabel);
-			unknownLabels++;
 		}
 
 		activeLabels.push_back(label);
@@ -733,14 +704,30 @@ void MetaDataTable::append(const MetaDataTable& mdt)
 			REPORT_ERROR("ERROR in appending metadata tables with not the same columns!");
 	}
 
-	// Now append
-	objects.reserve(objects.size() + mdt.numberOfObjects());
-	for (long i = 0; i < mdt.objects.size(); i++)
+	// Now append: copy whole columns rather than one object at a time
+	const long first_new = nr_objects;
+	resizeObjects(nr_objects + mdt.nr_objects);
+
+	for (long i = 0; i < mdt.activeLabels.size(); i++)
 	{
-		objects.push_back(new MetaDataContainer(
-			this, doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels));
+		const EMDLabel label = mdt.activeLabels[i];
+		const long srcOff = (label == EMDL_UNKNOWN_LABEL) ? mdt.unknownLabelPosition2Offset[i] : mdt.label2offset[label];
+		const long myOff = getOffsetOfColumnIn(mdt, i);
+
+		if (myOff < 0) continue;
 
-		setObjectUnsafe(mdt.getObject(i), objects.size() - 1);
+		if (EMDL::isDouble(label))
+			std::copy(mdt.doubleColumns[srcOff].begin(), mdt.doubleColumns[srcOff].end(), doubleColumns[myOff].begin() + first_new);
+		else if (EMDL::isInt(label))
+			std::copy(mdt.intColumns[srcOff].begin(), mdt.intColumns[srcOff].end(), intColumns[myOff].begin() + first_new);
+		else if (EMDL::isBool(label))
+			std::copy(mdt.boolColumns[srcOff].begin(), mdt.boolColumns[srcOff].end(), boolColumns[myOff].begin() + first_new);
+		else if (EMDL::isString(label))
+			std::copy(mdt.stringColumns[srcOff].begin(), mdt.stringColumns[srcOff].end(), stringColumns[myOff].begin() + first_new);
+		else if (EMDL::isDoubleVector(label))
+			std::copy(mdt.doubleVectorColumns[srcOff].begin(), mdt.doubleVectorColumns[srcOff].end(), doubleVectorColumns[myOff].begin() + first_new);
+		else if (EMDL::isUnknown(label))
+			std::copy(mdt.unknownColumns[srcOff].begin(), mdt.unknownColumns[srcOff].end(), unknownColumns[myOff].begin() + first_new);
 	}
 
 	// reset pointer to the beginning of the table
@@ -748,26 +735,26 @@ void MetaDataTable::append(const MetaDataTable& mdt)
 }
 
 
-MetaDataContainer* MetaDataTable::getObject(long objectID) const
+MetaDataContainer MetaDataTable::getObject(long objectID) const
 {
 	if (objectID < 0) objectID = current_objectID;
 
 	checkObjectID(objectID,  "MetaDataTable::getObject");
 
-	return objects[objectID];
+	return MetaDataContainer(this, objectID);
 }
 
-void MetaDataTable::setObject(MetaDataContainer* data, long objectID)
+void MetaDataTable::setObject(const MetaDataContainer &data, long objectID)
 {
 	if (objectID < 0) objectID = current_objectID;
 
 	checkObjectID(objectID,  "MetaDataTable::setObject");
-	addMissingLabels(data->table);
+	addMissingLabels(data.table);
 
 	setObjectUnsafe(data, objectID);
 }
 
-void MetaDataTable::setValuesOfDefinedLabels(MetaDataContainer* data, long objectID)
+void MetaDataTable::setValuesOfDefinedLabels(const MetaDataContainer &data, long objectID)
 {
 	if (objectID < 0) objectID = current_objectID;
 
@@ -776,94 +763,143 @@ void MetaDataTable::setValuesOfDefinedLabels(MetaDataContainer* data, long objec
 	setObjectUnsafe(data, objectID);
 }
 
+template<class T>
+static void reserveColumns(std::vector<std::vector<T> > &columns, size_t capacity)
+{
+	for (long c = 0; c < columns.size(); c++)
+		columns[c].reserve(capacity);
+}
+
 void MetaDataTable::reserve(size_t capacity)
 {
-	objects.reserve(capacity);
+	reserved_objects = capacity;
+
+	reserveColumns(doubleColumns, capacity);
+	reserveColumns(intColumns, capacity);
+	reserveColumns(boolColumns, capacity);
+	reserveColumns(stringColumns, capacity);
+	reserveColumns(doubleVectorColumns, capacity);
+	reserveColumns(unknownColumns, capacity);
+}
+
+template<class T>
+static void resizeColumns(std::vector<std::vector<T> > &columns, long size, const T &value)
+{
+	for (long c = 0; c < columns.size(); c++)
+		columns[c].resize(size, value);
 }
 
-void MetaDataTable::setObjectUnsafe(MetaDataContainer* data, long objectID)
+void MetaDataTable::resizeObjects(long size)
 {
-	MetaDataContainer* obj = objects[objectID];
+	resizeColumns(doubleColumns, size, 0.0);
+	resizeColumns(intColumns, size, 0L);
+	resizeColumns(boolColumns, size, false);
+	resizeColumns(stringColumns, size, std::string(""));
+	resizeColumns(doubleVectorColumns, size, std::vector<double>());
+	resizeColumns(unknownColumns, size, std::string(""));
 
-	for (long i = 0; i < data->table->activeLabels.size(); i++)
+	nr_objects = size;
+}
+
+long MetaDataTable::getOffsetOfColumnIn(const MetaDataTable &src, long labelPosition) const
+{
+	const EMDLabel label = src.activeLabels[labelPosition];
+
+	if (label != EMDL_UNKNOWN_LABEL)
+	{
+		return label2offset[label];
+	}
+	else
 	{
-		EMDLabel label = data->table->activeLabels[i];
+		const std::string unknownLabel = src.getUnknownLabelNameAt(labelPosition);
+
+		for (int j = 0; j < unknownLabelNames.size(); j++)
+		{
+			if (unknownLabelNames[j] == unknownLabel)
+			{
+				return j;
+			}
+		}
+
+		REPORT_ERROR("MetaDataTable::setObjectUnsafe: logic error. cannot find srcOff.");
+		return -1;
+	}
+}
+
+void MetaDataTable::setObjectUnsafe(const MetaDataContainer &data, long objectID)
+{
+	const MetaDataTable &src = *data.table;
+	const long srcID = data.objectID;
+
+	for (long i = 0; i < src.activeLabels.size(); i++)
+	{
+		EMDLabel label = src.activeLabels[i];
+		const long myOff = getOffsetOfColumnIn(src, i);
 
 		if (label != EMDL_UNKNOWN_LABEL)
 		{
-			long myOff = label2offset[label];
-			long srcOff = data->table->label2offset[label];
+			long srcOff = src.label2offset[label];
 
 			if (myOff < 0) continue;
 
 			if (EMDL::isDouble(label))
 			{
-				obj->doubles[myOff] = data->doubles[srcOff];
+				doubleColumns[myOff][objectID] = src.doubleColumns[srcOff][srcID];
 			}
 			else if (EMDL::isInt(label))
 			{
-				obj->ints[myOff] = data->ints[srcOff];
+				intColumns[myOff][objectID] = src.intColumns[srcOff][srcID];
 			}
 			else if (EMDL::isBool(label))
 			{
-				obj->bools[myOff] = data->bools[srcOff];
+				boolColumns[myOff][objectID] = src.boolColumns[srcOff][srcID];
 			}
 			else if (EMDL::isString(label))
 			{
-				obj->strings[myOff] = data->strings[srcOff];
+				stringColumns[myOff][objectID] = src.stringColumns[srcOff][srcID];
 			}
 			else if (EMDL::isDoubleVector(label))
 			{
-				obj->doubleVectors[myOff] = data->doubleVectors[srcOff];
+				doubleVectorColumns[myOff][objectID] = src.doubleVectorColumns[srcOff][srcID];
 			}
 		}
 		else
 		{
-			std::string unknownLabel = data->table->getUnknownLabelNameAt(i);
-			long srcOff = data->table->unknownLabelPosition2Offset[i];
-			long myOff = -1;
+			long srcOff = src.unknownLabelPosition2Offset[i];
 
-			for (int j = 0; j < unknownLabelNames.size(); j++)
-			{
-				if (unknownLabelNames[j] == unknownLabel)
-				{
-					myOff = j;
-					break;
-				}
-			}
-
-			if (myOff < 0)
-				REPORT_ERROR("MetaDataTable::setObjectUnsafe: logic error. cannot find srcOff."); 
-
-			obj->unknowns[myOff] = data->unknowns[srcOff];
+			unknownColumns[myOff][objectID] = src.unknownColumns[srcOff][srcID];
 		}
 	}
 }
 
 void MetaDataTable::addObject()
 {
-	objects.push_back(new MetaDataContainer(
-		this, doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels));
+	resizeObjects(nr_objects + 1);
 
-	current_objectID = objects.size()-1;
+	current_objectID = nr_objects - 1;
 }
 
-void MetaDataTable::addObject(MetaDataContainer* data)
+void MetaDataTable::addObject(const MetaDataContainer &data)
 {
-	objects.push_back(new MetaDataContainer(
-		this, doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels));
+	resizeObjects(nr_objects + 1);
 
-	setObject(data, objects.size()-1);
-	current_objectID = objects.size()-1;
+	setObject(data, nr_objects - 1);
+	current_objectID = nr_objects - 1;
 }
 
-void MetaDataTable::addValuesOfDefinedLabels(MetaDataContainer* data)
+void MetaDataTable::addValuesOfDefinedLabels(const MetaDataContainer &data)
 {
-	objects.push_back(new MetaDataContainer(
-		this, doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels));
+	resizeObjects(nr_objects + 1);
 
-	setValuesOfDefinedLabels(data, objects.size()-1);
-	current_objectID = objects.size()-1;
+	setValuesOfDefinedLabels(data, nr_objects - 1);
+	current_objectID = nr_objects - 1;
+}
+
+template<class T>
+static void eraseFromColumns(std::vector<std::vector<T> > &columns, long objectID)
+{
+	for (long c = 0; c < columns.size(); c++)
+		columns[c].erase(columns[c].begin() + objectID);
 }
 
 void MetaDataTable::removeObject(long objectID)
@@ -872,10 +908,15 @@ void MetaDataTable::removeObject(long objectID)
 
 	checkObjectID(i, "MetaDataTable::removeObject");
 
-	delete objects[i];
-	objects.erase(objects.begin() + i);
+	eraseFromColumns(doubleColumns, i);
+	eraseFromColumns(intColumns, i);
+	eraseFromColumns(boolColumns, i);
+	eraseFromColumns(stringColumns, i);
+	eraseFromColumns(doubleVectorColumns, i);
+	eraseFromColumns(unknownColumns, i);
+	nr_objects--;
 
-	current_objectID = objects.size() - 1;
+	current_objectID = nr_objects - 1;
 }
 
 long int MetaDataTable::firstObject()
@@ -888,7 +929,7 @@ long int MetaDataTable::nextObject()
 {
 	current_objectID++;
 
-	if (current_objectID >= objects.size())
+	if (current_objectID >= nr_objects)
 	{
 		return NO_MORE_OBJECTS;
 	}
@@ -906,16 +947,232 @@ long int MetaDataTable::goToObject(long int objectID)
 	return current_objectID;
 }
 
+void MetaDataTable::setLineByLineStarReading(bool line_by_line)
+{
+	line_by_line_star_reading = line_by_line;
+}
+
+// Read-only memory map of an entire file. data is NULL if the file could not be mapped.
+class MappedFile
+{
+public:
+
+	const char* data;
+	size_t size;
+
+	MappedFile(const std::string &filename)
+	:	data(NULL), size(0)
+	{
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) return;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		{
+			void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED)
+			{
+				madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+				data = (const char*)ptr;
+				size = st.st_size;
+			}
+		}
+
+		close(fd);
+	}
+
+	~MappedFile()
+	{
+		if (data != NULL) munmap((void*)data, size);
+	}
+
+private:
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+// true if simplify() turns the line [begin, end) into an empty string
+static inline bool isEmptyStarLine(const char* begin, const char* end)
+{
+	for (const char* c = begin; c < end; c++)
+	{
+		switch (*c)
+		{
+			case ' ': case '\t': case '\n': case '\v': case '\b': case '\r': case '\f': case '\a':
+				break;
+			default:
+				return *c == '\0';
+		}
+	}
+
+	return true;
+}
+
+// Collect the start of every line in [begin, end) until the first empty line.
+// Returns the start of that empty line, or end if there is none.
+static const char* findStarRows(const char* begin, const char* end, std::vector<const char*> &rows)
+{
+	const char* pos = begin;
+
+	while (pos < end)
+	{
+		const char* nl = (const char*)memchr(pos, '\n', end - pos);
+		const char* line_end = (nl == NULL) ? end : nl;
+
+		if (isEmptyStarLine(pos, line_end))
+			return pos;
+
+		rows.push_back(pos);
+		pos = (nl == NULL) ? end : nl + 1;
+	}
+
+	return end;
+}
+
+// start of the line following the one that contains pos
+static const char* nextStarLine(const char* pos, const char* end)
+{
+	if (pos >= end) return end;
+	const char* nl = (const char*)memchr(pos, '\n', end - pos);
+	return (nl == NULL) ? end : nl + 1;
+}
+
+// Same as findStarRows, but large loops are scanned in chunks on several threads
+static const char* findStarRows(const char* begin, const char* end, std::vector<const char*> &rows, int nr_threads)
+{
+	// Most loops (e.g. the optics groups) are short: look for their end serially first
+	const size_t probe_size = 1 << 20;
+	const char* probe_end = (nr_threads > 1 && (size_t)(end - begin) > probe_size) ? nextStarLine(begin + probe_size, end) : end;
+
+	const char* stop = findStarRows(begin, probe_end, rows);
+	if (stop != probe_end || probe_end == end)
+		return stop;
+
+	std::vector<const char*> bounds(nr_threads + 1);
+	bounds[0] = probe_end;
+	for (int i = 1; i < nr_threads; i++)
+		bounds[i] = XMIPP_MAX(bounds[i - 1], nextStarLine(probe_end + (end - probe_end) * i / nr_threads - 1, end));
+	bounds[nr_threads] = end;
+
+	std::vector<std::vector<const char*> > chunk_rows(nr_threads);
+	std::vector<const char*> chunk_stop(nr_threads);
+
+	#pragma omp parallel for num_threads(nr_threads)
+	for (int i = 0; i < nr_threads; i++)
+		chunk_stop[i] = findStarRows(bounds[i], bounds[i + 1], chunk_rows[i]);
+
+	for (int i = 0; i < nr_threads; i++)
+	{
+		rows.insert(rows.end(), chunk_rows[i].begin(), chunk_rows[i].end());
+		if (chunk_stop[i] != bounds[i + 1])
+			return chunk_stop[i];
+	}
+
+	return end;
+}
+
+// Same result as "std::istringstream(token) >> value" for a double, without the stream
+static double parseStarDouble(const char* begin, const char* end)
+{
+	// Only the characters the stream would have accepted are handed to strtod
+	const char* c = begin;
+	bool has_digits = false;
+
+	if (c < end && (*c == '+' || *c == '-')) c++;
+	for (; c < end && *c >= '0' && *c <= '9'; c++) has_digits = true;
+	if (c < end && *c == '.')
+		for (c++; c < end && *c >= '0' && *c <= '9'; c++) has_digits = true;
+	if (has_digits && c < end && (*c == 'e' || *c == 'E'))
+	{
+		c++;
+		if (c < end && (*c == '+' || *c == '-')) c++;
+		while (c < end && *c >= '0' && *c <= '9') c++;
+	}
+
+	const size_t len = c - begin;
+	char buffer[64];
+	std::string long_buffer;
+	const char* str;
+
+	if (len < sizeof(buffer))
+	{
+		memcpy(buffer, begin, len);
+		buffer[len] = '\0';
+		str = buffer;
+	}
+	else
+	{
+		long_buffer.assign(begin, len);
+		str = long_buffer.c_str();
+	}
+
+	char* str_end;
+	double value = strtod(str, &str_end);
+
+	if (len == 0 || str_end != str + len)
+		return 0.;
+	else if (value == HUGE_VAL)
+		return DBL_MAX;
+	else if (value == -HUGE_VAL)
+		return -DBL_MAX;
+	else
+		return value;
+}
+
+// Same result as "std::istringstream(token) >> value" for a long, without the stream
+static long parseStarLong(const char* begin, const char* end)
+{
+	const char* c = begin;
+	bool negative = false;
+
+	if (c < end && (*c == '+' || *c == '-'))
+	{
+		negative = (*c == '-');
+		c++;
+	}
+
+	const unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+	unsigned long value = 0;
+
+	for (; c < end && *c >= '0' && *c <= '9'; c++)
+	{
+		const unsigned long digit = *c - '0';
+		if (value > (limit - digit) / 10)
+			return negative ? LONG_MIN : LONG_MAX;
+		value = 10 * value + digit;
+	}
+
+	if (!negative)
+		return (long)value;
+	else if (value == limit)
+		return LONG_MIN;
+	else
+		return -(long)value;
+}
+
 long int MetaDataTable::readStarLoop(std::ifstream& in, bool do_only_count)
+{
+	return readStarLoop(in, NULL, 0, do_only_count, 1);
+}
+
+long int MetaDataTable::readStarLoop(std::ifstream& in, const char* mapped, size_t mapped_size, bool do_only_count, int nr_threads)
 {
 	setIsList(false);
 
 	//Read column labels
 	int labelPosition = 0;
 	std::string line, token;
+	std::streamoff line_start = 0;
+	bool has_rows = false;
+
+	// Pipes and FIFOs cannot tell where the rows start, so they are read line by line
+	const bool line_by_line = line_by_line_star_reading || in.tellg() < 0;
+	if (line_by_line)
+		mapped = NULL;
 
 	// First read all the column labels
-	while (getline(in, line, '\n'))
+	while ((line_by_line || (line_start = in.tellg()) >= 0) && getline(in, line, '\n'))
 	{
 		line = simplify(line);
 		// TODO: handle comments...
@@ -944,14 +1201,52 @@ long int MetaDataTable::readStarLoop(std::ifstream& in, bool do_only_count)
 		}
 		else // found first data line
 		{
+			has_rows = true;
 			break;
 		}
 	}
 
-	// Then fill the table (dont read another line until the one from above has been handled)
+	if (!has_rows)
+		return 0;
+
+	size_t consumed;
+
+	if (mapped != NULL)
+	{
+		// Parse the rows straight from the mapped file and move the stream behind them
+		const long int nr_rows = readStarLoopRows(mapped + line_start, mapped + mapped_size, do_only_count, consumed, nr_threads);
+		in.clear();
+		in.seekg(line_start + consumed);
+
+		return nr_rows;
+	}
+	else if (line_by_line)
+	{
+		return readStarLoopRows(in, line, do_only_count);
+	}
+	else
+	{
+		// Copy the rows (up to the first empty line) into a buffer and parse that
+		std::string rows;
+		do
+		{
+			if (isEmptyStarLine(line.data(), line.data() + line.size()))
+				break;
+
+			rows += line;
+			rows += '\n';
+		}
+		while (getline(in, line, '\n'));
+
+		return readStarLoopRows(rows.data(), rows.data() + rows.size(), do_only_count, consumed, nr_threads);
+	}
+}
+
+long int MetaDataTable::readStarLoopRows(std::ifstream& in, std::string& line, bool do_only_count)
+{
+	// Fill the table (dont read another line until the one from above has been handled)
 	bool is_first = true;
 	long int nr_objects = 0;
-	const int num_labels = activeLabels.size();
 
 	while (is_first || getline(in, line, '\n'))
 	{
@@ -967,46 +1262,195 @@ long int MetaDataTable::readStarLoop(std::ifstream& in, bool do_only_count)
 		{
 			// Add a new line to the table
 			addObject();
+			setValuesFromStarRow(line, current_objectID);
+		}
+	}
+
+	return nr_objects;
+}
+
+long int MetaDataTable::readStarLoopRows(const char* begin, const char* end, bool do_only_count, size_t &consumed, int nr_threads)
+{
+	nr_threads = XMIPP_MAX(1, nr_threads);
+
+	std::vector<const char*> rows;
+	const char* stop = findStarRows(begin, end, rows, nr_threads);
+	consumed = nextStarLine(stop, end) - begin;
+
+	const long int nr_rows = rows.size();
+
+	if (do_only_count || nr_rows == 0)
+		return nr_rows;
+
+	// Look up where each column goes before going parallel
+	enum ColumnType {DOUBLE_COLUMN, INT_COLUMN, BOOL_COLUMN, STRING_COLUMN, DOUBLE_VECTOR_COLUMN, UNKNOWN_COLUMN};
+
+	const int num_labels = activeLabels.size();
+	std::vector<ColumnType> column_types(num_labels);
+	std::vector<long> column_offsets(num_labels);
+
+	for (int i = 0; i < num_labels; i++)
+	{
+		const EMDLabel label = activeLabels[i];
+
+		if (label == EMDL_UNKNOWN_LABEL)
+		{
+			column_types[i] = UNKNOWN_COLUMN;
+			column_offsets[i] = unknownLabelPosition2Offset[i];
+		}
+		else
+		{
+			if (EMDL::isString(label)) column_types[i] = STRING_COLUMN;
+			else if (EMDL::isDouble(label)) column_types[i] = DOUBLE_COLUMN;
+			else if (EMDL::isInt(label)) column_types[i] = INT_COLUMN;
+			else if (EMDL::isBool(label)) column_types[i] = BOOL_COLUMN;
+			else if (EMDL::isDoubleVector(label)) column_types[i] = DOUBLE_VECTOR_COLUMN;
+			else REPORT_ERROR("Logic error: should not happen");
+
+			column_offsets[i] = label2offset[label];
+		}
+	}
+
+	resizeObjects(nr_objects + nr_rows);
+	const long int first_row = nr_objects - nr_rows;
+
+	// std::vector<bool> cannot be written to from several threads
+	std::vector<std::vector<char> > bool_values(boolColumns.size());
+	for (int i = 0; i < num_labels; i++)
+		if (column_types[i] == BOOL_COLUMN)
+			bool_values[column_offsets[i]].resize(nr_rows, 0);
+
+	// Rows containing quoted strings, escape characters or errors are left to the old parser below
+	std::vector<char> is_slow_row(nr_rows, 0);
+
+	#pragma omp parallel for num_threads(nr_threads) schedule(dynamic, 4096)
+	for (long int r = 0; r < nr_rows; r++)
+	{
+		const char* c = rows[r];
+		const char* line_end = (r + 1 < nr_rows) ? rows[r + 1] - 1 : stop;
+		if (line_end > c && line_end[-1] == '\n') line_end--;
+		if (line_end > c && line_end[-1] == '\r') line_end--;
+
+		const long int objectID = first_row + r;
+		int labelPosition = 0;
+
+		while (true)
+		{
+			while (c < line_end && (*c == ' ' || *c == '\t')) c++;
+
+			if (c == line_end || *c == '#')
+				break;
 
-			// Parse data values
-			int pos = 0;
-			std::string value;
-			labelPosition = 0;
-			while (nextTokenInSTAR(line, pos, value))
+			if (*c == '"' || *c == '\'' || labelPosition >= num_labels)
 			{
-				if (labelPosition >= num_labels)
-				{
-					std::cerr << "Error in line: " << line << std::endl;
-					REPORT_ERROR("A line in the STAR file contains more columns than the number of labels.");
-				}
-				// Check whether this is an unknown label
-				if (activeLabels[labelPosition] == EMDL_UNKNOWN_LABEL)
-				{
-					setUnknownValue(labelPosition, value);
-				}
-				else
-				{
-					setValueFromString(activeLabels[labelPosition], value);
-				}
-				labelPosition++;
+				is_slow_row[r] = 1;
+				break;
 			}
-			if (labelPosition < num_labels && num_labels > 2)
+
+			const char* value = c;
+			for (; c < line_end && *c != ' ' && *c != '\t'; c++)
+				if ((unsigned char)*c < 32) is_slow_row[r] = 1;
+
+			if (is_slow_row[r])
+				break;
+
+			const long offset = column_offsets[labelPosition];
+
+			switch (column_types[labelPosition])
 			{
-				// For backward-compatibility for cases like "fn_mtf <empty>", don't die if num_labels == 2.
-				std::cerr << "Error in line: " << line << std::endl;
-				REPORT_ERROR("A line in the STAR file contains fewer columns than the number of labels. Expected = " + integerToString(num_labels) + " Found = " +  integerToString(labelPosition));
+				case DOUBLE_COLUMN:
+					doubleColumns[offset][objectID] = parseStarDouble(value, c);
+					break;
+				case INT_COLUMN:
+					intColumns[offset][objectID] = parseStarLong(value, c);
+					break;
+				case BOOL_COLUMN:
+					bool_values[offset][r] = (parseStarLong(value, c) != 0);
+					break;
+				case STRING_COLUMN:
+					stringColumns[offset][objectID].assign(value, c - value);
+					break;
+				case DOUBLE_VECTOR_COLUMN:
+					parseDoubleVector(std::string(value, c - value), doubleVectorColumns[offset][objectID]);
+					break;
+				case UNKNOWN_COLUMN:
+					unknownColumns[offset][objectID].assign(value, c - value);
+					break;
 			}
+
+			labelPosition++;
+		}
+
+		// For backward-compatibility for cases like "fn_mtf <empty>", don't die if num_labels == 2.
+		if (labelPosition < num_labels && num_labels > 2)
+			is_slow_row[r] = 1;
+	}
+
+	for (int i = 0; i < num_labels; i++)
+	{
+		if (column_types[i] == BOOL_COLUMN)
+		{
+			const long offset = column_offsets[i];
+			for (long int r = 0; r < nr_rows; r++)
+				boolColumns[offset][first_row + r] = bool_values[offset][r];
+		}
+	}
+
+	for (long int r = 0; r < nr_rows; r++)
+	{
+		if (!is_slow_row[r])
+			continue;
+
+		const char* line_end = (r + 1 < nr_rows) ? rows[r + 1] : stop;
+		std::string line = simplify(std::string(rows[r], line_end - rows[r]));
+		setValuesFromStarRow(line, first_row + r);
+	}
+
+	current_objectID = nr_objects - 1;
+
+	return nr_rows;
+}
+
+void MetaDataTable::setValuesFromStarRow(const std::string &line, long int objectID)
+{
+	const int num_labels = activeLabels.size();
+	current_objectID = objectID;
+
+	// Parse data values
+	int pos = 0;
+	std::string value;
+	int labelPosition = 0;
+	while (nextTokenInSTAR(line, pos, value))
+	{
+		if (labelPosition >= num_labels)
+		{
+			std::cerr << "Error in line: " << line << std::endl;
+			REPORT_ERROR("A line in the STAR file contains more columns than the number of labels.");
+		}
+		// Check whether this is an unknown label
+		if (activeLabels[labelPosition] == EMDL_UNKNOWN_LABEL)
+		{
+			setUnknownValue(labelPosition, value);
+		}
+		else
+		{
+			setValueFromString(activeLabels[labelPosition], value, objectID);
 		}
+		labelPosition++;
+	}
+	if (labelPosition < num_labels && num_labels > 2)
+	{
+		// For backward-compatibility for cases like "fn_mtf <empty>", don't die if num_labels == 2.
+		std::cerr << "Error in line: " << line << std::endl;
+		REPORT_ERROR("A line in the STAR file contains fewer columns than the number of labels. Expected = " + integerToString(num_labels) + " Found = " +  integerToString(labelPosition));
 	}
-
-	return nr_objects;
 }
 
 bool MetaDataTable::readStarList(std::ifstream& in)
 {
 	setIsList(true);
 	addObject();
-	long int objectID = objects.size() - 1;
+	long int objectID = nr_objects - 1;
 
 	std::string line, firstword, value;
 
@@ -1067,13 +1511,19 @@ bool MetaDataTable::readStarList(std::ifstream& in)
 }
 
 long int MetaDataTable::readStar(std::ifstream& in, const std::string &name, bool do_only_count)
+{
+	return readStar(in, NULL, 0, name, do_only_count, 1);
+}
+
+long int MetaDataTable::readStar(std::ifstream& in, const char* mapped, size_t mapped_size, const std::string &name, bool do_only_count, int nr_threads)
 {
 	std::string line, token, value;
 	clear();
 	bool also_has_loop;
 
-	// Start reading the ifstream at the top
-	in.seekg(0);
+	// Start reading the ifstream at the top (a pipe can only be read from where it is)
+	if (in.tellg() > 0)
+		in.seekg(0);
 
 	// Set the version to 30000 by default, in case there is no version tag
 	// (version tags were introduced in version 31000)
@@ -1107,7 +1557,7 @@ long int MetaDataTable::readStar(std::ifstream& in, const std::string &name, boo
 				{
 					if (line.find("loop_") != std::string::npos)
 					{
-						return readStarLoop(in, do_only_count);
+						return readStarLoop(in, mapped, mapped_size, do_only_count, nr_threads);
 					}
 					else if (line[0] == '_')
 					{
@@ -1127,7 +1577,7 @@ long int MetaDataTable::readStar(std::ifstream& in, const std::string &name, boo
 	return 0;
 }
 
-long int MetaDataTable::read(const FileName &filename, const std::string &name, bool do_only_count)
+long int MetaDataTable::read(const FileName &filename, const std::string &name, bool do_only_count, int nr_threads)
 {
 
 	// Clear current table
@@ -1136,6 +1586,10 @@ long int MetaDataTable::read(const FileName &filename, const std::string &name,
 	// Check for an :star extension
 	FileName fn_read = filename.removeFileFormat();
 
+	long int result;
+	if (readBinaryCache(fn_read, name, do_only_count, result))
+		return result;
+
 	std::ifstream in(fn_read.data(), std::ios_base::in);
 
 	if (in.fail())
@@ -1143,12 +1597,485 @@ long int MetaDataTable::read(const FileName &filename, const std::string &name,
 		REPORT_ERROR( (std::string) "MetaDataTable::read: File " + fn_read + " does not exist" );
 	}
 
-	return readStar(in, name, do_only_count);
+	// The stream is used to find the data block, the rows of a loop are parsed from the mapped file.
+	// If the file cannot be mapped (e.g. it is a pipe), everything is read from the stream.
+	MappedFile mapped(fn_read);
 
-	in.close();
+	return readStar(in, mapped.data, mapped.size, name, do_only_count, nr_threads);
+}
 
-	// Go to the first object
-	firstObject();
+// Binary cache ==============================================================
+//
+// <file>.star.rbin starts with a header:
+//   "RLNRBIN1", size and modification time of the STAR file, whether the first
+//   data block can be read without a name, and the number of data blocks.
+// Every data block then has:
+//   its name, version, isList, the return value of readStar, the number of objects,
+//   the number of labels, the type and name of each label and finally the columns.
+// Doubles and integers are stored as 8-byte arrays, bools as 1-byte arrays,
+// strings and vectors as an array of n+1 offsets followed by the concatenated values.
+// All items start at a multiple of 8 bytes, so the columns can be used straight from a memory map.
+
+static const char rbinMagic[8] = {'R', 'L', 'N', 'R', 'B', 'I', 'N', '1'};
+
+enum RbinColumnType {RBIN_DOUBLE, RBIN_INT, RBIN_BOOL, RBIN_STRING, RBIN_DOUBLE_VECTOR, RBIN_UNKNOWN};
+
+class RbinWriter
+{
+public:
+
+	std::ofstream out;
+	size_t pos;
+
+	RbinWriter(const std::string &filename)
+	:	out(filename.c_str(), std::ios::out | std::ios::binary), pos(0)
+	{}
+
+	void put(const void* data, size_t size)
+	{
+		out.write((const char*)data, size);
+		pos += size;
+	}
+
+	void putInt(int64_t value)
+	{
+		put(&value, sizeof(int64_t));
+	}
+
+	void align()
+	{
+		static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+		if (pos % 8 != 0) put(zeros, 8 - pos % 8);
+	}
+
+	void putString(const std::string &value)
+	{
+		putInt(value.size());
+		put(value.data(), value.size());
+		align();
+	}
+
+	void putStrings(const std::vector<std::string> &values)
+	{
+		int64_t offset = 0;
+		putInt(offset);
+		for (size_t i = 0; i < values.size(); i++)
+			putInt(offset += values[i].size());
+
+		for (size_t i = 0; i < values.size(); i++)
+			put(values[i].data(), values[i].size());
+		align();
+	}
+};
+
+// All get functions return NULL or false when reading beyond the end of the cache
+class RbinReader
+{
+public:
+
+	const char* data;
+	size_t size, pos;
+
+	RbinReader(const char* data, size_t size)
+	:	data(data), size(size), pos(0)
+	{}
+
+	const char* get(size_t bytes)
+	{
+		if (pos > size || bytes > size - pos) return NULL;
+
+		const char* ptr = data + pos;
+		pos += bytes;
+		pos += (8 - pos % 8) % 8;
+		return ptr;
+	}
+
+	bool getInt(int64_t &value)
+	{
+		const char* ptr = get(sizeof(int64_t));
+		if (ptr == NULL) return false;
+		memcpy(&value, ptr, sizeof(int64_t));
+		return true;
+	}
+
+	bool getString(std::string &value)
+	{
+		int64_t length;
+		if (!getInt(length) || length < 0) return false;
+		const char* ptr = get(length);
+		if (ptr == NULL) return false;
+		value.assign(ptr, length);
+		return true;
+	}
+
+	// Get the offsets and contents of n strings or vectors with elements of element_size bytes
+	bool getArrays(int64_t n, size_t element_size, const int64_t* &offsets, const char* &values)
+	{
+		offsets = (const int64_t*)get((n + 1) * sizeof(int64_t));
+		if (offsets == NULL || offsets[0] != 0 || offsets[n] > (int64_t)(size / element_size)) return false;
+		for (int64_t i = 0; i < n; i++)
+			if (offsets[i + 1] < offsets[i]) return false;
+		values = get(offsets[n] * element_size);
+		return values != NULL;
+	}
+};
+
+static bool getModificationTime(const FileName &fn, struct stat &st)
+{
+	return stat(fn.c_str(), &st) == 0;
+}
+
+static int64_t modificationSeconds(const struct stat &st)
+{
+#ifdef __APPLE__
+	return st.st_mtimespec.tv_sec;
+#else
+	return st.st_mtim.tv_sec;
+#endif
+}
+
+static int64_t modificationNanoseconds(const struct stat &st)
+{
+#ifdef __APPLE__
+	return st.st_mtimespec.tv_nsec;
+#else
+	return st.st_mtim.tv_nsec;
+#endif
+}
+
+void MetaDataTable::writeBinaryCache(const FileName &fn_star)
+{
+	// The state of the STAR file is recorded before reading it,
+	// so that the cache is invalid if it changes while it is being read
+	struct stat st;
+	if (!getModificationTime(fn_star, st))
+		REPORT_ERROR("MetaDataTable::writeBinaryCache: cannot find file: " + fn_star);
+
+	std::ifstream in(fn_star.data(), std::ios_base::in);
+	if (in.fail())
+		REPORT_ERROR("MetaDataTable::writeBinaryCache: cannot read file: " + fn_star);
+
+	// Find the data blocks in the same way as readStar() does.
+	// Only blocks that start on a data_ line are stored; reading any other name falls back to the STAR file.
+	std::vector<std::string> block_names;
+	std::set<std::string> seen_names;
+	bool has_default_block = false;
+	std::string line;
+
+	while (getline(in, line, '\n'))
+	{
+		trim(line);
+		const size_t pos = line.find("data_");
+		if (pos == std::string::npos)
+			continue;
+
+		const std::string token = line.substr(pos + 5);
+		if (!seen_names.insert(token).second)
+			continue;
+
+		if (seen_names.size() == 1)
+			has_default_block = (pos == 0);
+
+		if (pos == 0)
+			block_names.push_back(token);
+	}
+
+	MappedFile mapped(fn_star);
+
+	const FileName fn_rbin = fn_star + ".rbin";
+	const FileName fn_tmp = fn_rbin + ".tmp";
+	RbinWriter out(fn_tmp);
+	if (!out.out)
+		REPORT_ERROR("MetaDataTable::writeBinaryCache: cannot write to file: " + fn_rbin);
+
+	out.put(rbinMagic, 8);
+	out.putInt(st.st_size);
+	out.putInt(modificationSeconds(st));
+	out.putInt(modificationNanoseconds(st));
+	out.putInt(has_default_block);
+	out.putInt(block_names.size());
+
+	for (int b = 0; b < block_names.size(); b++)
+	{
+		MetaDataTable MD;
+		in.clear();
+		const long int result = MD.readStar(in, mapped.data, mapped.size, block_names[b], false, 1);
+		const long n = MD.nr_objects;
+		const int num_labels = MD.activeLabels.size();
+
+		out.putString(block_names[b]);
+		out.putInt(MD.version);
+		out.putInt(MD.isList);
+		out.putInt(result);
+		out.putInt(n);
+		out.putInt(num_labels);
+
+		std::vector<RbinColumnType> types(num_labels);
+		std::vector<long> offsets(num_labels);
+
+		for (int i = 0; i < num_labels; i++)
+		{
+			const EMDLabel label = MD.activeLabels[i];
+
+			if (label == EMDL_UNKNOWN_LABEL)
+			{
+				types[i] = RBIN_UNKNOWN;
+				offsets[i] = MD.unknownLabelPosition2Offset[i];
+				out.putInt(types[i]);
+				out.putString(MD.unknownLabelNames[offsets[i]]);
+				continue;
+			}
+
+			if (EMDL::isDouble(label)) types[i] = RBIN_DOUBLE;
+			else if (EMDL::isInt(label)) types[i] = RBIN_INT;
+			else if (EMDL::isBool(label)) types[i] = RBIN_BOOL;
+			else if (EMDL::isString(label)) types[i] = RBIN_STRING;
+			else if (EMDL::isDoubleVector(label)) types[i] = RBIN_DOUBLE_VECTOR;
+			else REPORT_ERROR("Logic error: should not happen");
+
+			offsets[i] = MD.label2offset[label];
+			out.putInt(types[i]);
+			out.putString(EMDL::label2Str(label));
+		}
+
+		for (int i = 0; i < num_labels; i++)
+		{
+			const long off = offsets[i];
+
+			switch (types[i])
+			{
+				case RBIN_DOUBLE:
+				{
+					out.put(MD.doubleColumns[off].data(), n * sizeof(double));
+					break;
+				}
+				case RBIN_INT:
+				{
+					for (long r = 0; r < n; r++)
+						out.putInt(MD.intColumns[off][r]);
+					break;
+				}
+				case RBIN_BOOL:
+				{
+					std::vector<char> values(MD.boolColumns[off].begin(), MD.boolColumns[off].end());
+					out.put(values.data(), n);
+					out.align();
+					break;
+				}
+				case RBIN_STRING:
+				{
+					out.putStrings(MD.stringColumns[off]);
+					break;
+				}
+				case RBIN_UNKNOWN:
+				{
+					out.putStrings(MD.unknownColumns[off]);
+					break;
+				}
+				case RBIN_DOUBLE_VECTOR:
+				{
+					const std::vector<std::vector<double> > &column = MD.doubleVectorColumns[off];
+					int64_t offset = 0;
+					out.putInt(offset);
+					for (long r = 0; r < n; r++)
+						out.putInt(offset += column[r].size());
+					for (long r = 0; r < n; r++)
+						out.put(column[r].data(), column[r].size() * sizeof(double));
+					break;
+				}
+			}
+		}
+	}
+
+	out.out.close();
+	if (out.out.fail())
+	{
+		std::remove(fn_tmp.c_str());
+		REPORT_ERROR("MetaDataTable::writeBinaryCache: cannot write to file: " + fn_rbin);
+	}
+
+	std::rename(fn_tmp.c_str(), fn_rbin.c_str());
+}
+
+void MetaDataTable::updateBinaryCache(const FileName &fn_star)
+{
+	const char* do_write = getenv("RELION_WRITE_RBIN");
+
+	if (do_write != NULL && std::string(do_write) != "" && std::string(do_write) != "0")
+		writeBinaryCache(fn_star);
+	else if (exists(fn_star + ".rbin"))
+		std::remove((fn_star + ".rbin").c_str());
+}
+
+bool MetaDataTable::readBinaryCache(const FileName &fn_star, const std::string &name, bool do_only_count, long int &result)
+{
+	const FileName fn_rbin = fn_star + ".rbin";
+
+	struct stat st;
+	if (!exists(fn_rbin) || !getModificationTime(fn_star, st))
+		return false;
+
+	MappedFile mapped(fn_rbin);
+	if (mapped.data == NULL)
+		return false;
+
+	RbinReader in(mapped.data, mapped.size);
+
+	// Only use the cache if the STAR file has not changed since it was written
+	const char* magic = in.get(8);
+	int64_t star_size, star_sec, star_nsec, has_default_block, nr_blocks;
+
+	if (magic == NULL || memcmp(magic, rbinMagic, 8) != 0
+	    || !in.getInt(star_size) || !in.getInt(star_sec) || !in.getInt(star_nsec)
+	    || !in.getInt(has_default_block) || !in.getInt(nr_blocks)
+	    || star_size != st.st_size || star_sec != modificationSeconds(st) || star_nsec != modificationNanoseconds(st))
+	{
+		return false;
+	}
+
+	if (name == "" && !has_default_block)
+		return false;
+
+	for (int64_t b = 0; b < nr_blocks; b++)
+	{
+		std::string block_name;
+		int64_t block_version, block_is_list, block_result, n, num_labels;
+
+		if (!in.getString(block_name) || !in.getInt(block_version) || !in.getInt(block_is_list)
+		    || !in.getInt(block_result) || !in.getInt(n) || !in.getInt(num_labels)
+		    || n < 0 || n > (int64_t)mapped.size || num_labels < 0 || num_labels > (int64_t)mapped.size)
+		{
+			return false;
+		}
+
+		const bool is_wanted = (name == "") ? (b == 0) : (block_name == name);
+
+		std::vector<int64_t> types(num_labels);
+		std::vector<std::string> label_names(num_labels);
+
+		for (int64_t i = 0; i < num_labels; i++)
+			if (!in.getInt(types[i]) || !in.getString(label_names[i]))
+				return false;
+
+		if (is_wanted)
+		{
+			clear();
+			setName(block_name);
+			setVersion(block_version);
+			setIsList(block_is_list);
+
+			for (int64_t i = 0; i < num_labels; i++)
+			{
+				const EMDLabel label = EMDL::str2Label(label_names[i]);
+
+				if (types[i] == RBIN_UNKNOWN)
+				{
+					// A label that has become known since the cache was written
+					if (label != EMDL_UNDEFINED) return false;
+
+					std::cerr << " + WARNING: will ignore (but maintain) values for the unknown label: " << label_names[i] << std::endl;
+					addLabel(EMDL_UNKNOWN_LABEL, label_names[i]);
+				}
+				else
+				{
+					if (label == EMDL_UNDEFINED) return false;
+
+					if (!(types[i] == RBIN_DOUBLE && EMDL::isDouble(label)) &&
+					    !(types[i] == RBIN_INT && EMDL::isInt(label)) &&
+					    !(types[i] == RBIN_BOOL && EMDL::isBool(label)) &&
+					    !(types[i] == RBIN_STRING && EMDL::isString(label)) &&
+					    !(types[i] == RBIN_DOUBLE_VECTOR && EMDL::isDoubleVector(label)))
+					{
+						return false;
+					}
+
+					addLabel(label);
+				}
+			}
+
+			// A repeated label would leave fewer columns than in the cache
+			if (activeLabels.size() != num_labels)
+				return false;
+
+			// Like readStarLoop, only count the objects if so requested
+			if (!do_only_count || block_is_list)
+				resizeObjects(n);
+		}
+
+		const bool do_fill = is_wanted && nr_objects == n;
+
+		for (int64_t i = 0; i < num_labels; i++)
+		{
+			const long off = (do_fill && types[i] == RBIN_UNKNOWN) ? unknownLabelPosition2Offset[i]
+			               : (do_fill) ? label2offset[activeLabels[i]] : -1;
+
+			switch (types[i])
+			{
+				case RBIN_DOUBLE:
+				{
+					const char* values = in.get(n * sizeof(double));
+					if (values == NULL) return false;
+					if (do_fill) memcpy(doubleColumns[off].data(), values, n * sizeof(double));
+					break;
+				}
+				case RBIN_INT:
+				{
+					const char* values = in.get(n * sizeof(int64_t));
+					if (values == NULL) return false;
+					if (do_fill)
+						for (long r = 0; r < n; r++)
+							intColumns[off][r] = ((const int64_t*)values)[r];
+					break;
+				}
+				case RBIN_BOOL:
+				{
+					const char* values = in.get(n);
+					if (values == NULL) return false;
+					if (do_fill)
+						for (long r = 0; r < n; r++)
+							boolColumns[off][r] = values[r];
+					break;
+				}
+				case RBIN_STRING:
+				case RBIN_UNKNOWN:
+				{
+					const int64_t* string_offsets;
+					const char* values;
+					if (!in.getArrays(n, 1, string_offsets, values)) return false;
+					if (do_fill)
+					{
+						std::vector<std::string> &column = (types[i] == RBIN_STRING) ? stringColumns[off] : unknownColumns[off];
+						for (long r = 0; r < n; r++)
+							column[r].assign(values + string_offsets[r], string_offsets[r + 1] - string_offsets[r]);
+					}
+					break;
+				}
+				case RBIN_DOUBLE_VECTOR:
+				{
+					const int64_t* vector_offsets;
+					const char* values;
+					if (!in.getArrays(n, sizeof(double), vector_offsets, values)) return false;
+					if (do_fill)
+						for (long r = 0; r < n; r++)
+							doubleVectorColumns[off][r].assign((const double*)values + vector_offsets[r], (const double*)values + vector_offsets[r + 1]);
+					break;
+				}
+				default:
+					return false;
+			}
+		}
+
+		if (is_wanted)
+		{
+			if (nr_objects > 0)
+				current_objectID = nr_objects - 1;
+
+			result = block_result;
+			return true;
+		}
+	}
+
+	return false;
 }
 
 void MetaDataTable::write(std::ostream& out)
@@ -1195,7 +2122,7 @@ void MetaDataTable::write(std::ostream& out)
 		}
 
 		// Write actual data block
-		for (long int idx = 0; idx < objects.size(); idx++)
+		for (long int idx = 0; idx < nr_objects; idx++)
 		{
 			std::string entryComment = "";
 
@@ -1208,7 +2135,7 @@ void MetaDataTable::write(std::ostream& out)
 					out.width(10);
 					std::string token, val;
 					long offset = unknownLabelPosition2Offset[i];
-					val = objects[idx]->unknowns[offset];
+					val = unknownColumns[offset][idx];
 					escapeStringForSTAR(val);
 					out << val << " ";
 				}
@@ -1269,7 +2196,7 @@ void MetaDataTable::write(std::ostream& out)
 			{
 				long offset = unknownLabelPosition2Offset[i];
 				int w = unknownLabelNames[offset].length();
-				out << "_" << unknownLabelNames[offset] << std::setw(12 + maxWidth - w) << " " << objects[0]->unknowns[offset] << "\n";
+				out << "_" << unknownLabelNames[offset] << std::setw(12 + maxWidth - w) << " " << unknownColumns[offset][0] << "\n";
 			}
 			else if (l != EMDL_COMMENT)
 			{
@@ -1304,6 +2231,8 @@ void MetaDataTable::write(const FileName &fn_out)
 	// Rename to prevent errors with programs in pipeliner reading in incomplete STAR files
 	std::rename(fn_tmp.c_str(), fn_out.c_str());
 
+	updateBinaryCache(fn_out);
+
 }
 
 void MetaDataTable::columnHistogram(EMDLabel label, std::vector<RFLOAT> &histX, std::vector<RFLOAT> &histY,
@@ -1315,32 +2244,24 @@ void MetaDataTable::columnHistogram(EMDLabel label, std::vector<RFLOAT> &histX,
 		REPORT_ERROR("ERROR: The column specified is not present in the MetaDataTable.");
 
 	std::vector<RFLOAT> values;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(*this)
+	if (EMDL::isDouble(label))
 	{
-		RFLOAT val;
-		if (EMDL::isDouble(label))
-		{
-			getValue(label, val);
-		}
-		else if (EMDL::isInt(label))
-		{
-			long aux;
-			getValue(label, aux);
-			val = aux;
-		}
-		else if (EMDL::isBool(label))
-		{
-			bool aux;
-			getValue(label, aux);
-			val = aux ? 1 : 0;
-		}
-		else
-		{
-			REPORT_ERROR("Cannot use --stat_column for this type of column");
-		}
-		values.push_back(val);
+		values = getColumn<RFLOAT>(label);
+	}
+	else if (EMDL::isInt(label))
+	{
+		const std::vector<long> aux = getColumn<long>(label);
+		values.assign(aux.begin(), aux.end());
+	}
+	else if (EMDL::isBool(label))
+	{
+		const std::vector<bool> aux = getColumn<bool>(label);
+		values.assign(aux.begin(), aux.end());
+	}
+	else
+	{
+		REPORT_ERROR("Cannot use --stat_column for this type of column");
 	}
-
 
 	std::string title = EMDL::label2Str(label);
 	histogram(values, histX, histY, verb, title, plot2D, nr_bin, hist_min, hist_max, do_fractional_instead, do_cumulative_instead);
@@ -1484,7 +2405,7 @@ void MetaDataTable::addToCPlot2D(CPlot2D *plot2D, EMDLabel xaxis, EMDLabel yaxis
 	double mydbl;
 	long int myint;
 	double xval, yval;
-	for (long int idx = 0; idx < objects.size(); idx++)
+	for (long int idx = 0; idx < nr_objects; idx++)
 	{
 		const long offx = label2offset[xaxis];
 		if (offx < 0)
@@ -1496,12 +2417,12 @@ void MetaDataTable::addToCPlot2D(CPlot2D *plot2D, EMDLabel xaxis, EMDLabel yaxis
 		}
 		else if (EMDL::isDouble(xaxis))
 		{
-			objects[idx]->getValue(offx, mydbl);
+			getValueAt(offx, idx, mydbl);
 			xval = mydbl;
 		}
 		else if (EMDL::isInt(xaxis))
 		{
-			objects[idx]->getValue(offx, myint);
+			getValueAt(offx, idx, myint);
 			xval = myint;
 		}
 		else
@@ -1513,12 +2434,12 @@ void MetaDataTable::addToCPlot2D(CPlot2D *plot2D, EMDLabel xaxis, EMDLabel yaxis
 
 		if (EMDL::isDouble(yaxis))
 		{
-			objects[idx]->getValue(offy, mydbl);
+			getValueAt(offy, idx, mydbl);
 			yval = mydbl;
 		}
 		else if (EMDL::isInt(yaxis))
 		{
-			objects[idx]->getValue(offy, myint);
+			getValueAt(offy, idx, myint);
 			yval = myint;
 		}
 		else
@@ -1547,16 +2468,21 @@ void MetaDataTable::printLabels(std::ostream &ost)
 
 void MetaDataTable::randomiseOrder()
 {
-	std::random_shuffle(objects.begin(), objects.end());
+	std::vector<long> order(nr_objects);
+	for (long i = 0; i < nr_objects; i++)
+		order[i] = i;
+
+	std::random_shuffle(order.begin(), order.end());
+	permuteObjects(order);
 }
 
 void MetaDataTable::checkObjectID(long id, std::string caller) const
 {
-	if (id >= objects.size() || id < 0)
+	if (id >= nr_objects || id < 0)
 	{
 		std::stringstream sts0, sts1;
 		sts0 << id;
-		sts1 << objects.size();
+		sts1 << nr_objects;
 		REPORT_ERROR(caller+": object " + sts0.str()
 					 + " out of bounds! (" + sts1.str() + " objects present)");
 	}
@@ -1805,28 +2731,24 @@ MetaDataTable subsetMetaDataTable(MetaDataTable &MDin, EMDLabel label, RFLOAT mi
 	if (!MDin.containsLabel(label))
 		REPORT_ERROR("subsetMetadataTable ERROR: input MetaDataTable does not contain label: " +  EMDL::label2Str(label));
 
-	MetaDataTable MDout;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDin)
+	std::vector<RFLOAT> values;
+	if (EMDL::isInt(label))
 	{
-		bool do_include = false;
-		if (EMDL::isInt(label))
-		{
-			long val;
-			MDin.getValue(label, val);
-			do_include = ((RFLOAT)val <= max_value && (RFLOAT)val >= min_value);
-		}
-		else
-		{
-			RFLOAT val;
-			MDin.getValue(label, val);
-			do_include = ((RFLOAT)val <= max_value && (RFLOAT)val >= min_value);
-		}
+		const std::vector<long> aux = MDin.getColumn<long>(label);
+		values.assign(aux.begin(), aux.end());
+	}
+	else
+	{
+		values = MDin.getColumn<RFLOAT>(label);
+	}
 
-		if (do_include)
+	MetaDataTable MDout;
+	for (long i = 0; i < values.size(); i++)
+	{
+		if (values[i] <= max_value && values[i] >= min_value)
 		{
-			MDout.addObject(MDin.getObject(current_object));
+			MDout.addObject(MDin.getObject(i));
 		}
-
 	}
 
 	return MDout;
@@ -1842,17 +2764,16 @@ MetaDataTable subsetMetaDataTable(MetaDataTable &MDin, EMDLabel label, std::stri
 	if (!MDin.containsLabel(label))
 		REPORT_ERROR("subsetMetadataTable ERROR: input MetaDataTable does not contain label: " +  EMDL::label2Str(label));
 
+	const std::vector<std::string> values = MDin.getColumn<std::string>(label);
+
 	MetaDataTable MDout;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDin)
+	for (long i = 0; i < values.size(); i++)
 	{
-		std::string val;
-		MDin.getValue(label, val);
-
-		bool found = (val.find(search_str) != std::string::npos);
+		bool found = (values[i].find(search_str) != std::string::npos);
 
 		if ((!exclude && found) || (exclude && !found))
 		{
-			MDout.addObject(MDin.getObject(current_object));
+			MDout.addObject(MDin.getObject(i));
 		}
 	}
 
@@ -1889,27 +2810,28 @@ MetaDataTable removeDuplicatedParticles(MetaDataTable &MDin, EMDLabel mic_label,
 
 	// group by micrograph
 	std::map<std::string, std::vector<long> > grouped;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDin)
 	{
-		std::string mic_name;
-		MDin.getValue(mic_label, mic_name);
+		const std::vector<std::string> mic_names = MDin.getColumn<std::string>(mic_label);
+		const std::vector<RFLOAT> origin_xs = MDin.getColumn<RFLOAT>(EMDL_ORIENT_ORIGIN_X_ANGSTROM);
+		const std::vector<RFLOAT> origin_ys = MDin.getColumn<RFLOAT>(EMDL_ORIENT_ORIGIN_Y_ANGSTROM);
+		const std::vector<RFLOAT> coord_xs = MDin.getColumn<RFLOAT>(EMDL_IMAGE_COORD_X);
+		const std::vector<RFLOAT> coord_ys = MDin.getColumn<RFLOAT>(EMDL_IMAGE_COORD_Y);
 
-		RFLOAT val1, val2;
-		MDin.getValue(EMDL_ORIENT_ORIGIN_X_ANGSTROM, val1);
-		MDin.getValue(EMDL_IMAGE_COORD_X, val2);
-		xs[current_object] = -val1 * origin_scale + val2;
-		MDin.getValue(EMDL_ORIENT_ORIGIN_Y_ANGSTROM, val1);
-		MDin.getValue(EMDL_IMAGE_COORD_Y, val2);
-		ys[current_object] = -val1 * origin_scale + val2;
+		for (long i = 0; i < mic_names.size(); i++)
+		{
+			xs[i] = -origin_xs[i] * origin_scale + coord_xs[i];
+			ys[i] = -origin_ys[i] * origin_scale + coord_ys[i];
+			grouped[mic_names[i]].push_back(i);
+		}
 
 		if (dataIs3D)
-        {
-            MDin.getValue(EMDL_ORIENT_ORIGIN_Z_ANGSTROM, val1);
-            MDin.getValue(EMDL_IMAGE_COORD_Z, val2);
-            zs[current_object] = -val1 * origin_scale + val2;
-        }
+		{
+			const std::vector<RFLOAT> origin_zs = MDin.getColumn<RFLOAT>(EMDL_ORIENT_ORIGIN_Z_ANGSTROM);
+			const std::vector<RFLOAT> coord_zs = MDin.getColumn<RFLOAT>(EMDL_IMAGE_COORD_Z);
 
-		grouped[mic_name].push_back(current_object);
+			for (long i = 0; i < mic_names.size(); i++)
+				zs[i] = -origin_zs[i] * origin_scale + coord_zs[i];
+		}
 	}
 
 	// find duplicate
@@ -76,13 +76,11 @@
  *	- the rows are stored in per-type contiguous blocks of memory
  *
  *	2020/Nov/12:
- *	  This class is organized as an array (`objects`) of structures (`MetaDataContainer`).
- *
- *        `activeLabels` contains all valid labels.
- *        Even when a label is `deactivateLabel`-ed, the values remain in `MetaDataContainer`s.
+ *	  `activeLabels` contains all valid labels.
+ *        Even when a label is `deactivateLabel`-ed, the values remain in the column arrays.
  *        The label is only removed from `activeLabels`.
  *
- *        Each data type (int, double, etc) contains its own storage array inside `MetaDataContainer`.
+ *        Each data type (int, double, etc) has its own set of columns.
  *        Thus, values in `label2offsets` are NOT unique. Accessing columns via a wrong type is
  *        very DANGEROUS. Use `cmake -DMDT_TYPE_CHECK=ON` to enable runtime checks.
  *
@@ -95,20 +93,35 @@
  *        Whenever `activeLabels` is modified, `unknownLabelPosition2Offset` MUST be updated accordingly.
  *        When the label for a column is EMD_UNKNOWN_LABEL, the corresponding element in
  *        `unknownLabelPosition2Offset` must store the offset in `unknownLabelNames` and
- *        `MetaDataContainer->unknowns`. Otherwise, the value does not matter.
+ *        `unknownColumns`. Otherwise, the value does not matter.
+ *
+ *	2026/Oct/17:
+ *	  The table is stored column-major: one contiguous array per label (e.g. `doubleColumns`),
+ *	  instead of one heap-allocated MetaDataContainer per row. A MetaDataContainer is now only
+ *	  a reference to a row (table + objectID). All columns, including deactivated ones,
+ *	  always have exactly `nr_objects` elements.
+ *	  Use getColumn() and setColumn() to access a whole column at once.
  */
 class MetaDataTable
 {
-	// Effectively stores all metadata
-	std::vector<MetaDataContainer*> objects;
+	// Number of objects (rows) in the table
+	long nr_objects;
 
-	// Maps labels to corresponding indices in the vectors in MetaDataContainer.
-	// The length of label2offset is always equal to the number of defined labels (~320)
+	// Effectively stores all metadata: one array per column.
 	// e.g.:
 	// the value of "defocus-U" for row r is stored in:
-	//	 objects[r]->doubles[label2offset[EMDL_CTF_DEFOCUSU]]
+	//	 doubleColumns[label2offset[EMDL_CTF_DEFOCUSU]][r]
 	// the value of "image name" is stored in:
-	//	 objects[r]->strings[label2offset[EMDL_IMAGE_NAME]]
+	//	 stringColumns[label2offset[EMDL_IMAGE_NAME]][r]
+	std::vector<std::vector<double> > doubleColumns;
+	std::vector<std::vector<long> > intColumns;
+	std::vector<std::vector<bool> > boolColumns;
+	std::vector<std::vector<std::string> > stringColumns;
+	std::vector<std::vector<std::vector<double> > > doubleVectorColumns;
+	std::vector<std::vector<std::string> > unknownColumns;
+
+	// Maps labels to corresponding indices in the per-type column arrays.
+	// The length of label2offset is always equal to the number of defined labels (~320)
 	std::vector<long> label2offset;
 
 	/** What labels have been read from a docfile/metadata file
@@ -123,8 +136,8 @@ class MetaDataTable
 	// Current object id
 	long current_objectID;
 
-	// Number of labels of each type
-	long doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels;
+	// Number of rows for which memory has been reserved
+	size_t reserved_objects;
 
 	// Is this a 2D table or a 1D list?
 	bool isList;
@@ -189,6 +202,16 @@ public:
 	bool setUnknownValue(int labelPosition, const std::string &value);
 	bool setValueFromString(EMDLabel label, const std::string &value, long int objectID = -1);
 
+	// Get all values of a column as a flat array (one element per object).
+	// The values are converted to T as in getValue. Crashes if the label is not present.
+	template<class T>
+	std::vector<T> getColumn(EMDLabel label) const;
+
+	// Set all values of a column from a flat array (one element per object).
+	// The label is added if it was not present yet.
+	template<class T>
+	void setColumn(EMDLabel label, const std::vector<T> &values);
+
 	// Sort the order of the elements based on the values in the input label
 	// (only numbers, no strings/bools)
 	void sort(EMDLabel name, bool do_reverse = false, bool only_set_index = false, bool do_random = false);
@@ -216,8 +239,8 @@ public:
 	// insert all missing labels
 	void append(const MetaDataTable& app);
 
-	// Get metadatacontainer for objectID (current_objectID if objectID < 0)
-	MetaDataContainer* getObject(long objectID = -1) const;
+	// Get a reference to the row objectID (current_objectID if objectID < 0)
+	MetaDataContainer getObject(long objectID = -1) const;
 
 	/* setObject(data, objectID)
 	 *  copies values from 'data' to object 'objectID'.
@@ -226,7 +249,7 @@ public:
 	 *  Undefined labels are inserted.
 	 *
 	 *  Use addObject() to set an object that does not yet exist */
-	void setObject(MetaDataContainer* data, long objectID = -1);
+	void setObject(const MetaDataContainer &data, long objectID = -1);
 
 	/* setValuesOfDefinedLabels(data, objectID)
 	 * copies values from 'data' to object 'objectID'.
@@ -235,7 +258,7 @@ public:
 	 * Only already defined labels are considered.
 	 *
 	 * Use addValuesOfDefinedLabels() to add an object that does not yet exist */
-	void setValuesOfDefinedLabels(MetaDataContainer* data, long objectID = -1);
+	void setValuesOfDefinedLabels(const MetaDataContainer &data, long objectID = -1);
 
 	// reserve memory for this many lines
 	void reserve(size_t capacity);
@@ -249,13 +272,13 @@ public:
 	 *  Adds a new object and sets its values to those from 'data'.
 	 *  The set of labels for the table is extended as necessary.
 	 *  Afterwards, 'current_objectID' points to the newly added object.*/
-	void addObject(MetaDataContainer* data);
+	void addObject(const MetaDataContainer &data);
 
 	/* addValuesOfDefinedLabels(data)
 	 *  Adds a new object and sets the already defined values to those from 'data'.
 	 *  Labels from 'data' that are not already defined are ignored.
 	 *  Afterwards, 'current_objectID' points to the newly added object.*/
-	void addValuesOfDefinedLabels(MetaDataContainer* data);
+	void addValuesOfDefinedLabels(const MetaDataContainer &data);
 
 	/* removeObject(objectID)
 	 *  If objectID is not given, 'current_objectID' will be removed.
@@ -292,7 +315,19 @@ public:
 	long int readStar(std::ifstream& in, const std::string &name = "", bool do_only_count = false);
 
 	// Read a MetaDataTable (get file format from extension)
-	long int read(const FileName &filename, const std::string &name = "", bool do_only_count = false);
+	// STAR files are memory-mapped, so the rows of a loop are parsed straight from the file, on nr_threads threads
+	long int read(const FileName &filename, const std::string &name = "", bool do_only_count = false, int nr_threads = 1);
+
+	/* Binary cache of a STAR file: <fn_star>.rbin holds all data blocks of fn_star as columns.
+	 * read() uses it instead of parsing fn_star, as long as fn_star has not changed since the cache was written. */
+	static void writeBinaryCache(const FileName &fn_star);
+
+	/* To be called after writing fn_star: rewrite its binary cache if the environment variable
+	 * RELION_WRITE_RBIN is set (and not 0), otherwise remove the cache as it is now out of date. */
+	static void updateBinaryCache(const FileName &fn_star);
+
+	// Parse the rows of STAR loops one line at a time, as is always done for pipes (for comparisons only)
+	static void setLineByLineStarReading(bool line_by_line);
 
 	// Write a MetaDataTable in STAR format
 	void write(std::ostream& out = std::cout);
@@ -340,13 +375,132 @@ public:
 
 private:
 
+	static bool line_by_line_star_reading;
+
+	/* Versions of readStar and readStarLoop that take the contents of the file behind 'in' as well.
+	 * If 'mapped' is NULL, the rows of the loop are first copied from 'in' into a buffer.
+	 * If 'in' cannot seek (a pipe), the rows are parsed one by one as they are read. */
+	long int readStar(std::ifstream& in, const char* mapped, size_t mapped_size, const std::string &name, bool do_only_count, int nr_threads);
+	long int readStarLoop(std::ifstream& in, const char* mapped, size_t mapped_size, bool do_only_count, int nr_threads);
+
+	/* Read data block 'name' from the binary cache of fn_star.
+	 * Returns false if there is no up-to-date cache or if it does not contain that block. */
+	bool readBinaryCache(const FileName &fn_star, const std::string &name, bool do_only_count, long int &result);
+
+	/* Parse the rows of a loop in [begin, end) until the first empty line.
+	 * 'consumed' is set to the number of bytes read, including the empty line. */
+	long int readStarLoopRows(const char* begin, const char* end, bool do_only_count, size_t &consumed, int nr_threads);
+
+	/* Parse the rows of a loop one line at a time from 'in', starting with the one in 'line',
+	 * until the first empty line. */
+	long int readStarLoopRows(std::ifstream& in, std::string& line, bool do_only_count);
+
+	// Set the values of object objectID from one (simplified) row of a loop, die if it does not match the labels
+	void setValuesFromStarRow(const std::string &line, long int objectID);
+
 	// Check if 'id' corresponds to an actual object.
 	// Crash if it does not.
 	void checkObjectID(long id, std::string caller) const;
 
 	/* setObjectUnsafe(data)
 	 *  Same as setObject, but assumes that all labels are present. */
-	void setObjectUnsafe(MetaDataContainer* data, long objId);
+	void setObjectUnsafe(const MetaDataContainer &data, long objId);
+
+	// Reorder all columns so that new row i is old row order[i]
+	void permuteObjects(const std::vector<long> &order);
+
+	// Grow or shrink all columns to 'size' objects. New objects get default values.
+	void resizeObjects(long size);
+
+	// Offset in this table of the column at 'labelPosition' in src.activeLabels (-1 if absent)
+	long getOffsetOfColumnIn(const MetaDataTable &src, long labelPosition) const;
+
+	// Typed access to the column arrays
+	void getValueAt(long offset, long objectID, double& dest) const
+	{
+		dest = doubleColumns[offset][objectID];
+	}
+
+	void getValueAt(long offset, long objectID, float& dest) const
+	{
+		dest = (float)doubleColumns[offset][objectID];
+	}
+
+	void getValueAt(long offset, long objectID, int& dest) const
+	{
+		dest = (int)intColumns[offset][objectID];
+	}
+
+	void getValueAt(long offset, long objectID, long& dest) const
+	{
+		dest = intColumns[offset][objectID];
+	}
+
+	void getValueAt(long offset, long objectID, bool& dest) const
+	{
+		dest = boolColumns[offset][objectID];
+	}
+
+	void getValueAt(long offset, long objectID, std::string& dest) const
+	{
+		const std::string &src = stringColumns[offset][objectID];
+		if (src == "\"\"") dest = "";
+		else dest = src;
+	}
+
+	void getValueAt(long offset, long objectID, std::vector<double>& dest) const
+	{
+		dest = doubleVectorColumns[offset][objectID];
+	}
+
+	void getValueAt(long offset, long objectID, std::vector<float>& dest) const
+	{
+		const std::vector<double> &src = doubleVectorColumns[offset][objectID];
+		dest.resize(src.size());
+		std::copy(src.begin(), src.end(), dest.begin());
+	}
+
+	void setValueAt(long offset, long objectID, const double& src)
+	{
+		doubleColumns[offset][objectID] = src;
+	}
+
+	void setValueAt(long offset, long objectID, const float& src)
+	{
+		doubleColumns[offset][objectID] = src;
+	}
+
+	void setValueAt(long offset, long objectID, const int& src)
+	{
+		intColumns[offset][objectID] = src;
+	}
+
+	void setValueAt(long offset, long objectID, const long& src)
+	{
+		intColumns[offset][objectID] = src;
+	}
+
+	void setValueAt(long offset, long objectID, const bool& src)
+	{
+		boolColumns[offset][objectID] = src;
+	}
+
+	void setValueAt(long offset, long objectID, const std::string& src)
+	{
+		stringColumns[offset][objectID] = (src.length() == 0) ? "\"\"" : src;
+	}
+
+	void setValueAt(long offset, long objectID, const std::vector<double>& src)
+	{
+		doubleVectorColumns[offset][objectID] = src;
+	}
+
+	void setValueAt(long offset, long objectID, const std::vector<float>& src)
+	{
+		std::vector<double> &dest = doubleVectorColumns[offset][objectID];
+		dest.resize(src.size());
+		std::copy(src.begin(), src.end(), dest.begin());
+	}
 
 };
 
@@ -418,7 +572,7 @@ bool MetaDataTable::getValue(EMDLabel label, T& value, long objectID) const
 		else
 			checkObjectID(objectID,  "MetaDataTable::getValue");
 
-		objects[objectID]->getValue(off, value);
+		getValueAt(off, objectID, value);
 		return true;
 	}
 	else
@@ -455,7 +609,7 @@ bool MetaDataTable::setValue(EMDLabel label, const T &value, long int objectID)
 
 	if (off > -1)
 	{
-		objects[objectID]->setValue(off, value);
+		setValueAt(off, objectID, value);
 		return true;
 	}
 	else
@@ -464,4 +618,63 @@ bool MetaDataTable::setValue(EMDLabel label, const T &value, long int objectID)
 	}
 }
 
+template<class T>
+std::vector<T> MetaDataTable::getColumn(EMDLabel label) const
+{
+	if (label < 0 || label >= EMDL_LAST_LABEL || label == EMDL_UNKNOWN_LABEL)
+		REPORT_ERROR("MetaDataTable::getColumn does not support this label.");
+
+	const long off = label2offset[label];
+	if (off < 0)
+		REPORT_ERROR("MetaDataTable::getColumn: the table does not contain label " + EMDL::label2Str(label));
+
+	std::vector<T> values(nr_objects);
+
+#ifdef METADATA_TABLE_TYPE_CHECK
+	if (nr_objects > 0 && !isTypeCompatible(label, values[0]))
+		REPORT_ERROR("Runtime error: wrong type given to MetaDataTable::getColumn for label " + EMDL::label2Str(label));
+#endif
+
+	T value;
+	for (long i = 0; i < nr_objects; i++)
+	{
+		getValueAt(off, i, value);
+		values[i] = value;
+	}
+
+	return values;
+}
+
+template<class T>
+void MetaDataTable::setColumn(EMDLabel label, const std::vector<T> &values)
+{
+	if (label < 0 || label >= EMDL_LAST_LABEL || label == EMDL_UNKNOWN_LABEL)
+		REPORT_ERROR("MetaDataTable::setColumn does not support this label.");
+
+	if (values.size() != nr_objects)
+		REPORT_ERROR("MetaDataTable::setColumn: the number of values does not match the number of objects.");
+
+#ifdef METADATA_TABLE_TYPE_CHECK
+	if (nr_objects > 0)
+	{
+		T value = values[0];
+		if (!isTypeCompatible(label, value))
+			REPORT_ERROR("Runtime error: wrong type given to MetaDataTable::setColumn for label " + EMDL::label2Str(label));
+	}
+#endif
+
+	long off = label2offset[label];
+	if (off < 0)
+	{
+		addLabel(label);
+		off = label2offset[label];
+	}
+
+	for (long i = 0; i < nr_objects; i++)
+	{
+		T value = values[i];
+		setValueAt(off, i, value);
+	}
+}
+
 #endif
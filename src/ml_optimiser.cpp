@@ -66,18 +66,14 @@ ThreadManager * global_ThreadManager;
 
 /** ========================== Threaded parallelization of expectation === */
 
+#ifdef CUDA
 void globalThreadExpectationSomeParticles(ThreadArgument &thArg)
 {
 	MlOptimiser *MLO = (MlOptimiser*) thArg.workClass;
 
 	try
 	{
-#ifdef CUDA
-		if (MLO->do_gpu)
-			((MlOptimiserCuda*) MLO->cudaOptimisers[thArg.thread_id])->doThreadExpectationSomeParticles(thArg.thread_id);
-		else
-#endif
-		MLO->doThreadExpectationSomeParticles(thArg.thread_id);
+		((MlOptimiserCuda*) MLO->cudaOptimisers[thArg.thread_id])->doThreadExpectationSomeParticles(thArg.thread_id);
 	}
 	catch (RelionError XE)
 	{
@@ -86,6 +82,7 @@ void globalThreadExpectationSomeParticles(ThreadArgument &thArg)
 		MLO->threadException = gE;
 	}
 }
+#endif
 
 
 /** ========================== I/O operations  =========================== */
@@ -403,6 +400,11 @@ void MlOptimiser::parseContinue(int argc, char **argv)
 	combine_weights_thru_disc = !parser.checkOption("--dont_combine_weights_via_disc", "Send the large arrays of summed weights through the MPI network, instead of writing large files to disc");
 	do_shifts_onthefly = parser.checkOption("--onthefly_shifts", "Calculate shifted images on-the-fly, do not store precalculated ones in memory");
 	do_preread_images  = parser.checkOption("--preread_images", "Use this to let the leader process read all particles into memory. Be careful you have enough RAM for large data sets!");
+	do_prefetch_images = parser.checkOption("--prefetch_images", "Read the particles of the next pools on separate I/O threads while the current pool is being processed");
+	prefetch_pools = textToInteger(parser.getOption("--prefetch_pools", "Number of pools to read ahead with --prefetch_images", "2"));
+	prefetch_threads = textToInteger(parser.getOption("--prefetch_threads", "Number of I/O threads for --prefetch_images", "1"));
+	prefetch_max_mem_Gb = textToFloat(parser.getOption("--prefetch_max_mem", "Maximum memory (in Gb) for the particles that are read ahead with --prefetch_images", "2"));
+	do_pool_arrays = parser.checkOption("--pool_arrays", "Re-use the memory of arrays that are freed during the expectation of a particle, instead of returning it to the system");
 	fn_scratch = parser.getOption("--scratch_dir", "If provided, particle stacks will be copied to this local scratch disk prior to refinement.", "");
 	keep_free_scratch_Gb = textToFloat(parser.getOption("--keep_free_scratch", "Space available for copying particle stacks (in Gb)", "10"));
 	do_reuse_scratch = parser.checkOption("--reuse_scratch", "Re-use data on scratchdir, instead of wiping it and re-copying all data. This works only when ALL particles have already been cached.");
@@ -687,6 +689,11 @@ void MlOptimiser::parseInitial(int argc, char **argv)
 	do_shifts_onthefly = parser.checkOption("--onthefly_shifts", "Calculate shifted images on-the-fly, do not store precalculated ones in memory");
 	do_parallel_disc_io = !parser.checkOption("--no_parallel_disc_io", "Do NOT let parallel (MPI) processes access the disc simultaneously (use this option with NFS)");
 	do_preread_images  = parser.checkOption("--preread_images", "Use this to let the leader process read all particles into memory. Be careful you have enough RAM for large data sets!");
+	do_prefetch_images = parser.checkOption("--prefetch_images", "Read the particles of the next pools on separate I/O threads while the current pool is being processed");
+	prefetch_pools = textToInteger(parser.getOption("--prefetch_pools", "Number of pools to read ahead with --prefetch_images", "2"));
+	prefetch_threads = textToInteger(parser.getOption("--prefetch_threads", "Number of I/O threads for --prefetch_images", "1"));
+	prefetch_max_mem_Gb = textToFloat(parser.getOption("--prefetch_max_mem", "Maximum memory (in Gb) for the particles that are read ahead with --prefetch_images", "2"));
+	do_pool_arrays = parser.checkOption("--pool_arrays", "Re-use the memory of arrays that are freed during the expectation of a particle, instead of returning it to the system");
 	fn_scratch = parser.getOption("--scratch_dir", "If provided, particle stacks will be copied to this local scratch disk prior to refinement.", "");
 	keep_free_scratch_Gb = textToFloat(parser.getOption("--keep_free_scratch", "Space available for copying particle stacks (in Gb)", "10"));
 	do_reuse_scratch = parser.checkOption("--reuse_scratch", "Re-use data on scratchdir, instead of wiping it and re-copying all data.");
@@ -986,7 +993,7 @@ void MlOptimiser::read(FileName fn_in, int rank, bool do_prevent_preread)
 	bool do_preread = (do_preread_images) ? (do_parallel_disc_io || rank == 0) : false;
 	if (do_prevent_preread) do_preread = false;
 	bool is_helical_segment = (do_helical_refine) || ((mymodel.ref_dim == 2) && (helical_tube_outer_diameter > 0.));
-	mydata.read(fn_data, false, false, do_preread, is_helical_segment);
+	mydata.read(fn_data, false, false, do_preread, is_helical_segment, 0, nr_threads);
 
 #ifdef DEBUG_READ
 	std::cerr<<"MlOptimiser::readStar before model."<<std::endl;
@@ -1309,7 +1316,7 @@ void MlOptimiser::initialise()
 
 	// And allow plans before expectation to run using allowed
 	// number of threads
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	if (fn_sigma != "")
@@ -1626,7 +1633,7 @@ void MlOptimiser::initialiseGeneral(int rank)
 		bool do_preread = (do_preread_images) ? (do_parallel_disc_io || rank == 0) : false;
 		bool is_helical_segment = (do_helical_refine) || ((mymodel.ref_dim == 2) && (helical_tube_outer_diameter > 0.));
 		int myverb = (rank==0) ? 1 : 0;
-		mydata.read(fn_data, true, false, do_preread, is_helical_segment, myverb); // true means ignore original particle name
+		mydata.read(fn_data, true, false, do_preread, is_helical_segment, myverb, nr_threads); // true means ignore original particle name
 
 		// Read in the reference(s) and initialise mymodel
 		int refdim = (fn_ref == "denovo") ? 3 : 2;
@@ -1934,6 +1941,7 @@ void MlOptimiser::initialiseGeneral(int rank)
 			sampling.tilt_angles.push_back(tilt);
 			sampling.directions_ipix.push_back(ipix);
 		}
+		sampling.buildDirectionIndex();
 		sampling.psi_angles.clear();
 		sampling.psi_angles.push_back(psi);
 		directions_have_changed = true;
@@ -2516,6 +2524,17 @@ void MlOptimiser::iterateSetup()
 	// Set up the thread task distributors for the particles and the orientations (will be resized later on)
 	exp_ipart_ThreadTaskDistributor = new ThreadTaskDistributor(nr_threads, 1);
 
+	// Read the particles on separate I/O threads (only for 2D images, 3D ones are read by the threads themselves)
+	if (do_prefetch_images && do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3)
+	{
+		int max_size = 0;
+		for (int i = 0; i < image_full_size.size(); i++)
+			max_size = XMIPP_MAX(max_size, image_full_size[i]);
+		RFLOAT image_bytes = XMIPP_MAX(1, max_size * max_size) * sizeof(RFLOAT);
+		long int max_images = XMIPP_MAX(1, (long int)(prefetch_max_mem_Gb * 1024. * 1024. * 1024. / image_bytes));
+		exp_prefetcher = new ImagePrefetcher(prefetch_threads, max_images);
+	}
+
 }
 void MlOptimiser::iterateWrapUp()
 {
@@ -2524,6 +2543,8 @@ void MlOptimiser::iterateWrapUp()
 	delete global_barrier;
 	delete global_ThreadManager;
 	delete exp_ipart_ThreadTaskDistributor;
+	delete exp_prefetcher;
+	exp_prefetcher = NULL;
 
 	// Delete volatile space on scratch
 	if (!keep_scratch)
@@ -2713,7 +2734,12 @@ void MlOptimiser::iterate()
 
 #ifdef TIMING
 		if (verb > 0)
+		{
 			timer.printTimes(false);
+			// Number of tasks (particles) and busy time of each thread in the expectation
+			global_ThreadManager->getPool().printStatistics();
+		}
+		global_ThreadManager->getPool().resetStatistics();
 #endif
 
 
@@ -2722,6 +2748,10 @@ void MlOptimiser::iterate()
 	// delete threads etc
 	iterateWrapUp();
 
+	// Only now that the threads have exited are their statistics complete
+	if (do_pool_arrays && verb > 0)
+		printMultidimArrayPoolStatistics();
+
 }
 
 void MlOptimiser::expectation()
@@ -2734,7 +2764,7 @@ void MlOptimiser::expectation()
 
 #ifdef MKLFFT
 	// Allow parallel FFTW execution
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	// Initialise some stuff
@@ -2894,7 +2924,7 @@ void MlOptimiser::expectation()
 
 #ifdef MKLFFT
 	// Single-threaded FFTW execution for code inside parallel processing loop
-	fftw_plan_with_nthreads(1);
+	FourierTransformer::setPlannerThreads(1);
 #endif
 
 	// Now perform real expectation over all particles
@@ -2938,6 +2968,10 @@ void MlOptimiser::expectation()
 		// Get the metadata for these particles
 		getMetaAndImageDataSubset(my_pool_first_part_id, my_pool_last_part_id, !do_parallel_disc_io);
 
+		// Read the images of this pool and the next ones on the I/O threads
+		if (exp_prefetcher != NULL)
+			prefetchPools(my_pool_first_part_id, my_last_part_id);
+
 #ifdef TIMING
 		timer.toc(TIMING_EXP_METADATA);
 #endif
@@ -3091,7 +3125,7 @@ void MlOptimiser::expectation()
 #ifdef  MKLFFT
 	// Allow parallel FFTW execution to continue now that we are outside the parallel
 	// portion of expectation
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	// Clean up some memory
@@ -3376,6 +3410,7 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 	// Store total number of particle images in this bunch of SomeParticles, and set translations and orientations for skip_align/rotate
 	long int my_metadata_offset = 0;
 	exp_imgs.clear();
+	std::vector<FileName> exp_fn_prefetch;
     int metadata_offset = 0;
     for (long int part_id_sorted = my_first_part_id; part_id_sorted <= my_last_part_id; part_id_sorted++)
 	{
@@ -3439,7 +3474,26 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 
 		// Sjors 7 March 2016 to prevent too high disk access... Read in all pooled images simultaneously
 		// Don't do this for sub-tomograms to save RAM!
-		if (do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3)
+		if (do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3 && exp_prefetcher != NULL)
+		{
+			// Leave the reading to the I/O threads of the prefetcher
+			if (!exp_prefetcher->isRequested(my_first_part_id))
+			{
+				for (int img_id = 0; img_id < mydata.numberOfImagesInParticle(part_id); img_id++, my_metadata_offset++)
+				{
+					if (!mydata.getImageNameOnScratch(part_id, img_id, fn_img))
+					{
+						std::istringstream split(exp_fn_img);
+						for (int i = 0; i <= my_metadata_offset; i++)
+						{
+							getline(split, fn_img);
+						}
+					}
+					exp_fn_prefetch.push_back(fn_img);
+				}
+			}
+		}
+		else if (do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3)
 		{
 			// Read in the actual image from disc, only open/close common stacks once
 			// Read in all images, only open/close common stacks once
@@ -3477,18 +3531,35 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 
 	} //end loop over part_id
 
+	// In MPI runs the followers only know their pool now, so it has not been requested yet
+	if (exp_prefetcher != NULL)
+	{
+		if (!exp_prefetcher->isRequested(my_first_part_id))
+			exp_prefetcher->request(my_first_part_id, exp_fn_prefetch);
+		exp_prefetcher->setCurrent(my_first_part_id);
+	}
+
 
 #ifdef DEBUG_EXPSOME
 	std::cerr << " exp_my_first_part_id= " << exp_my_first_part_id << " exp_my_last_part_id= " << exp_my_last_part_id << std::endl;
 #endif
-	if (!do_cpu)
+#ifdef CUDA
+	if (do_gpu)
 	{
-		// GPU and traditional CPU case - use RELION's built-in task manager to
-		// process multiple particles at once
+		// GPU case - use RELION's built-in task manager to process multiple
+		// particles at once, one GPU optimiser per thread
 		exp_ipart_ThreadTaskDistributor->resize(my_last_part_id - my_first_part_id + 1, 1);
 		exp_ipart_ThreadTaskDistributor->reset();
 		global_ThreadManager->run(globalThreadExpectationSomeParticles);
 	}
+	else
+#endif
+	if (!do_cpu)
+	{
+		// Traditional CPU case - the threads of the work-stealing pool take
+		// particles from each other until all of them have been done
+		doThreadExpectationSomeParticles(my_last_part_id - my_first_part_id + 1);
+	}
 #ifdef ALTCPU
 	else
 	{
@@ -3522,6 +3593,9 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 	if (threadException != NULL)
 		throw *threadException;
 
+	if (exp_prefetcher != NULL)
+		exp_prefetcher->releaseCurrent();
+
 #ifdef TIMING
     timer.toc(TIMING_ESP);
 #endif
@@ -3530,52 +3604,51 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 }
 
 
-void MlOptimiser::doThreadExpectationSomeParticles(int thread_id)
+void MlOptimiser::doThreadExpectationSomeParticles(long int nr_particles)
 {
 
 #ifdef TIMING
-	// Only time one thread
-	if (thread_id == 0)
-		timer.tic(TIMING_ESP_THR);
+	// Only time the calling thread (which is thread 0 of the pool)
+	timer.tic(TIMING_ESP_THR);
 #endif
 
-	size_t first_ipart = 0, last_ipart = 0;
-	while (exp_ipart_ThreadTaskDistributor->getTasks(first_ipart, last_ipart))
+	global_ThreadManager->getPool().parallelFor(0, nr_particles - 1, [this](long int ipart, int thread_id)
 	{
+		// Keep the pool of arrays of this thread from one particle to the next
+		multidimArrayPoolKeepInThread(do_pool_arrays);
+
 //#define DEBUG_EXPSOMETHR
 #ifdef DEBUG_EXPSOMETHR
 		pthread_mutex_lock(&global_mutex);
-		std::cerr << " thread_id= " << thread_id << " first_ipart= " << first_ipart << " last_ipart= " << last_ipart << std::endl;
+		std::cerr << " thread_id= " << thread_id << " ipart= " << ipart << std::endl;
 		std::cerr << " exp_my_first_part_id= " << exp_my_first_part_id << " exp_my_last_part_id= " << exp_my_last_part_id << std::endl;
 		pthread_mutex_unlock(&global_mutex);
 #endif
 
-		for (long int ipart = first_ipart; ipart <= last_ipart; ipart++)
-		{
 #ifdef TIMING
-			// Only time one thread
-			if (thread_id == 0)
-				timer.tic(TIMING_ESP_ONEPART);
-			else if (thread_id == nr_threads -1)
-				timer.tic(TIMING_ESP_ONEPARTN);
+		// Only time one thread
+		if (thread_id == 0)
+			timer.tic(TIMING_ESP_ONEPART);
+		else if (thread_id == nr_threads -1)
+			timer.tic(TIMING_ESP_ONEPARTN);
 #endif
-			expectationOneParticle(exp_my_first_part_id + ipart, thread_id);
+		expectationOneParticle(exp_my_first_part_id + ipart, thread_id);
 
 #ifdef TIMING
-			// Only time one thread
-			if (thread_id == 0)
-				timer.toc(TIMING_ESP_ONEPART);
-			else if (thread_id == nr_threads -1)
-				timer.toc(TIMING_ESP_ONEPARTN);
+		// Only time one thread
+		if (thread_id == 0)
+			timer.toc(TIMING_ESP_ONEPART);
+		else if (thread_id == nr_threads -1)
+			timer.toc(TIMING_ESP_ONEPARTN);
 #endif
+	});
 
-		}
-	}
+	// This thread is thread 0 of the pool, but it does more than the expectation.
+	// The pools of the other threads are freed when the pool is destroyed in iterateWrapUp().
+	multidimArrayPoolEndThread();
 
 #ifdef TIMING
-	// Only time one thread
-	if (thread_id == 0)
-		timer.toc(TIMING_ESP_THR);
+	timer.toc(TIMING_ESP_THR);
 #endif
 
 }
@@ -3965,7 +4038,7 @@ void MlOptimiser::symmetriseReconstructions()
 				}
 
 
-				wsum_model.BPref[ith_recons].applyPointGroupSymmetry();
+				wsum_model.BPref[ith_recons].applyPointGroupSymmetry(nr_threads);
 			}
 		}
 	}
@@ -5107,7 +5180,7 @@ void MlOptimiser::getFourierTransformsAndCtfs(
 				}
 				else
 				{
-					img() = exp_imgs[my_metadata_offset];
+					getPooledImage(my_metadata_offset, img());
 				}
 #endif
 			}
@@ -9413,3 +9486,44 @@ void MlOptimiser::getMetaAndImageDataSubset(long int first_part_id, long int las
 
 }
 
+void MlOptimiser::getImageNamesSubset(long int first_part_id, long int last_part_id, std::vector<FileName> &fn_imgs)
+{
+	fn_imgs.clear();
+	for (long int part_id_sorted = first_part_id; part_id_sorted <= last_part_id; part_id_sorted++)
+	{
+		long int part_id = mydata.sorted_idx[part_id_sorted];
+		for (int img_id = 0; img_id < mydata.numberOfImagesInParticle(part_id); img_id++)
+		{
+			FileName fn_img;
+			if (!mydata.getImageNameOnScratch(part_id, img_id, fn_img))
+				mydata.MDimg.getValue(EMDL_IMAGE_NAME, fn_img, mydata.particles[part_id].images[img_id].id);
+			fn_imgs.push_back(fn_img);
+		}
+	}
+}
+
+void MlOptimiser::prefetchPools(long int my_pool_first_part_id, long int my_last_part_id)
+{
+	for (int ipool = 0; ipool <= prefetch_pools; ipool++)
+	{
+		long int first_part_id = my_pool_first_part_id + ipool * nr_pool;
+		if (first_part_id > my_last_part_id)
+			break;
+
+		if (!exp_prefetcher->isRequested(first_part_id))
+		{
+			long int last_part_id = XMIPP_MIN(my_last_part_id, first_part_id + nr_pool - 1);
+			std::vector<FileName> fn_imgs;
+			getImageNamesSubset(first_part_id, last_part_id, fn_imgs);
+			exp_prefetcher->request(first_part_id, fn_imgs);
+		}
+	}
+}
+
+void MlOptimiser::getPooledImage(long int my_metadata_offset, MultidimArray<RFLOAT> &img)
+{
+	if (exp_prefetcher != NULL)
+		exp_prefetcher->getImage(my_metadata_offset, img);
+	else
+		img = exp_imgs[my_metadata_offset];
+}
@@ -34,6 +34,7 @@
 #include <iterator>
 #include "src/ml_model.h"
 #include "src/parallel.h"
+#include "src/image_prefetcher.h"
 #include "src/exp_model.h"
 #include "src/ctf.h"
 #include "src/time.h"
@@ -410,6 +411,15 @@ public:
 	// Or preread all images into RAM on the leader node?
 	bool do_preread_images;
 
+	// Or read the images of the next pools on separate I/O threads while processing the current one?
+	bool do_prefetch_images;
+	int prefetch_pools, prefetch_threads;
+	RFLOAT prefetch_max_mem_Gb;
+	ImagePrefetcher *exp_prefetcher;
+
+	// Re-use the memory of the arrays that are allocated during the expectation of each particle?
+	bool do_pool_arrays;
+
 	// Place on scratch disk to copy particle stacks temporarily
 	FileName fn_scratch;
 
@@ -700,6 +710,12 @@ public:
 		do_shifts_onthefly(0),
 		exp_ipart_ThreadTaskDistributor(0),
 		do_parallel_disc_io(0),
+		do_prefetch_images(0),
+		prefetch_pools(0),
+		prefetch_threads(1),
+		prefetch_max_mem_Gb(0),
+		exp_prefetcher(NULL),
+		do_pool_arrays(0),
 		sum_changes_optimal_orientations(0),
 		do_solvent(0),
 		strict_highres_exp(0),
@@ -855,8 +871,8 @@ public:
 	 */
 	void expectationSomeParticles(long int my_first_particle, long int my_last_particle);
 
-	/* Perform expectation step for some particles using threads */
-	void doThreadExpectationSomeParticles(int thread_id);
+	/* Perform expectation step for some particles using the threads of the pool */
+	void doThreadExpectationSomeParticles(long int nr_particles);
 
 	/* Perform the expectation integration over all k, phi and series elements for a given particle */
 	void expectationOneParticle(long int part_id_sorted, int thread_id);
@@ -1022,9 +1038,20 @@ public:
 	// Get metadata array of a subset of particles from the experimental model
 	void getMetaAndImageDataSubset(long int my_first_part_id, long int my_last_part_id, bool do_also_imagedata = true);
 
+	// Get the names of all images of the particles in this range
+	void getImageNamesSubset(long int my_first_part_id, long int my_last_part_id, std::vector<FileName> &fn_imgs);
+
+	// Let the prefetcher read the images of the pool starting at my_pool_first_part_id and of the next prefetch_pools pools
+	void prefetchPools(long int my_pool_first_part_id, long int my_last_part_id);
+
+	// Get the 2D image at this offset in the current pool (from exp_imgs or from the prefetcher)
+	void getPooledImage(long int my_metadata_offset, MultidimArray<RFLOAT> &img);
+
 };
 
-// Global call to threaded core of doThreadExpectationSomeParticles
+#ifdef CUDA
+// Global call to threaded core of doThreadExpectationSomeParticles (one GPU optimiser per thread)
 void globalThreadExpectationSomeParticles(ThreadArgument &thArg);
+#endif
 
 #endif /* MAXLIK_H_ */
@@ -52,6 +52,7 @@ void MlOptimiserMpi::read(int argc, char **argv)
 
     // Define a new MpiNode
     node = new MpiNode(argc, argv);
+    halfsetC = MPI_COMM_NULL;
 
     if (node->isLeader())
     	PRINT_VERSION_INFO();
@@ -62,6 +63,10 @@ void MlOptimiserMpi::read(int argc, char **argv)
     int mpi_section = parser.addSection("MPI options");
     halt_all_followers_except_this = textToInteger(parser.getOption("--halt_all_followers_except", "For debugging: keep all followers except this one waiting", "-1"));
     do_keep_debug_reconstruct_files  = parser.checkOption("--keep_debug_reconstruct_files", "For debugging: keep temporary data and weight files for debug-reconstructions.");
+    do_combine_weights_tree = parser.checkOption("--combine_weights_tree", "Combine weighted sums with a tree-based MPI_Allreduce among the followers of each half (instead of through disc or a chain of followers)");
+    do_combine_weights_float = parser.checkOption("--combine_weights_float", "Send weighted sums in single precision when using --combine_weights_tree (halves the network traffic)");
+    if (do_combine_weights_float && !do_combine_weights_tree)
+    	REPORT_ERROR("ERROR: --combine_weights_float can only be used in combination with --combine_weights_tree");
 
     // Don't put any output to screen for mpi followers
     ori_verb = verb;
@@ -97,6 +102,14 @@ void MlOptimiserMpi::initialise()
 
 	// Print information about MPI nodes:
 	printMpiNodesMachineNames(*node, nr_threads);
+
+	// Communicator for the tree-based combination of the weighted sums: one for the followers of each random half
+	halfsetC = MPI_COMM_NULL;
+	if (do_combine_weights_tree)
+	{
+		int color = (node->isLeader()) ? MPI_UNDEFINED : ((do_split_random_halves) ? node->myRandomSubset() : 1);
+		MPI_Comm_split(MPI_COMM_WORLD, color, node->rank, &halfsetC);
+	}
 #ifdef CUDA
     /************************************************************************/
 	//Setup GPU related resources
@@ -472,7 +485,7 @@ will still yield good performance and possibly a more stable execution. \n" << s
 
 	// And allow plans before expectation to run using allowed
 	// number of threads
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	if (fn_sigma != "")
@@ -725,7 +738,9 @@ void MlOptimiserMpi::calculateSumOfPowerSpectraAndAverageImage(MultidimArray<RFL
 
 	// Now combine all weighted sums
 	// Leave the option of both for a while. Then, if there are no problems with the system via files keep that one and remove the MPI version from the code
-	if (combine_weights_thru_disc)
+	if (do_combine_weights_tree)
+		combineAllWeightedSumsTree();
+	else if (combine_weights_thru_disc)
 		combineAllWeightedSumsViaFile();
 	else
 		combineAllWeightedSums();
@@ -759,7 +774,7 @@ void MlOptimiserMpi::expectation()
 
 #ifdef MKLFFT
 	// Allow parallel FFTW execution
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	// Initialise some stuff
@@ -1090,7 +1105,7 @@ void MlOptimiserMpi::expectation()
 
 #ifdef MKLFFT
 	// Single-threaded FFTW execution for code inside parallel processing loop
-	fftw_plan_with_nthreads(1);
+	FourierTransformer::setPlannerThreads(1);
 #endif
 
 #ifdef TIMING
@@ -1573,7 +1588,7 @@ void MlOptimiserMpi::expectation()
 #ifdef  MKLFFT
 	// Allow parallel FFTW execution to continue now that we are outside the parallel
 	// portion of expectation
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	// Just make sure the temporary arrays are empty...
@@ -1856,6 +1871,59 @@ void MlOptimiserMpi::combineAllWeightedSums()
 #endif
 }
 
+void MlOptimiserMpi::combineAllWeightedSumsTree()
+{
+#ifdef TIMING
+	timer.tic(TIMING_MPICOMBINENETW);
+#endif
+
+	int nr_halfsets = (do_split_random_halves) ? 2 : 1;
+	// Only combine weighted sums if there are more than one followers per subset!
+	if ((node->size - 1)/nr_halfsets > 1)
+	{
+		// Time spent in packing, reducing and unpacking, and the total size of the weighted sums (in Mb)
+		double times[4] = {0., 0., 0., 0.};
+		if (!node->isLeader())
+		{
+			MultidimArray<RFLOAT> Mpack;
+			// Loop over possibly multiple instances of Mpack of maximum size
+			// All followers have the same model, so they all go through the same number of pieces
+			int piece = 0;
+			int nr_pieces = 1;
+			while (piece < nr_pieces)
+			{
+				double t0 = MPI_Wtime();
+				nr_pieces = 0;
+				wsum_model.pack(Mpack, piece, nr_pieces);
+				double t1 = MPI_Wtime();
+				node->relion_MPI_Allreduce_sum(MULTIDIM_ARRAY(Mpack), MULTIDIM_SIZE(Mpack), halfsetC, do_combine_weights_float);
+				double t2 = MPI_Wtime();
+				times[3] += (double)MULTIDIM_SIZE(Mpack) * ((do_combine_weights_float) ? sizeof(float) : sizeof(RFLOAT)) / (1024. * 1024.);
+				// Subtract 1 from piece because it was incremented already...
+				wsum_model.unpack(Mpack, piece - 1);
+				double t3 = MPI_Wtime();
+
+				times[0] += t1 - t0;
+				times[1] += t2 - t1;
+				times[2] += t3 - t2;
+			}
+		}
+
+		// The leader reports the slowest follower
+		double max_times[4];
+		MPI_Reduce(times, max_times, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+		if (verb > 0)
+			std::cout << " Combined " << max_times[3] << " Mb of weighted sums per follower: pack " << max_times[0]
+			          << " s, reduce " << max_times[1] << " s, unpack " << max_times[2] << " s" << std::endl;
+
+		MPI_Barrier(MPI_COMM_WORLD);
+	}
+
+#ifdef TIMING
+	timer.toc(TIMING_MPICOMBINENETW);
+#endif
+}
+
 void MlOptimiserMpi::combineWeightedSumsTwoRandomHalvesViaFile()
 {
 	// Just sum the weighted halves from follower 1 and follower 2 and Bcast to everyone else
@@ -3040,6 +3108,10 @@ void MlOptimiserMpi::iterate()
 	TIMING_MPISLAVEWAIT3= timer.setNew("mpiFollowerWaiting3");
 #endif
 
+	// The leader does not do the expectation, so it does not need I/O threads to read particles ahead
+	if (node->isLeader())
+		do_prefetch_images = false;
+
 	// Launch threads etc.
 	MlOptimiser::iterateSetup();
 
@@ -3098,7 +3170,9 @@ void MlOptimiserMpi::iterate()
 #ifdef DEBUG
 		std::cerr << " before combineAllWeightedSums..." << std::endl;
 #endif
-		if (combine_weights_thru_disc)
+		if (do_combine_weights_tree)
+			combineAllWeightedSumsTree();
+		else if (combine_weights_thru_disc)
 			combineAllWeightedSumsViaFile();
 		else
 			combineAllWeightedSums();
@@ -3360,5 +3434,10 @@ void MlOptimiserMpi::iterate()
 
 	// delete threads etc.
 	MlOptimiser::iterateWrapUp();
+
+	// Only the followers do the expectation; report those of the first one
+	// (only now that the threads have exited are their statistics complete)
+	if (do_pool_arrays && node->rank == 1)
+		printMultidimArrayPoolStatistics();
 	MPI_Barrier(MPI_COMM_WORLD);
 }
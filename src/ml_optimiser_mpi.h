@@ -45,9 +45,20 @@ public:
     // Original verb
     int ori_verb;
 
+    // Combine the weighted sums with a tree-based allreduce within each random half, instead of passing them along all followers
+    bool do_combine_weights_tree;
+
+    // Send the weighted sums in single precision in the tree-based combination
+    bool do_combine_weights_float;
+
+    // Communicator between all followers of the same random half (MPI_COMM_NULL on the leader)
+    MPI_Comm halfsetC;
+
 	/** Destructor, calls MPI_Finalize */
     ~MlOptimiserMpi()
     {
+        if (halfsetC != MPI_COMM_NULL)
+            MPI_Comm_free(&halfsetC);
         delete node;
     }
 
@@ -90,6 +101,11 @@ public:
      */
     void combineAllWeightedSums();
 
+    /** After expectation combine all weighted sum arrays across all nodes
+     *  Use an MPI_Allreduce among the followers of each random half
+     */
+    void combineAllWeightedSumsTree();
+
     /** Join the sums from two random halves
      */
     void combineWeightedSumsTwoRandomHalves();
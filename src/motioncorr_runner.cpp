@@ -123,6 +123,8 @@ void MotioncorrRunner::read(int argc, char **argv, int rank)
 	if (max_iter != 5 && !do_own)
 		REPORT_ERROR("--max_iter is valid only with --do_own");
 	interpolate_shifts = parser.checkOption("--interpolate_shifts", "(EXPERIMENTAL) Interpolate shifts");
+	do_pool_arrays = parser.checkOption("--pool_arrays", "Re-use the memory of the frames of one movie for the next one, instead of returning it to the system. Only valid with --use_own");
+	pool_max_mem_Gb = textToFloat(parser.getOption("--pool_max_mem", "Maximum memory (in Gb) that is kept for re-use with --pool_arrays", "4"));
 	ccf_downsample = textToFloat(parser.getOption("--ccf_downsample", "(EXPERT) Downsampling rate of CC map. default = 0 = automatic based on B factor", "0"));
 	if (parser.checkOption("--early_binning", "Do binning before alignment to reduce memory usage. This might dampen signal near Nyquist. (ON by default)"))
 		std::cerr << "Since RELION 3.1, --early_binning is on by default. Use --no_early_binning to disable it." << std::endl;
@@ -134,6 +136,7 @@ void MotioncorrRunner::read(int argc, char **argv, int rank)
 	dose_motionstats_cutoff = textToFloat(parser.getOption("--dose_motionstats_cutoff", "Electron dose (in electrons/A2) at which to distinguish early/late global accumulated motion in output statistics", "4."));
 	if (ccf_downsample > 1) REPORT_ERROR("--ccf_downsample cannot exceed 1.");
 	if (skip_defect && !do_own) REPORT_ERROR("--skip_decet is valid only for --use_own");
+	if (do_pool_arrays && !do_own) REPORT_ERROR("--pool_arrays is valid only for --use_own");
 	// Initialise verb for non-parallel execution
 	verb = 1;
 
@@ -444,6 +447,10 @@ void MotioncorrRunner::run()
 		init_progress_bar(fn_micrographs.size());
 		barstep = XMIPP_MAX(1, fn_micrographs.size() / 60);
 	}
+	const time_t time_start = time(NULL);
+
+	// Movies of the same size get the memory that was freed by the previous one
+	MultidimArrayPoolGuard pool_guard(do_pool_arrays, (size_t)(pool_max_mem_Gb * 1024. * 1024. * 1024.));
 
 	for (long int imic = 0; imic < fn_micrographs.size(); imic++)
 	{
@@ -475,7 +482,12 @@ void MotioncorrRunner::run()
 	}
 
 	if (verb > 0)
+	{
 		progress_bar(fn_micrographs.size());
+		printThroughput(fn_micrographs.size(), time_start);
+		if (do_pool_arrays)
+			printMultidimArrayPoolStatistics();
+	}
 
 	// Make a logfile with the shifts in pdf format and write output STAR files
 	generateLogFilePDFAndWriteStarFiles();
@@ -808,6 +820,12 @@ void MotioncorrRunner::saveModel(Micrograph &mic) {
 	mic.write(fn_avg.withoutExtension() + ".star");
 }
 
+void MotioncorrRunner::printThroughput(long int n_movies, time_t time_start)
+{
+	const long int elapsed = XMIPP_MAX(1, time(NULL) - time_start);
+	std::cout << " Processed " << n_movies << " movies in " << elapsed << " seconds (" << (RFLOAT)n_movies * 3600 / elapsed << " movies per hour)" << std::endl;
+}
+
 void MotioncorrRunner::generateLogFilePDFAndWriteStarFiles()
 {
 
@@ -1376,9 +1394,9 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
 	if (do_local) {
 		const int patch_nx = nx / patch_x, patch_ny = ny / patch_y, n_patches = patch_x * patch_y;
 		std::vector<RFLOAT> patch_xshifts, patch_yshifts, patch_frames, patch_xs, patch_ys;
-		std::vector<MultidimArray<fComplex> > Fpatches(n_groups);
+		std::vector<int> x_starts(n_patches), x_ends(n_patches), y_starts(n_patches), y_ends(n_patches);
 
-		int ipatch = 1;
+		int ipatch = 0;
 		for (int iy = 0; iy < patch_y; iy++) {
 			for (int ix = 0; ix < patch_x; ix++) {
 				int x_start = ix * patch_nx, y_start = iy * patch_ny; // Inclusive
@@ -1395,70 +1413,116 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
 					else y_end--;
 				}
 
-				int x_center = (x_start + x_end - 1) / 2, y_center = (y_start + y_end - 1) / 2;
-				logfile << "Patch (" << iy + 1 << ", " << ix + 1 << "): " << ipatch << " / " << patch_x * patch_y;
-				logfile << ", X range = [" << x_start << ", " << x_end << "), Y range = [" << y_start << ", " << y_end << ")";
-				logfile << ", Center = (" << x_center << ", " << y_center << ")" << std::endl;
+				x_starts[ipatch] = x_start; x_ends[ipatch] = x_end;
+				y_starts[ipatch] = y_start; y_ends[ipatch] = y_end;
 				ipatch++;
+			}
+		}
 
-				std::vector<RFLOAT> local_xshifts(n_groups), local_yshifts(n_groups);
-				RCTIC(TIMING_PREP_PATCH);
-				std::vector<MultidimArray<float> >Ipatches(n_threads);
-				#pragma omp parallel for num_threads(n_threads)
-				for (int igroup = 0; igroup < n_groups; igroup++) {
-					const int tid = omp_get_thread_num();
-					Ipatches[tid].reshape(y_end - y_start, x_end - x_start); // end is not included
-					RCTIC(TIMING_CLIP_PATCH);
-					for (int iframe = group_start[igroup]; iframe < group_start[igroup] + group_size[igroup]; iframe++) {
-						for (int ipy = y_start; ipy < y_end; ipy++) {
-							for (int ipx = x_start; ipx < x_end; ipx++) {
-								DIRECT_A2D_ELEM(Ipatches[tid], ipy - y_start, ipx - x_start) = DIRECT_A2D_ELEM(Iframes[iframe](), ipy, ipx);
-							}
+		// All patches have the same size, so they share FFT plans and the CCF size
+		const int pnx = x_ends[0] - x_starts[0], pny = y_ends[0] - y_starts[0];
+		for (ipatch = 1; ipatch < n_patches; ipatch++) {
+			if (x_ends[ipatch] - x_starts[ipatch] != pnx || y_ends[ipatch] - y_starts[ipatch] != pny)
+				REPORT_ERROR("BUG: patches of different sizes in MotioncorrRunner::executeOwnMotionCorrection");
+		}
+
+		// Only the low frequencies that enter the CCF are used in the alignment,
+		// so the patches are cropped in Fourier space right after the FFT.
+		const RFLOAT scaled_B = bfactor / (prescaling * prescaling);
+		int ccf_nx, ccf_ny;
+		getCCFSize(pnx, pny, scaled_B, ccf_nx, ccf_ny);
+		const int ccf_nfx = ccf_nx / 2 + 1, ccf_nfy = ccf_ny, ccf_nfy_half = ccf_ny / 2;
+
+		// Crop and FFT all patches of a group in one pass
+		std::vector<std::vector<MultidimArray<fComplex> > > Fpatches(n_patches, std::vector<MultidimArray<fComplex> >(n_groups));
+		std::vector<MultidimArray<float> > Ipatches(n_threads);
+		std::vector<MultidimArray<fComplex> > Fpatch_full(n_threads);
+		NewFFT::FloatPlan patch_plan(pnx, pny);
+
+		RCTIC(TIMING_PREP_PATCH);
+		#pragma omp parallel for num_threads(n_threads)
+		for (int igroup = 0; igroup < n_groups; igroup++) {
+			const int tid = omp_get_thread_num();
+			Ipatches[tid].reshape(pny, pnx);
+
+			for (int ipatch = 0; ipatch < n_patches; ipatch++) {
+				const int x_start = x_starts[ipatch], x_end = x_ends[ipatch], y_start = y_starts[ipatch], y_end = y_ends[ipatch];
+				RCTIC(TIMING_CLIP_PATCH);
+				for (int iframe = group_start[igroup]; iframe < group_start[igroup] + group_size[igroup]; iframe++) {
+					for (int ipy = y_start; ipy < y_end; ipy++) {
+						for (int ipx = x_start; ipx < x_end; ipx++) {
+							DIRECT_A2D_ELEM(Ipatches[tid], ipy - y_start, ipx - x_start) = DIRECT_A2D_ELEM(Iframes[iframe](), ipy, ipx);
 						}
 					}
-					RCTOC(TIMING_CLIP_PATCH);
-
-					RCTIC(TIMING_PATCH_FFT);
-					NewFFT::FourierTransform(Ipatches[tid], Fpatches[igroup]);
-					RCTOC(TIMING_PATCH_FFT);
 				}
-				RCTOC(TIMING_PREP_PATCH);
-
-				RCTIC(TIMING_PATCH_ALIGN);
-				bool converged = alignPatch(Fpatches, x_end - x_start, y_end - y_start, bfactor / (prescaling * prescaling), local_xshifts, local_yshifts, logfile);
-				RCTOC(TIMING_PATCH_ALIGN);
-				if (!converged) continue;
-
-				std::vector<RFLOAT> interpolated_xshifts(n_frames), interpolated_yshifts(n_frames);
-				interpolateShifts(group_start, group_size, local_xshifts, local_yshifts, n_frames, interpolated_xshifts, interpolated_yshifts);
-				if (interpolate_shifts) {
-					// Recenter to the first frame
-					for (int iframe = 0; iframe < n_frames; iframe++) {
-						interpolated_xshifts[iframe] -= interpolated_xshifts[0];
-						interpolated_yshifts[iframe] -= interpolated_yshifts[0];
-					}
-					// Store shifts
-					for (int iframe = 0; iframe < n_frames; iframe++) {
-						patch_xshifts.push_back(interpolated_xshifts[iframe]);
-						patch_yshifts.push_back(interpolated_yshifts[iframe]);
-						patch_frames.push_back(iframe);
-						patch_xs.push_back(x_center);
-						patch_ys.push_back(y_center);
-					}
-				} else { // only recenter to the center
-					for (int igroup = 0; igroup < n_groups; igroup++) {
-						patch_xshifts.push_back(local_xshifts[igroup] - interpolated_xshifts[0]);
-						patch_yshifts.push_back(local_yshifts[igroup] - interpolated_yshifts[0]);
-						RFLOAT middle_frame = group_start[igroup] + group_size[igroup] / 2.0;
-						patch_frames.push_back(middle_frame);
-						patch_xs.push_back(x_center);
-						patch_ys.push_back(y_center);
+				RCTOC(TIMING_CLIP_PATCH);
+
+				RCTIC(TIMING_PATCH_FFT);
+				NewFFT::FourierTransform(Ipatches[tid], Fpatch_full[tid], patch_plan);
+
+				MultidimArray<fComplex> &Fpatch = Fpatches[ipatch][igroup];
+				Fpatch.reshape(ccf_nfy, ccf_nfx);
+				for (int y = 0; y < ccf_nfy; y++) {
+					const int ly = (y > ccf_nfy_half) ? (y - ccf_nfy + pny) : y;
+					for (int x = 0; x < ccf_nfx; x++) {
+						DIRECT_A2D_ELEM(Fpatch, y, x) = DIRECT_A2D_ELEM(Fpatch_full[tid], ly, x);
 					}
 				}
+				RCTOC(TIMING_PATCH_FFT);
 			}
 		}
+		Ipatches.clear();
+		Fpatch_full.clear();
+		RCTOC(TIMING_PREP_PATCH);
+
+		// Align all patches together
+		std::vector<std::vector<RFLOAT> > all_local_xshifts(n_patches, std::vector<RFLOAT>(n_groups)), all_local_yshifts(n_patches, std::vector<RFLOAT>(n_groups));
+		std::vector<bool> converged;
+		std::vector<std::string> patch_logs;
+		RCTIC(TIMING_PATCH_ALIGN);
+		alignPatches(Fpatches, pnx, pny, scaled_B, all_local_xshifts, all_local_yshifts, converged, patch_logs);
+		RCTOC(TIMING_PATCH_ALIGN);
 		Fpatches.clear();
 
+		for (ipatch = 0; ipatch < n_patches; ipatch++) {
+			const int x_start = x_starts[ipatch], x_end = x_ends[ipatch], y_start = y_starts[ipatch], y_end = y_ends[ipatch];
+			int x_center = (x_start + x_end - 1) / 2, y_center = (y_start + y_end - 1) / 2;
+			logfile << "Patch (" << ipatch / patch_x + 1 << ", " << ipatch % patch_x + 1 << "): " << ipatch + 1 << " / " << patch_x * patch_y;
+			logfile << ", X range = [" << x_start << ", " << x_end << "), Y range = [" << y_start << ", " << y_end << ")";
+			logfile << ", Center = (" << x_center << ", " << y_center << ")" << std::endl;
+			logfile << patch_logs[ipatch];
+
+			if (!converged[ipatch]) continue;
+			std::vector<RFLOAT> &local_xshifts = all_local_xshifts[ipatch], &local_yshifts = all_local_yshifts[ipatch];
+
+			std::vector<RFLOAT> interpolated_xshifts(n_frames), interpolated_yshifts(n_frames);
+			interpolateShifts(group_start, group_size, local_xshifts, local_yshifts, n_frames, interpolated_xshifts, interpolated_yshifts);
+			if (interpolate_shifts) {
+				// Recenter to the first frame
+				for (int iframe = 0; iframe < n_frames; iframe++) {
+					interpolated_xshifts[iframe] -= interpolated_xshifts[0];
+					interpolated_yshifts[iframe] -= interpolated_yshifts[0];
+				}
+				// Store shifts
+				for (int iframe = 0; iframe < n_frames; iframe++) {
+					patch_xshifts.push_back(interpolated_xshifts[iframe]);
+					patch_yshifts.push_back(interpolated_yshifts[iframe]);
+					patch_frames.push_back(iframe);
+					patch_xs.push_back(x_center);
+					patch_ys.push_back(y_center);
+				}
+			} else { // only recenter to the center
+				for (int igroup = 0; igroup < n_groups; igroup++) {
+					patch_xshifts.push_back(local_xshifts[igroup] - interpolated_xshifts[0]);
+					patch_yshifts.push_back(local_yshifts[igroup] - interpolated_yshifts[0]);
+					RFLOAT middle_frame = group_start[igroup] + group_size[igroup] / 2.0;
+					patch_frames.push_back(middle_frame);
+					patch_xs.push_back(x_center);
+					patch_ys.push_back(y_center);
+				}
+			}
+		}
+
 		// Fit polynomial model
 
 		RCTIC(TIMING_FIT_POLYNOMIAL);
@@ -1848,38 +1912,68 @@ void MotioncorrRunner::realSpaceInterpolation_ThirdOrderPolynomial(Image <float>
 	}
 }
 
+void MotioncorrRunner::getCCFSize(const int pnx, const int pny, const RFLOAT scaled_B, int &ccf_nx, int &ccf_ny) {
+	float ccf_requested_scale = ccf_downsample;
+	if (ccf_downsample <= 0) {
+		ccf_requested_scale = sqrt(-log(1E-8) / (2 * scaled_B)); // exp(-2 B max_dist^2) = 1E-8
+	}
+	ccf_nx = findGoodSize(int(pnx * ccf_requested_scale));
+	ccf_ny = findGoodSize(int(pny * ccf_requested_scale));
+	if (ccf_nx > pnx) ccf_nx = pnx;
+	if (ccf_ny > pny) ccf_ny = pny;
+	if (ccf_nx % 2 == 1) ccf_nx++;
+	if (ccf_ny % 2 == 1) ccf_ny++;
+}
+
 bool MotioncorrRunner::alignPatch(std::vector<MultidimArray<fComplex> > &Fframes, const int pnx, const int pny, const RFLOAT scaled_B, std::vector<RFLOAT> &xshifts, std::vector<RFLOAT> &yshifts, std::ostream &logfile) {
+	std::vector<std::vector<MultidimArray<fComplex> > > Fpatches(1);
+	std::vector<std::vector<RFLOAT> > all_xshifts(1, xshifts), all_yshifts(1, yshifts);
+	std::vector<bool> converged;
+	std::vector<std::string> logs;
+
+	Fpatches[0].swap(Fframes);
+	alignPatches(Fpatches, pnx, pny, scaled_B, all_xshifts, all_yshifts, converged, logs);
+	Fframes.swap(Fpatches[0]);
+
+	xshifts = all_xshifts[0];
+	yshifts = all_yshifts[0];
+	logfile << logs[0];
+
+	return converged[0];
+}
+
+void MotioncorrRunner::alignPatches(std::vector<std::vector<MultidimArray<fComplex> > > &Fpatches, const int pnx, const int pny, const RFLOAT scaled_B,
+                                    std::vector<std::vector<RFLOAT> > &xshifts, std::vector<std::vector<RFLOAT> > &yshifts, std::vector<bool> &converged, std::vector<std::string> &logs) {
+	const int n_patches = Fpatches.size();
 	std::vector<Image<float> > Iccs(n_threads);
-	MultidimArray<fComplex> Fref;
+	std::vector<MultidimArray<fComplex> > Frefs(n_patches);
 	std::vector<MultidimArray<fComplex> > Fccs(n_threads);
 	MultidimArray<float> weight;
-	std::vector<RFLOAT> cur_xshifts, cur_yshifts;
-	bool converged = false;
+	std::vector<std::vector<RFLOAT> > cur_xshifts(n_patches), cur_yshifts(n_patches);
 
 	// Parameters TODO: make an option
 	int search_range = 50; // px
 	const RFLOAT tolerance = 0.5; // px
 	const RFLOAT EPS = 1e-15;
 
+	converged.assign(n_patches, false);
+	logs.assign(n_patches, "");
+	if (n_patches == 0) return;
+
 	// Shifts within an iteration
-	const int n_frames = xshifts.size();
-	cur_xshifts.resize(n_frames);
-	cur_yshifts.resize(n_frames);
+	const int n_frames = xshifts[0].size();
+	for (int ipatch = 0; ipatch < n_patches; ipatch++) {
+		cur_xshifts[ipatch].resize(n_frames);
+		cur_yshifts[ipatch].resize(n_frames);
+	}
 
 	if (pny % 2 == 1 || pnx % 2 == 1) {
 		REPORT_ERROR("Patch size must be even");
 	}
 
 	// Calculate the size of down-sampled CCF
-	float ccf_requested_scale = ccf_downsample;
-	if (ccf_downsample <= 0) {
-		ccf_requested_scale = sqrt(-log(1E-8) / (2 * scaled_B)); // exp(-2 B max_dist^2) = 1E-8
-	}
-	int ccf_nx = findGoodSize(int(pnx * ccf_requested_scale)), ccf_ny = findGoodSize(int(pny * ccf_requested_scale));
-	if (ccf_nx > pnx) ccf_nx = pnx;
-	if (ccf_ny > pny) ccf_ny = pny;
-	if (ccf_nx % 2 == 1) ccf_nx++;
-	if (ccf_ny % 2 == 1) ccf_ny++;
+	int ccf_nx, ccf_ny;
+	getCCFSize(pnx, pny, scaled_B, ccf_nx, ccf_ny);
 	const int ccf_nfx = ccf_nx / 2 + 1, ccf_nfy = ccf_ny;
 	const int ccf_nfy_half = ccf_ny / 2;
 	const RFLOAT ccf_scale_x = (RFLOAT)pnx / ccf_nx;
@@ -1888,26 +1982,34 @@ bool MotioncorrRunner::alignPatch(std::vector<MultidimArray<fComplex> > &Fframes
 	if (search_range * 2 + 1 > ccf_nx) search_range = ccf_nx / 2 - 1;
 	if (search_range * 2 + 1 > ccf_ny) search_range = ccf_ny / 2 - 1;
 
-	const int nfx = XSIZE(Fframes[0]), nfy = YSIZE(Fframes[0]);
-	const int nfy_half = nfy / 2;
+	// The frames may already have been cropped to the size of the CCF (see getCCFSize);
+	// the B factor weight is always relative to the full patch.
+	const int nfx = pnx / 2 + 1, nfy = pny;
+	const int arr_nfy = YSIZE(Fpatches[0][0]);
+	if (XSIZE(Fpatches[0][0]) < ccf_nfx || arr_nfy < ccf_nfy) {
+		REPORT_ERROR("MotioncorrRunner::alignPatches: the frames are smaller than the CCF");
+	}
 
-	Fref.reshape(ccf_nfy, ccf_nfx);
+	for (int ipatch = 0; ipatch < n_patches; ipatch++) {
+		Frefs[ipatch].reshape(ccf_nfy, ccf_nfx);
+	}
 	for (int i = 0; i < n_threads; i++) {
 		Iccs[i]().reshape(ccf_ny, ccf_nx);
-		Fccs[i].reshape(Fref);
+		Fccs[i].reshape(ccf_nfy, ccf_nfx);
 	}
+	// All CCFs have the same size, so they share one plan
+	NewFFT::FloatPlan ccf_plan(ccf_nx, ccf_ny);
 
 #ifdef DEBUG
-	std::cout << "Patch Size X = " << pnx << " Y  = " << pny << std::endl;
-	std::cout << "Fframes X = " << nfx << " Y = " << nfy << std::endl;
+	std::cout << "Patch Size X = " << pnx << " Y  = " << pny << " number of patches = " << n_patches << std::endl;
+	std::cout << "Fframes X = " << XSIZE(Fpatches[0][0]) << " Y = " << arr_nfy << std::endl;
 	std::cout << "Fccf X = " << ccf_nfx << " Y = " << ccf_nfy << std::endl;
-	std::cout << "CCF crop request = " << ccf_requested_scale << ", actual X = " << 1 / ccf_scale_x << " Y = " << 1 / ccf_scale_y << std::endl;
 	std::cout << "CCF search range = " << search_range << std::endl;
-	std::cout << "Trajectory size: " << xshifts.size() << std::endl;
+	std::cout << "Trajectory size: " << n_frames << std::endl;
 #endif
 
 	// Initialize B factor weight
-	weight.reshape(Fref);
+	weight.reshape(ccf_nfy, ccf_nfx);
 	RCTIC(TIMING_PREP_WEIGHT);
 	#pragma omp parallel for num_threads(n_threads)
 	for (int y = 0; y < ccf_nfy; y++) {
@@ -1921,37 +2023,49 @@ bool MotioncorrRunner::alignPatch(std::vector<MultidimArray<fComplex> > &Fframes
 	}
 	RCTOC(TIMING_PREP_WEIGHT);
 
-	for (int iter = 1; iter	<= max_iter; iter++) {
-		RCTIC(TIMING_MAKE_REF);
-		Fref.initZeros();
+	// Patches that have not converged yet
+	std::vector<int> active(n_patches);
+	for (int ipatch = 0; ipatch < n_patches; ipatch++) active[ipatch] = ipatch;
 
+	for (int iter = 1; iter	<= max_iter && active.size() > 0; iter++) {
+		const int n_active = active.size();
+		const int n_jobs = n_active * n_frames;
+
+		RCTIC(TIMING_MAKE_REF);
 		#pragma omp parallel for num_threads(n_threads)
-		for (int y = 0; y < ccf_nfy; y++) {
-			const int ly = (y > ccf_nfy_half) ? (y - ccf_nfy + nfy) : y;
+		for (int job = 0; job < n_active * ccf_nfy; job++) {
+			const int ipatch = active[job / ccf_nfy], y = job % ccf_nfy;
+			const int ly = (y > ccf_nfy_half) ? (y - ccf_nfy + arr_nfy) : y;
+			MultidimArray<fComplex> &Fref = Frefs[ipatch];
 			for (int x = 0; x < ccf_nfx; x++) {
+				DIRECT_A2D_ELEM(Fref, y, x) = 0;
 				for (int iframe = 0; iframe < n_frames; iframe++) {
-					DIRECT_A2D_ELEM(Fref, y, x) += DIRECT_A2D_ELEM(Fframes[iframe], ly, x);
+					DIRECT_A2D_ELEM(Fref, y, x) += DIRECT_A2D_ELEM(Fpatches[ipatch][iframe], ly, x);
 				}
 			}
 		}
 		RCTOC(TIMING_MAKE_REF);
 
+		// The CCFs of all frames of all patches are independent
 		#pragma omp parallel for num_threads(n_threads)
-		for (int iframe = 0; iframe < n_frames; iframe++) {
+		for (int job = 0; job < n_jobs; job++) {
 			const int tid = omp_get_thread_num();
+			const int ipatch = active[job / n_frames], iframe = job % n_frames;
+			MultidimArray<fComplex> &Fframe = Fpatches[ipatch][iframe];
+			MultidimArray<fComplex> &Fref = Frefs[ipatch];
 
 			RCTIC(TIMING_CCF_CALC);
 			for (int y = 0; y < ccf_nfy; y++) {
-				const int ly = (y > ccf_nfy_half) ? (y - ccf_nfy + nfy) : y;
+				const int ly = (y > ccf_nfy_half) ? (y - ccf_nfy + arr_nfy) : y;
 				for (int x = 0; x < ccf_nfx; x++) {
-					DIRECT_A2D_ELEM(Fccs[tid], y, x) = (DIRECT_A2D_ELEM(Fref, y, x) - DIRECT_A2D_ELEM(Fframes[iframe], ly, x)) *
-					                                    DIRECT_A2D_ELEM(Fframes[iframe], ly, x).conj() * DIRECT_A2D_ELEM(weight, y, x);
+					DIRECT_A2D_ELEM(Fccs[tid], y, x) = (DIRECT_A2D_ELEM(Fref, y, x) - DIRECT_A2D_ELEM(Fframe, ly, x)) *
+					                                    DIRECT_A2D_ELEM(Fframe, ly, x).conj() * DIRECT_A2D_ELEM(weight, y, x);
 				}
 			}
 			RCTOC(TIMING_CCF_CALC);
 
 			RCTIC(TIMING_CCF_IFFT);
-			NewFFT::inverseFourierTransform(Fccs[tid], Iccs[tid]());
+			NewFFT::inverseFourierTransform(Fccs[tid], Iccs[tid](), ccf_plan, NewFFT::FwdOnly, false);
 			RCTOC(TIMING_CCF_IFFT);
 
 			RCTIC(TIMING_CCF_FIND_MAX);
@@ -1963,7 +2077,6 @@ bool MotioncorrRunner::alignPatch(std::vector<MultidimArray<fComplex> > &Fframes
 				for (int x = -search_range; x <= search_range; x++) {
 					const int ix = (x < 0) ? ccf_nx + x : x;
 					RFLOAT val = DIRECT_A2D_ELEM(Iccs[tid](), iy, ix);
-//					std::cout << "(x, y) = " << x << ", " << y << ", (ix, iy) = " << ix << " , " << iy << " val = " << val << std::endl;
 					if (val > maxval) {
 						posx = x; posy = y;
 						maxval = val;
@@ -1984,68 +2097,79 @@ bool MotioncorrRunner::alignPatch(std::vector<MultidimArray<fComplex> > &Fframes
 			vp = DIRECT_A2D_ELEM(Iccs[tid](), ipy, ipx_p);
 			vn = DIRECT_A2D_ELEM(Iccs[tid](), ipy, ipx_n);
  			if (std::abs(vp + vn - 2.0 * maxval) > EPS) {
-				cur_xshifts[iframe] = posx - 0.5 * (vp - vn) / (vp + vn - 2.0 * maxval);
+				cur_xshifts[ipatch][iframe] = posx - 0.5 * (vp - vn) / (vp + vn - 2.0 * maxval);
 			} else {
-				cur_xshifts[iframe] = posx;
+				cur_xshifts[ipatch][iframe] = posx;
 			}
 
 			vp = DIRECT_A2D_ELEM(Iccs[tid](), ipy_p, ipx);
 			vn = DIRECT_A2D_ELEM(Iccs[tid](), ipy_n, ipx);
  			if (std::abs(vp + vn - 2.0 * maxval) > EPS) {
-				cur_yshifts[iframe] = posy - 0.5 * (vp - vn) / (vp + vn - 2.0 * maxval);
+				cur_yshifts[ipatch][iframe] = posy - 0.5 * (vp - vn) / (vp + vn - 2.0 * maxval);
 			} else {
-				cur_yshifts[iframe] = posy;
+				cur_yshifts[ipatch][iframe] = posy;
 			}
-			cur_xshifts[iframe] *= ccf_scale_x;
-			cur_yshifts[iframe] *= ccf_scale_y;
+			cur_xshifts[ipatch][iframe] *= ccf_scale_x;
+			cur_yshifts[ipatch][iframe] *= ccf_scale_y;
 #ifdef DEBUG_OWN
-			std::cout << "tid " << tid << " Frame " << 1 + iframe << ": raw shift x = " << posx << " y = " << posy << " cc = " << maxval << " interpolated x = " << cur_xshifts[iframe] << " y = " << cur_yshifts[iframe] << std::endl;
+			std::cout << "tid " << tid << " Patch " << ipatch << " Frame " << 1 + iframe << ": raw shift x = " << posx << " y = " << posy << " cc = " << maxval << " interpolated x = " << cur_xshifts[ipatch][iframe] << " y = " << cur_yshifts[ipatch][iframe] << std::endl;
 #endif
 			RCTOC(TIMING_CCF_FIND_MAX);
 		}
 
 		// Set origin
-		RFLOAT x_sumsq = 0, y_sumsq = 0;
-		for (int iframe = n_frames - 1; iframe >= 0; iframe--) { // do frame 0 last!
-			cur_xshifts[iframe] -= cur_xshifts[0];
-			cur_yshifts[iframe] -= cur_yshifts[0];
-			x_sumsq += cur_xshifts[iframe] * cur_xshifts[iframe];
-			y_sumsq += cur_yshifts[iframe] * cur_yshifts[iframe];
-		}
-		cur_xshifts[0] = 0; cur_yshifts[0] = 0;
+		std::vector<RFLOAT> rmsds(n_active);
+		for (int i = 0; i < n_active; i++) {
+			const int ipatch = active[i];
+			std::vector<RFLOAT> &cur_x = cur_xshifts[ipatch], &cur_y = cur_yshifts[ipatch];
+			RFLOAT x_sumsq = 0, y_sumsq = 0;
+			for (int iframe = n_frames - 1; iframe >= 0; iframe--) { // do frame 0 last!
+				cur_x[iframe] -= cur_x[0];
+				cur_y[iframe] -= cur_y[0];
+				x_sumsq += cur_x[iframe] * cur_x[iframe];
+				y_sumsq += cur_y[iframe] * cur_y[iframe];
+			}
+			cur_x[0] = 0; cur_y[0] = 0;
 
-		for (int iframe = 0; iframe < n_frames; iframe++) {
-			xshifts[iframe] += cur_xshifts[iframe];
-			yshifts[iframe] += cur_yshifts[iframe];
-//			std::cout << "Shift for Frame " << iframe << ": delta_x = " << cur_xshifts[iframe] << " delta_y = " << cur_yshifts[iframe] << std::endl;
+			for (int iframe = 0; iframe < n_frames; iframe++) {
+				xshifts[ipatch][iframe] += cur_x[iframe];
+				yshifts[ipatch][iframe] += cur_y[iframe];
+			}
+			rmsds[i] = std::sqrt((x_sumsq + y_sumsq) / n_frames);
 		}
 
 		// Apply shifts
 		// Since the image is not necessarily square, we cannot use the method in fftw.cpp
 		RCTIC(TIMING_FOURIER_SHIFT);
 		#pragma omp parallel for num_threads(n_threads)
-		for (int iframe = 1; iframe < n_frames; iframe++) {
-			shiftNonSquareImageInFourierTransform(Fframes[iframe], -cur_xshifts[iframe] / pnx, -cur_yshifts[iframe] / pny);
+		for (int job = 0; job < n_jobs; job++) {
+			const int ipatch = active[job / n_frames], iframe = job % n_frames;
+			if (iframe == 0) continue;
+			shiftNonSquareImageInFourierTransform(Fpatches[ipatch][iframe], -cur_xshifts[ipatch][iframe] / pnx, -cur_yshifts[ipatch][iframe] / pny);
 		}
 		RCTOC(TIMING_FOURIER_SHIFT);
 
 		// Test convergence
-		RFLOAT rmsd = std::sqrt((x_sumsq + y_sumsq) / n_frames);
-		logfile << " Iteration " << iter << ": RMSD = " << rmsd << " px" << std::endl;
+		std::vector<int> still_active;
+		for (int i = 0; i < n_active; i++) {
+			const int ipatch = active[i];
+			std::ostringstream ss;
+			ss << " Iteration " << iter << ": RMSD = " << rmsds[i] << " px" << std::endl;
+			logs[ipatch] += ss.str();
 
-		if (rmsd < tolerance) {
-			converged = true;
-			break;
+			if (rmsds[i] < tolerance) converged[ipatch] = true;
+			else still_active.push_back(ipatch);
 		}
+		active.swap(still_active);
 	}
 
 #ifdef DEBUG_OWN
-	for (int iframe = 0; iframe < n_frames; iframe++) {
-		std::cout << iframe << " " << xshifts[iframe] << " " << yshifts[iframe] << std::endl;
+	for (int ipatch = 0; ipatch < n_patches; ipatch++) {
+		for (int iframe = 0; iframe < n_frames; iframe++) {
+			std::cout << ipatch << " " << iframe << " " << xshifts[ipatch][iframe] << " " << yshifts[ipatch][iframe] << std::endl;
+		}
 	}
 #endif
-
-	return converged;
 }
 
 int MotioncorrRunner::findGoodSize(int request) {
@@ -67,6 +67,10 @@ public:
 	// Maximum number of iterations
 	int max_iter;
 
+	// Re-use the memory of the arrays of one movie for the next one, and the maximum amount to keep (in Gb)
+	bool do_pool_arrays;
+	RFLOAT pool_max_mem_Gb;
+
 	// Save aligned but non-dose weighted micrograph.
 	// With MOTIONCOR2, this flag is always assumed to be true
 	bool save_noDW;
@@ -179,6 +183,9 @@ public:
 	// Save micrograph model
 	void saveModel(Micrograph &mic);
 
+	// Print the number of movies processed per hour since time_start
+	void printThroughput(long int n_movies, time_t time_start);
+
 	// Make a PDF file with all the shifts and write output STAR files
 	void generateLogFilePDFAndWriteStarFiles();
 
@@ -197,6 +204,15 @@ private:
 
 	bool alignPatch(std::vector<MultidimArray<fComplex> > &Fframes, const int pnx, const int pny, const RFLOAT scaled_B, std::vector<RFLOAT> &xshifts, std::vector<RFLOAT> &yshifts, std::ostream &logfile);
 
+	// Align all patches (of the same size pnx * pny) together, parallelising over patches and frames.
+	// Fpatches[ipatch][iframe] can be cropped in Fourier space down to the CCF size (see getCCFSize).
+	// The iteration log of each patch is returned in logs.
+	void alignPatches(std::vector<std::vector<MultidimArray<fComplex> > > &Fpatches, const int pnx, const int pny, const RFLOAT scaled_B,
+	                  std::vector<std::vector<RFLOAT> > &xshifts, std::vector<std::vector<RFLOAT> > &yshifts, std::vector<bool> &converged, std::vector<std::string> &logs);
+
+	// Size of the (down-sampled) cross-correlation function for a patch of pnx * pny
+	void getCCFSize(const int pnx, const int pny, const RFLOAT scaled_B, int &ccf_nx, int &ccf_ny);
+
 	void binNonSquareImage(Image<float> &Iwork, RFLOAT bin_factor);
 
 	int findGoodSize(int request);
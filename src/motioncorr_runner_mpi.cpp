@@ -57,6 +57,10 @@ void MotioncorrRunnerMpi::run()
 		init_progress_bar(my_nr_micrographs);
 		barstep = XMIPP_MAX(1, my_nr_micrographs / 60);
 	}
+	const time_t time_start = time(NULL);
+
+	// Movies of the same size get the memory that was freed by the previous one
+	MultidimArrayPoolGuard pool_guard(do_pool_arrays, (size_t)(pool_max_mem_Gb * 1024. * 1024. * 1024.));
 
 	for (long int imic = my_first_micrograph; imic <= my_last_micrograph; imic++)
 	{
@@ -91,6 +95,13 @@ void MotioncorrRunnerMpi::run()
 
 	MPI_Barrier(MPI_COMM_WORLD);
 
+	if (verb > 0)
+	{
+		printThroughput(fn_micrographs.size(), time_start);
+		if (do_pool_arrays)
+			printMultidimArrayPoolStatistics();
+	}
+
 	// Only the leader writes the joined result file
 	if (node->isLeader())
 		generateLogFilePDFAndWriteStarFiles();
@@ -44,6 +44,7 @@
  ***************************************************************************/
 
 #include "src/mpi.h"
+#include <vector>
 //#define MPI_DEBUG
 
 //------------ MPI ---------------------------
@@ -282,6 +283,101 @@ int MpiNode::relion_MPI_Bcast(void *buffer, long int count, MPI_Datatype datatyp
 	return result;
 }
 
+int MpiNode::relion_MPI_Allreduce_sum(RFLOAT *buffer, long int count, MPI_Comm comm, bool reduce_in_float)
+{
+	int result(MPI_SUCCESS);
+	if (count < 0)
+		report_MPI_ERROR(MPI_ERR_COUNT);  // overflow
+
+	const long blocksize(512 * 1024 * 1024);
+	const long blockcount = (reduce_in_float) ? blocksize / sizeof(float) : blocksize / sizeof(RFLOAT);
+	const long nblocks = (count + blockcount - 1) / blockcount;
+
+#ifdef MPI_DEBUG
+	std::cout << "relion_MPI_Allreduce_sum: rank = " << rank << " count = " << count << " nblocks = " << nblocks << " comm = " << comm << std::endl;
+#endif
+
+	if (!reduce_in_float || sizeof(RFLOAT) == sizeof(float))
+	{
+		for (long iblock = 0; iblock < nblocks; iblock++)
+		{
+			long offset = iblock * blockcount;
+			int n = static_cast<int>(XMIPP_MIN(blockcount, count - offset));
+			result = MPI_Allreduce(MPI_IN_PLACE, buffer + offset, n, MY_MPI_DOUBLE, MPI_SUM, comm);
+			if (result != MPI_SUCCESS)
+				report_MPI_ERROR(result);
+		}
+		return result;
+	}
+
+	// Reduce in single precision: two conversion buffers, so that (with MPI-3) converting the
+	// next block overlaps with the communication of the current one
+	std::vector<float> fbuf[2];
+	for (int i = 0; i < 2 && i < nblocks; i++)
+		fbuf[i].resize(XMIPP_MIN(blockcount, count));
+
+	for (long iblock = 0; iblock < nblocks; iblock++)
+	{
+		long offset = iblock * blockcount;
+		int n = static_cast<int>(XMIPP_MIN(blockcount, count - offset));
+		float *fb = &(fbuf[iblock % 2][0]);
+		if (iblock == 0)
+			for (int i = 0; i < n; i++)
+				fb[i] = (float)buffer[offset + i];
+
+#if MPI_VERSION >= 3
+		MPI_Request request;
+		result = MPI_Iallreduce(MPI_IN_PLACE, fb, n, MPI_FLOAT, MPI_SUM, comm, &request);
+		if (result != MPI_SUCCESS)
+			report_MPI_ERROR(result);
+#else
+		result = MPI_Allreduce(MPI_IN_PLACE, fb, n, MPI_FLOAT, MPI_SUM, comm);
+		if (result != MPI_SUCCESS)
+			report_MPI_ERROR(result);
+#endif
+
+		// Convert the next block while this one is being reduced
+		if (iblock + 1 < nblocks)
+		{
+			long next_offset = offset + blockcount;
+			int next_n = static_cast<int>(XMIPP_MIN(blockcount, count - next_offset));
+			float *next_fb = &(fbuf[(iblock + 1) % 2][0]);
+			for (int i = 0; i < next_n; i++)
+				next_fb[i] = (float)buffer[next_offset + i];
+		}
+
+#if MPI_VERSION >= 3
+		result = MPI_Wait(&request, MPI_STATUS_IGNORE);
+		if (result != MPI_SUCCESS)
+			report_MPI_ERROR(result);
+#endif
+		for (int i = 0; i < n; i++)
+			buffer[offset + i] = (RFLOAT)fb[i];
+	}
+
+	return result;
+}
+
+#ifdef RELION_SINGLE_PRECISION
+int MpiNode::relion_MPI_Allreduce_sum(double *buffer, long int count, MPI_Comm comm)
+{
+	int result(MPI_SUCCESS);
+	if (count < 0)
+		report_MPI_ERROR(MPI_ERR_COUNT);  // overflow
+
+	const long blockcount = (512 * 1024 * 1024) / sizeof(double);
+	for (long offset = 0; offset < count; offset += blockcount)
+	{
+		int n = static_cast<int>(XMIPP_MIN(blockcount, count - offset));
+		result = MPI_Allreduce(MPI_IN_PLACE, buffer + offset, n, MPI_DOUBLE, MPI_SUM, comm);
+		if (result != MPI_SUCCESS)
+			report_MPI_ERROR(result);
+	}
+
+	return result;
+}
+#endif
+
 void MpiNode::report_MPI_ERROR(int error_code)
 {
 	char error_string[200];
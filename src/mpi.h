@@ -101,6 +101,20 @@ public:
 
 	int relion_MPI_Bcast(void *buffer, long int count, MPI_Datatype datatype, int root, MPI_Comm comm);
 
+	/** Sum buffer in place over all ranks of comm.
+	 *  The data are reduced in blocks of at most 512Mb, so that the MPI library can use its
+	 *  tree-based (recursive halving/doubling) allreduce on each block. When reduce_in_float is true,
+	 *  the data are converted to single precision before being sent, which halves the traffic.
+	 */
+	int relion_MPI_Allreduce_sum(RFLOAT *buffer, long int count, MPI_Comm comm, bool reduce_in_float = false);
+
+#ifdef RELION_SINGLE_PRECISION
+	/** Sum a double-precision buffer in place over all ranks of comm, in the same blocks as above.
+	 *  (In double-precision builds, RFLOAT is double and the function above is used.)
+	 */
+	int relion_MPI_Allreduce_sum(double *buffer, long int count, MPI_Comm comm);
+#endif
+
 	/* Better error handling of MPI error messages */
 	void report_MPI_ERROR(int error_code);
 
@@ -55,6 +55,8 @@
 #include "src/matrix1d.h"
 #include "src/matrix2d.h"
 #include "src/complex.h"
+#include "src/multidim_array_expr.h"
+#include "src/multidim_array_pool.h"
 #include <limits>
 
 // Intel MKL provides an FFTW-like interface, so this is enough.
@@ -446,7 +448,7 @@ void coreArrayByArray(const MultidimArray<T>& op1, const MultidimArray<T>& op2,
   * This class provides physical and logical access.
 */
 template<typename T>
-class MultidimArray
+class MultidimArray : public MultidimExpr<T, MultidimArray<T> >
 {
 public:
     /* The array itself.
@@ -600,6 +602,21 @@ public:
             (*this)(i) = vector[i];
     }
 
+    /** Constructor from an expression.
+     * The array gets the shape of the arrays in the expression, which is
+     * evaluated in a single loop.
+     *
+     * @code
+     * MultidimArray< RFLOAT > V3(V1 * V2 + 1.);
+     * @endcode
+     */
+    template<class E>
+    MultidimArray(const MultidimExpr<T, E>& expr)
+    {
+        coreInit();
+        *this = expr;
+    }
+
     /** Destructor.
      */
     ~MultidimArray()
@@ -664,6 +681,27 @@ public:
         coreAllocate();
     }
 
+    /** Allocate memory for n elements.
+     *
+     * Inside a MultidimArrayPoolGuard, memory of the same size that was freed
+     * before is re-used.
+     */
+    static T* allocateData(long int n)
+    {
+        void* ptr = multidimArrayPoolAllocate(sizeof(T) * n);
+        return (ptr != NULL) ? (T*)ptr : (T*)RELION_ALIGNED_MALLOC(sizeof(T) * n);
+    }
+
+    /** Free memory that was allocated for n elements.
+     *
+     * Inside a MultidimArrayPoolGuard, the memory is kept for re-use.
+     */
+    static void freeData(T* ptr, long int n)
+    {
+        if (!multidimArrayPoolRelease(ptr, sizeof(T) * n))
+            RELION_ALIGNED_FREE(ptr);
+    }
+
     /** Core allocate without dimensions.
      *
      * It is supposed the dimensions are set previously with setXdim(x), setYdim(y)
@@ -697,7 +735,7 @@ public:
         }
         else
         {
-            data = (T*)RELION_ALIGNED_MALLOC(sizeof(T) * nzyxdim);
+            data = allocateData(nzyxdim);
             if (data == NULL)
                 REPORT_ERROR( "Allocate: No space left");
         }
@@ -738,7 +776,7 @@ public:
         }
         else
         {
-            data = (T*)RELION_ALIGNED_MALLOC(sizeof(T) * nzyxdim);
+            data = allocateData(nzyxdim);
             if (data == NULL)
                 REPORT_ERROR( "Allocate: No space left");
         }
@@ -769,7 +807,7 @@ public:
                 remove(mapFile.c_str());
             }
             else
-                RELION_ALIGNED_FREE(data);
+                freeData(data, nzyxdimAlloc);
         }
         data=NULL;
         nzyxdimAlloc = 0;
@@ -913,9 +951,9 @@ public:
         if (data == NULL || mmapOn || nzyxdim <= 0 || nzyxdimAlloc <= nzyxdim)
             return;
         T* old_array = data;
-        data = (T*)RELION_ALIGNED_MALLOC(sizeof(T) * nzyxdim);
+        data = allocateData(nzyxdim);
         memcpy(data, old_array, sizeof(T) * nzyxdim);
-        RELION_ALIGNED_FREE(old_array);
+        freeData(old_array, nzyxdimAlloc);
         nzyxdimAlloc = nzyxdim;
     }
 
@@ -1050,7 +1088,7 @@ public:
                     REPORT_ERROR("MultidimArray::resize: mmap failed.");
             }
             else
-                new_data = (T*)RELION_ALIGNED_MALLOC(sizeof(T) * NZYXdim);
+                new_data = allocateData(NZYXdim);
         }
         catch (std::bad_alloc &)
         {
@@ -1143,7 +1181,7 @@ public:
                     REPORT_ERROR("MultidimArray::resize: mmap failed.");
             }
             else
-                new_data = (T*)RELION_ALIGNED_MALLOC(sizeof(T) * NZYXdim);
+                new_data = allocateData(NZYXdim);
         }
         catch (std::bad_alloc &)
         {
@@ -2920,41 +2958,12 @@ public:
         coreArrayByArray(op1, op2, result, operation);
     }
 
-    /** v3 = v1 + v2.
-     */
-    MultidimArray<T> operator+(const MultidimArray<T>& op1) const
-    {
-        MultidimArray<T> tmp;
-        arrayByArray(*this, op1, tmp, '+');
-        return tmp;
-    }
-
-    /** v3 = v1 - v2.
-     */
-    MultidimArray<T> operator-(const MultidimArray<T>& op1) const
-    {
-        MultidimArray<T> tmp;
-        arrayByArray(*this, op1, tmp, '-');
-        return tmp;
-    }
-
-    /** v3 = v1 * v2.
-     */
-    MultidimArray<T> operator*(const MultidimArray<T>& op1) const
-    {
-        MultidimArray<T> tmp;
-        arrayByArray(*this, op1, tmp, '*');
-        return tmp;
-    }
-
-    /** v3 = v1 / v2.
+    /** v3 = v1 + v2, v3 = v1 - v2, v3 = v1 * v2 and v3 = v1 / v2.
+     *
+     * These operators (see multidim_array_expr.h) return an expression that
+     * is only evaluated when it is assigned to an array, in a single loop over
+     * all elements, so that longer expressions need no temporary arrays.
      */
-    MultidimArray<T> operator/(const MultidimArray<T>& op1) const
-    {
-        MultidimArray<T> tmp;
-        arrayByArray(*this, op1, tmp, '/');
-        return tmp;
-    }
 
     /** v3 += v2.
      */
@@ -2983,6 +2992,36 @@ public:
     {
         arrayByArray(*this, op1, *this, '/');
     }
+
+    /** v3 += expression, v3 -= expression, etc.
+     *
+     * @code
+     * v3 += v1 * v2;
+     * @endcode
+     */
+    template<class E>
+    void operator+=(const MultidimExpr<T, E>& op1)
+    {
+        *this = MultidimExprBinary<T, MultidimArray<T>, E, MultidimExprAdd>(*this, op1.derived());
+    }
+
+    template<class E>
+    void operator-=(const MultidimExpr<T, E>& op1)
+    {
+        *this = MultidimExprBinary<T, MultidimArray<T>, E, MultidimExprSubtract>(*this, op1.derived());
+    }
+
+    template<class E>
+    void operator*=(const MultidimExpr<T, E>& op1)
+    {
+        *this = MultidimExprBinary<T, MultidimArray<T>, E, MultidimExprMultiply>(*this, op1.derived());
+    }
+
+    template<class E>
+    void operator/=(const MultidimExpr<T, E>& op1)
+    {
+        *this = MultidimExprBinary<T, MultidimArray<T>, E, MultidimExprDivide>(*this, op1.derived());
+    }
     //@}
 
     /** @name Array "by" scalar operations
@@ -3050,41 +3089,9 @@ public:
         coreArrayByScalar(op1, op2, result, operation);
     }
 
-    /** v3 = v1 + k.
+    /* v3 = v1 + k, v3 = v1 - k, v3 = v1 * k and v3 = v1 / k
+     * return expressions (see multidim_array_expr.h).
      */
-    MultidimArray<T> operator+(T op1) const
-    {
-        MultidimArray<T> tmp;
-        arrayByScalar(*this, op1, tmp, '+');
-        return tmp;
-    }
-
-    /** v3 = v1 - k.
-     */
-    MultidimArray<T> operator-(T op1) const
-    {
-        MultidimArray<T> tmp;
-        arrayByScalar(*this, op1, tmp, '-');
-        return tmp;
-    }
-
-    /** v3 = v1 * k.
-     */
-    MultidimArray<T> operator*(T op1) const
-    {
-        MultidimArray<T> tmp;
-        arrayByScalar(*this, op1, tmp, '*');
-        return tmp;
-    }
-
-    /** v3 = v1 / k.
-     */
-    MultidimArray<T> operator/(T op1) const
-    {
-        MultidimArray<T> tmp;
-        arrayByScalar(*this, op1, tmp, '/');
-        return tmp;
-    }
 
     /** v3 += k.
      *
@@ -3189,41 +3196,9 @@ public:
         coreScalarByArray(op1, op2, result, operation);
     }
 
-    /** v3 = k + v2.
-     */
-    friend MultidimArray<T> operator+(T op1, const MultidimArray<T>& op2)
-    {
-        MultidimArray<T> tmp;
-        scalarByArray(op1, op2, tmp, '+');
-        return tmp;
-    }
-
-    /** v3 = k - v2.
-     */
-    friend MultidimArray<T> operator-(T op1, const MultidimArray<T>& op2)
-    {
-        MultidimArray<T> tmp;
-        scalarByArray(op1, op2, tmp, '-');
-        return tmp;
-    }
-
-    /** v3 = k * v2.
-     */
-    friend MultidimArray<T> operator*(T op1, const MultidimArray<T>& op2)
-    {
-        MultidimArray<T> tmp;
-        scalarByArray(op1, op2, tmp, '*');
-        return tmp;
-    }
-
-    /** v3 = k / v2
+    /* v3 = k + v2, v3 = k - v2, v3 = k * v2 and v3 = k / v2
+     * return expressions (see multidim_array_expr.h).
      */
-    friend MultidimArray<T> operator/(T op1, const MultidimArray<T>& op2)
-    {
-        MultidimArray<T> tmp;
-        scalarByArray(op1, op2, tmp, '/');
-        return tmp;
-    }
     //@}
 
     /// @name Initialization
@@ -4312,6 +4287,44 @@ public:
         return *this;
     }
 
+    /** Assignment of an expression.
+     *
+     * The expression is evaluated in a single loop over all elements (which
+     * is spread over multidimExprThreads() threads for large arrays). The array
+     * itself can appear in the expression.
+     *
+     * @code
+     * v1 = v2 * v3 + v4;
+     * v1 = (v1 - v2) * 0.5;
+     * @endcode
+     */
+    template<class E>
+    MultidimArray<T>& operator=(const MultidimExpr<T, E>& expr)
+    {
+        const MultidimArray<T>* shape = expr.derived().exprShape();
+
+        if (data == NULL || !sameShape(*shape))
+            resize(*shape);
+
+        evaluateMultidimExpr(expr, data, MULTIDIM_SIZE(*this));
+
+        return *this;
+    }
+
+    /** Value of the n-th element, as an operand of an expression.
+     */
+    inline T exprElem(long int n) const
+    {
+        return data[n];
+    }
+
+    /** Shape of this array, as an operand of an expression.
+     */
+    inline const MultidimArray<T>* exprShape() const
+    {
+        return this;
+    }
+
     /** Unary minus.
      *
      * It is used to build arithmetic expressions. You can make a minus
@@ -0,0 +1,271 @@
+/***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef MULTIDIM_ARRAY_EXPR_H
+#define MULTIDIM_ARRAY_EXPR_H
+
+#include <iostream>
+#include "src/error.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/** @defgroup MultidimArrayExpressions Element-wise expressions of MultidimArrays
+ *
+ * The arithmetic operators of MultidimArray (+, -, * and / between arrays,
+ * and between an array and a scalar) do not compute their result right away.
+ * Instead, they return a small object that describes the operation, and that
+ * refers to its operands. The whole expression is only evaluated when it is
+ * assigned to (or used to construct) a MultidimArray, in a single loop over
+ * all elements:
+ *
+ * @code
+ * v1 = v2 * v3 + v4 * 2.;    // one loop, no temporary arrays
+ * v1 += v2 * v3;             // idem
+ * @endcode
+ *
+ * An expression can be passed to any function that takes a
+ * const MultidimArray<T>&, in which case it is evaluated into a temporary.
+ * Since the expression refers to its operands, it should not be stored
+ * (e.g. through auto) beyond the statement in which it was built.
+ */
+//@{
+
+template<typename T>
+class MultidimArray;
+
+/** Number of threads used to evaluate an expression.
+ *
+ * This is 1 by default. Expressions that are evaluated inside a parallel
+ * region, or that have fewer than MULTIDIM_EXPR_MIN_PARALLEL_SIZE elements,
+ * are always evaluated by a single thread.
+ */
+inline int& multidimExprThreads()
+{
+    static int threads = 1;
+    return threads;
+}
+
+/** Set the number of threads used to evaluate an expression.
+ */
+inline void setMultidimExprThreads(int threads)
+{
+    multidimExprThreads() = (threads < 1) ? 1 : threads;
+}
+
+#define MULTIDIM_EXPR_MIN_PARALLEL_SIZE 65536
+
+template<typename T>
+class MultidimExprScalar;
+
+template<typename T, class L, class R, class Op>
+class MultidimExprBinary;
+
+struct MultidimExprAdd;
+struct MultidimExprSubtract;
+struct MultidimExprMultiply;
+struct MultidimExprDivide;
+
+#define MULTIDIM_EXPR_SCALAR_OPERATOR(OP, OPERATION) \
+    friend inline MultidimExprBinary<T, E, MultidimExprScalar<T>, OPERATION> operator OP ( \
+        const E& op1, T op2) \
+    { \
+        return MultidimExprBinary<T, E, MultidimExprScalar<T>, OPERATION>( \
+            op1, MultidimExprScalar<T>(op2)); \
+    } \
+    friend inline MultidimExprBinary<T, MultidimExprScalar<T>, E, OPERATION> operator OP ( \
+        T op1, const E& op2) \
+    { \
+        return MultidimExprBinary<T, MultidimExprScalar<T>, E, OPERATION>( \
+            MultidimExprScalar<T>(op1), op2); \
+    }
+
+/** Base class of all expressions (including MultidimArray itself).
+ *
+ * Each expression E provides exprElem(n), the value of its n-th element, and
+ * exprShape(), an array whose shape the result will have (or NULL for a scalar).
+ */
+template<typename T, class E>
+class MultidimExpr
+{
+public:
+    inline const E& derived() const
+    {
+        return static_cast<const E&>(*this);
+    }
+
+    /** v3 = v1 + k, v3 = k + v1, etc.
+     *
+     * These are friends (rather than templates), so that k can be of any type
+     * that converts to T. They take the expression as an E (rather than as a
+     * MultidimExpr), so that they are preferred over the templated operators
+     * of tComplex.
+     */
+    MULTIDIM_EXPR_SCALAR_OPERATOR(+, MultidimExprAdd)
+    MULTIDIM_EXPR_SCALAR_OPERATOR(-, MultidimExprSubtract)
+    MULTIDIM_EXPR_SCALAR_OPERATOR(*, MultidimExprMultiply)
+    MULTIDIM_EXPR_SCALAR_OPERATOR(/, MultidimExprDivide)
+};
+
+#undef MULTIDIM_EXPR_SCALAR_OPERATOR
+
+/** Expressions are stored by value in the expressions that use them,
+ *  but arrays are stored by reference.
+ */
+template<class E>
+struct MultidimExprStorage
+{
+    typedef const E type;
+};
+
+template<typename T>
+struct MultidimExprStorage<MultidimArray<T> >
+{
+    typedef const MultidimArray<T>& type;
+};
+
+/** A scalar operand.
+ */
+template<typename T>
+class MultidimExprScalar : public MultidimExpr<T, MultidimExprScalar<T> >
+{
+public:
+    const T value;
+
+    MultidimExprScalar(const T& value) : value(value)
+    {}
+
+    inline T exprElem(long int n) const
+    {
+        return value;
+    }
+
+    inline const MultidimArray<T>* exprShape() const
+    {
+        return NULL;
+    }
+};
+
+/** The four element-wise operations.
+ */
+struct MultidimExprAdd
+{
+    static const char symbol = '+';
+    template<typename T> static inline T apply(const T& a, const T& b) { return a + b; }
+};
+
+struct MultidimExprSubtract
+{
+    static const char symbol = '-';
+    template<typename T> static inline T apply(const T& a, const T& b) { return a - b; }
+};
+
+struct MultidimExprMultiply
+{
+    static const char symbol = '*';
+    template<typename T> static inline T apply(const T& a, const T& b) { return a * b; }
+};
+
+struct MultidimExprDivide
+{
+    static const char symbol = '/';
+    template<typename T> static inline T apply(const T& a, const T& b) { return a / b; }
+};
+
+/** Element-wise operation between two operands.
+ *
+ * As with arrayByArray, both arrays need to have the same shape.
+ */
+template<typename T, class L, class R, class Op>
+class MultidimExprBinary : public MultidimExpr<T, MultidimExprBinary<T, L, R, Op> >
+{
+public:
+    typename MultidimExprStorage<L>::type left;
+    typename MultidimExprStorage<R>::type right;
+
+    MultidimExprBinary(const L& left, const R& right)
+    : left(left), right(right)
+    {
+        const MultidimArray<T>* shape1 = left.exprShape();
+        const MultidimArray<T>* shape2 = right.exprShape();
+
+        if (shape1 != NULL && shape2 != NULL && !shape1->sameShape(*shape2))
+        {
+            shape1->printShape();
+            shape2->printShape();
+            REPORT_ERROR( (std::string) "Array_by_array: different shapes (" +
+                          Op::symbol + ")");
+        }
+    }
+
+    inline T exprElem(long int n) const
+    {
+        return Op::apply(left.exprElem(n), right.exprElem(n));
+    }
+
+    inline const MultidimArray<T>* exprShape() const
+    {
+        const MultidimArray<T>* shape = left.exprShape();
+        return (shape != NULL) ? shape : right.exprShape();
+    }
+};
+
+/** Evaluate an expression into size consecutive elements starting at dest.
+ */
+template<typename T, class E>
+void evaluateMultidimExpr(const MultidimExpr<T, E>& expr, T* dest, long int size)
+{
+    const E& e = expr.derived();
+
+#ifdef _OPENMP
+    const int threads = multidimExprThreads();
+
+    if (threads > 1 && size >= MULTIDIM_EXPR_MIN_PARALLEL_SIZE && !omp_in_parallel())
+    {
+        #pragma omp parallel for num_threads(threads)
+        for (long int n = 0; n < size; n++)
+            dest[n] = e.exprElem(n);
+
+        return;
+    }
+#endif
+
+    for (long int n = 0; n < size; n++)
+        dest[n] = e.exprElem(n);
+}
+
+#define MULTIDIM_EXPR_OPERATOR(OP, OPERATION) \
+    template<typename T, class L, class R> \
+    inline MultidimExprBinary<T, L, R, OPERATION> operator OP ( \
+        const MultidimExpr<T, L>& op1, const MultidimExpr<T, R>& op2) \
+    { \
+        return MultidimExprBinary<T, L, R, OPERATION>(op1.derived(), op2.derived()); \
+    }
+
+/** v3 = v1 + v2, v3 = v1 - v2, v3 = v1 * v2 and v3 = v1 / v2,
+ *  where v1 and v2 are arrays or expressions.
+ */
+MULTIDIM_EXPR_OPERATOR(+, MultidimExprAdd)
+MULTIDIM_EXPR_OPERATOR(-, MultidimExprSubtract)
+MULTIDIM_EXPR_OPERATOR(*, MultidimExprMultiply)
+MULTIDIM_EXPR_OPERATOR(/, MultidimExprDivide)
+
+#undef MULTIDIM_EXPR_OPERATOR
+
+
+//@}
+#endif
@@ -0,0 +1,211 @@
+/***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "src/multidim_array_pool.h"
+#include "src/multidim_array.h"
+#include <pthread.h>
+#include <iomanip>
+#include <map>
+#include <vector>
+
+// The pool of one thread
+struct MultidimArrayPoolState
+{
+    size_t max_bytes, pooled_bytes;
+    std::map<size_t, std::vector<void*> > buffers;
+    MultidimArrayPoolStatistics stats;
+
+    MultidimArrayPoolState() : max_bytes(0), pooled_bytes(0)
+    {}
+
+    // A thread may exit while multidimArrayPoolKeepInThread() is in effect
+    ~MultidimArrayPoolState();
+
+    // Free the pooled memory and add the statistics to those of all threads
+    void end();
+};
+
+// Kept apart from the state, so that checking whether a guard is alive is cheap
+static thread_local int pool_depth = 0;
+static thread_local bool pool_kept_in_thread = false;
+static thread_local MultidimArrayPoolState pool_state;
+
+static MultidimArrayPoolStatistics pool_statistics;
+static pthread_mutex_t pool_statistics_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+MultidimArrayPoolStatistics::MultidimArrayPoolStatistics()
+: requests(0), hits(0), requested_bytes(0), releases(0), peak_bytes(0)
+{}
+
+double MultidimArrayPoolStatistics::hitRate() const
+{
+    return (requests > 0) ? (double)hits / requests : 0.;
+}
+
+static void addStatistics(MultidimArrayPoolStatistics& sum, const MultidimArrayPoolStatistics& stats)
+{
+    sum.requests += stats.requests;
+    sum.hits += stats.hits;
+    sum.requested_bytes += stats.requested_bytes;
+    sum.releases += stats.releases;
+    if (stats.peak_bytes > sum.peak_bytes)
+        sum.peak_bytes = stats.peak_bytes;
+}
+
+void* multidimArrayPoolAllocate(size_t bytes)
+{
+    if (pool_depth == 0 || bytes == 0)
+        return NULL;
+
+    MultidimArrayPoolState& state = pool_state;
+    state.stats.requests++;
+    state.stats.requested_bytes += bytes;
+
+    std::map<size_t, std::vector<void*> >::iterator it = state.buffers.find(bytes);
+    if (it == state.buffers.end() || it->second.empty())
+        return NULL;
+
+    void* ptr = it->second.back();
+    it->second.pop_back();
+    state.pooled_bytes -= bytes;
+    state.stats.hits++;
+
+    return ptr;
+}
+
+bool multidimArrayPoolRelease(void* ptr, size_t bytes)
+{
+    if (pool_depth == 0 || ptr == NULL || bytes == 0)
+        return false;
+
+    MultidimArrayPoolState& state = pool_state;
+
+    if (state.pooled_bytes + bytes > state.max_bytes)
+        return false;
+
+    state.buffers[bytes].push_back(ptr);
+    state.pooled_bytes += bytes;
+    state.stats.releases++;
+
+    if (state.pooled_bytes > state.stats.peak_bytes)
+        state.stats.peak_bytes = state.pooled_bytes;
+
+    return true;
+}
+
+MultidimArrayPoolStatistics getMultidimArrayPoolStatistics()
+{
+    pthread_mutex_lock(&pool_statistics_mutex);
+    MultidimArrayPoolStatistics stats = pool_statistics;
+    pthread_mutex_unlock(&pool_statistics_mutex);
+
+    if (pool_depth > 0)
+        addStatistics(stats, pool_state.stats);
+
+    return stats;
+}
+
+void resetMultidimArrayPoolStatistics()
+{
+    pthread_mutex_lock(&pool_statistics_mutex);
+    pool_statistics = MultidimArrayPoolStatistics();
+    pthread_mutex_unlock(&pool_statistics_mutex);
+}
+
+void printMultidimArrayPoolStatistics(std::ostream& out)
+{
+    MultidimArrayPoolStatistics stats = getMultidimArrayPoolStatistics();
+
+    out << " Array pool: " << stats.hits << " of " << stats.requests << " allocations re-used memory ("
+        << std::fixed << std::setprecision(1) << 100. * stats.hitRate() << "%), at most "
+        << std::setprecision(1) << stats.peak_bytes / (1024. * 1024.) << " MB pooled per thread" << std::endl;
+}
+
+MultidimArrayPoolGuard::MultidimArrayPoolGuard(bool enable, size_t max_bytes)
+: enabled(enable)
+{
+    if (!enabled)
+        return;
+
+    if (pool_depth == 0)
+        pool_state.max_bytes = max_bytes;
+
+    pool_depth++;
+}
+
+MultidimArrayPoolGuard::~MultidimArrayPoolGuard()
+{
+    if (!enabled)
+        return;
+
+    pool_depth--;
+
+    if (pool_depth == 0)
+        pool_state.end();
+}
+
+void multidimArrayPoolKeepInThread(bool enable, size_t max_bytes)
+{
+    if (!enable || pool_kept_in_thread)
+        return;
+
+    if (pool_depth == 0)
+        pool_state.max_bytes = max_bytes;
+
+    pool_depth++;
+    pool_kept_in_thread = true;
+}
+
+void multidimArrayPoolEndThread()
+{
+    if (!pool_kept_in_thread)
+        return;
+
+    pool_kept_in_thread = false;
+    pool_depth--;
+
+    if (pool_depth == 0)
+        pool_state.end();
+}
+
+void MultidimArrayPoolState::end()
+{
+    for (std::map<size_t, std::vector<void*> >::iterator it = buffers.begin(); it != buffers.end(); it++)
+    {
+        for (int i = 0; i < it->second.size(); i++)
+            RELION_ALIGNED_FREE(it->second[i]);
+    }
+
+    buffers.clear();
+    pooled_bytes = 0;
+
+    pthread_mutex_lock(&pool_statistics_mutex);
+    addStatistics(pool_statistics, stats);
+    pthread_mutex_unlock(&pool_statistics_mutex);
+
+    stats = MultidimArrayPoolStatistics();
+}
+
+MultidimArrayPoolState::~MultidimArrayPoolState()
+{
+    if (pool_depth > 0)
+    {
+        pool_depth = 0;
+        pool_kept_in_thread = false;
+        end();
+    }
+}
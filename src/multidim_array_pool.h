@@ -0,0 +1,145 @@
+/***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef MULTIDIM_ARRAY_POOL_H
+#define MULTIDIM_ARRAY_POOL_H
+
+#include <cstddef>
+#include <iostream>
+
+/** @defgroup MultidimArrayPool Re-use of MultidimArray memory within a thread
+ *
+ * Loops that process one particle or one frame at a time allocate and free
+ * the same few array sizes over and over again. While a
+ * MultidimArrayPoolGuard is alive in a thread, the memory that is freed by
+ * MultidimArrays in that thread is kept in a pool (keyed by its size in
+ * bytes), and handed out again to the next array of the same size, instead of
+ * being returned to the system:
+ *
+ * @code
+ * for (long int part_id = 0; part_id < nr_particles; part_id++)
+ * {
+ *     MultidimArrayPoolGuard guard(do_pool_arrays);
+ *     ...
+ * }
+ * @endcode
+ *
+ * Guards can be nested; the pooled memory is only freed when the outermost
+ * guard of the thread goes out of scope. Outside of a guard, nothing changes.
+ *
+ * Tasks of a ThreadPool cannot hold a guard for their thread beyond their own
+ * end. Instead, they call multidimArrayPoolKeepInThread(), which acts as a guard
+ * that lasts until multidimArrayPoolEndThread() is called in the same thread,
+ * or until the thread exits (i.e. until the ThreadPool is destroyed):
+ *
+ * @code
+ * pool.parallelFor(0, nr_particles - 1, [&](long int part_id, int thread_id)
+ * {
+ *     multidimArrayPoolKeepInThread(do_pool_arrays);
+ *     ...
+ * });
+ * multidimArrayPoolEndThread(); // the calling thread was one of the pool
+ * @endcode
+ * Since every buffer is allocated with RELION_ALIGNED_MALLOC, arrays that
+ * were allocated outside of a guard (or by another thread) can safely be
+ * released into the pool.
+ */
+//@{
+
+/** Default maximum number of bytes kept in the pool of one thread.
+ */
+#define MULTIDIM_ARRAY_POOL_DEFAULT_MAX_BYTES ((size_t)1 << 30)
+
+/** Usage statistics, summed over all threads.
+ */
+struct MultidimArrayPoolStatistics
+{
+    // Number of allocations while a guard was alive, and how many of those were served by the pool
+    long int requests, hits;
+
+    // Number of bytes asked for by those allocations
+    size_t requested_bytes;
+
+    // Number of buffers that were kept in the pool when they were freed
+    long int releases;
+
+    // Largest number of bytes that was kept in the pool of a single thread
+    size_t peak_bytes;
+
+    MultidimArrayPoolStatistics();
+
+    double hitRate() const;
+};
+
+/** Get a buffer of exactly the given size from the pool of this thread.
+ *
+ * Returns NULL if no guard is alive, or if the pool has no such buffer.
+ */
+void* multidimArrayPoolAllocate(size_t bytes);
+
+/** Keep a buffer of the given size in the pool of this thread.
+ *
+ * Returns false (and leaves the buffer alone) if no guard is alive, or if
+ * the pool is full; the caller then has to free the buffer itself.
+ */
+bool multidimArrayPoolRelease(void* ptr, size_t bytes);
+
+/** Statistics of the calling thread, and of all threads whose outermost guard has ended
+ * (or which have exited).
+ */
+MultidimArrayPoolStatistics getMultidimArrayPoolStatistics();
+
+/** Reset the statistics.
+ */
+void resetMultidimArrayPoolStatistics();
+
+/** Print the statistics.
+ */
+void printMultidimArrayPoolStatistics(std::ostream& out = std::cout);
+
+/** Keep the memory of MultidimArrays in a pool in the calling thread, until
+ * multidimArrayPoolEndThread() is called in it or until it exits.
+ *
+ * Does nothing if enable is false, or if this was already done in this thread.
+ */
+void multidimArrayPoolKeepInThread(bool enable = true, size_t max_bytes = MULTIDIM_ARRAY_POOL_DEFAULT_MAX_BYTES);
+
+/** End what multidimArrayPoolKeepInThread() started in the calling thread (if anything).
+ */
+void multidimArrayPoolEndThread();
+
+/** Keeps the memory of MultidimArrays in a pool while it is alive.
+ *
+ * If enable is false, the guard does nothing, so that it can be switched on
+ * and off through a command-line option. The maximum size of the pool is set
+ * by the outermost guard of the thread.
+ */
+class MultidimArrayPoolGuard
+{
+public:
+    MultidimArrayPoolGuard(bool enable = true, size_t max_bytes = MULTIDIM_ARRAY_POOL_DEFAULT_MAX_BYTES);
+    ~MultidimArrayPoolGuard();
+
+private:
+    bool enabled;
+
+    MultidimArrayPoolGuard(const MultidimArrayPoolGuard&);
+    MultidimArrayPoolGuard& operator=(const MultidimArrayPoolGuard&);
+};
+
+//@}
+#endif
@@ -41,6 +41,7 @@
  *  All comments concerning this program package may be sent to the
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
+#include <time.h>
 #include "src/parallel.h"
 
 
@@ -96,126 +97,376 @@ void Barrier::wait()
     pthread_mutex_unlock(&mutex);
 }
 
-// ================= THREAD MANAGER =======================
+// ================= THREAD POOL =======================
 
-ThreadArgument::ThreadArgument()
+// The pool and the id of the pool thread that runs this code (if any)
+static thread_local ThreadPool * current_pool = NULL;
+static thread_local int current_thread = 0;
+
+void * _threadPoolMain(void * data)
 {
-    thread_id = -1;
-    manager = NULL;
-    data = NULL;
+    ThreadPool::Worker * worker = (ThreadPool::Worker*) data;
+    ThreadPool * pool = worker->pool;
+    int thread_id = worker->thread_id;
+
+    current_pool = pool;
+    current_thread = thread_id;
+
+    ThreadPool::QueuedTask task;
+    while (true)
+    {
+        if (pool->findTask(thread_id, task))
+        {
+            pool->execute(thread_id, task);
+            continue;
+        }
+
+        // Sleep until new tasks are queued. Together with the order in push(),
+        // checking nr_queued after announcing to sleep avoids lost wake-ups.
+        pthread_mutex_lock(&pool->sleep_mutex);
+        pool->nr_sleeping++;
+        while (pool->nr_queued == 0 && !pool->stopping)
+            pthread_cond_wait(&pool->sleep_cond, &pool->sleep_mutex);
+        pool->nr_sleeping--;
+        bool stop = pool->stopping && pool->nr_queued == 0;
+        pthread_mutex_unlock(&pool->sleep_mutex);
+
+        if (stop)
+            break;
+    }
+
+    return NULL;
 }
 
-ThreadArgument::ThreadArgument(int id, ThreadManager * manager, void * data)
+ThreadPool::ThreadPool(int numberOfThreads)
 {
-    this->thread_id = id;
-    this->manager = manager;
-    this->data = data;
+    threads = (numberOfThreads < 1) ? 1 : numberOfThreads;
+    nr_queued = 0;
+    nr_sleeping = 0;
+    stopping = false;
+    pthread_mutex_init(&sleep_mutex, NULL);
+    pthread_cond_init(&sleep_cond, NULL);
+
+    workers.resize(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        workers[i] = new Worker();
+        workers[i]->pool = this;
+        workers[i]->thread_id = i;
+        workers[i]->nr_tasks = 0;
+        workers[i]->busy_time = 0.;
+        pthread_mutex_init(&workers[i]->mutex, NULL);
+    }
+
+    // Thread 0 is whoever waits for the tasks
+    for (int i = 1; i < threads; ++i)
+    {
+        if (pthread_create(&workers[i]->id, NULL, _threadPoolMain, (void*) workers[i]) != 0)
+        {
+            std::cerr << "ThreadPool: can't create threads." << std::endl;
+            exit(1);
+        }
+    }
 }
 
-void * _threadMain(void * data)
+ThreadPool::~ThreadPool()
 {
-    ThreadArgument * thArg = (ThreadArgument*) data;
-    ThreadManager * thMgr = thArg->manager;
+    pthread_mutex_lock(&sleep_mutex);
+    stopping = true;
+    pthread_cond_broadcast(&sleep_cond);
+    pthread_mutex_unlock(&sleep_mutex);
 
-    while (true)
+    for (int i = 1; i < threads; ++i)
+        pthread_join(workers[i]->id, NULL);
+
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_mutex_destroy(&workers[i]->mutex);
+        delete workers[i];
+    }
+    pthread_mutex_destroy(&sleep_mutex);
+    pthread_cond_destroy(&sleep_cond);
+}
+
+int ThreadPool::currentThread() const
+{
+    return (current_pool == this) ? current_thread : 0;
+}
+
+void ThreadPool::push(const Task &function, TaskGroup * group)
+{
+    Worker * worker = workers[currentThread()];
+    QueuedTask task;
+    task.function = function;
+    task.group = group;
+
+    group->pending++;
+    pthread_mutex_lock(&worker->mutex);
+    worker->tasks.push_back(task);
+    nr_queued++;
+    pthread_mutex_unlock(&worker->mutex);
+
+    if (nr_sleeping > 0)
+    {
+        pthread_mutex_lock(&sleep_mutex);
+        pthread_cond_signal(&sleep_cond);
+        pthread_mutex_unlock(&sleep_mutex);
+    }
+}
+
+bool ThreadPool::findTask(int thread_id, QueuedTask &task)
+{
+    // Newest task from our own queue first
+    Worker * own = workers[thread_id];
+    pthread_mutex_lock(&own->mutex);
+    if (!own->tasks.empty())
     {
-        //Wait for start working or leave
-        thMgr->wait();
-        //After awaked check what to do
-        if (thMgr->workFunction != NULL)
+        task = own->tasks.back();
+        own->tasks.pop_back();
+        nr_queued--;
+        pthread_mutex_unlock(&own->mutex);
+        return true;
+    }
+    pthread_mutex_unlock(&own->mutex);
+
+    // Otherwise steal the oldest task of another thread
+    for (int i = 1; i < threads; ++i)
+    {
+        Worker * victim = workers[(thread_id + i) % threads];
+        pthread_mutex_lock(&victim->mutex);
+        if (!victim->tasks.empty())
         {
-        	try
-        	{
-        		thMgr->workFunction(*thArg);
-        		thMgr->wait(); //wait for finish together
-        	}
-        	catch (RelionError XE)
-        	{
-        		std::cerr << XE << std::endl
-        		          << "In thread " << thArg->thread_id << std::endl;
-        		pthread_exit(NULL);
-        	}
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+            nr_queued--;
+            pthread_mutex_unlock(&victim->mutex);
+            return true;
         }
-        else //exit thread
+        pthread_mutex_unlock(&victim->mutex);
+    }
+
+    return false;
+}
+
+void ThreadPool::execute(int thread_id, QueuedTask &task)
+{
+    TaskGroup * group = task.group;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    try
+    {
+        task.function(thread_id);
+    }
+    catch (...)
+    {
+        group->setException(std::current_exception());
+    }
+    task.function = Task();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+    workers[thread_id]->nr_tasks++;
+    workers[thread_id]->busy_time += seconds;
+
+    // The group may be destroyed as soon as this is done, so wake up
+    // a thread that is waiting for it through the pool only
+    if (--group->pending == 0)
+    {
+        pthread_mutex_lock(&sleep_mutex);
+        pthread_cond_broadcast(&sleep_cond);
+        pthread_mutex_unlock(&sleep_mutex);
+    }
+}
+
+void ThreadPool::splitRange(TaskGroup &group, long int first, long int last,
+                            const std::function<void(long int, int)> &function, long int grain, int thread_id)
+{
+    // Leave the second half to be stolen and continue with the first one
+    while (last - first + 1 > grain)
+    {
+        long int middle = first + (last - first) / 2;
+        long int second = middle + 1, end = last;
+        group.run([this, &group, &function, second, end, grain](int thread_id)
         {
-            pthread_exit(NULL);
-        }
+            splitRange(group, second, end, function, grain, thread_id);
+        });
+        last = middle;
     }
+
+    for (long int i = first; i <= last; ++i)
+        function(i, thread_id);
 }
 
-ThreadManager::ThreadManager(int numberOfThreads, void * workClass)
+void ThreadPool::parallelFor(long int first, long int last,
+                             const std::function<void(long int, int)> &function, long int grain)
 {
-    threads = numberOfThreads;
-    barrier = new Barrier(threads);
-    workFunction = NULL;
-    ids = new pthread_t[threads];
-    arguments = new ThreadArgument[threads];
-    started = false;
-    this->workClass = workClass;
+    if (last < first)
+        return;
+    if (grain < 1)
+        grain = 1;
+
+    TaskGroup group(*this);
+    group.run([this, &group, &function, first, last, grain](int thread_id)
+    {
+        splitRange(group, first, last, function, grain, thread_id);
+    });
+    group.wait();
+}
+
+void ThreadPool::resetStatistics()
+{
+    for (int i = 0; i < threads; ++i)
+    {
+        workers[i]->nr_tasks = 0;
+        workers[i]->busy_time = 0.;
+    }
+}
 
+long int ThreadPool::getNumberOfTasks(int thread_id) const
+{
+    return workers[thread_id]->nr_tasks;
 }
 
-void ThreadManager::startThreads()
+double ThreadPool::getBusyTime(int thread_id) const
 {
-    //Create threads
-    int result;
+    return workers[thread_id]->busy_time;
+}
 
+void ThreadPool::printStatistics(std::ostream &out) const
+{
     for (int i = 0; i < threads; ++i)
+        out << " thread " << i << ": " << workers[i]->nr_tasks << " tasks in "
+            << workers[i]->busy_time << " sec" << std::endl;
+}
+
+// ================= TASK GROUP =======================
+
+TaskGroup::TaskGroup(ThreadPool &pool) : pool(pool)
+{
+    pending = 0;
+    pthread_mutex_init(&mutex, NULL);
+}
+
+TaskGroup::~TaskGroup()
+{
+    try
     {
-        arguments[i].thread_id = i;
-        arguments[i].manager = this;
-        arguments[i].data = NULL;
-        arguments[i].workClass = workClass;
+        wait();
+    }
+    catch (...)
+    {}
+    pthread_mutex_destroy(&mutex);
+}
+
+void TaskGroup::run(const ThreadPool::Task &task)
+{
+    pool.push(task, this);
+}
 
-#ifdef DEBUG_THREADS
-        std::cerr << " startThreads: i= " << i << std::endl;
-#endif
-        result = pthread_create(ids + i, NULL, _threadMain, (void*) (arguments + i));
+void TaskGroup::wait()
+{
+    int thread_id = pool.currentThread();
+    ThreadPool::QueuedTask task;
 
-        if (result != 0)
+    // Help with any work (including that of other groups) until ours is done
+    while (pending > 0)
+    {
+        if (pool.findTask(thread_id, task))
         {
-            std::cerr << "ThreadManager: can't create threads." << std::endl;
-            exit(1);
+            pool.execute(thread_id, task);
+            continue;
         }
+
+        // Sleep in the same way as the workers, until there is something to steal
+        // or until the tasks of this group that are still running are done
+        pthread_mutex_lock(&pool.sleep_mutex);
+        pool.nr_sleeping++;
+        while (pool.nr_queued == 0 && pending > 0)
+            pthread_cond_wait(&pool.sleep_cond, &pool.sleep_mutex);
+        pool.nr_sleeping--;
+        pthread_mutex_unlock(&pool.sleep_mutex);
     }
-    started = true;
+
+    pthread_mutex_lock(&mutex);
+    std::exception_ptr e = exception;
+    exception = std::exception_ptr();
+    pthread_mutex_unlock(&mutex);
+
+    if (e)
+        std::rethrow_exception(e);
 }
 
-ThreadManager::~ThreadManager()
+void TaskGroup::setException(std::exception_ptr e)
+{
+    pthread_mutex_lock(&mutex);
+    if (!exception)
+        exception = e;
+    pthread_mutex_unlock(&mutex);
+}
+
+// ================= THREAD MANAGER =======================
+
+ThreadArgument::ThreadArgument()
+{
+    thread_id = -1;
+    manager = NULL;
+    data = NULL;
+}
+
+ThreadArgument::ThreadArgument(int id, ThreadManager * manager, void * data)
+{
+    this->thread_id = id;
+    this->manager = manager;
+    this->data = data;
+}
+
+
+ThreadManager::ThreadManager(int numberOfThreads, void * workClass)
 {
-    //Destroy the threads
-    workFunction = NULL;
-    if (started)
+    threads = numberOfThreads;
+    pool = new ThreadPool(threads);
+    group = new TaskGroup(*pool);
+    arguments = new ThreadArgument[threads];
+    this->workClass = workClass;
+
+    for (int i = 0; i < threads; ++i)
     {
-        wait();
-        for (int i = 0; i < threads; ++i)
-        	pthread_join(ids[i], NULL);
+        arguments[i].thread_id = i;
+        arguments[i].manager = this;
+        arguments[i].data = NULL;
+        arguments[i].workClass = workClass;
     }
+}
 
-    delete barrier;
-    delete[] ids;
+ThreadManager::~ThreadManager()
+{
+    delete group;
+    delete pool;
     delete[] arguments;
 }
 
 void ThreadManager::run(ThreadFunction function)
 {
-	runAsync(function);
-    //Wait on barrier to wait for threads finish
+    runAsync(function);
     wait();
 }
 
 void ThreadManager::runAsync(ThreadFunction function)
 {
-    workFunction = function;
-    if (!started)
-        startThreads();
-    //Wait on barrier to threads starts working
-    wait();
+    for (int i = 0; i < threads; ++i)
+    {
+        ThreadArgument * argument = arguments + i;
+        group->run([function, argument](int thread_id)
+        {
+            function(*argument);
+        });
+    }
 }
 
 void ThreadManager::wait()
 {
-    barrier->wait();
+    group->wait();
 }
 
 // =================== TASK_DISTRIBUTOR ============================
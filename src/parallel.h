@@ -47,6 +47,12 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <vector>
 #include "src/error.h"
 
 // This code was copied from a developmental version of Xmipp-3.0
@@ -56,6 +62,7 @@
 
 class ThreadManager;
 class ThreadArgument;
+class TaskGroup;
 
 /* Prototype of functions for threads works. */
 typedef void (*ThreadFunction) (ThreadArgument &arg);
@@ -170,10 +177,147 @@ public:
     ThreadArgument(int id, ThreadManager * manager = NULL, void * data = NULL);
 
     friend class ThreadManager;
-    friend void * _threadMain(void * data);
 };
 
-void * _threadMain(void * data);
+/** Persistent pool of threads that share their work through work stealing.
+ * Every thread of the pool has its own double-ended queue of tasks. A thread
+ * pushes new tasks to the back of its own queue and takes them from there again,
+ * while threads that run out of work steal the oldest (and usually largest) tasks
+ * from the front of the queues of other threads. Tasks are forked and joined through
+ * a TaskGroup, and a thread that waits for a TaskGroup keeps on executing tasks in
+ * the meantime, so that tasks can fork and join tasks of their own.
+ *
+ * A pool of N threads starts N-1 worker threads: the thread that waits for the
+ * tasks (i.e. the one that calls parallelFor or TaskGroup::wait from outside the pool)
+ * acts as thread 0. Therefore, only one thread outside the pool should use it at a time.
+ * Each task gets the id of the thread that executes it, which lies between 0 and N-1
+ * and is unique among the tasks that run at the same time, so that it can be used to
+ * index per-thread data.
+ * @code
+ *  ThreadPool pool(nr_threads);
+ *  pool.parallelFor(0, nr_images - 1, [&](long int i, int thread_id)
+ *  {
+ *      processOneImage(i, thread_buffers[thread_id]);
+ *  });
+ * @endcode
+ */
+class ThreadPool
+{
+public:
+    /// A task receives the id of the thread that executes it
+    typedef std::function<void(int)> Task;
+
+    /** Constructor, starts numberOfThreads - 1 worker threads */
+    ThreadPool(int numberOfThreads);
+
+    /** Destructor, waits for the worker threads to finish */
+    ~ThreadPool();
+
+    /** Number of threads, including the calling thread */
+    int getNumberOfThreads() const
+    {
+        return threads;
+    }
+
+    /** Execute function(i, thread_id) for all i from first to last (both included).
+     * The range is split recursively in halves down to chunks of at most grain
+     * iterations, so that idle threads steal large parts of the range first.
+     * Returns when all iterations are done. An exception thrown by one of the
+     * iterations is rethrown here.
+     */
+    void parallelFor(long int first, long int last,
+                     const std::function<void(long int, int)> &function, long int grain = 1);
+
+    /** Reset the number of tasks and the busy time of all threads */
+    void resetStatistics();
+
+    /** Number of tasks executed by a thread since the last resetStatistics() */
+    long int getNumberOfTasks(int thread_id) const;
+
+    /** Time (in seconds) a thread spent executing tasks since the last resetStatistics() */
+    double getBusyTime(int thread_id) const;
+
+    /** Print the number of tasks and the busy time of all threads */
+    void printStatistics(std::ostream &out = std::cout) const;
+
+private:
+    struct QueuedTask
+    {
+        Task function;
+        TaskGroup * group;
+    };
+
+    struct Worker
+    {
+        ThreadPool * pool;
+        int thread_id;
+        pthread_t id;
+        pthread_mutex_t mutex; ///< Protects the queue
+        std::deque<QueuedTask> tasks;
+        long int nr_tasks; ///< Only changed by the thread itself
+        double busy_time;
+    };
+
+    int threads;
+    std::vector<Worker*> workers;
+    std::atomic<long int> nr_queued; ///< Tasks waiting in any of the queues
+    std::atomic<int> nr_sleeping; ///< Workers waiting for new tasks
+    bool stopping;
+    pthread_mutex_t sleep_mutex;
+    pthread_cond_t sleep_cond; ///< Signalled when tasks are queued and when the last task of a group is done
+
+    // The id of the calling thread in this pool (0 for threads outside the pool)
+    int currentThread() const;
+
+    void push(const Task &function, TaskGroup * group);
+    bool findTask(int thread_id, QueuedTask &task);
+    void execute(int thread_id, QueuedTask &task);
+    void splitRange(TaskGroup &group, long int first, long int last,
+                    const std::function<void(long int, int)> &function, long int grain, int thread_id);
+
+    friend class TaskGroup;
+    friend void * _threadPoolMain(void * data);
+};
+
+void * _threadPoolMain(void * data);
+
+/** Group of tasks executed by a ThreadPool that can be waited for together.
+ * Tasks may add new tasks to their own or to other groups.
+ * @code
+ *  TaskGroup group(pool);
+ *  group.run([&](int thread_id) { left = sum(first, middle); });
+ *  group.run([&](int thread_id) { right = sum(middle + 1, last); });
+ *  group.wait();
+ * @endcode
+ */
+class TaskGroup
+{
+public:
+    TaskGroup(ThreadPool &pool);
+
+    /** Destructor, waits for the remaining tasks (but does not rethrow their exceptions) */
+    ~TaskGroup();
+
+    /** Queue a task on the queue of the calling thread */
+    void run(const ThreadPool::Task &task);
+
+    /** Execute tasks until all tasks of this group are done.
+     * When there is nothing to execute, the calling thread sleeps until new tasks are
+     * queued or until the last task of the group is done.
+     * If any task threw an exception, the first one is rethrown here.
+     */
+    void wait();
+
+private:
+    ThreadPool &pool;
+    std::atomic<long int> pending;
+    pthread_mutex_t mutex; ///< Protects exception
+    std::exception_ptr exception;
+
+    void setException(std::exception_ptr e);
+
+    friend class ThreadPool;
+};
 
 /** Class for manage a group of threads performing one or several tasks.
  * This class is very useful when we have some function that can be executed
@@ -183,22 +327,21 @@ void * _threadMain(void * data);
  * wait() function allow in the main thread to wait until all threads have
  * finish working on a task and maybe then execute another one.
  * This class is supposed to be used only in the main thread.
+ *
+ * The threads are those of a ThreadPool: run() executes the function once for each
+ * thread id as a task of the pool, so the functions should not wait for each other
+ * except through a Barrier for all threads. Code that wants to use the pool directly
+ * (e.g. through parallelFor) can get it with getPool().
  */
 class ThreadManager
 {
 private:
     int threads; ///< number of working threads.
-    pthread_t * ids; ///< pthreads identifiers
+    ThreadPool * pool; ///< The threads that do the work
+    TaskGroup * group; ///< The tasks started by runAsync
     ThreadArgument * arguments; ///< Arguments passed to threads
-    Barrier * barrier; ///< barrier for syncronized between tasks.
-    /// Pointer to the function to work on,
-    /// if null threads should exit
-    ThreadFunction workFunction;
-    bool started;
     void * workClass;
 
-    void startThreads();
-
 public:
     /** Constructor, number of working threads should be supplied */
     ThreadManager(int numberOfThreads, void * workClass = NULL);
@@ -255,13 +398,16 @@ public:
     /** Same as run but without blocking. */
     void runAsync(ThreadFunction function);
 
-    /** Function that should be called to wait until all threads finished work */
+    /** Function that should be called to wait until all threads finished work.
+     * An exception thrown by one of the threads is rethrown here.
+     */
     void wait();
 
-    /** function to start running the threads.
-     * Should be external and declared as friend */
-    friend void * _threadMain(void * data);
-
+    /** The pool of threads, for more fine-grained parallelism */
+    ThreadPool & getPool()
+    {
+        return *pool;
+    }
 
 }
 ;//end of class ThreadManager
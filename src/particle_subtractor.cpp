@@ -18,6 +18,7 @@
  * author citations must be preserved.
  ***************************************************************************/
 
+#include <omp.h>
 #include "src/particle_subtractor.h"
 
 void ParticleSubtractor::read(int argc, char **argv)
@@ -40,6 +41,10 @@ void ParticleSubtractor::read(int argc, char **argv)
 	ZZ(new_center) = textToInteger(parser.getOption("--center_z", "Z-coordinate of 3D coordinate, which will be projected to center the subtracted particles.", "9999"));
 	boxsize = textToInteger(parser.getOption("--new_box", "Output size of the subtracted particles", "-1"));
 
+	int comp_section = parser.addSection("Computation options");
+	nr_threads = textToInteger(parser.getOption("--j", "Number of threads to subtract particles in parallel", "1"));
+	do_pool_arrays = parser.checkOption("--pool_arrays", "Re-use the memory of the arrays of one particle for the next one, instead of returning it to the system");
+
 	verb = 1;
 	// Check for errors in the command-line option
 	if (parser.checkForErrors())
@@ -310,24 +315,92 @@ void ParticleSubtractor::run()
 	}
 
 	MDimg_out.clear();
-	//for (long int part_id_sorted = my_first_part_id, cc = 0; part_id_sorted <= my_last_part_id; part_id_sorted++, cc++)
-	for (long int part_id_sorted = my_first_part_id, cc = 0; part_id_sorted <= my_last_part_id; part_id_sorted++, cc++)
+
+	// The threads only read from MDimg while the output columns are set in storeSubtractedParticle,
+	// so add any new columns beforehand (in the same order as setValue would have added them)
+	if (!do_ssnr)
+	{
+		opt.mydata.MDimg.addLabel(EMDL_IMAGE_ORI_NAME);
+		opt.mydata.MDimg.addLabel(EMDL_IMAGE_ID);
+	}
+
+	// Threads subtract particles in any order, but the results are stored (and the stacks written) in the
+	// order of the particles. This keeps the output identical to the sequential program, while reading
+	// and writing of images overlaps with the calculations in the other threads.
+	std::vector<SubtractionWorkspace> workspaces(nr_threads);
+	std::vector<RelionError> thread_errors;
+	bool has_error = false;
+
+	#pragma omp parallel num_threads(nr_threads)
 	{
+		// The arrays of one particle get the memory that was freed by the previous one of the same thread
+		MultidimArrayPoolGuard pool_guard(do_pool_arrays);
 
-		//long int part_id = opt.mydata.sorted_idx[part_id_sorted];
-		if (cc % barstep == 0)
+		#pragma omp for ordered schedule(dynamic)
+		for (long int cc = 0; cc < nr_parts; cc++)
 		{
-			if (pipeline_control_check_abort_job())
-				exit(RELION_EXIT_ABORTED);
-		}
+			SubtractionWorkspace &ws = workspaces[omp_get_thread_num()];
+			long int part_id = opt.mydata.sorted_idx[my_first_part_id + cc];
 
-		long int part_id = opt.mydata.sorted_idx[part_id_sorted];
-		subtractOneParticle(part_id, 0, cc);
+			bool skip;
+			#pragma omp atomic read
+			skip = has_error;
 
-		if (cc % barstep == 0 && verb > 0) progress_bar(cc);
+			if (!skip)
+			{
+				try
+				{
+					calculateSubtractedParticle(part_id, 0, ws);
+				}
+				catch (RelionError XE)
+				{
+					#pragma omp critical(ParticleSubtractor_error)
+					{
+						thread_errors.push_back(XE);
+						#pragma omp atomic write
+						has_error = true;
+					}
+					skip = true;
+				}
+			}
+
+			#pragma omp ordered
+			{
+				if (!skip)
+				{
+					try
+					{
+						if (cc % barstep == 0)
+						{
+							if (pipeline_control_check_abort_job())
+								exit(RELION_EXIT_ABORTED);
+						}
+
+						storeSubtractedParticle(ws, cc);
+
+						if (cc % barstep == 0 && verb > 0) progress_bar(cc);
+					}
+					catch (RelionError XE)
+					{
+						#pragma omp critical(ParticleSubtractor_error)
+						{
+							thread_errors.push_back(XE);
+							#pragma omp atomic write
+							has_error = true;
+						}
+					}
+				}
+			}
+		}
 	}
 
+	if (thread_errors.size() > 0)
+		throw thread_errors[0];
+
 	if (verb > 0) progress_bar(nr_parts);
+
+	if (do_pool_arrays && verb > 0)
+		printMultidimArrayPoolStatistics();
 }
 
 void ParticleSubtractor::saveStarFile(int myrank)
@@ -460,13 +533,24 @@ FileName ParticleSubtractor::getParticleName(long int imgno, int myrank, int opt
 }
 
 void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, long int counter)
+{
+	SubtractionWorkspace ws;
+	calculateSubtractedParticle(part_id, imgno, ws);
+	storeSubtractedParticle(ws, counter);
+}
+
+void ParticleSubtractor::calculateSubtractedParticle(long int part_id, long int imgno, SubtractionWorkspace &ws)
 {
 	// Read the particle image
-	Image<RFLOAT> img;
+	Image<RFLOAT> &img = ws.img;
 	long int ori_img_id = opt.mydata.particles[part_id].images[imgno].id;
 	int optics_group = opt.mydata.getOpticsGroup(part_id, 0);
 	img.read(opt.mydata.particles[part_id].images[0].name);
 	img().setXmippOrigin();
+	ws.part_id = part_id;
+	ws.ori_img_id = ori_img_id;
+	ws.optics_group = optics_group;
+	ws.has_new_angles = ws.has_new_offsets = false;
 
 	// Make sure gold-standard is adhered to!
 	int my_subset = (rank % 2 == 1) ? 1 : 2;
@@ -479,6 +563,8 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 	// Get the consensus class, orientational parameters and norm (if present)
 	RFLOAT my_pixel_size = opt.mydata.getImagePixelSize(part_id, 0);
 	RFLOAT remap_image_sizes = (opt.mymodel.ori_size * opt.mymodel.pixel_size) / (XSIZE(img()) * my_pixel_size);
+	ws.my_pixel_size = my_pixel_size;
+	ws.remap_image_sizes = remap_image_sizes;
 	Matrix1D<RFLOAT> my_old_offset(3), my_residual_offset(3), centering_offset(3);
 	Matrix2D<RFLOAT> Aori;
 	RFLOAT rot, tilt, psi, xoff, yoff, zoff, mynorm, scale;
@@ -526,9 +612,9 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 	}
 
 	// Now that the particle is centered (for multibody), get the FourierTransform of the particle
-	MultidimArray<Complex> Faux, Fimg;
-	MultidimArray<RFLOAT> Fctf;
-	FourierTransformer transformer;
+	MultidimArray<Complex> &Faux = ws.Faux, &Fimg = ws.Fimg;
+	MultidimArray<RFLOAT> &Fctf = ws.Fctf;
+	FourierTransformer &transformer = ws.transformer;
 	transformer.FourierTransform(img(), Fimg);
 	CenterFFTbySign(Fimg);
 	Fctf.resize(Fimg);
@@ -576,7 +662,7 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 		Fctf.initConstant(1.);
 	}
 
-	MultidimArray<Complex> Fsubtract;
+	MultidimArray<Complex> &Fsubtract = ws.Fsubtract;
 	Fsubtract.initZeros(Fimg);
 
 	if (opt.fn_body_masks != "None")
@@ -613,7 +699,7 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 			Abody = opt.mydata.obsModel.applyScaleDifference(Abody, optics_group, opt.mymodel.ori_size, opt.mymodel.pixel_size);
 
 			// Get the FT of the projection in the right direction
-			MultidimArray<Complex> FTo;
+			MultidimArray<Complex> &FTo = ws.FTo;
 			FTo.initZeros(Fimg);
 			// The following line gets the correct pointer to account for overlap in the bodies
 			int oobody = DIRECT_A2D_ELEM(opt.mymodel.pointer_body_overlap, subtract_body, obody);
@@ -645,10 +731,11 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 		Abody = Aori * (opt.mymodel.orient_bodies[subtract_body]).transpose() * A_rot90 * Aresi_subtract * opt.mymodel.orient_bodies[subtract_body];
 		Euler_matrix2angles(Abody, rot, tilt, psi);
 
-		// Store the optimal orientations in the MDimg table
-		opt.mydata.MDimg.setValue(EMDL_ORIENT_ROT, rot, ori_img_id);
-		opt.mydata.MDimg.setValue(EMDL_ORIENT_TILT, tilt, ori_img_id);
-		opt.mydata.MDimg.setValue(EMDL_ORIENT_PSI, psi, ori_img_id);
+		// Store the optimal orientations in the MDimg table (in storeSubtractedParticle)
+		ws.has_new_angles = true;
+		ws.rot = rot;
+		ws.tilt = tilt;
+		ws.psi = psi;
 
 		// Also get refined offset for this body
 		opt.mydata.MDbodies[subtract_body].getValue(EMDL_ORIENT_ORIGIN_X_ANGSTROM, XX(my_refined_ibody_offset), ori_img_id);
@@ -716,27 +803,7 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 	// Do the actual subtraction
 	Fimg -= Fsubtract;
 
-	if (do_ssnr)
-	{
-		// Don't write out subtracted image,
-		// only accumulate power of the signal (in Fsubtract) divided by the power of the noise (now in Fimg)
-		FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(Fimg)
-		{
-			long int idx = ROUND(sqrt(kp*kp + ip*ip + jp*jp));
-			int idx_remapped = ROUND(remap_image_sizes * idx);
-			if (idx_remapped < opt.mymodel.ori_size/2 + 1)
-			{
-				RFLOAT S2 = norm( dAkij(Fsubtract, k, i, j) );
-				RFLOAT N2 = norm( dAkij(Fimg, k, i, j) );
-				// division by two keeps the numbers similar to tau2 and sigma2_noise,
-				// which are per real/imaginary component
-				sum_S2(idx_remapped) += S2 / 2.;
-				sum_N2(idx_remapped) += N2 / 2.;
-				sum_count(idx_remapped) += 1.;
-			}
-		}
-	}
-	else
+	if (!do_ssnr)
 	{
 		// And go finally back to real-space
 		CenterFFTbySign(Fimg);
@@ -751,12 +818,8 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 			selfTranslate(img(), centering_offset, WRAP);
 
 			// Set the non-integer difference between the rounded centering offset and the actual offsets in the STAR file
-			opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_X_ANGSTROM, my_pixel_size * XX(my_residual_offset), ori_img_id);
-			opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_Y_ANGSTROM, my_pixel_size * YY(my_residual_offset), ori_img_id);
-			if (opt.mymodel.data_dim == 3)
-			{
-				opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_Z_ANGSTROM, my_pixel_size * ZZ(my_residual_offset), ori_img_id);
-			}
+			ws.has_new_offsets = true;
+			ws.residual_offset = my_residual_offset;
 		}
 
 		// Rebox the image
@@ -773,6 +836,55 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 						   LAST_XMIPP_INDEX(boxsize),  LAST_XMIPP_INDEX(boxsize),  LAST_XMIPP_INDEX(boxsize));
 			}
 		}
+	}
+}
+
+void ParticleSubtractor::storeSubtractedParticle(SubtractionWorkspace &ws, long int counter)
+{
+	long int part_id = ws.part_id;
+	long int ori_img_id = ws.ori_img_id;
+	int optics_group = ws.optics_group;
+	RFLOAT my_pixel_size = ws.my_pixel_size;
+	Image<RFLOAT> &img = ws.img;
+
+	if (ws.has_new_angles)
+	{
+		opt.mydata.MDimg.setValue(EMDL_ORIENT_ROT, ws.rot, ori_img_id);
+		opt.mydata.MDimg.setValue(EMDL_ORIENT_TILT, ws.tilt, ori_img_id);
+		opt.mydata.MDimg.setValue(EMDL_ORIENT_PSI, ws.psi, ori_img_id);
+	}
+
+	if (do_ssnr)
+	{
+		// Don't write out subtracted image,
+		// only accumulate power of the signal (in Fsubtract) divided by the power of the noise (now in Fimg)
+		FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(ws.Fimg)
+		{
+			long int idx = ROUND(sqrt(kp*kp + ip*ip + jp*jp));
+			int idx_remapped = ROUND(ws.remap_image_sizes * idx);
+			if (idx_remapped < opt.mymodel.ori_size/2 + 1)
+			{
+				RFLOAT S2 = norm( dAkij(ws.Fsubtract, k, i, j) );
+				RFLOAT N2 = norm( dAkij(ws.Fimg, k, i, j) );
+				// division by two keeps the numbers similar to tau2 and sigma2_noise,
+				// which are per real/imaginary component
+				sum_S2(idx_remapped) += S2 / 2.;
+				sum_N2(idx_remapped) += N2 / 2.;
+				sum_count(idx_remapped) += 1.;
+			}
+		}
+	}
+	else
+	{
+		if (ws.has_new_offsets)
+		{
+			opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_X_ANGSTROM, my_pixel_size * XX(ws.residual_offset), ori_img_id);
+			opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_Y_ANGSTROM, my_pixel_size * YY(ws.residual_offset), ori_img_id);
+			if (opt.mymodel.data_dim == 3)
+			{
+				opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_Z_ANGSTROM, my_pixel_size * ZZ(ws.residual_offset), ori_img_id);
+			}
+		}
 
 		// Now write out the image & set filenames in output metadatatable
 		FileName fn_img = getParticleName(counter, rank, optics_group);
@@ -55,6 +55,12 @@ public:
 	// verbosity
 	int verb;
 
+	// Number of threads to subtract particles in parallel
+	int nr_threads;
+
+	// Re-use the memory of the arrays of one particle for the next one?
+	bool do_pool_arrays;
+
 public:
 	// Read command line arguments
 	void read(int argc, char **argv);
@@ -87,6 +93,32 @@ public:
 	void subtractOneParticle(long int part_id, long int imgno, long int counter);
 
 private:
+	// Buffers and results for the particle that one thread is working on.
+	// Each thread keeps its own, so that the arrays and the FFTW plans are re-used for all its particles.
+	struct SubtractionWorkspace
+	{
+		Image<RFLOAT> img;
+		MultidimArray<Complex> Fimg, Fsubtract, FTo, Faux;
+		MultidimArray<RFLOAT> Fctf;
+		FourierTransformer transformer;
+
+		long int part_id, ori_img_id;
+		int optics_group;
+		RFLOAT my_pixel_size, remap_image_sizes;
+
+		// Orientations and offsets to be stored in the output STAR file (for multi-body and re-centering)
+		bool has_new_angles, has_new_offsets;
+		RFLOAT rot, tilt, psi;
+		Matrix1D<RFLOAT> residual_offset;
+	};
+
+	// Read the particle image and calculate the subtracted image (or the signal and noise spectra for --ssnr).
+	// Only reads from the data and the model, so it can be called from multiple threads at once.
+	void calculateSubtractedParticle(long int part_id, long int imgno, SubtractionWorkspace &ws);
+
+	// Accumulate the SSNR, or write out the subtracted image and its metadata. Must be called in the order of the particles.
+	void storeSubtractedParticle(SubtractionWorkspace &ws, long int counter);
+
 	// Pre-calculated rotation matrix for (0,90,0) rotation, and its transpose, for multi-body orientations
 	Matrix2D<RFLOAT> A_rot90, A_rot90T;
 
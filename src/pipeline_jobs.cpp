@@ -814,7 +814,7 @@ void RelionJob::initialise(int _job_type)
 	else if (type == PROC_SUBTRACT)
 	{
 		has_mpi = true;
-		has_thread = false;
+		has_thread = true;
 		initialiseSubtractJob();
 	}
 	else if (type == PROC_POST)
@@ -4567,6 +4567,8 @@ bool RelionJob::getCommandsSubtractJob(std::string &outputname, std::vector<std:
 		}
 		if (error_message != "") return false;
 
+		// Running stuff
+		command += " --j " + joboptions["nr_threads"].getString();
 	}
 
 	// Other arguments
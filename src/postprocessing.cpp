@@ -18,6 +18,7 @@
  * author citations must be preserved.
  ***************************************************************************/
 
+#include <omp.h>
 #include "src/postprocessing.h"
 
 void Postprocessing::read(int argc, char **argv)
@@ -59,6 +60,8 @@ void Postprocessing::read(int argc, char **argv)
 	locres_edgwidth = textToFloat(parser.getOption("--locres_edgwidth", "Width of soft edge (in A) on masks for local-resolution map (default = sampling)", "-1"));
 	locres_randomize_fsc = textToFloat(parser.getOption("--locres_randomize_at", "Randomize phases from this resolution (in A)", "25."));
 	locres_minres = textToFloat(parser.getOption("--locres_minres", "Lowest local resolution allowed (in A)", "50."));
+	nr_threads = textToInteger(parser.getOption("--j", "Number of threads for local-resolution estimation", "1"));
+	do_locres_subbox = parser.checkOption("--locres_subbox", "Calculate local FSCs in boxes of twice the mask diameter (much faster, but local resolutions may differ by a shell)");
 
 	int expert_section = parser.addSection("Expert options");
 	do_ampl_corr = parser.checkOption("--ampl_corr", "Perform amplitude correlation and DPR, also re-normalize amplitudes for non-uniform angular distributions");
@@ -105,6 +108,8 @@ void Postprocessing::clear()
 	filter_edge_width = 2.;
 	verb = 1;
 	do_ampl_corr = false;
+	nr_threads = 1;
+	do_locres_subbox = false;
 }
 
 void Postprocessing::initialise()
@@ -904,6 +909,110 @@ void Postprocessing::writeFscXml(MetaDataTable &MDfsc)
 	fh.close();
 }
 
+// Copy a cube of XSIZE(box) around the voxel (z, y, x) (in logical coordinates) of map into box, with zeros outside map
+static void extractSubBox(const MultidimArray<RFLOAT> &map, MultidimArray<RFLOAT> &box, long int z, long int y, long int x)
+{
+	box.setXmippOrigin();
+	FOR_ALL_ELEMENTS_IN_ARRAY3D(box)
+	{
+		long int kk = z + k, ii = y + i, jj = x + j;
+		if (map.outside(kk, ii, jj))
+			A3D_ELEM(box, k, i, j) = 0.;
+		else
+			A3D_ELEM(box, k, i, j) = A3D_ELEM(map, kk, ii, jj);
+	}
+}
+
+// The voxels of a soft mask centred on the origin that have a non-zero weight
+struct LocalMaskSupport
+{
+	std::vector<long int> k, i, j;
+	std::vector<RFLOAT> w;
+
+	LocalMaskSupport(const MultidimArray<RFLOAT> &mask)
+	{
+		FOR_ALL_ELEMENTS_IN_ARRAY3D(mask)
+		{
+			if (A3D_ELEM(mask, k, i, j) > 0.)
+			{
+				this->k.push_back(k);
+				this->i.push_back(i);
+				this->j.push_back(j);
+				w.push_back(A3D_ELEM(mask, k, i, j));
+			}
+		}
+	}
+};
+
+// Multiply map by the mask centred on the voxel (z, y, x) and copy the result into box, centred on its origin.
+// Only the support of the mask is visited, the rest of box is set to zero.
+static void extractMaskedSubBox(const MultidimArray<RFLOAT> &map, MultidimArray<RFLOAT> &box, const LocalMaskSupport &mask, long int z, long int y, long int x)
+{
+	box.initZeros();
+	box.setXmippOrigin();
+	for (long int n = 0; n < mask.w.size(); n++)
+	{
+		const long int kk = z + mask.k[n], ii = y + mask.i[n], jj = x + mask.j[n];
+		if (!map.outside(kk, ii, jj))
+			A3D_ELEM(box, mask.k[n], mask.i[n], mask.j[n]) = mask.w[n] * A3D_ELEM(map, kk, ii, jj);
+	}
+}
+
+// Interpolate an FSC curve calculated in a box of box_size onto the resolution shells of a box of ori_size
+static void resampleFSC(const MultidimArray<RFLOAT> &fsc_box, int box_size, int ori_size, MultidimArray<RFLOAT> &fsc)
+{
+	fsc.initZeros(ori_size / 2 + 1);
+	FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(fsc)
+	{
+		RFLOAT x = (RFLOAT)i * box_size / ori_size;
+		int x0 = FLOOR(x);
+		if (x0 >= XSIZE(fsc_box) - 1)
+		{
+			DIRECT_A1D_ELEM(fsc, i) = DIRECT_A1D_ELEM(fsc_box, XSIZE(fsc_box) - 1);
+		}
+		else
+		{
+			RFLOAT w = x - x0;
+			DIRECT_A1D_ELEM(fsc, i) = (1. - w) * DIRECT_A1D_ELEM(fsc_box, x0) + w * DIRECT_A1D_ELEM(fsc_box, x0 + 1);
+		}
+	}
+}
+
+void Postprocessing::applyLocalFilter(MultidimArray<Complex > &FT, int box_size, int ori_size, MultidimArray<RFLOAT> &my_fsc, RFLOAT low_pass)
+{
+	// Same as applyFscWeighting and lowPassFilterMap on a box of ori_size, but for a Fourier transform of a box of box_size
+	int ires_max = 0 ;
+	FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(my_fsc)
+	{
+		if (DIRECT_A1D_ELEM(my_fsc, i) < 0.0001)
+			break;
+		ires_max = i;
+	}
+
+	int ires_filter = ROUND((ori_size * angpix)/low_pass);
+	int filter_edge_halfwidth = filter_edge_width / 2;
+	RFLOAT edge_low = XMIPP_MAX(0., (ires_filter - filter_edge_halfwidth) / (RFLOAT)ori_size); // in 1/pix
+	RFLOAT edge_high = XMIPP_MIN(ori_size / 2 + 1, (ires_filter + filter_edge_halfwidth) / (RFLOAT)ori_size); // in 1/pix
+	RFLOAT edge_width = edge_high - edge_low;
+
+	FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(FT)
+	{
+		RFLOAT res = sqrt((RFLOAT)kp * kp + ip * ip + jp * jp) / box_size; // in 1/pix
+		int ires = ROUND(res * ori_size);
+		if (ires > ires_max || res > edge_high)
+		{
+			DIRECT_A3D_ELEM(FT, k, i, j) = 0.;
+			continue;
+		}
+
+		RFLOAT fsc = DIRECT_A1D_ELEM(my_fsc, ires);
+		RFLOAT weight = (fsc > 0.) ? sqrt((2 * fsc) / (1 + fsc)) : 0.;
+		if (res >= edge_low)
+			weight *= 0.5 + 0.5 * cos( PI * (res-edge_low)/edge_width);
+		DIRECT_A3D_ELEM(FT, k, i, j) *= weight;
+	}
+}
+
 void Postprocessing::run_locres(int rank, int size)
 {
 	// Read input maps and perform some checks
@@ -912,15 +1021,12 @@ void Postprocessing::run_locres(int rank, int size)
 	// Also read the user-provided mask
 	//getMask();
 
-	MultidimArray<RFLOAT> I1m, I2m, I1p, I2p, Isum, locmask, Ilocres, Ifil, Isumw;
+	MultidimArray<RFLOAT> I1p, I2p, Isum, Ilocres, Ifil, Isumw;
 
 	// Get sum of two half-maps and sharpen according to estimated or ad-hoc B-factor
 	Isum.resize(I1());
-	I1m.resize(I1());
-	I2m.resize(I1());
 	I1p.resize(I1());
 	I2p.resize(I1());
-	locmask.resize(I1());
 	// Initialise local-resolution maps, weights etc
 	Ifil.initZeros(I1());
 	Ilocres.initZeros(I1());
@@ -957,6 +1063,34 @@ void Postprocessing::run_locres(int rank, int size)
 	// Randomize phases
 	randomizePhasesBeyond(I1p, randomize_at);
 	randomizePhasesBeyond(I2p, randomize_at);
+	I1p.setXmippOrigin();
+	I2p.setXmippOrigin();
+
+	// The FSCs of one sampling point are calculated in a box centred on it.
+	// By default, this box is as large as the map. The masked maps are then circular shifts of
+	// those in the map, which have the same FSCs, and the whole sharpened map is filtered, as before.
+	// With --locres_subbox, the box is twice the mask diameter. The masked maps are zero outside
+	// the local mask, so FSCs in the sub-box sample the same spectrum as in the full box, but on
+	// coarser shells, which are interpolated back onto the full-box shells. The sharpened map
+	// is then filtered in the sub-box, with zeros outside the map.
+	const int ori_size = XSIZE(I1());
+	int box_size = ori_size;
+	if (do_locres_subbox)
+	{
+		box_size = 4 * (maskrad_pix + edgewidth_pix + 1);
+		box_size = XMIPP_MIN(ori_size, box_size + box_size % 2);
+	}
+	const bool filter_sub_box = (box_size < ori_size);
+	if (filter_sub_box)
+	{
+		transformer.inverseFourierTransform(FTsum, Isum);
+		Isum.setXmippOrigin();
+	}
+	MultidimArray<RFLOAT> locmask(box_size, box_size, box_size);
+	raisedCosineMask(locmask, maskrad_pix, maskrad_pix + edgewidth_pix, 0, 0, 0);
+	// Only the voxels inside the soft mask are visited to mask the maps and to add up the results
+	const LocalMaskSupport support(locmask);
+	locmask.clear();
 
 	// Write an output STAR file with FSC curves, Guinier plots etc
 	FileName fn_tmp = fn_out + "_locres_fscs.star";
@@ -966,6 +1100,7 @@ void Postprocessing::run_locres(int rank, int size)
 		if (verb > 0)
 		{
 			std::cout.width(35); std::cout << std::left <<"  + Metadata output file: "; std::cout << fn_tmp<< std::endl;
+			std::cout.width(35); std::cout << std::left <<"  + Local-resolution box size: "; std::cout << box_size << " pixels" << std::endl;
 		}
 
 		fh.open((fn_tmp).c_str(), std::ios::out);
@@ -984,95 +1119,160 @@ void Postprocessing::run_locres(int rank, int size)
 		init_progress_bar(nr_samplings);
 	}
 
+	// Only calculate local-resolution inside a spherical mask with radius less than half-box-size minus maskrad_pix
+	std::vector<long int> point_k, point_i, point_j;
 	long int nn = 0;
 	for (long int kk=((I1()).zinit); kk<=((I1()).zinit + (I1()).zdim - 1); kk+= step_size)
-	{
 		for (long int ii=((I1()).yinit); ii<=((I1()).yinit + (I1()).ydim - 1); ii+= step_size)
-		{
 			for (long int jj=((I1()).xinit); jj<=((I1()).xinit + (I1()).xdim - 1); jj+= step_size)
-			{
-				// Abort through the pipeline_control system, TODO: check how this goes with MPI....
-				if (pipeline_control_check_abort_job())
-					exit(RELION_EXIT_ABORTED);
-
-				// Only calculate local-resolution inside a spherical mask with radius less than half-box-size minus maskrad_pix
-				float rad = sqrt(kk*kk + ii*ii + jj*jj);
-				if (rad < myrad)
+				if (sqrt(kk*kk + ii*ii + jj*jj) < myrad)
 				{
 					if (nn%size == rank)
 					{
-						// Make a spherical mask around (k,i,j), diameter is step_size pixels, soft-edge width is edgewidth_pix
-						raisedCosineMask(locmask, maskrad_pix, maskrad_pix + edgewidth_pix, kk, ii, jj);
-
-						// FSC of masked maps
-						I1m = I1() * locmask;
-						I2m = I2() * locmask;
-						getFSC(I1m, I2m, fsc_masked);
-
-						// FSC of masked randomized-phase map
-						I1m = I1p * locmask;
-						I2m = I2p * locmask;
-						getFSC(I1m, I2m, fsc_random_masked);
-
-						// Now that we have fsc_masked and fsc_random_masked, calculate fsc_true according to Richard's formula
-						// FSC_true = FSC_t - FSC_n / ( )
-						calculateFSCtrue(fsc_true, fsc_unmasked, fsc_masked, fsc_random_masked, randomize_at);
-
-						if (rank == 0)
-						{
-							MetaDataTable MDfsc;
-							FileName fn_name = "fsc_"+integerToString(kk, 5)+"_"+integerToString(ii, 5)+"_"+integerToString(jj, 5);
-							MDfsc.setName(fn_name);
-							FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(fsc_true)
-							{
-								MDfsc.addObject();
-								RFLOAT res = (i > 0) ? (XSIZE(I1()) * angpix / (RFLOAT)i) : 999.;
-								MDfsc.setValue(EMDL_SPECTRAL_IDX, (int)i);
-								MDfsc.setValue(EMDL_RESOLUTION, 1./res);
-								MDfsc.setValue(EMDL_RESOLUTION_ANGSTROM, res);
-								MDfsc.setValue(EMDL_POSTPROCESS_FSC_TRUE, DIRECT_A1D_ELEM(fsc_true, i) );
-								MDfsc.setValue(EMDL_POSTPROCESS_FSC_UNMASKED, DIRECT_A1D_ELEM(fsc_unmasked, i) );
-								MDfsc.setValue(EMDL_POSTPROCESS_FSC_MASKED, DIRECT_A1D_ELEM(fsc_masked, i) );
-								MDfsc.setValue(EMDL_POSTPROCESS_FSC_RANDOM_MASKED, DIRECT_A1D_ELEM(fsc_random_masked, i) );
-							}
-							MDfsc.write(fh);
-						}
-
-						float local_resol = 999.;
-						// See where corrected FSC drops below 0.143
-						FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(fsc_true)
-						{
-							if ( DIRECT_A1D_ELEM(fsc_true, i) < 0.143)
-								break;
-							local_resol = (i > 0) ? XSIZE(I1())*angpix/(RFLOAT)i : 999.;
-						}
-						local_resol = XMIPP_MIN(locres_minres, local_resol);
-						if (rank == 0)
-							fh << " kk= " << kk << " ii= " << ii << " jj= " << jj << " local resolution= " << local_resol << std::endl;
-
-						// Now low-pass filter Isum to the estimated resolution
-						MultidimArray<Complex > FT = FTsum;
-						applyFscWeighting(FT, fsc_true);
-						lowPassFilterMap(FT, XSIZE(I1()), local_resol, angpix, filter_edge_width);
-
-						// Re-use I1m to save some memory
-						transformer.inverseFourierTransform(FT, I1m);
-
-						// Store weighted sum of local resolution and filtered map
-						FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(I1m)
-						{
-							DIRECT_MULTIDIM_ELEM(Ifil, n) +=  DIRECT_MULTIDIM_ELEM(locmask, n) * DIRECT_MULTIDIM_ELEM(I1m, n);
-							DIRECT_MULTIDIM_ELEM(Ilocres, n) +=  DIRECT_MULTIDIM_ELEM(locmask, n) / local_resol;
-							DIRECT_MULTIDIM_ELEM(Isumw, n) +=  DIRECT_MULTIDIM_ELEM(locmask, n);
-						}
+						point_k.push_back(kk);
+						point_i.push_back(ii);
+						point_j.push_back(jj);
 					}
-
 					nn++;
-					if (verb > 0 && nn <= nr_samplings)
-						progress_bar(nn);
+				}
+
+	// Process the points in chunks: the points of a chunk are calculated in parallel,
+	// after which their FSC curves are written out in order.
+	const long int nr_points = point_k.size();
+	const long int chunk_size = 4 * nr_threads;
+	std::vector<MultidimArray<RFLOAT> > chunk_fsc_true(chunk_size), chunk_fsc_masked(chunk_size), chunk_fsc_random_masked(chunk_size);
+	std::vector<RFLOAT> chunk_resol(chunk_size);
+	std::vector<FourierTransformer> transformers(nr_threads);
+	std::vector<MultidimArray<RFLOAT> > thread_I1m(nr_threads), thread_I2m(nr_threads), thread_Ifilm(nr_threads);
+	for (int thread_id = 0; thread_id < nr_threads; thread_id++)
+	{
+		thread_I1m[thread_id].resize(box_size, box_size, box_size);
+		thread_I2m[thread_id].resize(box_size, box_size, box_size);
+		if (filter_sub_box)
+			thread_Ifilm[thread_id].resize(box_size, box_size, box_size);
+		else
+			thread_Ifilm[thread_id].resize(ori_size, ori_size, ori_size);
+	}
+
+	for (long int chunk_start = 0; chunk_start < nr_points; chunk_start += chunk_size)
+	{
+		// Abort through the pipeline_control system, TODO: check how this goes with MPI....
+		if (pipeline_control_check_abort_job())
+			exit(RELION_EXIT_ABORTED);
+
+		const long int chunk_end = XMIPP_MIN(nr_points, chunk_start + chunk_size);
+
+		#pragma omp parallel for num_threads(nr_threads) schedule(dynamic)
+		for (long int ipoint = chunk_start; ipoint < chunk_end; ipoint++)
+		{
+			const int thread_id = omp_get_thread_num();
+			FourierTransformer &my_transformer = transformers[thread_id];
+			MultidimArray<RFLOAT> &I1m = thread_I1m[thread_id], &I2m = thread_I2m[thread_id], &Ifilm = thread_Ifilm[thread_id];
+			const long int ichunk = ipoint - chunk_start;
+			MultidimArray<Complex > FT1, FT2;
+			MultidimArray<RFLOAT> fsc_box;
+
+			// The mask of (k,i,j) is centred on x = k, y = i, z = j, see raisedCosineMask
+			const long int z = point_j[ipoint], y = point_i[ipoint], x = point_k[ipoint];
+
+			// FSC of masked maps
+			extractMaskedSubBox(I1(), I1m, support, z, y, x);
+			extractMaskedSubBox(I2(), I2m, support, z, y, x);
+			my_transformer.FourierTransform(I1m, FT1);
+			my_transformer.FourierTransform(I2m, FT2);
+			getFSC(FT1, FT2, fsc_box);
+			resampleFSC(fsc_box, box_size, ori_size, chunk_fsc_masked[ichunk]);
+
+			// FSC of masked randomized-phase map
+			extractMaskedSubBox(I1p, I1m, support, z, y, x);
+			extractMaskedSubBox(I2p, I2m, support, z, y, x);
+			my_transformer.FourierTransform(I1m, FT1);
+			my_transformer.FourierTransform(I2m, FT2);
+			getFSC(FT1, FT2, fsc_box);
+			resampleFSC(fsc_box, box_size, ori_size, chunk_fsc_random_masked[ichunk]);
+
+			// Now that we have fsc_masked and fsc_random_masked, calculate fsc_true according to Richard's formula
+			// FSC_true = FSC_t - FSC_n / ( )
+			MultidimArray<RFLOAT> &my_fsc_true = chunk_fsc_true[ichunk];
+			calculateFSCtrue(my_fsc_true, fsc_unmasked, chunk_fsc_masked[ichunk], chunk_fsc_random_masked[ichunk], randomize_at);
+
+			float local_resol = 999.;
+			// See where corrected FSC drops below 0.143
+			FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(my_fsc_true)
+			{
+				if ( DIRECT_A1D_ELEM(my_fsc_true, i) < 0.143)
+					break;
+				local_resol = (i > 0) ? ori_size*angpix/(RFLOAT)i : 999.;
+			}
+			local_resol = XMIPP_MIN(locres_minres, local_resol);
+			chunk_resol[ichunk] = local_resol;
+
+			// Now low-pass filter the sharpened sum to the estimated resolution,
+			// either in the sub-box around the point, or the whole map as before
+			long int fz = 0, fy = 0, fx = 0;
+			if (filter_sub_box)
+			{
+				extractSubBox(Isum, Ifilm, z, y, x);
+				my_transformer.FourierTransform(Ifilm, FT1);
+				applyLocalFilter(FT1, box_size, ori_size, my_fsc_true, local_resol);
+			}
+			else
+			{
+				FT1 = FTsum;
+				applyLocalFilter(FT1, ori_size, ori_size, my_fsc_true, local_resol);
+				fz = z;
+				fy = y;
+				fx = x;
+			}
+			my_transformer.inverseFourierTransform(FT1, Ifilm);
+			Ifilm.setXmippOrigin();
+
+			// Store weighted sum of local resolution and filtered map
+			#pragma omp critical(Postprocessing_run_locres)
+			{
+				for (long int n = 0; n < support.w.size(); n++)
+				{
+					const RFLOAT w = support.w[n];
+					const long int k = support.k[n], i = support.i[n], j = support.j[n];
+					const long int kk = z + k, ii = y + i, jj = x + j;
+					if (Ifil.outside(kk, ii, jj))
+						continue;
+					A3D_ELEM(Ifil, kk, ii, jj) +=  w * A3D_ELEM(Ifilm, fz + k, fy + i, fx + j);
+					A3D_ELEM(Ilocres, kk, ii, jj) +=  w / local_resol;
+					A3D_ELEM(Isumw, kk, ii, jj) +=  w;
 				}
 			}
 		}
+
+		// Write out the FSC curves of this chunk in order
+		for (long int ipoint = chunk_start; ipoint < chunk_end; ipoint++)
+		{
+			const long int ichunk = ipoint - chunk_start;
+			const long int kk = point_k[ipoint], ii = point_i[ipoint], jj = point_j[ipoint];
+			if (rank == 0)
+			{
+				MetaDataTable MDfsc;
+				FileName fn_name = "fsc_"+integerToString(kk, 5)+"_"+integerToString(ii, 5)+"_"+integerToString(jj, 5);
+				MDfsc.setName(fn_name);
+				FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(chunk_fsc_true[ichunk])
+				{
+					MDfsc.addObject();
+					RFLOAT res = (i > 0) ? (XSIZE(I1()) * angpix / (RFLOAT)i) : 999.;
+					MDfsc.setValue(EMDL_SPECTRAL_IDX, (int)i);
+					MDfsc.setValue(EMDL_RESOLUTION, 1./res);
+					MDfsc.setValue(EMDL_RESOLUTION_ANGSTROM, res);
+					MDfsc.setValue(EMDL_POSTPROCESS_FSC_TRUE, DIRECT_A1D_ELEM(chunk_fsc_true[ichunk], i) );
+					MDfsc.setValue(EMDL_POSTPROCESS_FSC_UNMASKED, DIRECT_A1D_ELEM(fsc_unmasked, i) );
+					MDfsc.setValue(EMDL_POSTPROCESS_FSC_MASKED, DIRECT_A1D_ELEM(chunk_fsc_masked[ichunk], i) );
+					MDfsc.setValue(EMDL_POSTPROCESS_FSC_RANDOM_MASKED, DIRECT_A1D_ELEM(chunk_fsc_random_masked[ichunk], i) );
+				}
+				MDfsc.write(fh);
+				fh << " kk= " << kk << " ii= " << ii << " jj= " << jj << " local resolution= " << chunk_resol[ichunk] << std::endl;
+			}
+		}
+
+		if (verb > 0)
+			progress_bar(XMIPP_MIN(nr_samplings, chunk_end * size));
 	}
 
 	fh.close();
@@ -1082,6 +1282,7 @@ void Postprocessing::run_locres(int rank, int size)
 
 	if (size > 1)
 	{
+		MultidimArray<RFLOAT> I1m(Ifil);
 		I1m.initZeros();
 		MPI_Allreduce(MULTIDIM_ARRAY(Ifil), MULTIDIM_ARRAY(I1m), MULTIDIM_SIZE(Ifil), MY_MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 		Ifil = I1m;
@@ -1096,7 +1297,7 @@ void Postprocessing::run_locres(int rank, int size)
 	if (rank == 0)
 	{
 		// Now write out the local-resolution map and
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(I1m)
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Isumw)
 		{
 			if (DIRECT_MULTIDIM_ELEM(Isumw, n ) > 0.)
 			{
@@ -107,6 +107,12 @@ public:
 	// Lowest resolution allowed in the locres map
 	RFLOAT locres_minres;
 
+	// Number of threads for local resolution estimation
+	int nr_threads;
+
+	// Calculate the local FSCs and filtering in sub-boxes around each sampling point (faster, but approximate)
+	bool do_locres_subbox;
+
 	//////// Sharpening
 
 	// Filename for the STAR-file with the MTF of the detector
@@ -202,6 +208,10 @@ public:
 	// Write XML file for EMDB submission
 	void writeFscXml(MetaDataTable &MDfsc);
 
+	// FSC-weighting and low-pass filtering (as in applyFscWeighting and lowPassFilterMap for a box of ori_size)
+	// of the Fourier transform of a sub-box of box_size
+	void applyLocalFilter(MultidimArray<Complex > &FT, int box_size, int ori_size, MultidimArray<RFLOAT> &my_fsc, RFLOAT low_pass);
+
 	// Local-resolution running
 	void run_locres(int rank = 0, int size = 1);
 
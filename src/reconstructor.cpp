@@ -17,6 +17,7 @@
  * source code. Additional authorship citations may be added, but existing
  * author citations must be preserved.
  ***************************************************************************/
+#include <omp.h>
 #include "src/reconstructor.h"
 
 void Reconstructor::read(int argc, char **argv)
@@ -33,6 +34,7 @@ void Reconstructor::read(int argc, char **argv)
 	subset = textToInteger(parser.getOption("--subset", "Subset of images to consider (1: only reconstruct half1; 2: only half2; other: reconstruct all)", "-1"));
 	chosen_class = textToInteger(parser.getOption("--class", "Consider only this class (-1: use all classes)", "-1"));
 	angpix  = textToFloat(parser.getOption("--angpix", "Pixel size in the reconstruction (take from first optics group by default)", "-1"));
+	nr_threads = textToInteger(parser.getOption("--j", "Number of threads for the back-projection (each thread needs its own copy of the 3D arrays)", "1"));
 
 	int ctf_section = parser.addSection("CTF options");
 	do_ctf = parser.checkOption("--ctf", "Apply CTF correction");
@@ -295,6 +297,21 @@ void Reconstructor::backproject(int rank, int size)
 
 	long int nr_parts = DF.numberOfObjects();
 	long int barstep = XMIPP_MAX(1, nr_parts/(size*120));
+
+	// The random deviations and the noise all come from one random generator, which cannot be shared between threads
+	bool do_threads = (nr_threads > 1);
+	if (do_threads && (angular_error > 0. || shift_error > 0. || fn_noise != ""))
+	{
+		do_threads = false;
+		if (verb > 0)
+			std::cout << " + Random errors or noise were requested: back-projecting on a single thread ..." << std::endl;
+	}
+	else if (do_threads && verb > 0)
+	{
+		RFLOAT Gb = (nr_threads - 1) * (sizeof(Complex) + sizeof(RFLOAT)) * MULTIDIM_SIZE(backprojector.weight) / (1024. * 1024. * 1024.);
+		std::cout << " + Using " << nr_threads << " threads, with " << Gb << " Gb of extra memory for their data and weight arrays" << std::endl;
+	}
+
 	if (verb > 0)
 	{
 		std::cout << " + Back-projecting all images ..." << std::endl;
@@ -302,6 +319,12 @@ void Reconstructor::backproject(int rank, int size)
 		init_progress_bar(nr_parts);
 	}
 
+	if (do_threads)
+	{
+		backprojectWithThreads(rank, size);
+		return;
+	}
+
 	for (long int ipart = 0; ipart < nr_parts; ipart++)
 	{
 		if (ipart % size == rank)
@@ -315,22 +338,146 @@ void Reconstructor::backproject(int rank, int size)
 		progress_bar(nr_parts);
 }
 
-void Reconstructor::backprojectOneParticle(long int p)
+void Reconstructor::backprojectWithThreads(int rank, int size)
 {
-	RFLOAT rot, tilt, psi, fom, r_ewald_sphere;
-	Matrix2D<RFLOAT> A3D;
-	MultidimArray<RFLOAT> Fctf;
-	Matrix1D<RFLOAT> trans(2);
-	FourierTransformer transformer;
+	long int nr_parts = DF.numberOfObjects();
+
+	std::vector<long int> my_parts;
+	for (long int ipart = 0; ipart < nr_parts; ipart++)
+	{
+		if (ipart % size == rank && isSelectedParticle(ipart))
+			my_parts.push_back(ipart);
+	}
+	long int nr_my_parts = my_parts.size();
+
+	// Thread 0 back-projects into backprojector, all other threads into their own copies.
+	// These are summed at the end, so that threads never have to wait for each other.
+	std::vector<BackProjector> thread_backprojectors(nr_threads - 1, backprojector);
+	std::vector<FourierTransformer> transformers(nr_threads);
+
+	// Particle images are read on a separate I/O thread: the next batch is read while this one is back-projected
+	const long int batch_size = 64 * nr_threads;
+	bool do_prefetch = (!do_reconstruct_ctf && fn_noise == "" && data_dim == 2);
+	ImagePrefetcher *prefetcher = (do_prefetch) ? new ImagePrefetcher(1, 2 * batch_size) : NULL;
+
+	std::vector<RelionError> thread_errors;
+	for (long int first = 0; first < nr_my_parts; first += batch_size)
+	{
+		long int last = XMIPP_MIN(first + batch_size, nr_my_parts) - 1;
+
+		if (prefetcher != NULL)
+		{
+			for (long int batch_first = first; batch_first <= first + batch_size && batch_first < nr_my_parts; batch_first += batch_size)
+			{
+				if (prefetcher->isRequested(batch_first))
+					continue;
+
+				std::vector<FileName> fn_imgs;
+				for (long int i = batch_first; i < XMIPP_MIN(batch_first + batch_size, nr_my_parts); i++)
+				{
+					FileName fn_img;
+					DF.getValue(EMDL_IMAGE_NAME, fn_img, my_parts[i]);
+					fn_imgs.push_back(fn_img);
+				}
+				prefetcher->request(batch_first, fn_imgs);
+			}
+			prefetcher->setCurrent(first);
+		}
+
+		// A static schedule keeps the sums in the same order for a given number of threads
+		#pragma omp parallel num_threads(nr_threads)
+		{
+			int ithread = omp_get_thread_num();
+			BackProjector &BP = (ithread == 0) ? backprojector : thread_backprojectors[ithread - 1];
+			MultidimArray<RFLOAT> Mimg;
+
+			#pragma omp for schedule(static)
+			for (long int i = first; i <= last; i++)
+			{
+				try
+				{
+					if (prefetcher != NULL)
+					{
+						prefetcher->getImage(i - first, Mimg);
+						backprojectOneParticle(my_parts[i], BP, transformers[ithread], &Mimg);
+					}
+					else
+					{
+						backprojectOneParticle(my_parts[i], BP, transformers[ithread]);
+					}
+				}
+				catch (RelionError XE)
+				{
+					#pragma omp critical(Reconstructor_error)
+					thread_errors.push_back(XE);
+				}
+			}
+		}
+
+		if (thread_errors.size() > 0)
+		{
+			delete prefetcher;
+			throw thread_errors[0];
+		}
+
+		if (verb > 0)
+			progress_bar(my_parts[last]);
+	}
+
+	if (prefetcher != NULL)
+	{
+		prefetcher->releaseCurrent();
+		delete prefetcher;
+	}
+
+	// Sum the data and weight arrays of all threads
+	for (int ithread = 1; ithread < nr_threads; ithread++)
+	{
+		BackProjector &BP = thread_backprojectors[ithread - 1];
+		#pragma omp parallel for num_threads(nr_threads)
+		for (long int n = 0; n < MULTIDIM_SIZE(backprojector.weight); n++)
+		{
+			DIRECT_MULTIDIM_ELEM(backprojector.data, n) += DIRECT_MULTIDIM_ELEM(BP.data, n);
+			DIRECT_MULTIDIM_ELEM(backprojector.weight, n) += DIRECT_MULTIDIM_ELEM(BP.weight, n);
+		}
+		BP.data.clear();
+		BP.weight.clear();
+	}
 
+	if (verb > 0)
+		progress_bar(nr_parts);
+}
+
+bool Reconstructor::isSelectedParticle(long int p)
+{
 	int randSubset = 0, classid = 0;
 	DF.getValue(EMDL_PARTICLE_RANDOM_SUBSET, randSubset, p);
 	DF.getValue(EMDL_PARTICLE_CLASS, classid, p);
 
 	if (subset >= 1 && subset <= 2 && randSubset != subset)
-		return;
+		return false;
 
 	if (chosen_class >= 0 && chosen_class != classid)
+		return false;
+
+	return true;
+}
+
+void Reconstructor::backprojectOneParticle(long int p)
+{
+	FourierTransformer transformer;
+	backprojectOneParticle(p, backprojector, transformer);
+}
+
+void Reconstructor::backprojectOneParticle(long int p, BackProjector &BP, FourierTransformer &transformer,
+                                           MultidimArray<RFLOAT> *Mimg)
+{
+	RFLOAT rot, tilt, psi, fom, r_ewald_sphere;
+	Matrix2D<RFLOAT> A3D;
+	MultidimArray<RFLOAT> Fctf;
+	Matrix1D<RFLOAT> trans(2);
+
+	if (!isSelectedParticle(p))
 		return;
 
 	// Rotations
@@ -419,15 +566,19 @@ void Reconstructor::backprojectOneParticle(long int p)
 
 	if (!do_reconstruct_ctf && fn_noise == "")
 	{
-		DF.getValue(EMDL_IMAGE_NAME, fn_img, p);
-		img.read(fn_img);
-		img().setXmippOrigin();
-		transformer.FourierTransform(img(), F2D);
+		if (Mimg == NULL)
+		{
+			DF.getValue(EMDL_IMAGE_NAME, fn_img, p);
+			img.read(fn_img);
+			img().setXmippOrigin();
+			Mimg = &img();
+		}
+		transformer.FourierTransform(*Mimg, F2D);
 		CenterFFTbySign(F2D);
 
 		if (ABS(XX(trans)) > 0. || ABS(YY(trans)) > 0. || ABS(ZZ(trans)) > 0. ) // ZZ(trans) is 0 in case data_dim=2
 		{
-			shiftImageInFourierTransform(F2D, F2D, XSIZE(img()), XX(trans), YY(trans), ZZ(trans));
+			shiftImageInFourierTransform(F2D, F2D, XSIZE(*Mimg), XX(trans), YY(trans), ZZ(trans));
 		}
 	}
 	else
@@ -570,7 +721,7 @@ void Reconstructor::backprojectOneParticle(long int p)
 			DIRECT_MULTIDIM_ELEM(F2D, n) -= DIRECT_MULTIDIM_ELEM(Fsub, n);
 		}
 		// Back-project difference image
-		backprojector.set2DFourierTransform(F2D, A3D);
+		BP.set2DFourierTransform(F2D, A3D);
 	}
 	else
 	{
@@ -668,12 +819,12 @@ void Reconstructor::backprojectOneParticle(long int p)
 				magMat.initIdentity();
 			}
 
-			backprojector.set2DFourierTransform(F2DP, A3D, &Fctf, r_ewald_sphere, true, &magMat);
-			backprojector.set2DFourierTransform(F2DQ, A3D, &Fctf, r_ewald_sphere, false, &magMat);
+			BP.set2DFourierTransform(F2DP, A3D, &Fctf, r_ewald_sphere, true, &magMat);
+			BP.set2DFourierTransform(F2DQ, A3D, &Fctf, r_ewald_sphere, false, &magMat);
 		}
 		else
 		{
-			backprojector.set2DFourierTransform(F2D, A3D, &Fctf);
+			BP.set2DFourierTransform(F2D, A3D, &Fctf);
 		}
 	}
 
@@ -707,7 +858,7 @@ void Reconstructor::reconstruct()
 	if (verb > 0)
 		std::cout << " + Starting the reconstruction ..." << std::endl;
 
-	backprojector.symmetrise(nr_helical_asu, helical_twist, helical_rise/angpix);
+	backprojector.symmetrise(nr_helical_asu, helical_twist, helical_rise/angpix, nr_threads);
 
 	if (do_reconstruct_ctf)
 	{
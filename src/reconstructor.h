@@ -29,6 +29,7 @@
 #include <src/time.h>
 #include <src/ml_model.h>
 #include <src/jaz/obs_model.h>
+#include <src/image_prefetcher.h>
 
 class Reconstructor
 {
@@ -45,7 +46,7 @@ public:
 	int r_max, r_min_nn, blob_order, ref_dim, interpolator, iter,
 	    debug_ori_size, debug_size,
 	    ctf_dim, nr_helical_asu, newbox, width_mask_edge, nr_sectors, subset, chosen_class,
-	    data_dim, output_boxsize, verb;
+	    data_dim, output_boxsize, verb, nr_threads;
 
 	RFLOAT blob_radius, blob_alpha, angular_error, shift_error, angpix, maxres,
 	       helical_rise, helical_twist;
@@ -92,9 +93,19 @@ public:
 	// Loop over all particles to be back-projected
 	void backproject(int rank = 0, int size = 1);
 
+	// Back-project my particles on nr_threads threads, each with its own data and weight arrays
+	void backprojectWithThreads(int rank = 0, int size = 1);
+
+	// Is this particle in the selected random subset and class?
+	bool isSelectedParticle(long int ipart);
+
 	// For parallelisation purposes
 	void backprojectOneParticle(long int ipart);
 
+	// Back-project one particle into BP. If Mimg is given, it holds the (already read) particle image.
+	void backprojectOneParticle(long int ipart, BackProjector &BP, FourierTransformer &transformer,
+	                            MultidimArray<RFLOAT> *Mimg = NULL);
+
 	// perform the gridding reconstruction
 	void reconstruct();
 
@@ -4,6 +4,9 @@
 #include <vector>
 #include <algorithm>
 #include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
 
 #include <src/time.h>
 #include <src/metadata_table.h>
@@ -64,7 +67,7 @@ void EERRenderer::silenceTIFFWarnings()
 }
 
 template <typename T>
-void EERRenderer::render16K(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons)
+void EERRenderer::render16K(MultidimArray<T> &image, const unsigned int *positions, const unsigned char *symbols, int n_electrons)
 {
 	for (int i = 0; i < n_electrons; i++)
 	{
@@ -76,7 +79,7 @@ void EERRenderer::render16K(MultidimArray<T> &image, std::vector<unsigned int> &
 
 
 template <typename T>
-void EERRenderer::render8K(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons)
+void EERRenderer::render8K(MultidimArray<T> &image, const unsigned int *positions, const unsigned char *symbols, int n_electrons)
 {
 	for (int i = 0; i < n_electrons; i++)
 	{
@@ -87,7 +90,7 @@ void EERRenderer::render8K(MultidimArray<T> &image, std::vector<unsigned int> &p
 }
 
 template <typename T>
-void EERRenderer::render4K(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons)
+void EERRenderer::render4K(MultidimArray<T> &image, const unsigned int *positions, const unsigned char *symbols, int n_electrons)
 {
 	for (int i = 0; i < n_electrons; i++)
 	{
@@ -102,6 +105,8 @@ EERRenderer::EERRenderer()
 	ready = false;
 	read_data = false;
 	buf = NULL;
+	fd = -1;
+	nr_threads = 1;
 	preread_start = -1;
 	preread_end = -1;
 	eer_upsampling = 2;
@@ -222,46 +227,50 @@ void EERRenderer::readLegacy(FILE *fh)
 	read_data = true;
 }
 
-void EERRenderer::lazyReadFrames()
+void EERRenderer::lazyIndexFrames()
 {
-	#pragma omp critical(EERRenderer_lazyReadFrames)
+	#pragma omp critical(EERRenderer_lazyIndexFrames)
 	{
 		if (!read_data) // cannot return from within omp critical
-		{	
+		{
+			// Only the location of the strips is read here; the frames themselves are read
+			// when they are rendered, so that the raw movie never has to be held in memory.
 			TIFF *ftiff = TIFFOpen(fn_movie.c_str(), "r");
+			fd = open(fn_movie.c_str(), O_RDONLY);
+			if (ftiff == NULL || fd < 0)
+				REPORT_ERROR("Failed to open " + fn_movie);
 
-			frame_starts.resize(nframes, 0);
 			frame_sizes.resize(nframes, 0);
-			buf = (unsigned char*)malloc(file_size); // This is big enough
-			if (buf == NULL)
-				REPORT_ERROR("Failed to allocate the buffer for " + fn_movie);
-			long long pos = 0;
+			frame_first_strip.resize(nframes + 1, 0);
 
-			// Read everything
 			for (int frame = 0; frame < nframes; frame++)
 			{
+				frame_first_strip[frame] = strip_offsets.size();
 				if ((preread_start > 0 && frame < preread_start) ||
 				    (preread_end > 0 && frame > preread_end))
 					continue;
 
 				TIFFSetDirectory(ftiff, frame);
 				const int nstrips = TIFFNumberOfStrips(ftiff);
-				frame_starts[frame] = pos;
+				toff_t *offsets = NULL;
+				if (!TIFFGetField(ftiff, TIFFTAG_STRIPOFFSETS, &offsets) || offsets == NULL)
+					REPORT_ERROR("EER: failed to get the strip offsets of frame " + integerToString(frame + 1) + " in " + fn_movie);
 
 				for (int strip = 0; strip < nstrips; strip++)
 				{
-					const int strip_size = TIFFRawStripSize(ftiff, strip);
-					if (pos + strip_size >= file_size)
-						REPORT_ERROR("EER: buffer overflow when reading raw strips.");
+					const long long strip_size = TIFFRawStripSize(ftiff, strip);
+					if (offsets[strip] + strip_size > file_size)
+						REPORT_ERROR("EER: strip beyond the end of file in " + fn_movie);
 
-					TIFFReadRawStrip(ftiff, strip, buf + pos, strip_size);
-					pos += strip_size;
+					strip_offsets.push_back(offsets[strip]);
+					strip_sizes.push_back(strip_size);
 					frame_sizes[frame] += strip_size;
 				}
 	#ifdef DEBUG_EER
-				printf("EER in TIFF: Read frame %d from %s, nstrips = %d, current pos in buffer = %lld / %lld\n", frame, fn_movie.c_str(), nstrips, pos, file_size);
+				printf("EER in TIFF: Indexed frame %d from %s, nstrips = %d, frame size = %lld\n", frame, fn_movie.c_str(), nstrips, frame_sizes[frame]);
 	#endif
 			}
+			frame_first_strip[nframes] = strip_offsets.size();
 
 			TIFFClose(ftiff);
 
@@ -270,10 +279,120 @@ void EERRenderer::lazyReadFrames()
 	}
 }
 
+const unsigned char* EERRenderer::getFrameData(int iframe, std::vector<unsigned char> &scratch)
+{
+	if (is_legacy) // Frames are followed by their footer, so it is safe to read ahead.
+		return buf + frame_starts[iframe];
+
+	// The decoders may read up to 8 bytes beyond the end of the frame.
+	const long long size = frame_sizes[iframe];
+	if (scratch.size() < size + 8)
+		scratch.resize(size + 8);
+
+	long long pos = 0;
+	for (int strip = frame_first_strip[iframe]; strip < frame_first_strip[iframe + 1]; strip++)
+	{
+		long long done = 0;
+		while (done < strip_sizes[strip])
+		{
+			const ssize_t nread = pread(fd, &scratch[pos + done], strip_sizes[strip] - done, strip_offsets[strip] + done);
+			if (nread <= 0)
+				REPORT_ERROR("EERRenderer: failed to read frame " + integerToString(iframe + 1) + " from " + fn_movie);
+			done += nread;
+		}
+		pos += strip_sizes[strip];
+	}
+	memset(&scratch[size], 0, 8);
+
+	return &scratch[0];
+}
+
+unsigned int EERRenderer::decodeFrame(const unsigned char *data, long long size, unsigned int *positions, unsigned char *symbols, unsigned int &n_pix)
+{
+	unsigned int n_electron = 0;
+	n_pix = 0;
+
+	if (is_7bit)
+	{
+		unsigned long long bit_pos = 0;
+		const unsigned long long bit_limit = size * 8;
+
+		while (bit_pos < bit_limit)
+		{
+			// Fetch 64 bits and unpack as many chunks of 7 + 4 bits as they hold (at least 57 bits remain after the shift).
+			// This needs fewer loads than fetching 32 bits for two chunks, or unpacking 7 and 4 bits sequentially.
+			unsigned long long chunk;
+			memcpy(&chunk, data + (bit_pos >> 3), sizeof(chunk));
+			chunk >>= (bit_pos & 7); // 7 = 00000111 (same as % 8)
+
+			for (int avail = 57; avail >= 11; )
+			{
+				const unsigned int p = (unsigned int)(chunk & 127); // 127 = 01111111
+				n_pix += p;
+				if (n_pix >= EER_IMAGE_PIXELS) return n_electron;
+				if (p == 127) // this should be rare.
+				{
+					chunk >>= 7;
+					bit_pos += 7;
+					avail -= 7;
+					continue;
+				}
+
+				positions[n_electron] = n_pix;
+				symbols[n_electron] = (unsigned char)((chunk >> 7) & 15) ^ 0x0A; // 15 = 00001111; See below for 0x0A
+				n_electron++;
+				n_pix++;
+
+				chunk >>= 11;
+				bit_pos += 11;
+				avail -= 11;
+			}
+		}
+	}
+	else
+	{
+		// Every two symbols = 12 bit * 2 = 24 bit = 3 byte
+		// high <- |bbbbBBBB|BBBBaaaa|AAAAAAAA| -> low
+		// Fetch 64 bits at a time and unpack two such pairs (6 bytes) from them.
+		long long pos = 0;
+
+		while (pos < size)
+		{
+			unsigned long long chunk;
+			memcpy(&chunk, data + pos, sizeof(chunk));
+			const int n_codes = (pos + 3 < size) ? 4 : 2;
+
+			for (int i = 0; i < n_codes; i++)
+			{
+				// symbol is bit tricky. 0000YyXx; Y and X must be flipped.
+				const unsigned int p = (unsigned int)(chunk & 255);
+				const unsigned char s = (unsigned char)((chunk >> 8) & 15) ^ 0x0A; // 0x0F = 00001111, 0x0A = 00001010
+				chunk >>= 12;
+
+				// Note the order. Add p before checking the size and placing a new electron.
+				n_pix += p;
+				if (n_pix >= EER_IMAGE_PIXELS) return n_electron;
+				if (p < 255)
+				{
+					positions[n_electron] = n_pix;
+					symbols[n_electron] = s;
+					n_electron++;
+					n_pix++;
+				}
+			}
+			pos += 6;
+		}
+	}
+
+	return n_electron;
+}
+
 EERRenderer::~EERRenderer()
 {
 	if (buf != NULL)
 		free(buf);
+	if (fd >= 0)
+		close(fd);
 }
 
 int EERRenderer::getNFrames()
@@ -306,7 +425,8 @@ long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArra
 	if (!ready)
 		REPORT_ERROR("EERRenderer::renderNFrames called before ready.");
 
-	lazyReadFrames();
+	if (!is_legacy)
+		lazyIndexFrames();
 
 	if (frame_start <= 0 || frame_start > getNFrames() ||
 	    frame_end < frame_start || frame_end > getNFrames())
@@ -320,142 +440,101 @@ long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArra
 	frame_end--;
 
 	long long total_n_electron = 0;
-
-	std::vector<unsigned int> positions;
-	std::vector<unsigned char> symbols;
 	image.initZeros(getHeight(), getWidth());
 
-	for (int iframe = frame_start; iframe <= frame_end; iframe++)
+	// Callers often render several fraction groups in parallel already
+	const int n_threads = (omp_in_parallel()) ? 1 : nr_threads;
+	std::vector<std::vector<unsigned char> > raw(n_threads);
+	std::vector<std::vector<unsigned int> > positions(n_threads);
+	std::vector<std::vector<unsigned char> > symbols(n_threads);
+	std::vector<unsigned int> n_electrons(n_threads);
+	std::vector<RelionError> thread_errors;
+
+	// Decode a batch of frames in parallel (one frame per thread), then render them into the image.
+	// Only one batch of decoded frames is kept in memory.
+	for (int batch_start = frame_start; batch_start <= frame_end; batch_start += n_threads)
 	{
-		RCTIC(TIMING_UNPACK_RLE);
-		if ((preread_start > 0 && iframe < preread_start) ||
-	  	    (preread_end > 0 && iframe > preread_end))
-		{
-			std::cerr << "EERRenderer::renderFrames(frame_start = " << frame_start + 1 << ", frame_end = " << frame_end + 1<< "),  NFrames = " << getNFrames() << " preread_start = " << preread_start + 1 << " prered_end = " << preread_end + 1<< std::endl;
-			REPORT_ERROR("Tried to render frames outside pre-read region");
-		}		
-
-		long long pos = frame_starts[iframe];
-		unsigned int n_pix = 0, n_electron = 0;
-		const int max_electrons = frame_sizes[iframe] * 2; // at 4 bits per electron (very permissive bound!)
-		if (positions.size() < max_electrons)
-		{
-			positions.resize(max_electrons);
-			symbols.resize(max_electrons);
-		}
-
-		if (is_7bit)
-		{
-			unsigned int bit_pos = 0; // 4 K * 4 K * 11 bit << 2 ** 32
-			unsigned char p, s;
-
-			while (true)
-			{
-				// Fetch 32 bits and unpack up to 2 chunks of 7 + 4 bits.
-				// This is faster than unpack 7 and 4 bits sequentially.
-				// Since the size of buf is larger than the actual size by the TIFF header size,
-				// it is always safe to read ahead.
-
-				long long first_byte = pos + (bit_pos >> 3);
-				const unsigned int bit_offset_in_first_byte = bit_pos & 7; // 7 = 00000111 (same as % 8)
-				const unsigned int chunk = (*(unsigned int*)(buf + first_byte)) >> bit_offset_in_first_byte;
-
-				p = (unsigned char)(chunk & 127); // 127 = 01111111
-				bit_pos += 7; // TODO: we can remove this for further speed.
-				n_pix += p;
-				if (n_pix >= EER_IMAGE_PIXELS) break;
-				if (p == 127) continue; // this should be rare.
-				
-				s = (unsigned char)((chunk >> 7) & 15) ^ 0x0A; // 15 = 00001111; See below for 0x0A
-				bit_pos += 4;
-				positions[n_electron] = n_pix;
-				symbols[n_electron] = s;
-				n_electron++;
-				n_pix++;
+		const int batch_size = XMIPP_MIN(n_threads, frame_end - batch_start + 1);
 
-				p = (unsigned char)((chunk >> 11) & 127); // 127 = 01111111
-				bit_pos += 7;
-				n_pix += p;
-				if (n_pix >= EER_IMAGE_PIXELS) break;
-				if (p == 127) continue;
-				
-				s = (unsigned char)((chunk >> 18) & 15) ^ 0x0A; // 15 = 00001111; See below for 0x0A
-				bit_pos += 4;
-				positions[n_electron] = n_pix;
-				symbols[n_electron] = s;
-				n_electron++;
-				n_pix++;
-			}
-		}
-		else
+		RCTIC(TIMING_UNPACK_RLE);
+		#pragma omp parallel for num_threads(batch_size)
+		for (int i = 0; i < batch_size; i++)
 		{
-			// unpack every two symbols = 12 bit * 2 = 24 bit = 3 byte
-			// high <- |bbbbBBBB|BBBBaaaa|AAAAAAAA| -> low
-			// With SIMD intrinsics at the SSSE3 level, we can unpack 10 symbols (120 bits) simultaneously.
-			unsigned char p1, p2, s1, s2;
-
-			const long long pos_limit = frame_starts[iframe] + frame_sizes[iframe];
-			// Because there is a footer, it is safe to go beyond the limit by two bytes.
-			while (pos < pos_limit)
+			// An exception must not leave the parallel region, so it is thrown after the loop
+			try
 			{
-				// symbol is bit tricky. 0000YyXx; Y and X must be flipped.
-				p1 = buf[pos];
-				s1 = (buf[pos + 1] & 0x0F) ^ 0x0A; // 0x0F = 00001111, 0x0A = 00001010
-
-				p2 = (buf[pos + 1] >> 4) | (buf[pos + 2] << 4);
-				s2 = (buf[pos + 2] >> 4) ^ 0x0A;
+				const int iframe = batch_start + i;
+				if ((preread_start > 0 && iframe < preread_start) ||
+				    (preread_end > 0 && iframe > preread_end))
+				{
+					std::cerr << "EERRenderer::renderFrames(frame_start = " << frame_start + 1 << ", frame_end = " << frame_end + 1<< "),  NFrames = " << getNFrames() << " preread_start = " << preread_start + 1 << " prered_end = " << preread_end + 1<< std::endl;
+					REPORT_ERROR("Tried to render frames outside pre-read region");
+				}
 
-				// Note the order. Add p before checking the size and placing a new electron.
-				n_pix += p1;
-				if (n_pix >= EER_IMAGE_PIXELS) break;
-				if (p1 < 255)
+				const unsigned char *data = getFrameData(iframe, raw[i]);
+				const long long max_electrons = frame_sizes[iframe] * 2 + 8; // at 4 bits per electron (very permissive bound!)
+				if (positions[i].size() < max_electrons)
 				{
-					positions[n_electron] = n_pix;
-					symbols[n_electron] = s1;
-					n_electron++;
-					n_pix++;
+					positions[i].resize(max_electrons);
+					symbols[i].resize(max_electrons);
 				}
 
-				n_pix += p2;
-				if (n_pix >= EER_IMAGE_PIXELS) break;
-				if (p2 < 255)
+				unsigned int n_pix;
+				n_electrons[i] = decodeFrame(data, frame_sizes[iframe], &positions[i][0], &symbols[i][0], n_pix);
+
+				if (n_pix != EER_IMAGE_PIXELS)
 				{
-					positions[n_electron] = n_pix;
-					symbols[n_electron] = s2;
-					n_electron++;
-					n_pix++;
+					std::cerr << "WARNING: The number of pixels is not right in " + fn_movie + " frame " + integerToString(iframe + 1) + ". Probably this frame is corrupted. This frame is skipped." << std::endl;
+					n_electrons[i] = 0;
 				}
-#ifdef DEBUG_EER_DETAIL
-				printf("%d: %u %u, %u %u %d\n", pos, p1, s1, p2, s2, n_pix);
+#ifdef DEBUG_EER
+				printf("Decoded %u electrons / %u pixels from frame %5d.\n", n_electrons[i], n_pix, iframe);
 #endif
-				pos += 3;
+			}
+			catch (RelionError XE)
+			{
+				#pragma omp critical(EERRenderer_error)
+				thread_errors.push_back(XE);
 			}
 		}
+		RCTOC(TIMING_UNPACK_RLE);
+
+		if (thread_errors.size() > 0)
+			throw thread_errors[0];
 
-		if (n_pix != EER_IMAGE_PIXELS)
+		// Each thread renders a band of rows, so that no two threads write the same pixel.
+		// Electrons are sorted by position, so the electrons in a band are found by binary search.
+		RCTIC(TIMING_RENDER_ELECTRONS);
+		#pragma omp parallel for num_threads(n_threads)
+		for (int band = 0; band < n_threads; band++)
 		{
-			std::cerr << "WARNING: The number of pixels is not right in " + fn_movie + " frame " + integerToString(iframe + 1) + ". Probably this frame is corrupted. This frame is skipped." << std::endl;
-			continue;
-		}
+			const unsigned int band_start = (unsigned int)(EER_IMAGE_HEIGHT * band / n_threads) * EER_IMAGE_WIDTH;
+			const unsigned int band_end = (unsigned int)(EER_IMAGE_HEIGHT * (band + 1) / n_threads) * EER_IMAGE_WIDTH;
 
-		RCTOC(TIMING_UNPACK_RLE);
+			for (int i = 0; i < batch_size; i++)
+			{
+				if (n_electrons[i] == 0)
+					continue;
 
-		RCTIC(TIMING_RENDER_ELECTRONS);
-		if (eer_upsampling == 3)
-			render16K(image, positions, symbols, n_electron);
-		else if (eer_upsampling == 2)
-			render8K(image, positions, symbols, n_electron);
-		else if (eer_upsampling == 1)
-			render4K(image, positions, symbols, n_electron);
-		else
-			REPORT_ERROR("Invalid EER upsamle");
+				const unsigned int *begin = &positions[i][0];
+				const unsigned int *end = begin + n_electrons[i];
+				const long first = std::lower_bound(begin, end, band_start) - begin;
+				const long last = std::lower_bound(begin, end, band_end) - begin;
+
+				if (eer_upsampling == 3)
+					render16K(image, begin + first, &symbols[i][first], last - first);
+				else if (eer_upsampling == 2)
+					render8K(image, begin + first, &symbols[i][first], last - first);
+				else
+					render4K(image, begin + first, &symbols[i][first], last - first);
+			}
+		}
 		RCTOC(TIMING_RENDER_ELECTRONS);
 
-		total_n_electron += n_electron;
-#ifdef DEBUG_EER
-		printf("Decoded %lld electrons / %d pixels from frame %5d.\n", n_electron, n_pix, iframe);
-#endif
+		for (int i = 0; i < batch_size; i++)
+			total_n_electron += n_electrons[i];
 	}
+
 #ifdef DEBUG_EER
 	printf("Decoded %lld electrons in total.\n", total_n_electron);
 #endif
@@ -19,8 +19,13 @@ class EERRenderer {
 	bool is_7bit;
 	bool read_data;
 
+	// For legacy files, frame_starts are offsets into buf, which holds the whole file.
+	// For TIFF files, the raw strips of each frame are read on demand from fd.
 	std::vector<long long> frame_starts, frame_sizes;
 	unsigned char* buf;
+	int fd;
+	std::vector<long long> strip_offsets, strip_sizes;
+	std::vector<int> frame_first_strip;
 
 	static const char EER_FOOTER_OK[];
 	static const char EER_FOOTER_ERR[];
@@ -30,19 +35,27 @@ class EERRenderer {
 
 	int eer_upsampling;
 	int nframes;
+	int nr_threads;
 	int preread_start, preread_end;
 	long long file_size;
 	void readLegacy(FILE *fh);
-	void lazyReadFrames();
+	void lazyIndexFrames();
+
+	// Returns a pointer to the compressed data of a frame (0-indexed), followed by at least 8 readable bytes.
+	// For TIFF files, the data are read into scratch.
+	const unsigned char* getFrameData(int iframe, std::vector<unsigned char> &scratch);
+
+	// Decodes the run-length encoded electrons of one frame; returns the number of electrons.
+	unsigned int decodeFrame(const unsigned char *data, long long size, unsigned int *positions, unsigned char *symbols, unsigned int &n_pix);
 
 	template <typename T>
-	void render16K(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons);
+	void render16K(MultidimArray<T> &image, const unsigned int *positions, const unsigned char *symbols, int n_electrons);
 
 	template <typename T>
-	void render8K(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons);
+	void render8K(MultidimArray<T> &image, const unsigned int *positions, const unsigned char *symbols, int n_electrons);
 
 	template <typename T>
-	void render4K(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons);
+	void render4K(MultidimArray<T> &image, const unsigned int *positions, const unsigned char *symbols, int n_electrons);
 
 	static TIFFErrorHandler prevTIFFWarningHandler;
 
@@ -80,6 +93,13 @@ class EERRenderer {
 
 	void read(FileName _fn_movie, int eer_upsampling=2);
 
+	// Number of threads used to decode and render frames within one call to renderFrames.
+	// Calls from within a parallel region always use a single thread.
+	void setThreads(int _nr_threads)
+	{
+		nr_threads = (_nr_threads > 0) ? _nr_threads : 1;
+	}
+
 	int getNFrames();
 	int getWidth();
 	int getHeight();
@@ -43,7 +43,7 @@ void TIFFConverter::read(int argc, char **argv)
 	fn_in = parser.getOption("--i", "Input movie to be compressed (an MRC/MRCS file or a list of movies as .star or .lst)");
 	fn_out = parser.getOption("--o", "Directory for output TIFF files", "./");
 	only_do_unfinished = parser.checkOption("--only_do_unfinished", "Only process non-converted movies.");
-	nr_threads = textToInteger(parser.getOption("--j", "Number of threads (useful only for --estimate_gain)", "1"));
+	nr_threads = textToInteger(parser.getOption("--j", "Number of threads (useful only for --estimate_gain and for rendering EER movies)", "1"));
 	fn_gain = parser.getOption("--gain", "Estimated gain map and its reliablity map (read)", "");
 	thresh_reliable = textToInteger(parser.getOption("--thresh", "Number of success needed to consider a pixel reliable", "50"));
 	do_estimate = parser.checkOption("--estimate_gain", "Estimate gain");
@@ -279,6 +279,7 @@ void TIFFConverter::only_compress(FileName fn_movie, FileName fn_tiff)
 	{
 		EERRenderer renderer;
 		renderer.read(fn_movie, eer_upsampling);
+		renderer.setThreads(nr_threads);
 
 		const int nframes = renderer.getNFrames();
 		std::cout << " Found " << nframes << " raw frames" << std::endl;
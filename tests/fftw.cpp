@@ -0,0 +1,35 @@
+#include <catch2/catch.hpp>
+#include "src/fftw.h"
+
+static void fillTestImage(MultidimArray<RFLOAT> &img, int seed)
+{
+  img.initZeros(48, 64);
+  FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(img)
+    DIRECT_MULTIDIM_ELEM(img, n) = (RFLOAT)((n * 7919 + seed * 104729) % 1000) / 1000.;
+}
+
+TEST_CASE( "Test FourierTransformer with shared plans", "[fftw]" ) {
+  MultidimArray<RFLOAT> img1, img2, back;
+  fillTestImage(img1, 1);
+  fillTestImage(img2, 2);
+
+  // Two transformers of the same size use the same cached plans on their own arrays
+  FourierTransformer transformer1, transformer2;
+  MultidimArray<Complex> F1, F2, F2b;
+  transformer1.FourierTransform(img1, F1);
+  transformer2.FourierTransform(img2, F2);
+  transformer1.FourierTransform(img2, F2b);
+  REQUIRE(transformer1.fPlanForward == transformer2.fPlanForward);
+
+  RFLOAT max_diff = 0.;
+  FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(F2)
+    max_diff = XMIPP_MAX(max_diff, abs(DIRECT_MULTIDIM_ELEM(F2, n) - DIRECT_MULTIDIM_ELEM(F2b, n)));
+  REQUIRE(max_diff < 1e-6);
+
+  back.resize(img1);
+  transformer2.inverseFourierTransform(F1, back);
+  max_diff = 0.;
+  FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(img1)
+    max_diff = XMIPP_MAX(max_diff, fabs(DIRECT_MULTIDIM_ELEM(back, n) - DIRECT_MULTIDIM_ELEM(img1, n)));
+  REQUIRE(max_diff < 1e-5);
+}
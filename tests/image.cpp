@@ -0,0 +1,131 @@
+#include <catch2/catch.hpp>
+#include "src/image.h"
+#include "src/image_prefetcher.h"
+
+TEST_CASE( "Test reading MRC stacks through a mapping", "[image]" ) {
+  Image<RFLOAT> stack(16, 12, 1, 5);
+  FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(stack())
+    DIRECT_MULTIDIM_ELEM(stack(), n) = (RFLOAT)(n % 97) - 40.;
+  const FileName fn_tmp = "test_image_mmap.mrcs";
+  stack.write(fn_tmp, -1, true, WRITE_OVERWRITE);
+
+  for (int use_mmap = 0; use_mmap <= 1; use_mmap++)
+  {
+    fImageHandler::use_mmap = use_mmap;
+
+    fImageHandler hFile;
+    hFile.openFile(fn_tmp, WRITE_READONLY);
+    REQUIRE((bool)hFile.mapping == (bool)use_mmap);
+    for (int i = 4; i >= 0; i--)
+    {
+      Image<RFLOAT> img;
+      img.readFromOpenFile(integerToString(i + 1) + "@" + fn_tmp, hFile, -1, false);
+      REQUIRE(XSIZE(img()) == 16);
+      REQUIRE(YSIZE(img()) == 12);
+      REQUIRE(DIRECT_A2D_ELEM(img(), 3, 5) == DIRECT_NZYX_ELEM(stack(), i, 0, 3, 5));
+    }
+
+    Image<RFLOAT> all;
+    all.read(fn_tmp);
+    REQUIRE(NSIZE(all()) == 5);
+    REQUIRE(DIRECT_NZYX_ELEM(all(), 4, 0, 11, 15) == DIRECT_NZYX_ELEM(stack(), 4, 0, 11, 15));
+  }
+
+  // Zero-copy: the data point into the file, but writing to them does not change it
+  Image<float> mapped;
+  mapped.read("3@" + fn_tmp, true, -1, true);
+  REQUIRE(DIRECT_A2D_ELEM(mapped(), 2, 7) == (float)DIRECT_NZYX_ELEM(stack(), 2, 0, 2, 7));
+  DIRECT_A2D_ELEM(mapped(), 2, 7) = 1000.;
+  Image<float> reread;
+  reread.read("3@" + fn_tmp);
+  REQUIRE(DIRECT_A2D_ELEM(reread(), 2, 7) == (float)DIRECT_NZYX_ELEM(stack(), 2, 0, 2, 7));
+  mapped.read("1@" + fn_tmp);
+  REQUIRE(DIRECT_A2D_ELEM(mapped(), 0, 1) == (float)DIRECT_NZYX_ELEM(stack(), 0, 0, 0, 1));
+
+  // A file that is truncated after it was mapped gives an error instead of a SIGBUS
+  fImageHandler hFile;
+  hFile.openFile(fn_tmp, WRITE_READONLY);
+  REQUIRE(truncate(fn_tmp.c_str(), 1024) == 0);
+  Image<RFLOAT> truncated;
+  REQUIRE_THROWS_AS(truncated.readFromOpenFile("5@" + fn_tmp, hFile, -1, false), RelionError);
+  hFile.closeFile();
+
+  std::remove(fn_tmp.c_str());
+}
+
+TEST_CASE( "Test reading half-precision MRC files", "[image]" ) {
+  Image<RFLOAT> img(4, 2);
+  const FileName fn_tmp = "test_image_half.mrc";
+  img.write(fn_tmp, -1, false, WRITE_OVERWRITE);
+
+  // Turn it into a mode 12 file: 1.0, -2.0, 0.5, 65504 (largest half), smallest subnormal, 0, ...
+  const unsigned short half[8] = {0x3c00, 0xc000, 0x3800, 0x7bff, 0x0001, 0x0000, 0x0000, 0x0000};
+  FILE *fh = fopen(fn_tmp.c_str(), "r+");
+  int mode = 12;
+  fseek(fh, 12, SEEK_SET);
+  fwrite(&mode, sizeof(int), 1, fh);
+  fseek(fh, 1024, SEEK_SET);
+  fwrite(half, sizeof(unsigned short), 8, fh);
+  fclose(fh);
+
+  Image<RFLOAT> read;
+  read.read(fn_tmp);
+  REQUIRE(DIRECT_A2D_ELEM(read(), 0, 0) == 1.);
+  REQUIRE(DIRECT_A2D_ELEM(read(), 0, 1) == -2.);
+  REQUIRE(DIRECT_A2D_ELEM(read(), 0, 2) == 0.5);
+  REQUIRE(DIRECT_A2D_ELEM(read(), 0, 3) == 65504.);
+  REQUIRE(DIRECT_A2D_ELEM(read(), 1, 0) == Approx(5.960464477539063e-08));
+
+  std::remove(fn_tmp.c_str());
+}
+
+TEST_CASE( "Test reading batches of images ahead", "[image]" ) {
+  Image<RFLOAT> stack(8, 8, 1, 6);
+  FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(stack())
+    DIRECT_MULTIDIM_ELEM(stack(), n) = (RFLOAT)(n / 64);
+  const FileName fn_tmp = "test_image_prefetch.mrcs";
+  stack.write(fn_tmp, -1, true, WRITE_OVERWRITE);
+
+  std::vector<FileName> first, second, missing;
+  for (int i = 0; i < 2; i++)
+    first.push_back(integerToString(i + 1) + "@" + fn_tmp);
+  for (int i = 2; i < 6; i++)
+    second.push_back(integerToString(i + 1) + "@" + fn_tmp);
+  missing.push_back("1@test_image_prefetch_missing.mrcs");
+
+  ImagePrefetcher prefetcher(2, 2);
+  prefetcher.request(0, first);
+  prefetcher.request(2, second);
+  prefetcher.request(6, missing);
+  REQUIRE(prefetcher.isRequested(2));
+
+  // At most two images of the batches after the current one are read ahead
+  for (int wait = 0; wait < 1000 && prefetcher.getNrImagesAhead() < 2; wait++)
+    usleep(1000);
+  usleep(20000);
+  REQUIRE(prefetcher.getNrImagesAhead() == 2);
+
+  MultidimArray<RFLOAT> img;
+  prefetcher.setCurrent(0);
+  prefetcher.getImage(1, img);
+  REQUIRE(XSIZE(img) == 8);
+  REQUIRE(DIRECT_A2D_ELEM(img, 0, 0) == 1.);
+
+  // Images of the current batch can be taken in any order
+  prefetcher.setCurrent(2);
+  REQUIRE(!prefetcher.isRequested(0));
+  for (int i = 3; i >= 0; i--)
+  {
+    prefetcher.getImage(i, img);
+    REQUIRE(DIRECT_A2D_ELEM(img, 4, 4) == (RFLOAT)(i + 2));
+  }
+  REQUIRE_THROWS_AS(prefetcher.getImage(4, img), RelionError);
+
+  // Errors on the I/O threads are reported when the image is taken
+  prefetcher.setCurrent(6);
+  REQUIRE_THROWS_AS(prefetcher.getImage(0, img), RelionError);
+  prefetcher.releaseCurrent();
+  REQUIRE_THROWS_AS(prefetcher.setCurrent(2), RelionError);
+
+  std::remove(fn_tmp.c_str());
+}
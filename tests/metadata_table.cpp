@@ -0,0 +1,177 @@
+#include <catch2/catch.hpp>
+#include "src/metadata_table.h"
+
+static MetaDataTable makeTestTable()
+{
+  MetaDataTable MD;
+  MD.setName("particles");
+  for (int i = 0; i < 5; i++)
+  {
+    MD.addObject();
+    MD.setValue(EMDL_IMAGE_NAME, integerToString(i + 1) + "@stack.mrcs");
+    MD.setValue(EMDL_CTF_DEFOCUSU, 10000. + 1000. * ((i * 3) % 5));
+    MD.setValue(EMDL_PARTICLE_CLASS, 5 - i);
+    MD.setValue(EMDL_IMAGE_OPTICS_GROUP, 1);
+  }
+  return MD;
+}
+
+TEST_CASE( "Test MetaDataTable columns", "[metadata]" ) {
+  MetaDataTable MD = makeTestTable();
+  REQUIRE(MD.numberOfObjects() == 5);
+
+  std::vector<RFLOAT> defoci = MD.getColumn<RFLOAT>(EMDL_CTF_DEFOCUSU);
+  REQUIRE(defoci.size() == 5);
+  REQUIRE(defoci[1] == Approx(13000.));
+
+  std::vector<int> classes = MD.getColumn<int>(EMDL_PARTICLE_CLASS);
+  REQUIRE(classes[0] == 5);
+  REQUIRE(classes[4] == 1);
+
+  for (int i = 0; i < classes.size(); i++)
+    classes[i] *= 2;
+  MD.setColumn(EMDL_PARTICLE_CLASS, classes);
+  int val;
+  MD.getValue(EMDL_PARTICLE_CLASS, val, 2);
+  REQUIRE(val == 6);
+
+  // setColumn adds missing labels
+  std::vector<RFLOAT> scales(5, 0.5);
+  MD.setColumn(EMDL_IMAGE_PIXEL_SIZE, scales);
+  REQUIRE(MD.containsLabel(EMDL_IMAGE_PIXEL_SIZE));
+}
+
+TEST_CASE( "Test MetaDataTable sort and append", "[metadata]" ) {
+  MetaDataTable MD = makeTestTable();
+
+  MD.newSort(EMDL_CTF_DEFOCUSU);
+  std::vector<RFLOAT> defoci = MD.getColumn<RFLOAT>(EMDL_CTF_DEFOCUSU);
+  for (int i = 1; i < defoci.size(); i++)
+    REQUIRE(defoci[i - 1] <= defoci[i]);
+
+  // The other columns must have moved together with the sorted one
+  FileName fn_img;
+  MD.getValue(EMDL_IMAGE_NAME, fn_img, 0);
+  REQUIRE(fn_img == "1@stack.mrcs");
+  MD.getValue(EMDL_IMAGE_NAME, fn_img, 4);
+  REQUIRE(fn_img == "4@stack.mrcs");
+
+  MD.newSort(EMDL_IMAGE_NAME, true, false, true);
+  MD.getValue(EMDL_IMAGE_NAME, fn_img, 0);
+  REQUIRE(fn_img == "5@stack.mrcs");
+
+  MetaDataTable MD2 = makeTestTable();
+  MD2.append(MD);
+  REQUIRE(MD2.numberOfObjects() == 10);
+  MD2.getValue(EMDL_IMAGE_NAME, fn_img, 5);
+  REQUIRE(fn_img == "5@stack.mrcs");
+
+  MetaDataTable MD3;
+  MD3.addObject(MD2.getObject(7));
+  MD3.addObject(MD3.getObject(0));
+  REQUIRE(MD3.numberOfObjects() == 2);
+  MD3.getValue(EMDL_IMAGE_NAME, fn_img, 1);
+  REQUIRE(fn_img == "3@stack.mrcs");
+
+  MD2.removeObject(0);
+  REQUIRE(MD2.numberOfObjects() == 9);
+  MD2.getValue(EMDL_IMAGE_NAME, fn_img, 0);
+  REQUIRE(fn_img == "2@stack.mrcs");
+}
+
+TEST_CASE( "Test MetaDataTable read", "[metadata]" ) {
+  MetaDataTable MD = makeTestTable();
+  MD.setValue(EMDL_MICROGRAPH_NAME, std::string("with space.mrc"), 1);
+  MD.setValue(EMDL_MICROGRAPH_NAME, std::string(""), 2);
+  MD.setValue(EMDL_IMAGE_ENABLED, true, 3);
+
+  const std::string fn_tmp = "test_metadata_table_read.star";
+  MD.write(fn_tmp);
+
+  std::ostringstream expected;
+  MD.write(expected);
+
+  for (int nr_threads = 1; nr_threads <= 4; nr_threads *= 2)
+  {
+    MetaDataTable MDread;
+    REQUIRE(MDread.read(fn_tmp, "", false, nr_threads) == 5);
+
+    std::ostringstream written;
+    MDread.write(written);
+    REQUIRE(written.str() == expected.str());
+
+    std::string mic;
+    MDread.getValue(EMDL_MICROGRAPH_NAME, mic, 1);
+    REQUIRE(mic == "with space.mrc");
+    MDread.getValue(EMDL_MICROGRAPH_NAME, mic, 2);
+    REQUIRE(mic == "");
+
+    // Reading through a stream must give the same table
+    std::ifstream in(fn_tmp.c_str(), std::ios_base::in);
+    MDread.readStar(in, "particles");
+    std::ostringstream streamed;
+    MDread.write(streamed);
+    REQUIRE(streamed.str() == expected.str());
+  }
+
+  std::remove(fn_tmp.c_str());
+}
+
+TEST_CASE( "Test MetaDataTable binary cache", "[metadata]" ) {
+  MetaDataTable MD = makeTestTable();
+  MD.setValue(EMDL_MICROGRAPH_NAME, std::string("with space.mrc"), 1);
+  MD.setValue(EMDL_MICROGRAPH_NAME, std::string(""), 2);
+  MD.setValue(EMDL_IMAGE_ENABLED, true, 3);
+  std::vector<double> zernike(3, 0.25);
+  MD.setValue(EMDL_IMAGE_ODD_ZERNIKE_COEFFS, zernike, 4);
+
+  const std::string fn_tmp = "test_metadata_table_cache.star";
+  std::ofstream fh(fn_tmp.c_str());
+  MD.write(fh);
+  fh << "\ndata_unknown\n\nloop_\n_rlnNotALabel #1\n_rlnDefocusV #2\nabc 1.5\n\"\" 2.5\n";
+  fh.close();
+
+  std::ostringstream expected;
+  MetaDataTable MDtext, MDunknown;
+  MDtext.read(fn_tmp);
+  MDtext.write(expected);
+  MDunknown.read(fn_tmp, "unknown");
+  MDunknown.write(expected);
+
+  MetaDataTable::writeBinaryCache(fn_tmp);
+  REQUIRE(exists(fn_tmp + ".rbin"));
+
+  std::ostringstream cached;
+  MetaDataTable MDcache;
+  REQUIRE(MDcache.read(fn_tmp) == 5);
+  MDcache.write(cached);
+  REQUIRE(MDcache.read(fn_tmp, "unknown") == 2);
+  REQUIRE(MDcache.getUnknownLabelNameAt(0) == "rlnNotALabel");
+  MDcache.write(cached);
+  REQUIRE(cached.str() == expected.str());
+
+  std::vector<double> vec;
+  MDcache.read(fn_tmp, "particles");
+  MDcache.getValue(EMDL_IMAGE_ODD_ZERNIKE_COEFFS, vec, 4);
+  REQUIRE(vec.size() == 3);
+  REQUIRE(vec[2] == 0.25);
+
+  // A changed STAR file must not be read from the outdated cache
+  MD.setValue(EMDL_CTF_DEFOCUSU, 1.0, 0);
+  MD.write(fn_tmp);
+  REQUIRE(!exists(fn_tmp + ".rbin"));
+  MetaDataTable::writeBinaryCache(fn_tmp);
+  MD.setValue(EMDL_CTF_DEFOCUSU, 2.0, 0);
+  MD.setValue(EMDL_IMAGE_NAME, std::string("10@stack.mrcs"), 0);
+  std::ofstream fh2(fn_tmp.c_str());
+  MD.write(fh2);
+  fh2.close();
+
+  RFLOAT defocus;
+  MDcache.read(fn_tmp);
+  MDcache.getValue(EMDL_CTF_DEFOCUSU, defocus, 0);
+  REQUIRE(defocus == 2.0);
+
+  std::remove(fn_tmp.c_str());
+  std::remove((fn_tmp + ".rbin").c_str());
+}
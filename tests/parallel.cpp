@@ -0,0 +1,68 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include "src/parallel.h"
+
+TEST_CASE( "Test ThreadPool parallelFor", "[parallel]" ) {
+  ThreadPool pool(4);
+
+  std::vector<int> counts(1000, 0);
+  std::vector<long int> thread_sums(pool.getNumberOfThreads(), 0);
+  pool.parallelFor(0, counts.size() - 1, [&](long int i, int thread_id)
+  {
+    counts[i]++;
+    thread_sums[thread_id] += i;
+  }, 10);
+
+  long int sum = 0;
+  for (int t = 0; t < thread_sums.size(); t++)
+    sum += thread_sums[t];
+  REQUIRE(sum == 999 * 1000 / 2);
+  REQUIRE(std::count(counts.begin(), counts.end(), 1) == 1000);
+
+  // Nested fork/join
+  std::atomic<long int> nested(0);
+  pool.parallelFor(0, 7, [&](long int i, int thread_id)
+  {
+    pool.parallelFor(0, 99, [&](long int j, int thread_id2)
+    {
+      nested += 1;
+    });
+  });
+  REQUIRE(nested == 800);
+
+  // Exceptions are passed on to the caller
+  bool caught = false;
+  try
+  {
+    pool.parallelFor(0, 99, [&](long int i, int thread_id)
+    {
+      if (i == 42)
+        REPORT_ERROR("test error");
+    });
+  }
+  catch (RelionError XE)
+  {
+    caught = true;
+  }
+  REQUIRE(caught);
+}
+
+static int manager_runs[3];
+
+static void countRuns(ThreadArgument &thArg)
+{
+  manager_runs[thArg.thread_id]++;
+}
+
+TEST_CASE( "Test ThreadManager on ThreadPool", "[parallel]" ) {
+  ThreadManager manager(3);
+  manager.run(countRuns);
+  manager.run(countRuns);
+  for (int i = 0; i < 3; i++)
+    REQUIRE(manager_runs[i] == 2);
+
+  long int nr_tasks = 0;
+  for (int i = 0; i < 3; i++)
+    nr_tasks += manager.getPool().getNumberOfTasks(i);
+  REQUIRE(nr_tasks == 6);
+}
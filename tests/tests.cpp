@@ -2,3 +2,7 @@
 
 #include <catch2/catch.hpp>
 #include "ctf.cpp"
+#include "metadata_table.cpp"
+#include "fftw.cpp"
+#include "image.cpp"
+#include "parallel.cpp"